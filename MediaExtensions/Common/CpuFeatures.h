@@ -0,0 +1,93 @@
+#pragma once
+
+// CPU_FEATURES_X86 and CPU_FEATURES_ARM select the SIMD code to compile,
+// with the Microsoft compiler or with GCC and Clang (for the tests).
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CPU_FEATURES_X86
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__aarch64__)
+#define CPU_FEATURES_ARM
+#endif
+
+#if defined(CPU_FEATURES_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#elif defined(CPU_FEATURES_ARM)
+#include <arm_neon.h>
+#endif
+
+// CPU_TARGET_AVX2: Put before a function that uses AVX2 intrinsics. GCC
+// and Clang only compile AVX2 code for functions marked with the target.
+#if defined(CPU_FEATURES_X86) && !defined(_MSC_VER)
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CPU_TARGET_AVX2
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//  CpuSimdLevel
+//  Description: The widest SIMD instruction set that the image
+//  processing code can use on this CPU.
+//////////////////////////////////////////////////////////////////////////
+
+enum CpuSimdLevel
+{
+    CpuSimd_None,
+    CpuSimd_SSE2,
+    CpuSimd_AVX2,
+    CpuSimd_NEON
+};
+
+//////////////////////////////////////////////////////////////////////////
+//  DetectCpuSimdLevel
+//  Description: Queries the CPU (and, for AVX2, the OS) for SIMD support.
+//  Call GetCpuSimdLevel instead, which caches the result.
+//////////////////////////////////////////////////////////////////////////
+
+inline CpuSimdLevel DetectCpuSimdLevel()
+{
+#if defined(CPU_FEATURES_X86) && !defined(_MSC_VER)
+    __builtin_cpu_init();
+
+    // Like the code below, this also checks that the OS saves the YMM registers.
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return CpuSimd_AVX2;
+    }
+    return __builtin_cpu_supports("sse2") ? CpuSimd_SSE2 : CpuSimd_None;
+#elif defined(CPU_FEATURES_X86)
+    int info[4] = {};
+
+    __cpuid(info, 0);
+    const int cIds = info[0];
+
+    __cpuid(info, 1);
+    const bool fSSE2 = (info[3] & (1 << 26)) != 0;
+    const bool fOSXSAVE = (info[2] & (1 << 27)) != 0;
+    const bool fAVX = (info[2] & (1 << 28)) != 0;
+
+    // AVX2 also needs the OS to save the YMM registers on a context switch.
+    if (fOSXSAVE && fAVX && cIds >= 7 && (_xgetbv(0) & 0x06) == 0x06)
+    {
+        __cpuidex(info, 7, 0);
+        if ((info[1] & (1 << 5)) != 0)
+        {
+            return CpuSimd_AVX2;
+        }
+    }
+
+    return fSSE2 ? CpuSimd_SSE2 : CpuSimd_None;
+#elif defined(CPU_FEATURES_ARM)
+    // Windows on ARM requires NEON.
+    return CpuSimd_NEON;
+#else
+    return CpuSimd_None;
+#endif
+}
+
+inline CpuSimdLevel GetCpuSimdLevel()
+{
+    static const CpuSimdLevel level = DetectCpuSimdLevel();
+    return level;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//  EffectChain
+//  Description: An ordered list of video effects that are applied to a
+//  YUV frame in a single pass, instead of one pass (and one MFT) each.
+//
+//  Point steps (Grayscale, Invert) change each byte of a pixel on its
+//  own, so the point steps of the chain combine into one lookup table
+//  for the luma bytes and one for the chroma bytes. A gather step (for
+//  example, a polar transformation) moves pixels; a chain has at most
+//  one. The gather fills the pixels that have no source with a fixed
+//  value (black), which only the point steps after the gather apply to.
+//
+//  The frames are limited-range video (luma 16 to 235, chroma 16 to 240,
+//  no color at chroma 128), so Invert reflects luma about the middle of
+//  that range instead of 255. Values outside the range are clamped:
+//
+//  Grayscale:  luma is kept, chroma = 128.
+//  Invert:     luma = 235 + 16 - luma (at least 0),
+//              chroma = 256 - chroma (at most 255).
+//////////////////////////////////////////////////////////////////////////
+
+enum EffectChainStep
+{
+    EffectChain_Grayscale,
+    EffectChain_Invert,
+    EffectChain_Gather
+};
+
+class EffectChain
+{
+public:
+    void Clear()
+    {
+        m_steps.clear();
+    }
+
+    // Append: Adds a step at the end of the chain. Returns false (and
+    // does not add the step) for a second gather step.
+    bool Append(EffectChainStep step)
+    {
+        if (step == EffectChain_Gather && HasGather())
+        {
+            return false;
+        }
+
+        m_steps.push_back(step);
+        return true;
+    }
+
+    bool IsEmpty() const { return m_steps.empty(); }
+
+    bool HasGather() const
+    {
+        for (auto step : m_steps)
+        {
+            if (step == EffectChain_Gather)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool HasPointSteps() const
+    {
+        for (auto step : m_steps)
+        {
+            if (step != EffectChain_Gather)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // GetPointTables: Fills the tables that apply the point steps of the
+    // chain to luma and chroma bytes, in order. If fAfterGather is true,
+    // only the steps after the gather step are applied.
+    void GetPointTables(BYTE lumaTable[256], BYTE chromaTable[256], bool fAfterGather) const
+    {
+        for (DWORD i = 0; i < 256; i++)
+        {
+            lumaTable[i] = static_cast<BYTE>(i);
+            chromaTable[i] = static_cast<BYTE>(i);
+        }
+
+        bool fApply = !fAfterGather;
+
+        for (auto step : m_steps)
+        {
+            if (step == EffectChain_Gather)
+            {
+                fApply = true;
+                continue;
+            }
+
+            if (!fApply)
+            {
+                continue;
+            }
+
+            for (DWORD i = 0; i < 256; i++)
+            {
+                lumaTable[i] = ApplyStep(step, lumaTable[i], false);
+                chromaTable[i] = ApplyStep(step, chromaTable[i], true);
+            }
+        }
+    }
+
+private:
+    static BYTE ApplyStep(EffectChainStep step, BYTE value, bool fChroma)
+    {
+        switch (step)
+        {
+        case EffectChain_Grayscale:
+            return fChroma ? 128 : value;
+
+        case EffectChain_Invert:
+            if (fChroma)
+            {
+                return static_cast<BYTE>(value == 0 ? 255 : 256 - value);
+            }
+            return static_cast<BYTE>(value > 235 + 16 ? 0 : 235 + 16 - value);
+
+        default:
+            return value;
+        }
+    }
+
+private:
+    std::vector<EffectChainStep> m_steps;
+};
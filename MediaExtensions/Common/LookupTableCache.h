@@ -0,0 +1,110 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+//////////////////////////////////////////////////////////////////////////
+//  LookupTableCache
+//  Description: Shares lookup tables between the instances of an effect.
+//
+//  Tables are identified by a key (for example, the frame size, format
+//  and effect). The first caller that asks for a key generates the
+//  table. Callers that ask for the same key while it is being generated
+//  wait for it, and later callers get the same table. Tables for
+//  different keys are generated in parallel.
+//
+//  The cache does not keep tables alive: a table is released when the
+//  last caller releases its reference, and is generated again the next
+//  time it is needed.
+//
+//  Key must be copyable and have operator<.
+//////////////////////////////////////////////////////////////////////////
+
+template <class Key, class Table>
+class LookupTableCache
+{
+public:
+    typedef std::shared_ptr<const Table> TablePtr;
+
+    // GenerateFn: Fills in a new table.
+    typedef std::function<void(Table &table)> GenerateFn;
+
+    // GetTable: Returns the table for a key. If the cache does not hold
+    // the table, calls fnGenerate to create it. Exceptions thrown by
+    // fnGenerate are passed to the caller, and nothing is cached.
+    TablePtr GetTable(const Key &key, const GenerateFn &fnGenerate)
+    {
+        std::shared_ptr<Entry> spEntry;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            RemoveUnusedEntries();
+
+            std::shared_ptr<Entry> &slot = m_entries[key];
+            if (slot == nullptr)
+            {
+                slot = std::make_shared<Entry>();
+            }
+            spEntry = slot;
+        }
+
+        // Only one caller generates the table for each key.
+        std::lock_guard<std::mutex> lock(spEntry->mutex);
+
+        TablePtr spTable = spEntry->wpTable.lock();
+        if (spTable == nullptr)
+        {
+            std::shared_ptr<Table> spNewTable = std::make_shared<Table>();
+
+            fnGenerate(*spNewTable);
+
+            spEntry->wpTable = spNewTable;
+            spTable = spNewTable;
+        }
+
+        return spTable;
+    }
+
+private:
+    struct Entry
+    {
+        std::mutex              mutex;      // Held while the table is generated.
+        std::weak_ptr<const Table> wpTable;
+    };
+
+    // RemoveUnusedEntries: Removes the entries whose tables have been
+    // released. Call with m_mutex held.
+    void RemoveUnusedEntries()
+    {
+        for (auto it = m_entries.begin(); it != m_entries.end(); )
+        {
+            // If only the map holds the entry, no other thread can be
+            // using it, because they take m_mutex to find it. Taking the
+            // entry's lock (which is free) makes the last thread's
+            // changes to the entry visible here.
+            bool fUnused = false;
+
+            if (it->second.use_count() == 1)
+            {
+                std::lock_guard<std::mutex> lock(it->second->mutex);
+                fUnused = it->second->wpTable.expired();
+            }
+
+            if (fUnused)
+            {
+                it = m_entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+private:
+    std::mutex                              m_mutex;    // Protects m_entries.
+    std::map<Key, std::shared_ptr<Entry>>   m_entries;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+//  OutputSamplePool
+//  Description: Recycles the output samples of an MFT that provides its
+//  own samples (MFT_OUTPUT_STREAM_PROVIDES_SAMPLES or
+//  MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES), in system memory.
+//
+//  The samples come from a video sample allocator without a Direct3D
+//  device manager. A sample goes back to the pool when the last
+//  reference to it is released, so once the pool has grown to the
+//  number of frames that the pipeline holds at a time, no more frame
+//  buffers are allocated.
+//
+//  If the pipeline holds every sample of the pool, AllocateSample
+//  creates a sample outside the pool, which is freed when it is
+//  released, instead of failing.
+//////////////////////////////////////////////////////////////////////////
+
+class OutputSamplePool
+{
+public:
+    static const DWORD InitialSamples = 2;      // Samples that are allocated up front.
+    static const DWORD MaxSamples = 8;          // Samples the pool keeps for reuse.
+
+    OutputSamplePool()
+        : m_fInitialized(false)
+    {
+    }
+
+    ~OutputSamplePool()
+    {
+        Uninitialize();
+    }
+
+    // AllocateSample: Returns a sample with one buffer that holds a frame
+    // of pType. The pool is set up for pType on the first call after
+    // Uninitialize.
+    ComPtr<IMFSample> AllocateSample(IMFMediaType *pType)
+    {
+        ComPtr<IMFSample> spSample;
+
+        if (!m_fInitialized)
+        {
+            if (m_spAllocator == nullptr)
+            {
+                ThrowIfError(MFCreateVideoSampleAllocatorEx(IID_PPV_ARGS(&m_spAllocator)));
+            }
+
+            ThrowIfError(m_spAllocator->InitializeSampleAllocatorEx(InitialSamples, MaxSamples, nullptr, pType));
+            m_fInitialized = true;
+        }
+
+        HRESULT hr = m_spAllocator->AllocateSample(&spSample);
+
+        if (hr == MF_E_SAMPLEALLOCATOR_EMPTY)
+        {
+            spSample = CreateSample(pType);
+        }
+        else
+        {
+            ThrowIfError(hr);
+        }
+
+        return spSample;
+    }
+
+    // Uninitialize: Frees the samples in the pool. Call when streaming
+    // ends or the media type changes. Samples that the pipeline still
+    // holds are freed when it releases them.
+    void Uninitialize()
+    {
+        if (m_fInitialized)
+        {
+            m_spAllocator->UninitializeSampleAllocator();
+            m_fInitialized = false;
+        }
+    }
+
+private:
+    static ComPtr<IMFSample> CreateSample(IMFMediaType *pType)
+    {
+        GUID subtype = GUID_NULL;
+        UINT32 width = 0, height = 0;
+        ComPtr<IMFMediaBuffer> spBuffer;
+        ComPtr<IMFSample> spSample;
+
+        ThrowIfError(pType->GetGUID(MF_MT_SUBTYPE, &subtype));
+        ThrowIfError(MFGetAttributeSize(pType, MF_MT_FRAME_SIZE, &width, &height));
+        ThrowIfError(MFCreate2DMediaBuffer(width, height, subtype.Data1, FALSE, &spBuffer));
+        ThrowIfError(MFCreateSample(&spSample));
+        ThrowIfError(spSample->AddBuffer(spBuffer.Get()));
+
+        return spSample;
+    }
+
+private:
+    ComPtr<IMFVideoSampleAllocatorEx> m_spAllocator;
+    bool m_fInitialized;                        // m_spAllocator is set up for the current type.
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+//  PortableTypes.h
+//  Description: The Windows types and macros that the image processing
+//  kernels use, for building the kernels and their tests with GCC or
+//  Clang on other platforms. On Windows, pch.h already defines them.
+//////////////////////////////////////////////////////////////////////////
+
+#if !defined(_WIN32)
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+typedef uint8_t     BYTE;
+typedef uint16_t    WORD;
+typedef int16_t     INT16;
+typedef uint32_t    DWORD;
+typedef uint32_t    UINT32;
+typedef uint32_t    UINT;
+typedef int32_t     LONG;
+typedef int32_t     INT32;
+typedef int64_t     LONGLONG;
+typedef uint64_t    ULONGLONG;
+typedef float       FLOAT;
+typedef double      DOUBLE;
+typedef uintptr_t   UINT_PTR;
+
+const DWORD MAXDWORD = 0xFFFFFFFF;
+const INT16 MAXSHORT = 0x7FFF;
+
+struct D2D_RECT_U
+{
+    UINT32 left;
+    UINT32 top;
+    UINT32 right;
+    UINT32 bottom;
+};
+
+#define CopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+#define FillMemory(Destination, Length, Fill) memset((Destination), (Fill), (Length))
+#define ZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+
+#define LOWORD(l) static_cast<WORD>((l) & 0xFFFF)
+#define HIWORD(l) static_cast<WORD>(((l) >> 16) & 0xFFFF)
+
+using std::min;
+using std::max;
+
+// Source annotations (SAL) are only checked by the Microsoft compiler.
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_reads_(size)
+#define _In_reads_bytes_(size)
+#define _Out_writes_(size)
+#define _Out_writes_opt_(size)
+#define _Out_writes_bytes_(size)
+#define _Inout_updates_(size)
+#define _Inout_updates_bytes_(size)
+#define _Inexpressible_(size)
+
+#endif
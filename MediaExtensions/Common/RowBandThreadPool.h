@@ -0,0 +1,377 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <exception>
+
+//////////////////////////////////////////////////////////////////////////
+//  RowBandThreadPool
+//  Description: Runs a function over the rows of an image, split into
+//  horizontal bands, on a set of persistent worker threads.
+//
+//  The calling thread works on the bands too. Each thread claims the
+//  next unprocessed band from a shared counter, so threads that finish
+//  early take over the bands that the others have not started yet.
+//
+//  Band boundaries are a multiple of the row alignment that the caller
+//  passes (for example, 2 rows for 4:2:0 images, so that no chroma row
+//  is split) and, when the stride allows it, start on a cache line.
+//
+//  The worker threads are shared by all the RowBandThreadPool objects in
+//  the module, so several effects do not each start a thread per
+//  processor. The thread count of each object limits how many threads
+//  work on one of its frames; there are as many workers as the largest
+//  thread count that Run was called with, minus the caller (by default,
+//  one per logical processor). The workers are started by Run, and
+//  stopped when the last RowBandThreadPool object is destroyed.
+//
+//  If the function throws, on any thread, the bands that have not started
+//  are skipped, and Run rethrows the first exception once no thread is
+//  running the function anymore.
+//////////////////////////////////////////////////////////////////////////
+
+class RowBandThreadPool
+{
+public:
+    // BandFn: Processes rows [yBegin, yEnd).
+    typedef std::function<void(DWORD yBegin, DWORD yEnd)> BandFn;
+
+    static const DWORD CacheLineSize = 64;
+    static const DWORD BandsPerThread = 4;      // More bands than threads, to balance the load.
+    static const DWORD MinBandRows = 16;        // Smaller bands cost more to schedule than they save.
+    static const DWORD MaxThreads = 64;
+
+    RowBandThreadPool()
+        : m_cThreads(DefaultThreadCount())
+    {
+        SharedWorkers::Get().AddRef();
+    }
+
+    ~RowBandThreadPool()
+    {
+        SharedWorkers::Get().Release();
+    }
+
+    // SetThreadCount: Sets the number of threads, including the calling
+    // thread. Zero selects one thread per logical processor.
+    void SetThreadCount(DWORD cThreads)
+    {
+        if (cThreads == 0)
+        {
+            cThreads = DefaultThreadCount();
+        }
+        m_cThreads = (cThreads > MaxThreads ? MaxThreads : cThreads);
+    }
+
+    DWORD GetThreadCount() const { return m_cThreads; }
+
+    // Run: Calls fn for bands that cover rows [0, cRows), and returns when
+    // all the bands are done. lStride is the stride of the image that the
+    // bands write to.
+    void Run(DWORD cRows, DWORD dwRowAlign, LONG lStride, const BandFn &fn)
+    {
+        const DWORD cBandRows = GetBandRows(cRows, dwRowAlign, lStride);
+        SharedWorkers &workers = SharedWorkers::Get();
+
+        if (cBandRows >= cRows || !workers.Start(m_cThreads - 1))
+        {
+            // Not worth splitting, or no worker threads.
+            fn(0, cRows);
+            return;
+        }
+
+        Job job(fn, cRows, cBandRows, m_cThreads - 1);
+        workers.Submit(&job);
+
+        try
+        {
+            job.ProcessBands();
+        }
+        catch (...)
+        {
+            workers.Fail(&job, std::current_exception());
+        }
+
+        // Wait until every worker has left the job, so that none of them
+        // calls fn after Run returns.
+        workers.Finish(&job);
+
+        if (job.error)
+        {
+            std::rethrow_exception(job.error);
+        }
+    }
+
+private:
+    // Job: The bands of one call to Run.
+    struct Job
+    {
+        Job(const BandFn &fnBand, DWORD cJobRows, DWORD cJobBandRows, DWORD cJobMaxWorkers)
+            : fn(fnBand)
+            , cRows(cJobRows)
+            , cBandRows(cJobBandRows)
+            , cBands((cJobRows + cJobBandRows - 1) / cJobBandRows)
+            , nextBand(0)
+            , cMaxWorkers(cJobMaxWorkers)
+            , cBusyWorkers(0)
+        {
+        }
+
+        // ProcessBands: Claims and processes bands until there are none left.
+        void ProcessBands()
+        {
+            for (;;)
+            {
+                const DWORD iBand = nextBand.fetch_add(1);
+                if (iBand >= cBands)
+                {
+                    break;
+                }
+
+                const DWORD yBegin = iBand * cBandRows;
+                const DWORD yEnd = (yBegin + cBandRows < cRows ? yBegin + cBandRows : cRows);
+
+                fn(yBegin, yEnd);
+            }
+        }
+
+        const BandFn                &fn;
+        const DWORD                 cRows;
+        const DWORD                 cBandRows;
+        const DWORD                 cBands;
+        std::atomic<DWORD>          nextBand;       // Next band to claim.
+
+        // Guarded by the mutex of SharedWorkers.
+        const DWORD                 cMaxWorkers;    // Worker threads that can help the caller.
+        DWORD                       cBusyWorkers;   // Workers inside ProcessBands.
+        std::exception_ptr          error;          // First exception thrown by fn.
+    };
+
+    // SharedWorkers: The worker threads of the module, and the jobs that
+    // they can help with.
+    class SharedWorkers
+    {
+    public:
+        static SharedWorkers &Get()
+        {
+            static SharedWorkers s_workers;
+            return s_workers;
+        }
+
+        void AddRef()
+        {
+            std::lock_guard<std::mutex> lock(m_lifetimeMutex);
+            ++m_cRefs;
+        }
+
+        // Release: Stops the workers when the last pool is destroyed. No
+        // pool is running a job then.
+        void Release()
+        {
+            std::lock_guard<std::mutex> lock(m_lifetimeMutex);
+            if (--m_cRefs == 0)
+            {
+                StopWorkers();
+            }
+        }
+
+        // Start: Creates worker threads until there are cWorkers, if
+        // needed. Returns false if there are none.
+        bool Start(DWORD cWorkers)
+        {
+            std::lock_guard<std::mutex> lock(m_lifetimeMutex);
+
+            if (m_workers.empty())
+            {
+                m_fShutdown = false;
+            }
+
+            try
+            {
+                while (m_workers.size() < cWorkers)
+                {
+                    m_workers.push_back(std::thread(&SharedWorkers::WorkerThreadProc, this));
+                }
+            }
+            catch (...)
+            {
+                // Use the threads that were created.
+            }
+
+            return !m_workers.empty();
+        }
+
+        void Submit(Job *pJob)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_jobs.push_back(pJob);
+            }
+            m_cvWork.notify_all();
+        }
+
+        // Fail: Keeps the first exception of a job, and skips the bands
+        // that have not started.
+        void Fail(Job *pJob, std::exception_ptr error)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (!pJob->error)
+            {
+                pJob->error = error;
+            }
+            pJob->nextBand.store(pJob->cBands);
+        }
+
+        // Finish: Waits for the workers to leave a job whose bands are all
+        // claimed, and removes it.
+        void Finish(Job *pJob)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cvDone.wait(lock, [pJob]() { return pJob->cBusyWorkers == 0; });
+
+            for (size_t i = 0; i < m_jobs.size(); i++)
+            {
+                if (m_jobs[i] == pJob)
+                {
+                    m_jobs.erase(m_jobs.begin() + i);
+                    break;
+                }
+            }
+        }
+
+    private:
+        SharedWorkers()
+            : m_cRefs(0)
+            , m_fShutdown(false)
+        {
+        }
+
+        // Called with the lifetime lock held.
+        void StopWorkers()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_fShutdown = true;
+            }
+            m_cvWork.notify_all();
+
+            for (auto &worker : m_workers)
+            {
+                worker.join();
+            }
+            m_workers.clear();
+        }
+
+        // FindJob: Returns a job that has bands left and room for another
+        // worker, or nullptr. Called with the lock held.
+        Job *FindJob() const
+        {
+            for (Job *pJob : m_jobs)
+            {
+                if ((pJob->cBusyWorkers < pJob->cMaxWorkers) && (pJob->nextBand.load() < pJob->cBands))
+                {
+                    return pJob;
+                }
+            }
+            return nullptr;
+        }
+
+        void WorkerThreadProc()
+        {
+            for (;;)
+            {
+                Job *pJob = nullptr;
+
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+
+                    while (!m_fShutdown && (pJob = FindJob()) == nullptr)
+                    {
+                        m_cvWork.wait(lock);
+                    }
+
+                    if (m_fShutdown)
+                    {
+                        return;
+                    }
+
+                    ++pJob->cBusyWorkers;
+                }
+
+                try
+                {
+                    pJob->ProcessBands();
+                }
+                catch (...)
+                {
+                    Fail(pJob, std::current_exception());
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    --pJob->cBusyWorkers;
+                }
+                m_cvDone.notify_all();
+            }
+        }
+
+    private:
+        std::mutex                  m_lifetimeMutex;    // Serializes starting and stopping the workers.
+        DWORD                       m_cRefs;            // Number of RowBandThreadPool objects.
+        std::vector<std::thread>    m_workers;
+
+        std::mutex                  m_mutex;
+        std::condition_variable     m_cvWork;           // Signaled when a job starts or on shutdown.
+        std::condition_variable     m_cvDone;           // Signaled when a worker leaves a job.
+        bool                        m_fShutdown;
+        std::vector<Job*>           m_jobs;             // Jobs that are running.
+    };
+
+    static DWORD DefaultThreadCount()
+    {
+        DWORD cThreads = std::thread::hardware_concurrency();
+        return (cThreads == 0 ? 1 : (cThreads > MaxThreads ? MaxThreads : cThreads));
+    }
+
+    static DWORD GreatestCommonDivisor(DWORD a, DWORD b)
+    {
+        while (b != 0)
+        {
+            DWORD t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    // GetBandRows: Returns the number of rows in each band.
+    DWORD GetBandRows(DWORD cRows, DWORD dwRowAlign, LONG lStride) const
+    {
+        if (m_cThreads <= 1 || cRows == 0)
+        {
+            return cRows;
+        }
+
+        // Smallest number of rows that spans a whole number of cache lines.
+        const DWORD cbStride = static_cast<DWORD>(lStride < 0 ? -lStride : lStride);
+        const DWORD cLineRows = CacheLineSize / GreatestCommonDivisor(cbStride, CacheLineSize);
+
+        // Least common multiple of the two alignments.
+        dwRowAlign = (dwRowAlign == 0 ? 1 : dwRowAlign);
+        const DWORD cAlignRows = dwRowAlign / GreatestCommonDivisor(dwRowAlign, cLineRows) * cLineRows;
+
+        DWORD cBandRows = (cRows + (m_cThreads * BandsPerThread) - 1) / (m_cThreads * BandsPerThread);
+        cBandRows = (cBandRows < MinBandRows ? MinBandRows : cBandRows);
+        cBandRows = (cBandRows + cAlignRows - 1) / cAlignRows * cAlignRows;
+
+        return cBandRows;
+    }
+
+private:
+    DWORD                       m_cThreads;         // Number of threads, including the caller.
+};
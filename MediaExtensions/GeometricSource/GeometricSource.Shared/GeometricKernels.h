@@ -0,0 +1,257 @@
+//// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+//// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+//// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+//// PARTICULAR PURPOSE.
+////
+//// Copyright (c) Microsoft Corporation. All rights reserved
+
+#pragma once
+
+// Span rendering of the geometric shapes. The functions do not depend on
+// COM or Media Foundation, so that the tests can build them with GCC or
+// Clang (see CMakeLists.txt).
+
+#include "PortableTypes.h"
+#include "CpuFeatures.h"
+#include <math.h>
+#include <vector>
+
+// Function pointer for the function that fills part of a row of one plane
+// of the frame with one value. The plane elements (RGB32 pixels, YUY2
+// pixel pairs, NV12 Y samples or NV12 U-V pairs) are 1, 2 or 4 bytes, so
+// a value repeated to 32 bits fills any run of whole elements.
+typedef void (*FILL_PATTERN_FN)(
+    BYTE        *pDest,         // First element.
+    DWORD       cbDest,         // Size of the elements, in bytes.
+    DWORD       dwPattern       // Value of an element, repeated to 32 bits.
+    );
+
+inline void FillPattern(
+    _Out_writes_bytes_(cbDest) BYTE *pDest,
+    DWORD cbDest,
+    DWORD dwPattern)
+{
+    for ( ; cbDest >= sizeof(DWORD); cbDest -= sizeof(DWORD), pDest += sizeof(DWORD))
+    {
+        memcpy(pDest, &dwPattern, sizeof(DWORD));
+    }
+
+    // The rest starts on a multiple of 4 bytes, so it is the start of the
+    // pattern.
+    memcpy(pDest, &dwPattern, cbDest);
+}
+
+#if defined(CPU_FEATURES_X86)
+
+inline void FillPattern_SSE2(
+    _Out_writes_bytes_(cbDest) BYTE *pDest,
+    DWORD cbDest,
+    DWORD dwPattern)
+{
+    const __m128i pattern = _mm_set1_epi32(static_cast<int>(dwPattern));
+
+    for ( ; cbDest >= 64; cbDest -= 64, pDest += 64)
+    {
+        __m128i *pOut = reinterpret_cast<__m128i*>(pDest);
+
+        _mm_storeu_si128(pOut + 0, pattern);
+        _mm_storeu_si128(pOut + 1, pattern);
+        _mm_storeu_si128(pOut + 2, pattern);
+        _mm_storeu_si128(pOut + 3, pattern);
+    }
+
+    for ( ; cbDest >= 16; cbDest -= 16, pDest += 16)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest), pattern);
+    }
+
+    FillPattern(pDest, cbDest, dwPattern);
+}
+
+#elif defined(CPU_FEATURES_ARM)
+
+inline void FillPattern_NEON(
+    _Out_writes_bytes_(cbDest) BYTE *pDest,
+    DWORD cbDest,
+    DWORD dwPattern)
+{
+    const uint8x16_t pattern = vreinterpretq_u8_u32(vdupq_n_u32(dwPattern));
+
+    for ( ; cbDest >= 64; cbDest -= 64, pDest += 64)
+    {
+        vst1q_u8(pDest + 0, pattern);
+        vst1q_u8(pDest + 16, pattern);
+        vst1q_u8(pDest + 32, pattern);
+        vst1q_u8(pDest + 48, pattern);
+    }
+
+    for ( ; cbDest >= 16; cbDest -= 16, pDest += 16)
+    {
+        vst1q_u8(pDest, pattern);
+    }
+
+    FillPattern(pDest, cbDest, dwPattern);
+}
+
+#endif
+
+// Returns the fastest fill function for this CPU.
+
+inline FILL_PATTERN_FN SelectFillPattern()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+    case CpuSimd_SSE2:
+        return FillPattern_SSE2;
+#elif defined(CPU_FEATURES_ARM)
+    case CpuSimd_NEON:
+        return FillPattern_NEON;
+#endif
+
+    default:
+        return FillPattern;
+    }
+}
+
+// The part of a row that is inside the shape: [dwFirst, dwEnd).
+struct ShapeSpan
+{
+    DWORD                       dwFirst;
+    DWORD                       dwEnd;
+};
+
+// Sets a span, clipped to a row of dwWidth pixels.
+inline void SetShapeSpan(ShapeSpan *pSpan, int nLeft, int nRight, DWORD dwWidth)
+{
+    pSpan->dwFirst = static_cast<DWORD>(min(max(nLeft, 0), static_cast<int>(dwWidth)));
+    pSpan->dwEnd = static_cast<DWORD>(min(max(nRight, 0), static_cast<int>(dwWidth)));
+}
+
+//-------------------------------------------------------------------
+// Functions to compute the span of each of the dwHeight rows of a
+// frame, in pixels. The spans must be empty to begin with.
+//-------------------------------------------------------------------
+
+inline void GetSquareSpans(DWORD dwWidth, DWORD dwHeight, _Out_writes_(dwHeight) ShapeSpan *pSpans)
+{
+    const int nDimension = min(dwWidth, dwHeight);
+    const int nStartPos = (dwWidth-nDimension)/2;
+
+    for (int nLine = 0; nLine < nDimension; ++nLine)
+    {
+        SetShapeSpan(&pSpans[nLine], nStartPos, nStartPos + nDimension, dwWidth);
+    }
+}
+
+inline void GetCircleSpans(DWORD dwWidth, DWORD dwHeight, _Out_writes_(dwHeight) ShapeSpan *pSpans)
+{
+    const int nDimension = min(dwWidth, dwHeight);
+    const int nRadius = nDimension/2;
+    const int nCenter = dwWidth / 2;
+
+    for (int nLine = -nRadius; nLine < nRadius; ++nLine)
+    {
+        const int nXPos = (int)sqrt(nRadius*(double)nRadius - nLine*(double)nLine);
+
+        SetShapeSpan(&pSpans[nLine + nRadius], nCenter - nXPos, nCenter + nXPos, dwWidth);
+    }
+}
+
+inline void GetTriangleSpans(DWORD dwWidth, DWORD dwHeight, _Out_writes_(dwHeight) ShapeSpan *pSpans)
+{
+    const int nDimension = min(dwWidth, dwHeight);
+
+    int nLeft = dwWidth / 2;
+    int nRight = nLeft + 1;
+    const int cLinesPerPixel = 2;
+
+    for (int nLine = 0, nLinesToGrow = 1; nLine < nDimension; ++nLine, --nLinesToGrow)
+    {
+        if (nLinesToGrow == 0)
+        {
+            nLinesToGrow = cLinesPerPixel;
+            --nLeft;
+            ++nRight;
+        }
+
+        SetShapeSpan(&pSpans[nLine], nLeft, nRight, dwWidth);
+    }
+}
+
+// One plane of a frame, with its edge table.
+struct ShapePlane
+{
+    DWORD                   cbElement;
+    DWORD                   cElements;                  // Elements per row.
+    DWORD                   dwFirstRow;                 // Row of the buffer where the plane starts.
+    DWORD                   dwBlack;
+    std::vector<ShapeSpan>  spans;                      // Edge table, in elements: one span per row.
+};
+
+// Builds a plane with one element per dwStepX pixels and one row per
+// dwStepY rows, from the spans of the dwHeight rows of a frame. Element
+// n is in the shape if pixel n * dwStepX is.
+inline ShapePlane BuildShapePlane(
+    const std::vector<ShapeSpan> &spans,
+    DWORD dwWidth,
+    DWORD cbElement,
+    DWORD dwStepX,
+    DWORD dwStepY,
+    DWORD dwFirstRow,
+    DWORD dwBlack)
+{
+    ShapePlane plane;
+
+    plane.cbElement = cbElement;
+    plane.cElements = dwWidth / dwStepX;
+    plane.dwFirstRow = dwFirstRow;
+    plane.dwBlack = dwBlack;
+    plane.spans.resize(spans.size() / dwStepY);
+
+    for (DWORD nRow = 0; nRow < plane.spans.size(); ++nRow)
+    {
+        const ShapeSpan &span = spans[nRow * dwStepY];
+
+        if (span.dwFirst < span.dwEnd)
+        {
+            plane.spans[nRow].dwFirst = (span.dwFirst + dwStepX - 1) / dwStepX;
+            plane.spans[nRow].dwEnd = (span.dwEnd + dwStepX - 1) / dwStepX;
+        }
+    }
+
+    return plane;
+}
+
+// Writes every row of a plane with three fills: black, the color, and
+// black again. The rows outside the shape take a single fill.
+inline void RenderShapePlane(
+    BYTE *pBuf,
+    LONG lPitch,
+    const ShapePlane &plane,
+    DWORD dwColor,
+    FILL_PATTERN_FN pfnFill)
+{
+    const DWORD cbRow = plane.cElements * plane.cbElement;
+    BYTE *pLine = pBuf + lPitch * static_cast<LONG>(plane.dwFirstRow);
+
+    for (const ShapeSpan &span : plane.spans)
+    {
+        if (span.dwFirst == span.dwEnd)
+        {
+            (*pfnFill)(pLine, cbRow, plane.dwBlack);
+        }
+        else
+        {
+            const DWORD cbFirst = span.dwFirst * plane.cbElement;
+            const DWORD cbEnd = span.dwEnd * plane.cbElement;
+
+            (*pfnFill)(pLine, cbFirst, plane.dwBlack);
+            (*pfnFill)(pLine + cbFirst, cbEnd - cbFirst, dwColor);
+            (*pfnFill)(pLine + cbEnd, cbRow - cbEnd, plane.dwBlack);
+        }
+
+        pLine += lPitch;
+    }
+}
@@ -303,15 +303,16 @@ IFACEMETHODIMP CGeometricMediaSource::Shutdown()
             _spEventQueue->Shutdown();
         }
 
-        if (_spStream)
+        for (auto &spStream : _streams)
         {
-            _spStream->Shutdown();
+            spStream->Shutdown();
         }
 
          _eSourceState = SourceState_Shutdown;
 
         _spEventQueue.ReleaseAndGetAddressOf();
-        _spStream.ReleaseAndGetAddressOf();
+        _streams.clear();
+        _spRenderPool.reset();
         _spDeviceManager.ReleaseAndGetAddressOf();
     }
     
@@ -419,6 +420,8 @@ IFACEMETHODIMP CGeometricMediaSource::GetSourceAttributes(_Outptr_ IMFAttributes
     return S_OK;
 }
 
+// Returns the source attributes, with the statistics of the stream (see
+// GeometricStreamStatistics) at the time of the call.
 IFACEMETHODIMP CGeometricMediaSource::GetStreamAttributes(_In_ DWORD dwStreamIdentifier, _Outptr_ IMFAttributes **ppAttributes)
 {
     if (ppAttributes == nullptr)
@@ -426,10 +429,42 @@ IFACEMETHODIMP CGeometricMediaSource::GetStreamAttributes(_In_ DWORD dwStreamIde
         return E_POINTER;
     }
 
-    *ppAttributes = _spAttributes.Get();
-    (*ppAttributes)->AddRef();
+    HRESULT hr = S_OK;
+    AutoLock lock(_critSec);
 
-    return S_OK;
+    try
+    {
+        ThrowIfError(CheckShutdown());
+
+        const DWORD nStream = dwStreamIdentifier - c_dwGeometricStreamId;
+
+        if (dwStreamIdentifier < c_dwGeometricStreamId || nStream >= _streams.size())
+        {
+            ThrowException(MF_E_INVALIDSTREAMNUMBER);
+        }
+
+        GeometricStreamStatistics statistics;
+        _streams[nStream]->GetStatistics(&statistics);
+
+        ComPtr<IMFAttributes> spAttributes;
+
+        ThrowIfError(MFCreateAttributes(&spAttributes, 8));
+        ThrowIfError(_spAttributes->CopyAllItems(spAttributes.Get()));
+
+        ThrowIfError(spAttributes->SetUINT64(GEOMETRIC_STREAM_SAMPLES_GENERATED, statistics.cSamplesGenerated));
+        ThrowIfError(spAttributes->SetUINT64(GEOMETRIC_STREAM_SAMPLES_DELIVERED, statistics.cSamplesDelivered));
+        ThrowIfError(spAttributes->SetUINT32(GEOMETRIC_STREAM_QUEUED_SAMPLES, statistics.cQueuedSamples));
+        ThrowIfError(spAttributes->SetUINT64(GEOMETRIC_STREAM_AVERAGE_LATENCY, static_cast<UINT64>(statistics.hnsAverageLatency)));
+        ThrowIfError(spAttributes->SetUINT64(GEOMETRIC_STREAM_MAX_LATENCY, static_cast<UINT64>(statistics.hnsMaxLatency)));
+
+        *ppAttributes = spAttributes.Detach();
+    }
+    catch (Exception ^exc)
+    {
+        hr = exc->HResult;
+    }
+
+    return hr;
 }
 
 IFACEMETHODIMP CGeometricMediaSource::SetD3DManager(_In_opt_ IUnknown *pManager)
@@ -444,9 +479,9 @@ IFACEMETHODIMP CGeometricMediaSource::SetD3DManager(_In_opt_ IUnknown *pManager)
             ThrowIfError(pManager->QueryInterface(IID_PPV_ARGS(&_spDeviceManager)));
         }
 
-        if (_spStream != nullptr)
+        for (auto &spStream : _streams)
         {
-            _spStream->SetDXGIDeviceManager(_spDeviceManager.Get());
+            spStream->SetDXGIDeviceManager(_spDeviceManager.Get());
         }
     }
     catch (Exception ^exc)
@@ -570,26 +605,52 @@ concurrency::task<void> CGeometricMediaSource::OpenAsync(Platform::String ^url)
         ThrowException(MF_E_INVALIDREQUEST);
     }
 
-    // Parse url (to obtain host name and port)
-    GeometricShape eShape = ParseServerUrl(url);
-    
-    _spStream = CGeometricMediaStream::CreateInstance(this, eShape);
+    // Parse url (to obtain the shapes and the options)
+    std::vector<GeometricStreamConfig> configs = ParseServerUrl(url);
+
+    // One worker per unthrottled stream, up to one per processor.
+    DWORD cQueuedStreams = 0;
+    for (auto &config : configs)
+    {
+        cQueuedStreams += (config.cQueueSamples > 0) ? 1 : 0;
+    }
 
-    if (_spDeviceManager != nullptr)
+    if (cQueuedStreams > 0)
     {
-        _spStream->SetDXGIDeviceManager(_spDeviceManager.Get());
+        const DWORD cProcessors = max(std::thread::hardware_concurrency(), 1u);
+        _spRenderPool = std::make_shared<CRenderPool>(min(cQueuedStreams, cProcessors));
+    }
+
+    for (DWORD dwIndex = 0; dwIndex < configs.size(); ++dwIndex)
+    {
+        _streams.push_back(CGeometricMediaStream::CreateInstance(this, c_dwGeometricStreamId + dwIndex, configs[dwIndex], _spRenderPool));
+
+        if (_spDeviceManager != nullptr)
+        {
+            _streams.back()->SetDXGIDeviceManager(_spDeviceManager.Get());
+        }
     }
 
     ComPtr<CGeometricMediaSource> spThis = this;
     concurrency::create_task([this, spThis]()
     {
-        ComPtr<IMFStreamDescriptor> spStreamDesc;
         HRESULT hr = S_OK;
         try
         {
-            ThrowIfError(_spStream->GetStreamDescriptor(&spStreamDesc));
-            ThrowIfError(MFCreatePresentationDescriptor(1, spStreamDesc.GetAddressOf(), _spPresentationDescriptor.ReleaseAndGetAddressOf()));
-            ThrowIfError(_spPresentationDescriptor->SelectStream(0));
+            std::vector<IMFStreamDescriptor *> streamDescs;
+            for (auto &spStream : _streams)
+            {
+                ComPtr<IMFStreamDescriptor> spStreamDesc;
+                ThrowIfError(spStream->GetStreamDescriptor(&spStreamDesc));
+                // The stream keeps a reference to its descriptor.
+                streamDescs.push_back(spStreamDesc.Get());
+            }
+
+            ThrowIfError(MFCreatePresentationDescriptor(static_cast<DWORD>(streamDescs.size()), streamDescs.data(), _spPresentationDescriptor.ReleaseAndGetAddressOf()));
+            for (DWORD dwIndex = 0; dwIndex < streamDescs.size(); ++dwIndex)
+            {
+                ThrowIfError(_spPresentationDescriptor->SelectStream(dwIndex));
+            }
             _eSourceState = SourceState_Stopped;
         }
         catch (Exception ^exc)
@@ -661,11 +722,21 @@ HRESULT CGeometricMediaSource::DoStart(CStartOperation *pOp)
     {
         met = MEUpdatedStream;
     }
-    HRESULT hr = _spEventQueue->QueueEventParamUnk(met, GUID_NULL, S_OK, _spStream.Get());
+    HRESULT hr = S_OK;
 
-    if (SUCCEEDED(hr))
+    for (auto &spStream : _streams)
     {
-        hr = _spStream->Start();
+        hr = _spEventQueue->QueueEventParamUnk(met, GUID_NULL, S_OK, spStream.Get());
+
+        if (SUCCEEDED(hr))
+        {
+            hr = spStream->Start();
+        }
+
+        if (FAILED(hr))
+        {
+            break;
+        }
     }
 
     if (SUCCEEDED(hr))
@@ -687,7 +758,16 @@ HRESULT CGeometricMediaSource::DoStop(CSourceOperation *pOp)
 {
     assert(pOp->GetOperationType() == CSourceOperation::Operation_Stop);
     
-    HRESULT hr = _spStream->Stop();
+    HRESULT hr = S_OK;
+
+    for (auto &spStream : _streams)
+    {
+        HRESULT hrStream = spStream->Stop();
+        if (SUCCEEDED(hr))
+        {
+            hr = hrStream;
+        }
+    }
 
     // Send the "stopped" event. This might include a failure code.
     (void)_spEventQueue->QueueEventParamVar(MESourceStopped, GUID_NULL, hr, nullptr);
@@ -701,14 +781,17 @@ HRESULT CGeometricMediaSource::DoSetRate(CSetRateOperation *pOp)
 
     HRESULT hr = S_OK;
 
-    if (_spStream == nullptr)
+    if (_streams.empty())
     {
         hr = E_FAIL;
     }
 
-    if (SUCCEEDED(hr))
+    for (auto &spStream : _streams)
     {
-        hr = _spStream->SetRate(pOp->GetRate());
+        if (SUCCEEDED(hr))
+        {
+            hr = spStream->SetRate(pOp->GetRate());
+        }
     }
 
     if (SUCCEEDED(hr))
@@ -733,17 +816,17 @@ HRESULT CGeometricMediaSource::ValidatePresentationDescriptor(IMFPresentationDes
 
     if (SUCCEEDED(hr))
     {
-        if (cStreams != 1)
+        if (cStreams != _streams.size())
         {
             hr = E_INVALIDARG;
         }
     }
 
     // The caller must select at least one stream.
-    if (SUCCEEDED(hr))
+    for (DWORD dwIndex = 0; SUCCEEDED(hr) && dwIndex < cStreams; ++dwIndex)
     {
         ComPtr<IMFStreamDescriptor> spSD;
-        hr = pPD->GetStreamDescriptorByIndex(0, &fSelected, &spSD);
+        hr = pPD->GetStreamDescriptorByIndex(dwIndex, &fSelected, &spSD);
 
         // As for now all streams have to be selected
         if (SUCCEEDED(hr) && !fSelected)
@@ -756,7 +839,7 @@ HRESULT CGeometricMediaSource::ValidatePresentationDescriptor(IMFPresentationDes
             DWORD dwId = 0;
             hr = spSD->GetStreamIdentifier(&dwId);
 
-            if (SUCCEEDED(hr) && dwId != c_dwGeometricStreamId)
+            if (SUCCEEDED(hr) && dwId != c_dwGeometricStreamId + dwIndex)
             {
                 hr = E_INVALIDARG;
             }
@@ -766,7 +849,7 @@ HRESULT CGeometricMediaSource::ValidatePresentationDescriptor(IMFPresentationDes
     return hr;
 }
 
-GeometricShape CGeometricMediaSource::ParseServerUrl(String ^url)
+std::vector<GeometricStreamConfig> CGeometricMediaSource::ParseServerUrl(String ^url)
 {
     if (url == nullptr)
     {
@@ -781,23 +864,166 @@ GeometricShape CGeometricMediaSource::ParseServerUrl(String ^url)
     }
 
     String ^host = uri->Host;
-    GeometricShape result;
-    bool fFound = false;
+    GeometricStreamConfig result = {};
+    result.eShape = ParseUrlShape(host->Data());
+    result.eFormat = GeometricFormat_ARGB32;
+    result.dwWidth = c_dwDefaultImageWidth;
+    result.dwHeight = c_dwDefaultImageHeight;
+    result.dwFrameRateNumerator = c_dwDefaultFrameRate;
+    result.dwFrameRateDenominator = 1;
+
+    // Streams that the stream options add. A width of 0 stands for the
+    // width and height options.
+    std::vector<GeometricStreamConfig> extraStreams;
+    bool fQueueSet = false;
+
+    // Options in the query string.
+    auto query = uri->QueryParsed;
+    for (unsigned int nIndex = 0; nIndex < query->Size; ++nIndex)
+    {
+        auto entry = query->GetAt(nIndex);
+        const wchar_t *pszName = entry->Name->Data();
+
+        if (_wcsicmp(pszName, L"width") == 0)
+        {
+            result.dwWidth = ParseUrlNumber(entry->Value);
+        }
+        else if (_wcsicmp(pszName, L"height") == 0)
+        {
+            result.dwHeight = ParseUrlNumber(entry->Value);
+        }
+        else if (_wcsicmp(pszName, L"fps") == 0)
+        {
+            result.dwFrameRateNumerator = ParseUrlNumber(entry->Value);
+        }
+        else if (_wcsicmp(pszName, L"format") == 0)
+        {
+            result.eFormat = ParseUrlFormat(entry->Value);
+        }
+        else if (_wcsicmp(pszName, L"ring") == 0)
+        {
+            result.cRingFrames = ParseUrlNumber(entry->Value);
+        }
+        else if (_wcsicmp(pszName, L"queue") == 0)
+        {
+            result.cQueueSamples = ParseUrlNumber(entry->Value);
+            fQueueSet = true;
+        }
+        else if (_wcsicmp(pszName, L"stream") == 0)
+        {
+            if (extraStreams.size() + 1 >= c_cMaxStreams)
+            {
+                throw ref new COMException(MF_E_INVALIDNAME);
+            }
+
+            GeometricStreamConfig stream = {};
+            ParseUrlStream(entry->Value, &stream);
+            extraStreams.push_back(stream);
+        }
+        else
+        {
+            throw ref new COMException(MF_E_INVALIDNAME);
+        }
+    }
+
+    if (!extraStreams.empty() && !fQueueSet)
+    {
+        result.cQueueSamples = c_cDefaultMultiStreamQueue;
+    }
+
+    std::vector<GeometricStreamConfig> streams(1, result);
+
+    for (auto &extra : extraStreams)
+    {
+        GeometricStreamConfig stream = result;
+
+        stream.eShape = extra.eShape;
+        if (extra.dwWidth != 0)
+        {
+            stream.dwWidth = extra.dwWidth;
+            stream.dwHeight = extra.dwHeight;
+        }
+
+        streams.push_back(stream);
+    }
+
+    for (auto &stream : streams)
+    {
+        // YUY2 and NV12 need an even width and height, so all formats do.
+        if (stream.dwWidth == 0 || stream.dwWidth > c_dwMaxImageDimension || (stream.dwWidth & 1) != 0 ||
+            stream.dwHeight == 0 || stream.dwHeight > c_dwMaxImageDimension || (stream.dwHeight & 1) != 0 ||
+            stream.dwFrameRateNumerator == 0 || stream.dwFrameRateNumerator > c_dwMaxFrameRate)
+        {
+            throw ref new COMException(MF_E_INVALIDNAME);
+        }
+    }
+
+    return streams;
+}
+
+GeometricShape CGeometricMediaSource::ParseUrlShape(const wchar_t *pszValue)
+{
     for (DWORD dwIndex = 0; dwIndex < GeometricShape_Count; ++dwIndex)
     {
-        if (_wcsicmp(c_arrShapeNames[dwIndex], host->Data()) == 0)
+        if (_wcsicmp(c_arrShapeNames[dwIndex], pszValue) == 0)
         {
-            result = static_cast<GeometricShape>(dwIndex);
-            fFound = true;
-            break;
+            return static_cast<GeometricShape>(dwIndex);
         }
     }
 
-    if (!fFound)
+    throw ref new COMException(MF_E_INVALIDNAME);
+}
+
+// Parses the value of a stream option: <shape>[:<width>x<height>]. Leaves
+// the width and height at 0 if there is no size.
+void CGeometricMediaSource::ParseUrlStream(String ^value, GeometricStreamConfig *pConfig)
+{
+    const wchar_t *pszValue = value->Data();
+    const wchar_t *pszSize = wcschr(pszValue, L':');
+
+    if (pszSize == nullptr)
+    {
+        pConfig->eShape = ParseUrlShape(pszValue);
+        return;
+    }
+
+    const wchar_t *pszHeight = wcschr(pszSize, L'x');
+    if (pszHeight == nullptr)
     {
         throw ref new COMException(MF_E_INVALIDNAME);
     }
-    return result;
+
+    pConfig->eShape = ParseUrlShape((ref new String(pszValue, static_cast<unsigned int>(pszSize - pszValue)))->Data());
+    pConfig->dwWidth = ParseUrlNumber(ref new String(pszSize + 1, static_cast<unsigned int>(pszHeight - pszSize - 1)));
+    pConfig->dwHeight = ParseUrlNumber(ref new String(pszHeight + 1));
+}
+
+GeometricFormat CGeometricMediaSource::ParseUrlFormat(String ^value)
+{
+    for (DWORD dwIndex = 0; dwIndex < GeometricFormat_Count; ++dwIndex)
+    {
+        if (_wcsicmp(c_arrFormatNames[dwIndex], value->Data()) == 0)
+        {
+            return static_cast<GeometricFormat>(dwIndex);
+        }
+    }
+
+    throw ref new COMException(MF_E_INVALIDNAME);
+}
+
+// Parses the decimal number of a URL option.
+DWORD CGeometricMediaSource::ParseUrlNumber(String ^value)
+{
+    const wchar_t *pszValue = value->Data();
+    wchar_t *pszEnd = nullptr;
+
+    const unsigned long ulValue = wcstoul(pszValue, &pszEnd, 10);
+    if (pszEnd == pszValue || *pszEnd != L'\0' || ulValue > MAXDWORD)
+    {
+        throw ref new COMException(MF_E_INVALIDNAME);
+    }
+
+    return static_cast<DWORD>(ulValue);
 }
 
 BOOL CGeometricMediaSource::IsRateSupported(float flRate, float *pflAdjustedRate)
@@ -8,8 +8,11 @@
 #pragma once
 #include "OpQueue.h"
 #include "critsec.h"
+#include <vector>
+#include <memory>
 
 class CGeometricMediaStream;
+class CRenderPool;
 
 extern wchar_t const __declspec(selectany) c_szGeometricScheme[] = L"myscheme";
 extern wchar_t const __declspec(selectany) c_szGeometricSchemeWithColon[] = L"myscheme:";
@@ -29,6 +32,60 @@ extern LPCWSTR __declspec(selectany) c_arrShapeNames[] =
     L"triangle",
 };
 
+enum GeometricFormat
+{
+    GeometricFormat_ARGB32,
+    GeometricFormat_RGB32,
+    GeometricFormat_NV12,
+    GeometricFormat_YUY2,
+    GeometricFormat_Count,
+};
+
+extern LPCWSTR __declspec(selectany) c_arrFormatNames[] =
+{
+    L"argb32",
+    L"rgb32",
+    L"nv12",
+    L"yuy2",
+};
+
+// Options of the stream, from the URL:
+//
+//  myscheme://<shape>[?width=<pixels>][&height=<pixels>][&fps=<frames>][&format=<format>][&ring=<frames>][&queue=<samples>][&stream=<shape>[:<width>x<height>]]...
+//
+// For example, myscheme://circle?width=1920&height=1080&fps=60&format=nv12.
+// The width and height must be even.
+//
+// With queue=<samples>, the stream is unthrottled: a producer thread
+// renders samples ahead of the requests, so that a pipeline that is being
+// measured never waits for the source to render a frame.
+//
+// Each stream=<shape> option adds a stream, of the width and height
+// options or of its own size, for example
+// myscheme://circle?stream=square:640x480&stream=triangle. All streams
+// share the other options. When there is more than one stream, queue
+// defaults to 2, so that the streams render on a shared worker pool
+// rather than one after the other under the source lock.
+struct GeometricStreamConfig
+{
+    GeometricShape  eShape;
+    GeometricFormat eFormat;
+    DWORD           dwWidth;
+    DWORD           dwHeight;
+    DWORD           dwFrameRateNumerator;
+    DWORD           dwFrameRateDenominator;
+    DWORD           cRingFrames;        // Pre-rendered frames that are replayed. (0 = render every frame.)
+    DWORD           cQueueSamples;      // Samples rendered ahead of requests. (0 = render on request.)
+};
+
+const DWORD c_dwDefaultImageWidth = 320;
+const DWORD c_dwDefaultImageHeight = 256;
+const DWORD c_dwDefaultFrameRate = 10;
+const DWORD c_dwMaxImageDimension = 8192;
+const DWORD c_dwMaxFrameRate = 1000;
+const DWORD c_cMaxStreams = 16;
+const DWORD c_cDefaultMultiStreamQueue = 2;
+
 // Possible states of the source object
 enum SourceState
 {
@@ -178,7 +235,11 @@ private:
     HRESULT DoSetRate(CSetRateOperation *pOp);
 
     HRESULT ValidatePresentationDescriptor(IMFPresentationDescriptor *pPD);
-    GeometricShape ParseServerUrl(String ^url);
+    std::vector<GeometricStreamConfig> ParseServerUrl(String ^url);
+    static GeometricShape ParseUrlShape(const wchar_t *pszValue);
+    static void ParseUrlStream(String ^value, GeometricStreamConfig *pConfig);
+    static DWORD ParseUrlNumber(String ^value);
+    static GeometricFormat ParseUrlFormat(String ^value);
 
     BOOL IsRateSupported(float flRate, float *pflAdjustedRate);
 
@@ -199,7 +260,8 @@ private:
     CritSec                     _critSec;                   // critical section for thread safety
     SourceState                 _eSourceState;              // Flag to indicate if Shutdown() method was called.
     ComPtr<IMFMediaEventQueue>  _spEventQueue;              // Event queue
-    ComPtr<CGeometricMediaStream> _spStream;                // We only have one stream
+    std::vector<ComPtr<CGeometricMediaStream>> _streams;   // Stream i has the identifier c_dwGeometricStreamId + i.
+    std::shared_ptr<CRenderPool> _spRenderPool;             // Renders the unthrottled streams.
     ComPtr<IMFPresentationDescriptor> _spPresentationDescriptor;
     ComPtr<IMFDXGIDeviceManager> _spDeviceManager;
     ComPtr<IMFAttributes>       _spAttributes;
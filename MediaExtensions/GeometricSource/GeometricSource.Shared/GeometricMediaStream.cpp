@@ -8,19 +8,60 @@
 #include "pch.h"
 #include "GeometricMediaStream.h"
 #include "VideoBufferLock.h"
+#include "GeometricKernels.h"
 #include <initguid.h>
 #include <math.h>
+#include <vector>
+#include <algorithm>
 #include <wrl\module.h>
 
 namespace
 {
-    const DWORD c_dwOutputImageHeight = 256;
-    const DWORD c_dwOutputImageWidth = 320;
-    const DWORD c_cbOutputSamplenNumPixels = c_dwOutputImageWidth * c_dwOutputImageHeight;
-    const DWORD c_cbOutputSampleSize = c_cbOutputSamplenNumPixels * 4;
-    const DWORD c_dwOutputFrameRateNumerator = 1;
-    const DWORD c_dwOutputFrameRateDenominator = 1;
-    const LONGLONG c_llOutputFrameDuration = 1000000ll;
+    const DWORD c_cMaxRingFrames = 300;
+    const DWORD c_cMaxQueueSamples = 64;
+    const DWORD c_cAllocatorSamples = 4;        // Samples of the D3D allocator, besides the queued ones.
+    const DWORD c_dwAllocatorRetryMs = 1;       // Wait before a worker asks an empty allocator again.
+    const ULONGLONG c_cbMaxRingSize = 512 * 1024 * 1024;
+
+    // Subtype of each GeometricFormat.
+    const GUID c_arrFormatSubtypes[] =
+    {
+        MFVideoFormat_ARGB32,
+        MFVideoFormat_RGB32,
+        MFVideoFormat_NV12,
+        MFVideoFormat_YUY2,
+    };
+
+    LONG GetDefaultStride(const GeometricStreamConfig &config)
+    {
+        switch (config.eFormat)
+        {
+        case GeometricFormat_NV12:
+            return config.dwWidth;
+
+        case GeometricFormat_YUY2:
+            return config.dwWidth * 2;
+
+        default:
+            return config.dwWidth * 4;
+        }
+    }
+
+    // Rows of the buffer: NV12 has a U-V row for every two rows of Y.
+    DWORD GetBufferRows(const GeometricStreamConfig &config)
+    {
+        return (config.eFormat == GeometricFormat_NV12) ? config.dwHeight * 3 / 2 : config.dwHeight;
+    }
+
+    DWORD GetFrameSize(const GeometricStreamConfig &config)
+    {
+        return GetDefaultStride(config) * GetBufferRows(config);
+    }
+
+    LONGLONG GetFrameDuration(const GeometricStreamConfig &config)
+    {
+        return 10000000ll * config.dwFrameRateDenominator / config.dwFrameRateNumerator;
+    }
 }
 
 class CGeometricMediaStream::CSourceLock
@@ -49,6 +90,88 @@ private:
     ComPtr<CGeometricMediaSource> _spSource;
 };
 
+// Bounded queue of samples from the producer thread to RequestSample.
+//
+// There is one producer and one consumer at a time (the consumers hold
+// _requestMutex), and each index is written by one side only, so Push and
+// Pop do not take a lock. The release store of an index hands the slot it
+// passes over to the other side.
+
+class CGeometricMediaStream::CSampleQueue
+{
+public:
+    explicit CSampleQueue(DWORD cCapacity)
+        : _slots(cCapacity + 1)
+        , _nHead(0)
+        , _nTail(0)
+    {
+    }
+
+    DWORD GetCapacity() const
+    {
+        return static_cast<DWORD>(_slots.size()) - 1;
+    }
+
+    DWORD GetCount() const
+    {
+        const DWORD nHead = _nHead.load(std::memory_order_acquire);
+        const DWORD nTail = _nTail.load(std::memory_order_acquire);
+
+        return (nTail >= nHead) ? nTail - nHead : nTail + static_cast<DWORD>(_slots.size()) - nHead;
+    }
+
+    // Called by the producer. Returns false if the queue is full.
+    bool Push(IMFSample *pSample)
+    {
+        const DWORD nTail = _nTail.load(std::memory_order_relaxed);
+        const DWORD nNext = Next(nTail);
+
+        if (nNext == _nHead.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        _slots[nTail] = pSample;
+        _nTail.store(nNext, std::memory_order_release);
+
+        return true;
+    }
+
+    // Called by the consumer. Returns nullptr if the queue is empty.
+    ComPtr<IMFSample> Pop()
+    {
+        ComPtr<IMFSample> spSample;
+        const DWORD nHead = _nHead.load(std::memory_order_relaxed);
+
+        if (nHead != _nTail.load(std::memory_order_acquire))
+        {
+            spSample.Swap(_slots[nHead]);
+            _nHead.store(Next(nHead), std::memory_order_release);
+        }
+
+        return spSample;
+    }
+
+    // Only while the producer is stopped.
+    void Clear()
+    {
+        while (Pop() != nullptr)
+        {
+        }
+    }
+
+private:
+    DWORD Next(DWORD nIndex) const
+    {
+        return (nIndex + 1 == _slots.size()) ? 0 : nIndex + 1;
+    }
+
+private:
+    std::vector<ComPtr<IMFSample>> _slots;                  // One more than the capacity, so that full and empty differ.
+    std::atomic<DWORD>          _nHead;                     // Next slot to pop. Written by the consumer.
+    std::atomic<DWORD>          _nTail;                     // Next slot to push. Written by the producer.
+};
+
 BYTE Clip(int i)
 {
     return (i > 255 ? 255 : (i < 0 ? 0 : i));
@@ -74,131 +197,358 @@ DWORD YUVToRGB( BYTE Y, BYTE U, BYTE V)
     return ret;
 }
 
+// Generates the frames of one shape, in the size and format of the stream.
+//
+// The shapes are convex, so each row crosses a shape in one span. The
+// drawer computes the span of each row once per size, into an edge table,
+// and each frame is written one row at a time, with three fills: black,
+// the color of the frame, and black again. A frame is written only once,
+// and the rows outside the shape take a single fill. YUY2 pixel pairs and
+// NV12 U-V pairs take the color if their top-left pixel is in the shape.
+//
+// If a ring of frames is set up, the first frames are rendered once and
+// then copied in turn, so that no frame is rendered while streaming. A
+// copy reads and writes a whole frame, so the ring is slower than
+// rendering unless the fill is the bottleneck, for instance on a CPU
+// without SIMD.
+
 ref class CFrameGenerator abstract
 {
 internal:
-    CFrameGenerator() { }
+    CFrameGenerator()
+        : _dwWidth(0)
+        , _dwHeight(0)
+        , _pfnFill(SelectFillPattern())
+        , _eFormat(GeometricFormat_ARGB32)
+        , _llFrameDuration(0)
+        , _cRingFrames(0)
+        , _cbFrame(0)
+        , _lDefaultStride(0)
+        , _cBufferRows(0)
+    {
+    }
+
+    void Initialize(const GeometricStreamConfig &config)
+    {
+        if (config.cRingFrames > c_cMaxRingFrames ||
+            static_cast<ULONGLONG>(config.cRingFrames) * GetFrameSize(config) > c_cbMaxRingSize)
+        {
+            throw ref new InvalidArgumentException();
+        }
+
+        _dwWidth = config.dwWidth;
+        _dwHeight = config.dwHeight;
+        _eFormat = config.eFormat;
+        _llFrameDuration = GetFrameDuration(config);
+        _cRingFrames = config.cRingFrames;
+        _cbFrame = GetFrameSize(config);
+        _lDefaultStride = GetDefaultStride(config);
+        _cBufferRows = GetBufferRows(config);
+
+        _planes.clear();
+        _ring.clear();
+    }
 
     void PrepareFrame(BYTE *pBuf, LONGLONG llTimestamp, LONG lPitch)
     {
-        ZeroMemory(pBuf, lPitch * c_dwOutputImageHeight);
+        if (_cRingFrames == 0)
+        {
+            RenderFrame(pBuf, llTimestamp, lPitch);
+            return;
+        }
+
+        if (_ring.empty())
+        {
+            _ring.resize(_cRingFrames * _cbFrame);
 
-        sin((llTimestamp/100000.0)*3.1415);
-        DrawFrame(pBuf, YUVToRGB(128, 128 + BYTE(127 * sin(llTimestamp/10000000.0)), 128 + BYTE(127 * cos(llTimestamp/3300000.0))), lPitch);
+            for (DWORD nFrame = 0; nFrame < _cRingFrames; ++nFrame)
+            {
+                RenderFrame(&_ring[nFrame * _cbFrame], nFrame * _llFrameDuration, _lDefaultStride);
+            }
+        }
+
+        const DWORD nFrame = static_cast<DWORD>((llTimestamp / _llFrameDuration) % _cRingFrames);
+
+        ThrowIfError(MFCopyImage(pBuf, lPitch, &_ring[nFrame * _cbFrame], _lDefaultStride, _lDefaultStride, _cBufferRows));
     }
 
 protected private:
-    virtual void DrawFrame(BYTE *pBuf, DWORD dwColor, LONG lPitch) = 0;
+    // Fills the span of each of the _dwHeight rows of the frame, in
+    // pixels. The spans are empty to begin with. (See GetSquareSpans.)
+    virtual void GetSpans(_Out_writes_(_dwHeight) ShapeSpan *pSpans) = 0;
+
+protected private:
+    DWORD                       _dwWidth;                   // Frame size, in pixels.
+    DWORD                       _dwHeight;
+
+private:
+    void RenderFrame(BYTE *pBuf, LONGLONG llTimestamp, LONG lPitch)
+    {
+        if (_planes.empty())
+        {
+            BuildPlanes();
+        }
+
+        const BYTE Y = 128;
+        const BYTE U = 128 + BYTE(127 * sin(llTimestamp/10000000.0));
+        const BYTE V = 128 + BYTE(127 * cos(llTimestamp/3300000.0));
+
+        // Color of each plane, with the bytes of an element repeated.
+        DWORD adwColor[2] = {};
 
-    void SetColor(_In_reads_bytes_(cElements) DWORD *pBuf, DWORD dwColor, DWORD cElements)
+        switch (_eFormat)
+        {
+        case GeometricFormat_NV12:
+            adwColor[0] = Y * 0x01010101u;
+            adwColor[1] = (U | (V << 8)) * 0x00010001u;
+            break;
+
+        case GeometricFormat_YUY2:
+            adwColor[0] = Y | (U << 8) | (Y << 16) | (V << 24);
+            break;
+
+        default:
+            adwColor[0] = YUVToRGB(Y, U, V);
+            break;
+        }
+
+        for (size_t nPlane = 0; nPlane < _planes.size(); ++nPlane)
+        {
+            RenderShapePlane(pBuf, lPitch, _planes[nPlane], adwColor[nPlane], _pfnFill);
+        }
+    }
+
+    // Builds the edge table of each plane from the spans of the shape.
+    void BuildPlanes()
     {
-        for(DWORD nIndex = 0; nIndex < cElements; ++nIndex)
+        std::vector<ShapeSpan> spans(_dwHeight, ShapeSpan());
+
+        GetSpans(spans.data());
+
+        switch (_eFormat)
         {
-            pBuf[nIndex] = dwColor;
+        case GeometricFormat_NV12:
+            _planes.push_back(BuildShapePlane(spans, _dwWidth, sizeof(BYTE), 1, 1, 0, 0x10101010));
+            _planes.push_back(BuildShapePlane(spans, _dwWidth, sizeof(WORD), 2, 2, _dwHeight, 0x80808080));
+            break;
+
+        case GeometricFormat_YUY2:
+            _planes.push_back(BuildShapePlane(spans, _dwWidth, sizeof(DWORD), 2, 1, 0, 0x80108010));
+            break;
+
+        default:
+            _planes.push_back(BuildShapePlane(spans, _dwWidth, sizeof(DWORD), 1, 1, 0, 0));
+            break;
         }
     }
+
+private:
+    FILL_PATTERN_FN             _pfnFill;
+    GeometricFormat             _eFormat;
+    LONGLONG                    _llFrameDuration;
+    DWORD                       _cRingFrames;
+    DWORD                       _cbFrame;
+    LONG                        _lDefaultStride;
+    DWORD                       _cBufferRows;
+    std::vector<ShapePlane>     _planes;                    // Built with the first frame.
+    std::vector<BYTE>           _ring;                      // Pre-rendered frames, if _cRingFrames > 0.
 };
 
 ref class CSquareDrawer sealed: public CFrameGenerator
 {
 protected private:
-    void DrawFrame(BYTE *pBuf, DWORD dwColor, LONG lPitch) override
+    void GetSpans(ShapeSpan *pSpans) override
     {
-        const DWORD dwDimension = min(c_dwOutputImageWidth, c_dwOutputImageHeight);
-        const int nFirstLine = (c_dwOutputImageHeight-dwDimension)/2;    
-        const int nStartPos = (c_dwOutputImageWidth-dwDimension)/2;
-
-        for (int nLine = 0; nLine < dwDimension; ++nLine, pBuf += lPitch)
-        {
-            DWORD *pLine = reinterpret_cast<DWORD *>(pBuf) + nStartPos;
-            SetColor(pLine, dwColor, dwDimension);
-        }
+        GetSquareSpans(_dwWidth, _dwHeight, pSpans);
     }
 };
 
 ref class CCircleDrawer sealed: public CFrameGenerator
 {
 protected private:
-    void DrawFrame(BYTE *pBuf, DWORD dwColor, LONG lPitch) override
+    void GetSpans(ShapeSpan *pSpans) override
     {
-        const int dwDimension = min(c_dwOutputImageWidth, c_dwOutputImageHeight);
-        const int dwRadius = dwDimension/2;
-        const int nFirstLine = (c_dwOutputImageHeight-dwDimension)/2;    
-        const int nStartPos = (c_dwOutputImageWidth-dwDimension)/2;
-
-        for (int nLine = -dwRadius; nLine < dwRadius; ++nLine, pBuf += lPitch)
-        {
-            const int nXPos = (int)sqrt(dwRadius*(double)dwRadius - nLine*(double)nLine);
-            const int nStartPos = (c_dwOutputImageWidth / 2) - nXPos;
-            const int cPixels = nXPos * 2;
-            DWORD *pLine = reinterpret_cast<DWORD *>(pBuf) + nStartPos;
-
-            SetColor(pLine, dwColor, cPixels);
-        }
+        GetCircleSpans(_dwWidth, _dwHeight, pSpans);
     }
 };
 
 ref class CTriangleDrawer sealed: public CFrameGenerator
 {
 protected private:
-    void DrawFrame(BYTE *pBuf, DWORD dwColor, LONG lPitch) override
+    void GetSpans(ShapeSpan *pSpans) override
     {
-        const DWORD dwDimension = min(c_dwOutputImageWidth, c_dwOutputImageHeight);
-
-        const int nFirstLine = (c_dwOutputImageHeight-dwDimension)/2;    
-        const int nStartPos = (c_dwOutputImageWidth-dwDimension)/2;
-
-        int nLeft = c_dwOutputImageWidth / 2;
-        int nRight = nLeft + 1;
-        const int cLinesPerPixel = 2;
-
-        for (int nLine = 0, nLinesToGrow = 1; nLine < dwDimension; ++nLine, pBuf += lPitch, --nLinesToGrow)
-        {
-            if (nLinesToGrow == 0)
-            {
-                nLinesToGrow = cLinesPerPixel;
-                --nLeft;
-                ++nRight;
-            }
-
-            DWORD *pLine = reinterpret_cast<DWORD *>(pBuf) + nLeft;
-            SetColor(pLine, dwColor, nRight - nLeft);
-        }
+        GetTriangleSpans(_dwWidth, _dwHeight, pSpans);
     }
 };
 
-CFrameGenerator ^CreateFrameGenerator(GeometricShape eShape)
+CFrameGenerator ^CreateFrameGenerator(const GeometricStreamConfig &config)
 {
-    switch(eShape)
+    CFrameGenerator ^generator;
+
+    switch(config.eShape)
     {
     case GeometricShape_Square:
         {
-            return ref new CSquareDrawer();
+            generator = ref new CSquareDrawer();
+            break;
         }
     case GeometricShape_Circle:
         {
-            return ref new CCircleDrawer();
+            generator = ref new CCircleDrawer();
+            break;
         }
     case GeometricShape_Triangle:
         {
-            return ref new CTriangleDrawer();
+            generator = ref new CTriangleDrawer();
+            break;
         }
     default:
         {
             throw ref new InvalidArgumentException();
         }
     }
+
+    generator->Initialize(config);
+
+    return generator;
+}
+
+CRenderPool::CRenderPool(DWORD cThreads)
+    : _fShutdown(false)
+    , _generation(0)
+    , _nNextStream(0)
+{
+    try
+    {
+        for (DWORD i = 0; i < cThreads; i++)
+        {
+            _workers.push_back(std::thread(&CRenderPool::WorkerThreadProc, this));
+        }
+    }
+    catch (...)
+    {
+        StopWorkers();
+        ThrowException(E_OUTOFMEMORY);
+    }
+}
+
+CRenderPool::~CRenderPool()
+{
+    StopWorkers();
+}
+
+void CRenderPool::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _fShutdown = true;
+    }
+    _cvWork.notify_all();
+
+    for (auto &worker : _workers)
+    {
+        worker.join();
+    }
+    _workers.clear();
+}
+
+void CRenderPool::AddStream(CGeometricMediaStream *pStream)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _streams.push_back(pStream);
+        ++_generation;
+    }
+    _cvWork.notify_all();
+}
+
+void CRenderPool::RemoveStream(CGeometricMediaStream *pStream)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _streams.erase(std::remove(_streams.begin(), _streams.end(), pStream), _streams.end());
+    _cvIdle.wait(lock, [&]() { return !IsRendering(pStream); });
+}
+
+void CRenderPool::Wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_generation;
+    }
+    _cvWork.notify_one();
+}
+
+void CRenderPool::WorkerThreadProc()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (!_fShutdown)
+    {
+        CGeometricMediaStream *pStream = ClaimStream();
+
+        if (pStream == nullptr)
+        {
+            const DWORD generation = _generation;
+            _cvWork.wait(lock, [&]() { return _fShutdown || _generation != generation; });
+            continue;
+        }
+
+        _rendering.push_back(pStream);
+        lock.unlock();
+
+        const bool fRendered = pStream->ProduceSample();
+
+        lock.lock();
+        _rendering.erase(std::find(_rendering.begin(), _rendering.end(), pStream));
+
+        // Another worker may have skipped this stream while it was busy.
+        ++_generation;
+        _cvWork.notify_one();
+        _cvIdle.notify_all();
+
+        if (!fRendered)
+        {
+            // The pipeline holds every sample of the allocator.
+            _cvWork.wait_for(lock, std::chrono::milliseconds(c_dwAllocatorRetryMs), [this]() { return _fShutdown; });
+        }
+    }
+}
+
+// Returns the next stream that needs a sample and that no worker is
+// rendering, or nullptr. Called with _mutex held.
+CGeometricMediaStream *CRenderPool::ClaimStream()
+{
+    const size_t cStreams = _streams.size();
+
+    for (size_t i = 0; i < cStreams; i++)
+    {
+        CGeometricMediaStream *pStream = _streams[(_nNextStream + i) % cStreams];
+
+        if (!IsRendering(pStream) && pStream->CanProduceSample())
+        {
+            _nNextStream = (_nNextStream + i + 1) % cStreams;
+            return pStream;
+        }
+    }
+
+    return nullptr;
 }
 
-ComPtr<CGeometricMediaStream> CGeometricMediaStream::CreateInstance(CGeometricMediaSource *pSource, GeometricShape eShape)
+bool CRenderPool::IsRendering(CGeometricMediaStream *pStream) const
 {
-    if (pSource == nullptr)
+    return std::find(_rendering.begin(), _rendering.end(), pStream) != _rendering.end();
+}
+
+ComPtr<CGeometricMediaStream> CGeometricMediaStream::CreateInstance(CGeometricMediaSource *pSource, DWORD dwStreamId, const GeometricStreamConfig &config, const std::shared_ptr<CRenderPool> &spRenderPool)
+{
+    if (pSource == nullptr || (config.cQueueSamples > 0 && spRenderPool == nullptr))
     {
         throw ref new InvalidArgumentException();
     }
 
     ComPtr<CGeometricMediaStream> spStream;
-    spStream.Attach(new(std::nothrow) CGeometricMediaStream(pSource, eShape));
+    spStream.Attach(new(std::nothrow) CGeometricMediaStream(pSource, dwStreamId, config, spRenderPool));
     if (spStream == nullptr)
     {
         throw ref new OutOfMemoryException();
@@ -209,12 +559,21 @@ ComPtr<CGeometricMediaStream> CGeometricMediaStream::CreateInstance(CGeometricMe
     return spStream;
 }
 
-CGeometricMediaStream::CGeometricMediaStream(CGeometricMediaSource *pSource, GeometricShape eShape)
+CGeometricMediaStream::CGeometricMediaStream(CGeometricMediaSource *pSource, DWORD dwStreamId, const GeometricStreamConfig &config, const std::shared_ptr<CRenderPool> &spRenderPool)
     : _cRef(1)
     , _spSource(pSource)
+    , _dwStreamId(dwStreamId)
     , _eSourceState(SourceState_Invalid)
-    , _eShape(eShape)
+    , _config(config)
     , _flRate(1.0f)
+    , _spRenderPool(spRenderPool)
+    , _fProducing(false)
+    , _hrProducer(S_OK)
+    , _llProducerTimestamp(0)
+    , _cSamplesGenerated(0)
+    , _cSamplesDelivered(0)
+    , _hnsTotalLatency(0)
+    , _hnsMaxLatency(0)
 {
     auto module = ::Microsoft::WRL::GetModuleBase();
     if (module != nullptr)
@@ -226,6 +585,8 @@ CGeometricMediaStream::CGeometricMediaStream(CGeometricMediaSource *pSource, Geo
 
 CGeometricMediaStream::~CGeometricMediaStream(void)
 {
+    StopProducer();
+
     auto module = ::Microsoft::WRL::GetModuleBase();
     if (module != nullptr)
     {
@@ -415,8 +776,24 @@ IFACEMETHODIMP CGeometricMediaStream::RequestSample(IUnknown *pToken)
             ThrowException(MF_E_INVALIDREQUEST);
         }
 
-        // Trigger sample delivery
-        DeliverSample(pToken);
+        if (_spSampleQueue != nullptr)
+        {
+            // Deliver a queued sample, or leave the request for the render
+            // pool. Do not wait for a sample with the source lock held.
+            std::lock_guard<std::mutex> requestLock(_requestMutex);
+
+            ThrowIfError(_hrProducer.load());
+
+            const SampleRequest request = { pToken, MFGetSystemTime() };
+            _requests.push_back(request);
+
+            DispatchQueuedSamples();
+        }
+        else
+        {
+            // Trigger sample delivery
+            DeliverSample(pToken);
+        }
     }
     catch (Exception ^exc)
     {
@@ -443,6 +820,11 @@ HRESULT CGeometricMediaStream::Start()
             }
             _eSourceState = SourceState_Started;
 
+            if (_spSampleQueue != nullptr && !_fProducing)
+            {
+                StartProducer();
+            }
+
             // Inform the client that we've started
             ThrowIfError(QueueEvent(MEStreamStarted, GUID_NULL, S_OK, nullptr));
         }
@@ -469,6 +851,8 @@ HRESULT CGeometricMediaStream::Stop()
 
         if (_eSourceState == SourceState_Started)
         {
+            StopProducer();
+            ClearRequests();
             _eSourceState = SourceState_Stopped;
             // Inform the client that we've stopped.
             ThrowIfError(QueueEvent(MEStreamStopped, GUID_NULL, S_OK, nullptr));
@@ -510,6 +894,9 @@ void CGeometricMediaStream::Shutdown()
     {
         ThrowIfError(CheckShutdown());
 
+        StopProducer();
+        ClearRequests();
+
         if (_spEventQueue)
         {
             _spEventQueue->Shutdown();
@@ -526,6 +913,7 @@ void CGeometricMediaStream::Shutdown()
         _eSourceState = SourceState_Shutdown;
 
         _frameGenerator = nullptr;
+        _spRenderPool.reset();
     }
     catch (Exception ^exc)
     {
@@ -535,12 +923,39 @@ void CGeometricMediaStream::Shutdown()
 
 void CGeometricMediaStream::SetDXGIDeviceManager(IMFDXGIDeviceManager *pManager)
 {
+    // The producer uses the allocator, so it is stopped while the device
+    // changes. The samples it had queued are rendered again.
+    const bool fRestartProducer = _fProducing;
+
+    StopProducer();
+
     _spDeviceManager = pManager;
 
     if (_spDeviceManager)
     {
         CreateVideoSampleAllocator();
     }
+
+    if (fRestartProducer)
+    {
+        StartProducer();
+    }
+}
+
+void CGeometricMediaStream::GetStatistics(GeometricStreamStatistics *pStatistics)
+{
+    if (pStatistics == nullptr)
+    {
+        throw ref new InvalidArgumentException();
+    }
+
+    std::lock_guard<std::mutex> lock(_requestMutex);
+
+    pStatistics->cSamplesGenerated = _cSamplesGenerated.load();
+    pStatistics->cSamplesDelivered = _cSamplesDelivered;
+    pStatistics->cQueuedSamples = (_spSampleQueue != nullptr) ? _spSampleQueue->GetCount() : 0;
+    pStatistics->hnsAverageLatency = (_cSamplesDelivered != 0) ? _hnsTotalLatency / static_cast<LONGLONG>(_cSamplesDelivered) : 0;
+    pStatistics->hnsMaxLatency = _hnsMaxLatency;
 }
 
 void CGeometricMediaStream::Initialize()
@@ -554,7 +969,7 @@ void CGeometricMediaStream::Initialize()
     _spMediaType = CreateMediaType();
 
     // Now we can create MF stream descriptor.
-    ThrowIfError(MFCreateStreamDescriptor(c_dwGeometricStreamId, 1, _spMediaType.GetAddressOf(), &spSD));
+    ThrowIfError(MFCreateStreamDescriptor(_dwStreamId, 1, _spMediaType.GetAddressOf(), &spSD));
     ThrowIfError(spSD->GetMediaTypeHandler(&spMediaTypeHandler));
     // Set current media type
     ThrowIfError(spMediaTypeHandler->SetCurrentMediaType(_spMediaType.Get()));
@@ -562,7 +977,17 @@ void CGeometricMediaStream::Initialize()
     // State of the stream is started.
     _eSourceState = SourceState_Stopped;
 
-    _frameGenerator = CreateFrameGenerator(_eShape);
+    _frameGenerator = CreateFrameGenerator(_config);
+
+    if (_config.cQueueSamples > c_cMaxQueueSamples)
+    {
+        throw ref new InvalidArgumentException();
+    }
+
+    if (_config.cQueueSamples > 0)
+    {
+        _spSampleQueue.reset(new CSampleQueue(_config.cQueueSamples));
+    }
 }
 
 ComPtr<IMFMediaType> CGeometricMediaStream::CreateMediaType()
@@ -571,36 +996,170 @@ ComPtr<IMFMediaType> CGeometricMediaStream::CreateMediaType()
     ThrowIfError(MFCreateMediaType(&spOutputType));
 
     ThrowIfError(spOutputType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
-    ThrowIfError(spOutputType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_ARGB32));
+    ThrowIfError(spOutputType->SetGUID(MF_MT_SUBTYPE, c_arrFormatSubtypes[_config.eFormat]));
     ThrowIfError(spOutputType->SetUINT32(MF_MT_FIXED_SIZE_SAMPLES, TRUE));
     ThrowIfError(spOutputType->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE));
-    ThrowIfError(spOutputType->SetUINT32(MF_MT_SAMPLE_SIZE, c_cbOutputSampleSize));
-    ThrowIfError(MFSetAttributeSize(spOutputType.Get(), MF_MT_FRAME_SIZE, c_dwOutputImageWidth, c_dwOutputImageHeight));
-    ThrowIfError(MFSetAttributeRatio(spOutputType.Get(), MF_MT_FRAME_RATE, c_dwOutputFrameRateNumerator, c_dwOutputFrameRateDenominator));
+    ThrowIfError(spOutputType->SetUINT32(MF_MT_SAMPLE_SIZE, GetFrameSize(_config)));
+    ThrowIfError(spOutputType->SetUINT32(MF_MT_DEFAULT_STRIDE, static_cast<UINT32>(GetDefaultStride(_config))));
+    ThrowIfError(MFSetAttributeSize(spOutputType.Get(), MF_MT_FRAME_SIZE, _config.dwWidth, _config.dwHeight));
+    ThrowIfError(MFSetAttributeRatio(spOutputType.Get(), MF_MT_FRAME_RATE, _config.dwFrameRateNumerator, _config.dwFrameRateDenominator));
     ThrowIfError(spOutputType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
     ThrowIfError(MFSetAttributeRatio(spOutputType.Get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1));
 
     return spOutputType;
 }
 
+// Renders a sample for the request. (Not unthrottled mode.)
 void CGeometricMediaStream::DeliverSample(IUnknown *pToken)
 {
-    ComPtr<IMFSample> spSample = CreateImage(_eShape);
+    const SampleRequest request = { pToken, MFGetSystemTime() };
+
+    ComPtr<IMFSample> spSample = CreateImage(_llCurrentTimestamp);
+    if (spSample == nullptr)
+    {
+        ThrowException(MF_E_SAMPLEALLOCATOR_EMPTY);
+    }
+    ++_cSamplesGenerated;
+
+    std::lock_guard<std::mutex> lock(_requestMutex);
+    SendSample(spSample.Get(), request);
+}
+
+// Delivers the queued samples to the requests that wait, in order. Called
+// with _requestMutex held, by RequestSample and by the render pool after
+// it queues a sample.
+void CGeometricMediaStream::DispatchQueuedSamples()
+{
+    while (!_requests.empty())
+    {
+        // The render pool skips the stream while its queue is full.
+        const bool fWasFull = (_spSampleQueue->GetCount() == _spSampleQueue->GetCapacity());
+        ComPtr<IMFSample> spSample = _spSampleQueue->Pop();
+
+        if (spSample == nullptr)
+        {
+            break;
+        }
+
+        if (fWasFull)
+        {
+            _spRenderPool->Wake();
+        }
+
+        const SampleRequest request = _requests.front();
+        _requests.pop_front();
+
+        SendSample(spSample.Get(), request);
+    }
+}
+
+// Sends the MEMediaSample event for a request. Called with _requestMutex
+// held.
+void CGeometricMediaStream::SendSample(IMFSample *pSample, const SampleRequest &request)
+{
+    LONGLONG llSampleTime = 0;
+    LONGLONG llSampleDuration = 0;
 
-    ThrowIfError(spSample->SetSampleTime(_llCurrentTimestamp));
-    _llCurrentTimestamp += c_llOutputFrameDuration;
-    ThrowIfError(spSample->SetSampleDuration(c_llOutputFrameDuration));
+    ThrowIfError(pSample->GetSampleTime(&llSampleTime));
+    ThrowIfError(pSample->GetSampleDuration(&llSampleDuration));
+    _llCurrentTimestamp = llSampleTime + llSampleDuration;
     // If token was not null set the sample attribute.
-    ThrowIfError(spSample->SetUnknown(MFSampleExtension_Token, pToken));
+    ThrowIfError(pSample->SetUnknown(MFSampleExtension_Token, request.spToken.Get()));
     // Send a sample event.
-    ThrowIfError(_spEventQueue->QueueEventParamUnk(MEMediaSample, GUID_NULL, S_OK, spSample.Get()));
+    ThrowIfError(_spEventQueue->QueueEventParamUnk(MEMediaSample, GUID_NULL, S_OK, pSample));
+
+    const LONGLONG hnsLatency = MFGetSystemTime() - request.hnsRequestTime;
+
+    ++_cSamplesDelivered;
+    _hnsTotalLatency += hnsLatency;
+    _hnsMaxLatency = max(_hnsMaxLatency, hnsLatency);
+}
+
+// Drops the requests that wait for the render pool, when the stream stops.
+void CGeometricMediaStream::ClearRequests()
+{
+    std::lock_guard<std::mutex> lock(_requestMutex);
+    _requests.clear();
+}
+
+void CGeometricMediaStream::StartProducer()
+{
+    _llProducerTimestamp = _llCurrentTimestamp;
+    _hrProducer = S_OK;
+    _fProducing = true;
+
+    _spRenderPool->AddStream(this);
+}
+
+// Takes the stream out of the render pool, and releases the samples that
+// were rendered ahead.
+void CGeometricMediaStream::StopProducer()
+{
+    if (!_fProducing)
+    {
+        return;
+    }
+
+    _spRenderPool->RemoveStream(this);
+    _fProducing = false;
+
+    std::lock_guard<std::mutex> lock(_requestMutex);
+    _spSampleQueue->Clear();
+}
+
+// Called by the render pool, with its lock held.
+bool CGeometricMediaStream::CanProduceSample() const
+{
+    return SUCCEEDED(_hrProducer.load()) && _spSampleQueue->GetCount() < _spSampleQueue->GetCapacity();
+}
+
+// Called by a worker of the render pool, which no other worker renders
+// this stream with. Returns false if no sample could be allocated.
+bool CGeometricMediaStream::ProduceSample()
+{
+    try
+    {
+        ComPtr<IMFSample> spSample = CreateImage(_llProducerTimestamp);
+
+        if (spSample == nullptr)
+        {
+            return false;
+        }
+
+        _llProducerTimestamp += GetFrameDuration(_config);
+
+        _spSampleQueue->Push(spSample.Get());
+        ++_cSamplesGenerated;
+
+        // Deliver the sample if a request waits for it.
+        std::lock_guard<std::mutex> lock(_requestMutex);
+        DispatchQueuedSamples();
+    }
+    catch (Exception ^exc)
+    {
+        _hrProducer = exc->HResult;
+
+        // The requests that wait cannot be completed. RequestSample
+        // reports the error for the next ones. (HandleError would take the
+        // source lock, which the workers must not take.)
+        std::lock_guard<std::mutex> lock(_requestMutex);
+
+        if (!_requests.empty())
+        {
+            _requests.clear();
+            _spEventQueue->QueueEventParamVar(MEError, GUID_NULL, exc->HResult, nullptr);
+        }
+    }
+
+    return true;
 }
 
-ComPtr<IMFSample> CGeometricMediaStream::CreateImage(GeometricShape eShape)
+ComPtr<IMFSample> CGeometricMediaStream::CreateImage(LONGLONG llTimestamp)
 {
     ComPtr<IMFMediaBuffer> spOutputBuffer;
     ComPtr<IMFSample> spSample;
-    const LONG pitch = c_dwOutputImageWidth * sizeof(DWORD);
+    const LONG pitch = GetDefaultStride(_config);
+    const DWORD cbFrame = GetFrameSize(_config);
 
     if (_frameGenerator == nullptr)
     {
@@ -609,21 +1168,28 @@ ComPtr<IMFSample> CGeometricMediaStream::CreateImage(GeometricShape eShape)
 
     if (_spDeviceManager != nullptr)
     {
-        ThrowIfError(_spAllocEx->AllocateSample(&spSample));
+        HRESULT hr = _spAllocEx->AllocateSample(&spSample);
+        if (hr == MF_E_SAMPLEALLOCATOR_EMPTY)
+        {
+            return nullptr;
+        }
+        ThrowIfError(hr);
         ThrowIfError(spSample->GetBufferByIndex(0, &spOutputBuffer));
     }
     else
     {
-        ThrowIfError(MFCreateMemoryBuffer(c_cbOutputSampleSize, &spOutputBuffer));
+        ThrowIfError(MFCreateMemoryBuffer(cbFrame, &spOutputBuffer));
         ThrowIfError(MFCreateSample(&spSample));
         ThrowIfError(spSample->AddBuffer(spOutputBuffer.Get()));
     }
     
-    VideoBufferLock lock(spOutputBuffer.Get(), MF2DBuffer_LockFlags_Write, c_dwOutputImageHeight, pitch);
+    VideoBufferLock lock(spOutputBuffer.Get(), MF2DBuffer_LockFlags_Write, _config.dwHeight, pitch);
 
-    _frameGenerator->PrepareFrame(lock.GetData(), _llCurrentTimestamp, lock.GetStride());
+    _frameGenerator->PrepareFrame(lock.GetData(), llTimestamp, lock.GetStride());
 
-    ThrowIfError(spOutputBuffer->SetCurrentLength(c_cbOutputSampleSize));
+    ThrowIfError(spOutputBuffer->SetCurrentLength(cbFrame));
+    ThrowIfError(spSample->SetSampleTime(llTimestamp));
+    ThrowIfError(spSample->SetSampleDuration(GetFrameDuration(_config)));
 
     return spSample;
 }
@@ -648,5 +1214,5 @@ void CGeometricMediaStream::CreateVideoSampleAllocator()
     ThrowIfError(spAttributes->SetUINT32(MF_SA_D3D11_BINDFLAGS, D3D11_BIND_SHADER_RESOURCE));
     ThrowIfError(MFCreateVideoSampleAllocatorEx(IID_IMFVideoSampleAllocatorEx, (void**)&_spAllocEx));
     ThrowIfError(_spAllocEx->SetDirectXManager(_spDeviceManager.Get()));
-    ThrowIfError(_spAllocEx->InitializeSampleAllocatorEx(1, 4, spAttributes.Get(), _spMediaType.Get()));
+    ThrowIfError(_spAllocEx->InitializeSampleAllocatorEx(1, c_cAllocatorSamples + _config.cQueueSamples, spAttributes.Get(), _spMediaType.Get()));
 }
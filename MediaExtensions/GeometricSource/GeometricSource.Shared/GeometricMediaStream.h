@@ -7,16 +7,99 @@
 
 #pragma once
 #include "GeometricMediaSource.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <deque>
 
-const DWORD c_dwGeometricStreamId = 1;
+const DWORD c_dwGeometricStreamId = 1;                      // Identifier of the first stream; the others follow it.
 
 ref class CFrameGenerator;
 
+// Counters of a stream, since it was created.
+struct GeometricStreamStatistics
+{
+    ULONGLONG       cSamplesGenerated;  // Samples rendered, including the ones still queued.
+    ULONGLONG       cSamplesDelivered;
+    DWORD           cQueuedSamples;     // Samples rendered ahead of requests, now.
+    LONGLONG        hnsAverageLatency;  // Time from RequestSample to the MEMediaSample event, in 100-ns units.
+    LONGLONG        hnsMaxLatency;
+};
+
+// Attributes with the statistics of a stream, which
+// IMFMediaSourceEx::GetStreamAttributes returns with the source attributes.
+// They are the values at the time of the call.
+
+// {A2404864-9E62-430D-B585-DA8753724AC1}
+// UINT64: cSamplesGenerated
+extern GUID const __declspec(selectany) GEOMETRIC_STREAM_SAMPLES_GENERATED = { 0xa2404864, 0x9e62, 0x430d, { 0xb5, 0x85, 0xda, 0x87, 0x53, 0x72, 0x4a, 0xc1 } };
+
+// {BDBA15EF-D001-4F4B-AB78-48A30D512279}
+// UINT64: cSamplesDelivered
+extern GUID const __declspec(selectany) GEOMETRIC_STREAM_SAMPLES_DELIVERED = { 0xbdba15ef, 0xd001, 0x4f4b, { 0xab, 0x78, 0x48, 0xa3, 0x0d, 0x51, 0x22, 0x79 } };
+
+// {1E9D619D-5419-41F5-A9C1-DA02E3150316}
+// UINT32: cQueuedSamples
+extern GUID const __declspec(selectany) GEOMETRIC_STREAM_QUEUED_SAMPLES = { 0x1e9d619d, 0x5419, 0x41f5, { 0xa9, 0xc1, 0xda, 0x02, 0xe3, 0x15, 0x03, 0x16 } };
+
+// {4A9ED51B-301B-46C3-BB53-57B274AA9432}
+// UINT64: hnsAverageLatency
+extern GUID const __declspec(selectany) GEOMETRIC_STREAM_AVERAGE_LATENCY = { 0x4a9ed51b, 0x301b, 0x46c3, { 0xbb, 0x53, 0x57, 0xb2, 0x74, 0xaa, 0x94, 0x32 } };
+
+// {AEDDFBAC-5A32-4807-98C9-02EBFC0A9D5F}
+// UINT64: hnsMaxLatency
+extern GUID const __declspec(selectany) GEOMETRIC_STREAM_MAX_LATENCY = { 0xaeddfbac, 0x5a32, 0x4807, { 0x98, 0xc9, 0x02, 0xeb, 0xfc, 0x0a, 0x9d, 0x5f } };
+
+// Renders samples ahead of requests for the unthrottled streams of a
+// source (GeometricStreamConfig::cQueueSamples > 0).
+//
+// Each worker thread takes the next stream, round robin, whose queue has
+// space and that no other worker is rendering, and renders one sample for
+// it. So the streams share the processors, and the samples of a stream
+// are still rendered one at a time, in order.
+
+class CRenderPool
+{
+public:
+    explicit CRenderPool(DWORD cThreads);
+    ~CRenderPool();
+
+    void AddStream(CGeometricMediaStream *pStream);
+
+    // Returns once no worker is rendering pStream.
+    void RemoveStream(CGeometricMediaStream *pStream);
+
+    // Called when the queue of a stream stops being full.
+    void Wake();
+
+private:
+    void StopWorkers();
+    void WorkerThreadProc();
+    CGeometricMediaStream *ClaimStream();
+    bool IsRendering(CGeometricMediaStream *pStream) const;
+
+private:
+    std::vector<std::thread>    _workers;
+    std::mutex                  _mutex;
+    std::condition_variable     _cvWork;                    // Signaled when a stream may have become renderable, or on shutdown.
+    std::condition_variable     _cvIdle;                    // Signaled when a worker finishes a sample.
+    bool                        _fShutdown;
+    DWORD                       _generation;                // Incremented each time _cvWork is signaled.
+    std::vector<CGeometricMediaStream *> _streams;
+    std::vector<CGeometricMediaStream *> _rendering;        // Streams that a worker is rendering now.
+    size_t                      _nNextStream;               // Where the next round robin search starts.
+};
+
 class CGeometricMediaStream WrlSealed
     : public IMFMediaStream
 {
+    friend class CRenderPool;
+
 public:
-    static ComPtr<CGeometricMediaStream> CreateInstance(CGeometricMediaSource *pSource, GeometricShape eShape);
+    static ComPtr<CGeometricMediaStream> CreateInstance(CGeometricMediaSource *pSource, DWORD dwStreamId, const GeometricStreamConfig &config, const std::shared_ptr<CRenderPool> &spRenderPool);
 
     // IUnknown
     IFACEMETHOD (QueryInterface) (REFIID iid, void **ppv);
@@ -40,20 +123,35 @@ public:
     HRESULT SetRate(float flRate);
     void Shutdown();
     void SetDXGIDeviceManager(IMFDXGIDeviceManager *pManager);
+    void GetStatistics(GeometricStreamStatistics *pStatistics);
 
 protected:
     CGeometricMediaStream();
-    CGeometricMediaStream(CGeometricMediaSource *pSource, GeometricShape eShape);
+    CGeometricMediaStream(CGeometricMediaSource *pSource, DWORD dwStreamId, const GeometricStreamConfig &config, const std::shared_ptr<CRenderPool> &spRenderPool);
     ~CGeometricMediaStream(void);
 
 private:
     class CSourceLock;
+    class CSampleQueue;
 
 private:
     void Initialize();
     ComPtr<IMFMediaType> CreateMediaType();
+    struct SampleRequest
+    {
+        ComPtr<IUnknown>        spToken;
+        LONGLONG                hnsRequestTime;             // For the latency statistics.
+    };
+
     void DeliverSample(IUnknown *pToken);
-    ComPtr<IMFSample> CreateImage(GeometricShape eShape);
+    void DispatchQueuedSamples();
+    void SendSample(IMFSample *pSample, const SampleRequest &request);
+    void ClearRequests();
+    ComPtr<IMFSample> CreateImage(LONGLONG llTimestamp);
+    void StartProducer();
+    void StopProducer();
+    bool CanProduceSample() const;
+    bool ProduceSample();
     HRESULT HandleError(HRESULT hErrorCode);
     void CreateVideoSampleAllocator();
 
@@ -73,15 +171,37 @@ private:
     long                        _cRef;                      // reference count
     SourceState                 _eSourceState;              // Flag to indicate if Shutdown() method was called.
     ComPtr<CGeometricMediaSource> _spSource;
+    DWORD                       _dwStreamId;
     ComPtr<IMFMediaEventQueue>  _spEventQueue;              // Event queue
     ComPtr<IMFStreamDescriptor> _spStreamDescriptor;        // Stream descriptor
     ComPtr<IMFMediaBuffer>      _spPicture;
     LONGLONG                    _llCurrentTimestamp;
     ComPtr<IMFDXGIDeviceManager> _spDeviceManager;
-    GeometricShape              _eShape;
+    GeometricStreamConfig       _config;                    // Shape, size, frame rate and format, from the URL.
     ComPtr<IMFMediaType>        _spMediaType;
     ComPtr<IMFVideoSampleAllocatorEx> _spAllocEx;
     CFrameGenerator^            _frameGenerator;
     float                       _flRate;
+
+    // Unthrottled mode (_config.cQueueSamples > 0). While _fProducing,
+    // the render pool owns _frameGenerator and the sample allocator.
+    //
+    // RequestSample does not wait for the render pool: if no sample is
+    // queued, it records the request, and the worker that queues the next
+    // sample delivers it. The workers do not take the source lock, so
+    // both sides deliver under _requestMutex instead.
+    std::shared_ptr<CRenderPool> _spRenderPool;
+    std::unique_ptr<CSampleQueue> _spSampleQueue;
+    bool                        _fProducing;
+    std::mutex                  _requestMutex;              // Protects _requests, the delivery of samples, _llCurrentTimestamp and the statistics.
+    std::deque<SampleRequest>   _requests;                  // Requests that wait for the render pool.
+    std::atomic<HRESULT>        _hrProducer;                // Error that stopped the rendering.
+    LONGLONG                    _llProducerTimestamp;       // Time stamp of the next sample to render.
+
+    // Statistics. (See GetStatistics.)
+    std::atomic<ULONGLONG>      _cSamplesGenerated;
+    ULONGLONG                   _cSamplesDelivered;
+    LONGLONG                    _hnsTotalLatency;
+    LONGLONG                    _hnsMaxLatency;
 };
 
@@ -9,10 +9,14 @@
 #include <wrl\module.h>
 #include "Grayscale.h"
 #include "VideoBufferLock.h"
+#include "CpuFeatures.h"
+#include <math.h>
 
 #pragma comment(lib, "d2d1")
 
 using namespace Microsoft::WRL;
+using namespace Windows::Foundation;
+using namespace Windows::Foundation::Collections;
 
 ActivatableClass(CGrayscaleEffect);
 
@@ -24,7 +28,8 @@ NOTES ON THE MFT IMPLEMENTATION
 
 1. The MFT has fixed streams: One input stream and one output stream. 
 
-2. The MFT supports the following formats: UYVY, YUY2, NV12.
+2. The MFT supports the following formats: UYVY, YUY2, NV12, I420, IYUV, YV12,
+   RGB32.
 
 3. If the MFT is holding an input sample, SetInputType and SetOutputType both fail.
 
@@ -56,6 +61,33 @@ NOTES ON THE MFT IMPLEMENTATION
    streaming is stopped (either by changing the media types or by sending the 
    MFT_MESSAGE_NOTIFY_END_STREAMING message) and then restarted.
    
+10. The MFT can provide its own output samples (MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES).
+    If the client passes no output sample to ProcessOutput, the MFT returns an
+    output sample from a pool of samples that are reused once the client
+    releases them (see OutputSamplePool.h).
+
+    If the "InPlace" property is true, the MFT instead converts the input
+    sample in place and returns it as the output sample. Only the chroma
+    inside the destination rectangle is written. The MFT cannot tell whether
+    the component upstream still uses the sample, so this is off by default:
+    set it only if upstream does not read or reuse its samples after it
+    passes them on. Even then, samples that wrap a Direct3D surface (a
+    decoder might still use them as reference frames) and samples from a
+    sample allocator (IMFTrackedSample; the allocator can hand them out
+    again) are not modified.
+
+11. Each frame is split into horizontal bands of rows, which are converted in
+    parallel on worker threads that all the effects in the DLL share (see
+    RowBandThreadPool.h). The "ThreadCount" property limits the number of
+    threads that work on one frame (0 = one thread per logical processor,
+    1 = convert on the calling thread only).
+
+12. The "Regions" property sets the regions of interest: a Rect, or an array of
+    Rect, in pixels. Only the pixels inside the regions are converted. The
+    regions can be changed at any time and apply from the next frame. An empty
+    array (or a null value) selects the whole frame. When the MFT converts in
+    place, rows outside every region are not touched at all.
+
 */
 
 // Place holder requisite ref class to make component usable. -------------------------
@@ -80,13 +112,21 @@ HolderFunc^ MakeHolder()
 const DWORD FOURCC_YUY2 = '2YUY'; 
 const DWORD FOURCC_UYVY = 'YVYU'; 
 const DWORD FOURCC_NV12 = '21VN'; 
+const DWORD FOURCC_I420 = '024I'; 
+const DWORD FOURCC_IYUV = 'VUYI'; 
+const DWORD FOURCC_YV12 = '21VY'; 
+const DWORD FOURCC_RGB32 = 22;      // D3DFMT_X8R8G8B8 (MFVideoFormat_RGB32.Data1)
 
 // Static array of media types (preferred and accepted).
 const GUID g_MediaSubtypes[] =
 {
     MFVideoFormat_NV12,
     MFVideoFormat_YUY2,
-    MFVideoFormat_UYVY
+    MFVideoFormat_UYVY,
+    MFVideoFormat_I420,
+    MFVideoFormat_IYUV,
+    MFVideoFormat_YV12,
+    MFVideoFormat_RGB32
 };
 
 DWORD GetImageSize(DWORD fcc, UINT32 width, UINT32 height);
@@ -98,198 +138,30 @@ inline T clamp(const T &val, const T &minVal, const T &maxVal)
     return (val < minVal ? minVal : (val > maxVal ? maxVal : val));
 }
 
-//-------------------------------------------------------------------
-// Functions to convert a YUV images to grayscale.
-//
-// In all cases, the same transformation is applied to the 8-bit
-// chroma values, but the pixel layout in memory differs.
-//
-// The image conversion functions take the following parameters:
-//
-// mat               Transfomation matrix for chroma values.
-// rcDest            Destination rectangle.
-// pDest             Pointer to the destination buffer.
-// lDestStride       Stride of the destination buffer, in bytes.
-// pSrc              Pointer to the source buffer.
-// lSrcStride        Stride of the source buffer, in bytes.
-// dwWidthInPixels   Frame width in pixels.
-// dwHeightInPixels  Frame height, in pixels.
-//-------------------------------------------------------------------
+// Converts a region of interest to whole pixels. Partly covered pixels
+// are included.
 
-// Convert UYVY image.
-
-void TransformImage_UYVY(
-    const D2D_RECT_U &rcDest,
-    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
-    _In_ LONG lDestStride, 
-    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
-    _In_ LONG lSrcStride, 
-    _In_ DWORD dwWidthInPixels, 
-    _In_ DWORD dwHeightInPixels)
+D2D_RECT_U RectToPixels(Rect rect)
 {
-    DWORD y = 0;
-    // Round down to the even value.
-    const UINT32 left = rcDest.left & ~(1);
-    const UINT32 right = rcDest.right & ~(1);
-    const DWORD y0 = min(rcDest.bottom, dwHeightInPixels);
-
-    // Lines above the destination rectangle.
-    for ( ; y < rcDest.top; y++)
-    {
-        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-    }
-
-    // Lines within the destination rectangle.
-    for ( ; y < y0; y++)
-    {        
-        const WORD *pSrc_Pixel = reinterpret_cast<const WORD*>(pSrc);
-        WORD *pDest_Pixel = reinterpret_cast<WORD*>(pDest);
-
-        CopyMemory(pDest, pSrc, left * 2);
-        for (DWORD x = left; (x + 1) < right; x += 2)
-        {
-            // Byte order is Y0 U0 Y1 V0
-            // Each WORD is a byte pair (Y, U/V)
-            // Windows is little-endian so the order appears reversed.
-
-            DWORD tmp = *reinterpret_cast<const DWORD*>(&pSrc_Pixel[x]);
-            *reinterpret_cast<DWORD*>(&pDest_Pixel[x]) = (tmp & 0xFF00FF00) | 0x00800080;
-        }
-        CopyMemory(pDest + (right * 2), pSrc + (right * 2), (dwWidthInPixels - right) * 2);
-
-        pDest += lDestStride;
-        pSrc += lSrcStride;
-    }
-
-    // Lines below the destination rectangle.
-    for ( ; y < dwHeightInPixels; y++)
-    {
-        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-    }
-}
-
-
-// Convert YUY2 image.
-
-void TransformImage_YUY2(
-    const D2D_RECT_U &rcDest,
-    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
-    _In_ LONG lDestStride, 
-    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
-    _In_ LONG lSrcStride, 
-    _In_ DWORD dwWidthInPixels, 
-    _In_ DWORD dwHeightInPixels)
-{
-    DWORD y = 0;
-    // Round down to the even value.
-    const UINT32 left = rcDest.left & ~(1);
-    const UINT32 right = rcDest.right & ~(1);
-    const DWORD y0 = min(rcDest.bottom, dwHeightInPixels);
-
-    // Lines above the destination rectangle.
-    for ( ; y < rcDest.top; y++)
-    {
-        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-    }
-
-    // Lines within the destination rectangle.
-    for ( ; y < y0; y++)
-    {
-        const WORD *pSrc_Pixel = reinterpret_cast<const WORD*>(pSrc);
-        WORD *pDest_Pixel = reinterpret_cast<WORD*>(pDest);
-
-        CopyMemory(pDest, pSrc, left * 2);
-        for (DWORD x = left; (x + 1) < right; x += 2)
-        {
-            // Byte order is Y0 U0 Y1 V0
-            // Each WORD is a byte pair (Y, U/V)
-            // Windows is little-endian so the order appears reversed.
-
-            DWORD tmp = *reinterpret_cast<const DWORD*>(&pSrc_Pixel[x]);
-            *reinterpret_cast<DWORD*>(&pDest_Pixel[x]) = (tmp & 0x00FF00FF) | 0x80008000;
-        }
-        CopyMemory(pDest + (right * 2), pSrc + (right * 2), (dwWidthInPixels - right) * 2);
-
-        pDest += lDestStride;
-        pSrc += lSrcStride;
-    }
-
-    // Lines below the destination rectangle.
-    for ( ; y < dwHeightInPixels; y++)
-    {
-        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-    }
-}
-
-// Convert NV12 image
-
-void TransformImage_NV12(
-    const D2D_RECT_U &rcDest,
-    _Inout_updates_(_Inexpressible_(2 * lDestStride * dwHeightInPixels)) BYTE *pDest, 
-    _In_ LONG lDestStride, 
-    _In_reads_(_Inexpressible_(2 * lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
-    _In_ LONG lSrcStride, 
-    _In_ DWORD dwWidthInPixels, 
-    _In_ DWORD dwHeightInPixels)
-{
-    // NV12 is planar: Y plane, followed by packed U-V plane.
-
-    // Y plane
-    for (DWORD y = 0; y < dwHeightInPixels; y++)
-    {
-        CopyMemory(pDest, pSrc, dwWidthInPixels);
-        pDest += lDestStride;
-        pSrc += lSrcStride;
-    }
-
-    // U-V plane
-
-    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    const float fMax = static_cast<float>(MAXDWORD / 2);
 
-    // Lines above the destination rectangle.
-    DWORD y = 0;
-    const DWORD y0 = min(rcDest.bottom, dwHeightInPixels);
-
-    for ( ; y < rcDest.top/2; y++)
-    {
-        CopyMemory(pDest, pSrc, dwWidthInPixels);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-    }
+    const float left = min(max(floorf(rect.X), 0.0f), fMax);
+    const float top = min(max(floorf(rect.Y), 0.0f), fMax);
+    const float right = min(max(ceilf(rect.X + rect.Width), 0.0f), fMax);
+    const float bottom = min(max(ceilf(rect.Y + rect.Height), 0.0f), fMax);
 
-    // Lines within the destination rectangle.
-    for ( ; y < y0/2; y++)
-    {
-        CopyMemory(pDest, pSrc, rcDest.left);
-        FillMemory(pDest + rcDest.left, rcDest.right - rcDest.left, 128);
-        CopyMemory(pDest + rcDest.right, pSrc + rcDest.right, dwWidthInPixels - rcDest.right);
-        pDest += lDestStride;
-        pSrc += lSrcStride;
-    }
-
-    // Lines below the destination rectangle.
-    for ( ; y < dwHeightInPixels/2; y++)
-    {
-        CopyMemory(pDest, pSrc, dwWidthInPixels);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-    }
+    return D2D1::RectU(static_cast<UINT32>(left), static_cast<UINT32>(top), static_cast<UINT32>(right), static_cast<UINT32>(bottom));
 }
 
 CGrayscaleEffect::CGrayscaleEffect() 
     : m_pTransformFn(nullptr)
+    , m_pTransformInPlaceFn(nullptr)
     , m_imageWidthInPixels(0)
     , m_imageHeightInPixels(0)
     , m_cbImageSize(0)
-    , m_rcDest(D2D1::RectU())
+    , m_dwRegionRowBegin(0)
+    , m_dwRegionRowEnd(0)
+    , m_fInPlace(false)
     , m_fStreamingInitialized(false)
 {
 }
@@ -313,7 +185,65 @@ STDMETHODIMP CGrayscaleEffect::RuntimeClassInitialize()
 //-------------------------------------------------------------------
 HRESULT CGrayscaleEffect::SetProperties(ABI::Windows::Foundation::Collections::IPropertySet *pConfiguration)
 {
-    return S_OK;
+    HRESULT hr = S_OK;
+
+    try
+    {
+        IPropertySet ^configuration = reinterpret_cast<IPropertySet^>(pConfiguration);
+
+        // Number of threads that convert each frame. (0 = one per processor.)
+        if (configuration != nullptr && configuration->HasKey(L"ThreadCount"))
+        {
+            UINT32 cThreads = safe_cast<UINT32>(configuration->Lookup(L"ThreadCount"));
+
+            AutoLock lock(m_critSec);
+            m_threadPool.SetThreadCount(cThreads);
+        }
+
+        // Convert the input samples in place. (See note 10.)
+        if (configuration != nullptr && configuration->HasKey(L"InPlace"))
+        {
+            bool fInPlace = safe_cast<bool>(configuration->Lookup(L"InPlace"));
+
+            AutoLock lock(m_critSec);
+            m_fInPlace = fInPlace;
+        }
+
+        // Regions of interest.
+        if (configuration != nullptr && configuration->HasKey(L"Regions"))
+        {
+            IPropertyValue ^value = safe_cast<IPropertyValue^>(configuration->Lookup(L"Regions"));
+            std::vector<D2D_RECT_U> regions;
+
+            if (value != nullptr && value->Type == PropertyType::Rect)
+            {
+                regions.push_back(RectToPixels(value->GetRect()));
+            }
+            else if (value != nullptr)
+            {
+                Array<Rect> ^rects = nullptr;
+                value->GetRectArray(&rects);
+
+                for (auto rect : rects)
+                {
+                    regions.push_back(RectToPixels(rect));
+                }
+            }
+
+            AutoLock lock(m_critSec);
+            m_requestedRegions.swap(regions);
+            if (m_fStreamingInitialized)
+            {
+                UpdateRegions();
+            }
+        }
+    }
+    catch(Exception ^exc)
+    {
+        hr = exc->HResult;
+    }
+
+    return hr;
 }
 
 // IMFTransform methods. Refer to the Media Foundation SDK documentation for details.
@@ -467,7 +397,8 @@ HRESULT CGrayscaleEffect::GetOutputStreamInfo(
     pStreamInfo->dwFlags =
         MFT_OUTPUT_STREAM_WHOLE_SAMPLES |
         MFT_OUTPUT_STREAM_SINGLE_SAMPLE_PER_BUFFER |
-        MFT_OUTPUT_STREAM_FIXED_SAMPLE_SIZE ;
+        MFT_OUTPUT_STREAM_FIXED_SAMPLE_SIZE |
+        MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES ;
 
     if (m_spOutputType == nullptr)
     {
@@ -1135,11 +1066,9 @@ HRESULT CGrayscaleEffect::ProcessOutput(
             throw ref new InvalidArgumentException();
         }
 
-        // It must contain a sample.
-        if (pOutputSamples[0].pSample == nullptr)
-        {
-            throw ref new InvalidArgumentException();
-        }
+        // The output sample is optional. If there is none, the MFT provides
+        // the output sample (see note 10 at the top of this file).
+        ComPtr<IMFSample> spOutputSample = pOutputSamples[0].pSample;
 
         ComPtr<IMFMediaBuffer> spInput;
         ComPtr<IMFMediaBuffer> spOutput;
@@ -1156,29 +1085,49 @@ HRESULT CGrayscaleEffect::ProcessOutput(
         // Get the input buffer.
         ThrowIfError(m_spSample->ConvertToContiguousBuffer(&spInput));
 
-        // Get the output buffer.
-        ThrowIfError(pOutputSamples[0].pSample->ConvertToContiguousBuffer(&spOutput));
+        if (spOutputSample == nullptr && CanProcessInPlace(m_spSample.Get(), spInput.Get()))
+        {
+            // Convert the input sample and return it as the output sample.
+            // It already has the time stamp and duration.
+            OnProcessOutputInPlace(spInput.Get());
+            spOutputSample = m_spSample;
+        }
+        else
+        {
+            if (spOutputSample == nullptr)
+            {
+                spOutputSample = CreateOutputSample();
+            }
 
-        OnProcessOutput(spInput.Get(), spOutput.Get());
+            // Get the output buffer.
+            ThrowIfError(spOutputSample->ConvertToContiguousBuffer(&spOutput));
 
-        // Set status flags.
-        pOutputSamples[0].dwStatus = 0;
-        *pdwStatus = 0;
+            OnProcessOutput(spInput.Get(), spOutput.Get());
 
+            // Copy the duration and time stamp from the input sample, if present.
 
-        // Copy the duration and time stamp from the input sample, if present.
+            LONGLONG hnsDuration = 0;
+            LONGLONG hnsTime = 0;
 
-        LONGLONG hnsDuration = 0;
-        LONGLONG hnsTime = 0;
+            if (SUCCEEDED(m_spSample->GetSampleDuration(&hnsDuration)))
+            {
+                ThrowIfError(spOutputSample->SetSampleDuration(hnsDuration));
+            }
 
-        if (SUCCEEDED(m_spSample->GetSampleDuration(&hnsDuration)))
-        {
-            ThrowIfError(pOutputSamples[0].pSample->SetSampleDuration(hnsDuration));
+            if (SUCCEEDED(m_spSample->GetSampleTime(&hnsTime)))
+            {
+                ThrowIfError(spOutputSample->SetSampleTime(hnsTime));
+            }
         }
 
-        if (SUCCEEDED(m_spSample->GetSampleTime(&hnsTime)))
+        // Set status flags.
+        pOutputSamples[0].dwStatus = 0;
+        *pdwStatus = 0;
+
+        // Return the sample that we provided. The client releases it.
+        if (pOutputSamples[0].pSample == nullptr)
         {
-            ThrowIfError(pOutputSamples[0].pSample->SetSampleTime(hnsTime));
+            pOutputSamples[0].pSample = spOutputSample.Detach();
         }
     }
     catch(Exception ^exc)
@@ -1349,7 +1298,7 @@ void CGrayscaleEffect::BeginStreaming()
 {
     if (!m_fStreamingInitialized)
     {
-        m_rcDest = D2D1::RectU(0, 0, m_imageWidthInPixels, m_imageHeightInPixels);
+        UpdateRegions();
         m_fStreamingInitialized = true;
     }
 }
@@ -1363,6 +1312,7 @@ void CGrayscaleEffect::BeginStreaming()
 
 void CGrayscaleEffect::EndStreaming()
 {
+    m_outputSamples.Uninitialize();
     m_fStreamingInitialized = false;
 }
 
@@ -1383,7 +1333,28 @@ void CGrayscaleEffect::OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut
     assert (m_pTransformFn != nullptr);
     if (m_pTransformFn)
     {
-        (*m_pTransformFn)(m_rcDest, outputLock.GetTopRow(), outputLock.GetStride(), inputLock.GetTopRow(), inputLock.GetStride(), m_imageWidthInPixels, m_imageHeightInPixels);
+        BYTE *pDest = outputLock.GetTopRow();
+        const LONG lDestStride = outputLock.GetStride();
+        const BYTE *pSrc = inputLock.GetTopRow();
+        const LONG lSrcStride = inputLock.GetStride();
+
+        // The first region is converted while the rows are copied. (With
+        // no region, the transform function just copies the rows.) The
+        // other regions are then converted in place in the output, while
+        // the band is still in the cache.
+        const D2D_RECT_U rcFirst = m_regions.empty() ? D2D1::RectU() : m_regions[0];
+
+        // Convert bands of rows in parallel. Bands have an even number of
+        // rows, so that the 4:2:0 chroma rows are not split.
+        m_threadPool.Run(m_imageHeightInPixels, 2, lDestStride, [&](DWORD yBegin, DWORD yEnd)
+        {
+            (*m_pTransformFn)(rcFirst, pDest, lDestStride, pSrc, lSrcStride, m_imageWidthInPixels, m_imageHeightInPixels, yBegin, yEnd);
+
+            for (size_t i = 1; i < m_regions.size(); i++)
+            {
+                (*m_pTransformInPlaceFn)(m_regions[i], pDest, lDestStride, m_imageWidthInPixels, m_imageHeightInPixels, yBegin, yEnd);
+            }
+        });
     }
     else
     {
@@ -1396,6 +1367,79 @@ void CGrayscaleEffect::OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut
 }
 
 
+//-------------------------------------------------------------------
+// OnProcessOutputInPlace
+// Converts the image in the input buffer, without copying it.
+//-------------------------------------------------------------------
+
+void CGrayscaleEffect::OnProcessOutputInPlace(IMFMediaBuffer *pBuffer)
+{
+    // Stride if the buffer does not support IMF2DBuffer
+    const LONG lDefaultStride = GetDefaultStride(m_spInputType.Get());
+
+    VideoBufferLock bufferLock(pBuffer, MF2DBuffer_LockFlags_ReadWrite, m_imageHeightInPixels, lDefaultStride);
+
+    // Invoke the image transform function.
+    assert (m_pTransformInPlaceFn != nullptr);
+    if (m_pTransformInPlaceFn)
+    {
+        BYTE *pData = bufferLock.GetTopRow();
+        const LONG lStride = bufferLock.GetStride();
+
+        // Only the rows between the first and the last region are split
+        // into bands; the other rows are not touched.
+        const DWORD dwRowBegin = m_dwRegionRowBegin;
+
+        m_threadPool.Run(m_dwRegionRowEnd - dwRowBegin, 2, lStride, [&](DWORD yBegin, DWORD yEnd)
+        {
+            for (size_t i = 0; i < m_regions.size(); i++)
+            {
+                (*m_pTransformInPlaceFn)(m_regions[i], pData, lStride, m_imageWidthInPixels, m_imageHeightInPixels, dwRowBegin + yBegin, dwRowBegin + yEnd);
+            }
+        });
+    }
+    else
+    {
+        ThrowException(E_UNEXPECTED);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// CanProcessInPlace
+// Returns true if the MFT can write the output image into the input
+// buffer.
+//
+// Only if the client allows it (see note 10). A buffer that wraps a
+// Direct3D surface is not modified, because the decoder might still use
+// the surface as a reference frame, and neither is a sample from a
+// sample allocator, which can give the same sample out again.
+//-------------------------------------------------------------------
+
+bool CGrayscaleEffect::CanProcessInPlace(IMFSample *pSample, IMFMediaBuffer *pBuffer) const
+{
+    ComPtr<IMFDXGIBuffer> spDXGIBuffer;
+    ComPtr<IMFTrackedSample> spTrackedSample;
+
+    return m_fInPlace &&
+        (m_pTransformInPlaceFn != nullptr) &&
+        FAILED(pBuffer->QueryInterface(IID_PPV_ARGS(&spDXGIBuffer))) &&
+        FAILED(pSample->QueryInterface(IID_PPV_ARGS(&spTrackedSample)));
+}
+
+
+//-------------------------------------------------------------------
+// CreateOutputSample
+// Gets an output sample, for a client that does not provide one. The
+// samples are recycled (see OutputSamplePool.h).
+//-------------------------------------------------------------------
+
+ComPtr<IMFSample> CGrayscaleEffect::CreateOutputSample()
+{
+    return m_outputSamples.AllocateSample(m_spOutputType.Get());
+}
+
+
 // Flush the MFT.
 
 void CGrayscaleEffect::OnFlush()
@@ -1417,21 +1461,35 @@ void CGrayscaleEffect::UpdateFormatInfo()
     m_cbImageSize = 0;
 
     m_pTransformFn = nullptr;
+    m_pTransformInPlaceFn = nullptr;
 
     if (m_spInputType != nullptr)
     {
         ThrowIfError(m_spInputType->GetGUID(MF_MT_SUBTYPE, &subtype));
         if (subtype == MFVideoFormat_YUY2)
         {
-            m_pTransformFn = TransformImage_YUY2;
+            m_pTransformFn = SelectTransform_422<YUY2_LUMA_MASK, YUY2_GRAY_CHROMA>(TransformImage_YUY2);
+            m_pTransformInPlaceFn = SelectTransformInPlace_422<YUY2_LUMA_MASK, YUY2_GRAY_CHROMA>();
         }
         else if (subtype == MFVideoFormat_UYVY)
         {
-            m_pTransformFn = TransformImage_UYVY;
+            m_pTransformFn = SelectTransform_422<UYVY_LUMA_MASK, UYVY_GRAY_CHROMA>(TransformImage_UYVY);
+            m_pTransformInPlaceFn = SelectTransformInPlace_422<UYVY_LUMA_MASK, UYVY_GRAY_CHROMA>();
         }
         else if (subtype == MFVideoFormat_NV12)
         {
             m_pTransformFn = TransformImage_NV12;
+            m_pTransformInPlaceFn = TransformImageInPlace_NV12;
+        }
+        else if (subtype == MFVideoFormat_I420 || subtype == MFVideoFormat_IYUV || subtype == MFVideoFormat_YV12)
+        {
+            m_pTransformFn = TransformImage_YV12;
+            m_pTransformInPlaceFn = TransformImageInPlace_YV12;
+        }
+        else if (subtype == MFVideoFormat_RGB32)
+        {
+            m_pTransformFn = SelectTransform_RGB32();
+            m_pTransformInPlaceFn = SelectTransformInPlace_RGB32();
         }
         else
         {
@@ -1446,6 +1504,55 @@ void CGrayscaleEffect::UpdateFormatInfo()
 }
 
 
+//-------------------------------------------------------------------
+// UpdateRegions
+// Clips the requested regions of interest to the frame, and finds the
+// rows that they cover. Called when streaming starts, and when the
+// regions change during streaming.
+//-------------------------------------------------------------------
+
+void CGrayscaleEffect::UpdateRegions()
+{
+    m_regions.clear();
+    m_dwRegionRowBegin = 0;
+    m_dwRegionRowEnd = 0;
+
+    if (m_requestedRegions.empty())
+    {
+        // Whole frame.
+        m_regions.push_back(D2D1::RectU(0, 0, m_imageWidthInPixels, m_imageHeightInPixels));
+    }
+    else
+    {
+        for (auto rc : m_requestedRegions)
+        {
+            rc.right = min(rc.right, m_imageWidthInPixels);
+            rc.bottom = min(rc.bottom, m_imageHeightInPixels);
+
+            if (rc.left < rc.right && rc.top < rc.bottom)
+            {
+                m_regions.push_back(rc);
+            }
+        }
+    }
+
+    if (!m_regions.empty())
+    {
+        m_dwRegionRowBegin = m_imageHeightInPixels;
+
+        for (const auto &rc : m_regions)
+        {
+            m_dwRegionRowBegin = min(m_dwRegionRowBegin, rc.top);
+            m_dwRegionRowEnd = max(m_dwRegionRowEnd, rc.bottom);
+        }
+
+        // Keep the bands on even rows, for the 4:2:0 formats.
+        m_dwRegionRowBegin &= ~1;
+        m_dwRegionRowEnd = min((m_dwRegionRowEnd + 1) & ~1, m_imageHeightInPixels);
+    }
+}
+
+
 // Calculate the size of the buffer needed to store the image.
 
 // fcc: The FOURCC code of the video format.
@@ -1468,6 +1575,9 @@ DWORD GetImageSize(DWORD fcc, UINT32 width, UINT32 height)
         }
 
     case FOURCC_NV12:
+    case FOURCC_I420:
+    case FOURCC_IYUV:
+    case FOURCC_YV12:
         // check overflow
         if ((height/2 > MAXDWORD - height) || ((height + height/2) > MAXDWORD / width))
         {
@@ -1479,6 +1589,18 @@ DWORD GetImageSize(DWORD fcc, UINT32 width, UINT32 height)
             return width * (height + (height/2));
         }
 
+    case FOURCC_RGB32:
+        // check overflow
+        if ((width > MAXDWORD / 4) || (width * 4 > MAXDWORD / height))
+        {
+            throw ref new InvalidArgumentException();
+        }
+        else
+        {
+            // 32 bpp
+            return width * height * 4;
+        }
+
     default:
         // Unsupported type.
         ThrowException(MF_E_INVALIDTYPE);    
@@ -1504,7 +1626,8 @@ LONG GetDefaultStride(IMFMediaType *pType)
         // Get the subtype and the image size.
         ThrowIfError(pType->GetGUID(MF_MT_SUBTYPE, &subtype));
         ThrowIfError(MFGetAttributeSize(pType, MF_MT_FRAME_SIZE, &width, &height));
-        if (subtype == MFVideoFormat_NV12)
+        if (subtype == MFVideoFormat_NV12 || subtype == MFVideoFormat_I420 || 
+            subtype == MFVideoFormat_IYUV || subtype == MFVideoFormat_YV12)
         {
             lStride = width;
         }
@@ -1512,6 +1635,10 @@ LONG GetDefaultStride(IMFMediaType *pType)
         {
             lStride = ((width * 2) + 3) & ~3;
         }
+        else if (subtype == MFVideoFormat_RGB32)
+        {
+            ThrowIfError(MFGetStrideForBitmapInfoHeader(subtype.Data1, width, &lStride));
+        }
         else
         {
             throw ref new InvalidArgumentException();
@@ -9,17 +9,10 @@
 
 #pragma once
 #include "CritSec.h"
-
-// Function pointer for the function that transforms the image.
-typedef void (*IMAGE_TRANSFORM_FN)(
-    const D2D_RECT_U&       rcDest,          // Destination rectangle for the transformation.
-    BYTE*                   pDest,           // Destination buffer.
-    LONG                    lDestStride,     // Destination stride.
-    const BYTE*             pSrc,            // Source buffer.
-    LONG                    lSrcStride,      // Source stride.
-    DWORD                   dwWidthInPixels, // Image width in pixels.
-    DWORD                   dwHeightInPixels // Image height in pixels.
-    );
+#include "RowBandThreadPool.h"
+#include "OutputSamplePool.h"
+#include "GrayscaleKernels.h"
+#include <vector>
 
 // CGrayscale class:
 // Implements a grayscale video effect.
@@ -185,13 +178,21 @@ private:
     void BeginStreaming();
     void EndStreaming();
     void OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut);
+    void OnProcessOutputInPlace(IMFMediaBuffer *pBuffer);
+    bool CanProcessInPlace(IMFSample *pSample, IMFMediaBuffer *pBuffer) const;
+    ComPtr<IMFSample> CreateOutputSample();
     void OnFlush();
     void UpdateFormatInfo();
+    void UpdateRegions();
 
     CritSec m_critSec;
 
     // Transformation parameters
-    D2D_RECT_U m_rcDest;                    // Destination rectangle for the effect.
+    std::vector<D2D_RECT_U> m_requestedRegions; // Regions of interest from SetProperties. (Empty = whole frame.)
+    std::vector<D2D_RECT_U> m_regions;      // Regions to convert, clipped to the frame.
+    DWORD m_dwRegionRowBegin;               // First row of the first region. (Even.)
+    DWORD m_dwRegionRowEnd;                 // Row after the last row of the last region. (Even, or the frame height.)
+    bool m_fInPlace;                        // The client allows converting the input samples in place.
 
     // Streaming
     bool m_fStreamingInitialized;
@@ -206,6 +207,10 @@ private:
 
     ComPtr<IMFAttributes> m_spAttributes;
 
-    // Image transform function. (Changes based on the media type.)
+    // Image transform functions. (Change based on the media type.)
     IMAGE_TRANSFORM_FN  m_pTransformFn;
+    IMAGE_TRANSFORM_IN_PLACE_FN m_pTransformInPlaceFn;
+
+    RowBandThreadPool m_threadPool;         // Runs the transform functions on bands of rows.
+    OutputSamplePool m_outputSamples;       // Output samples that the MFT provides.
 };
\ No newline at end of file
@@ -0,0 +1,1041 @@
+// Grayscale conversion kernels for the grayscale transform.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+// Note: The kernels do not depend on COM or Media Foundation, so that the
+// tests can build them with GCC or Clang (see CMakeLists.txt).
+
+#include "PortableTypes.h"
+#include "CpuFeatures.h"
+
+// Function pointer for the function that transforms the image.
+typedef void (*IMAGE_TRANSFORM_FN)(
+    const D2D_RECT_U&       rcDest,          // Destination rectangle for the transformation.
+    BYTE*                   pDest,           // Destination buffer.
+    LONG                    lDestStride,     // Destination stride.
+    const BYTE*             pSrc,            // Source buffer.
+    LONG                    lSrcStride,      // Source stride.
+    DWORD                   dwWidthInPixels, // Image width in pixels.
+    DWORD                   dwHeightInPixels,// Image height in pixels.
+    DWORD                   dwRowBegin,      // First row to transform.
+    DWORD                   dwRowEnd         // Row after the last row to transform.
+    );
+
+// Function pointer for the function that transforms the image in place.
+typedef void (*IMAGE_TRANSFORM_IN_PLACE_FN)(
+    const D2D_RECT_U&       rcDest,          // Destination rectangle for the transformation.
+    BYTE*                   pData,           // Image buffer (source and destination).
+    LONG                    lStride,         // Image stride.
+    DWORD                   dwWidthInPixels, // Image width in pixels.
+    DWORD                   dwHeightInPixels,// Image height in pixels.
+    DWORD                   dwRowBegin,      // First row to transform.
+    DWORD                   dwRowEnd         // Row after the last row to transform.
+    );
+
+//-------------------------------------------------------------------
+// Functions to convert a YUV images to grayscale.
+//
+// In all cases, the same transformation is applied to the 8-bit
+// chroma values, but the pixel layout in memory differs.
+//
+// The image conversion functions take the following parameters:
+//
+// rcDest            Destination rectangle.
+// pDest             Pointer to the destination buffer.
+// lDestStride       Stride of the destination buffer, in bytes.
+// pSrc              Pointer to the source buffer.
+// lSrcStride        Stride of the source buffer, in bytes.
+// dwWidthInPixels   Frame width in pixels.
+// dwHeightInPixels  Frame height, in pixels.
+// dwRowBegin        First row to convert.
+// dwRowEnd          Row after the last row to convert.
+//
+// pDest and pSrc always point to the start of the frame. Only rows
+// [dwRowBegin, dwRowEnd) are written, so that several threads can
+// convert different bands of the same frame. For NV12, dwRowBegin
+// must be even.
+//
+// A chroma sample is converted if any of the pixels that share it is
+// inside rcDest, so odd edges are rounded outward.
+//-------------------------------------------------------------------
+
+// Convert UYVY image.
+
+inline void TransformImage_UYVY(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    DWORD y = dwRowBegin;
+    // Round left down and right up to the even value, so that a pixel
+    // pair is converted if either of its pixels is inside rcDest.
+    const UINT32 right = min((min(rcDest.right, dwWidthInPixels) + 1) & ~(1), dwWidthInPixels & ~(1));
+    const UINT32 left = min(rcDest.left & ~(1), right);
+    const DWORD yTop = min(rcDest.top, dwRowEnd);
+    const DWORD y0 = min(min(rcDest.bottom, dwHeightInPixels), dwRowEnd);
+
+    pSrc += lSrcStride * static_cast<LONG>(dwRowBegin);
+    pDest += lDestStride * static_cast<LONG>(dwRowBegin);
+
+    // Lines above the destination rectangle.
+    for ( ; y < yTop; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+
+    // Lines within the destination rectangle.
+    for ( ; y < y0; y++)
+    {        
+        const WORD *pSrc_Pixel = reinterpret_cast<const WORD*>(pSrc);
+        WORD *pDest_Pixel = reinterpret_cast<WORD*>(pDest);
+
+        CopyMemory(pDest, pSrc, left * 2);
+        for (DWORD x = left; (x + 1) < right; x += 2)
+        {
+            // Byte order is Y0 U0 Y1 V0
+            // Each WORD is a byte pair (Y, U/V)
+            // Windows is little-endian so the order appears reversed.
+
+            DWORD tmp = *reinterpret_cast<const DWORD*>(&pSrc_Pixel[x]);
+            *reinterpret_cast<DWORD*>(&pDest_Pixel[x]) = (tmp & 0xFF00FF00) | 0x00800080;
+        }
+        CopyMemory(pDest + (right * 2), pSrc + (right * 2), (dwWidthInPixels - right) * 2);
+
+        pDest += lDestStride;
+        pSrc += lSrcStride;
+    }
+
+    // Lines below the destination rectangle.
+    for ( ; y < dwRowEnd; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+}
+
+
+// Convert YUY2 image.
+
+inline void TransformImage_YUY2(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    DWORD y = dwRowBegin;
+    // Round left down and right up to the even value, so that a pixel
+    // pair is converted if either of its pixels is inside rcDest.
+    const UINT32 right = min((min(rcDest.right, dwWidthInPixels) + 1) & ~(1), dwWidthInPixels & ~(1));
+    const UINT32 left = min(rcDest.left & ~(1), right);
+    const DWORD yTop = min(rcDest.top, dwRowEnd);
+    const DWORD y0 = min(min(rcDest.bottom, dwHeightInPixels), dwRowEnd);
+
+    pSrc += lSrcStride * static_cast<LONG>(dwRowBegin);
+    pDest += lDestStride * static_cast<LONG>(dwRowBegin);
+
+    // Lines above the destination rectangle.
+    for ( ; y < yTop; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+
+    // Lines within the destination rectangle.
+    for ( ; y < y0; y++)
+    {
+        const WORD *pSrc_Pixel = reinterpret_cast<const WORD*>(pSrc);
+        WORD *pDest_Pixel = reinterpret_cast<WORD*>(pDest);
+
+        CopyMemory(pDest, pSrc, left * 2);
+        for (DWORD x = left; (x + 1) < right; x += 2)
+        {
+            // Byte order is Y0 U0 Y1 V0
+            // Each WORD is a byte pair (Y, U/V)
+            // Windows is little-endian so the order appears reversed.
+
+            DWORD tmp = *reinterpret_cast<const DWORD*>(&pSrc_Pixel[x]);
+            *reinterpret_cast<DWORD*>(&pDest_Pixel[x]) = (tmp & 0x00FF00FF) | 0x80008000;
+        }
+        CopyMemory(pDest + (right * 2), pSrc + (right * 2), (dwWidthInPixels - right) * 2);
+
+        pDest += lDestStride;
+        pSrc += lSrcStride;
+    }
+
+    // Lines below the destination rectangle.
+    for ( ; y < dwRowEnd; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+}
+
+// Convert NV12 image
+
+inline void TransformImage_NV12(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(2 * lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(2 * lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    // NV12 is planar: Y plane, followed by packed U-V plane.
+
+    // Y plane
+    BYTE *pDest_Y = pDest + lDestStride * static_cast<LONG>(dwRowBegin);
+    const BYTE *pSrc_Y = pSrc + lSrcStride * static_cast<LONG>(dwRowBegin);
+
+    if (lDestStride == lSrcStride && lSrcStride > 0 && dwRowEnd > dwRowBegin)
+    {
+        // Same layout: Copy the rows at once.
+        CopyMemory(pDest_Y, pSrc_Y, lSrcStride * (dwRowEnd - dwRowBegin - 1) + dwWidthInPixels);
+    }
+    else
+    {
+        for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+        {
+            CopyMemory(pDest_Y, pSrc_Y, dwWidthInPixels);
+            pDest_Y += lDestStride;
+            pSrc_Y += lSrcStride;
+        }
+    }
+
+    // U-V plane
+
+    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+
+    // Each U-V byte pair is shared by a 2x2 block of pixels. Round the
+    // byte range out to whole pairs and the rows out to whole blocks, so
+    // that a block is converted if any of its pixels is inside rcDest.
+
+    const UINT32 right = min((min(rcDest.right, dwWidthInPixels) + 1) & ~(1), dwWidthInPixels & ~(1));
+    const UINT32 left = min(rcDest.left & ~(1), right);
+
+    DWORD y = dwRowBegin/2;
+    const DWORD yTop = min(rcDest.top/2, dwRowEnd/2);
+    const DWORD y0 = min(min((rcDest.bottom + 1)/2, dwHeightInPixels/2), dwRowEnd/2);
+
+    pDest += lDestStride * static_cast<LONG>(dwHeightInPixels + y);
+    pSrc += lSrcStride * static_cast<LONG>(dwHeightInPixels + y);
+
+    // Lines above the destination rectangle.
+    for ( ; y < yTop; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+
+    // Lines within the destination rectangle.
+    for ( ; y < y0; y++)
+    {
+        CopyMemory(pDest, pSrc, left);
+        FillMemory(pDest + left, right - left, 128);
+        CopyMemory(pDest + right, pSrc + right, dwWidthInPixels - right);
+        pDest += lDestStride;
+        pSrc += lSrcStride;
+    }
+
+    // Lines below the destination rectangle.
+    for ( ; y < dwRowEnd/2; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+}
+
+//-------------------------------------------------------------------
+// SIMD versions of the packed 4:2:2 (UYVY, YUY2) conversion.
+//
+// Each DWORD of a packed 4:2:2 image holds two pixels. The grayscale
+// conversion keeps the luma bytes and sets the chroma bytes to 128:
+//
+//     dest = (src & dwLumaMask) | dwGrayChroma
+//
+// The MaskPixelPairs_xxx functions apply this to one run of pixel
+// pairs, 64 bytes per iteration, and finish the remainder with the
+// scalar loop. The output is identical to TransformImage_UYVY and
+// TransformImage_YUY2. UpdateFormatInfo selects the version for the
+// CPU (see CpuFeatures.h).
+//-------------------------------------------------------------------
+
+const DWORD UYVY_LUMA_MASK = 0xFF00FF00;
+const DWORD UYVY_GRAY_CHROMA = 0x00800080;
+const DWORD YUY2_LUMA_MASK = 0x00FF00FF;
+const DWORD YUY2_GRAY_CHROMA = 0x80008000;
+
+// Function pointer for the function that converts a run of pixel pairs.
+typedef void (*PIXEL_PAIR_FN)(
+    BYTE*       pDest,          // Destination pixels.
+    const BYTE* pSrc,           // Source pixels.
+    DWORD       cPairs,         // Number of pixel pairs (DWORDs).
+    DWORD       dwLumaMask,     // Bits to keep.
+    DWORD       dwGrayChroma    // Bits to set.
+    );
+
+inline void MaskPixelPairs(
+    _Out_writes_bytes_(cPairs * 4) BYTE *pDest,
+    _In_reads_bytes_(cPairs * 4) const BYTE *pSrc,
+    DWORD cPairs,
+    DWORD dwLumaMask,
+    DWORD dwGrayChroma)
+{
+    const DWORD *pSrc_Pair = reinterpret_cast<const DWORD*>(pSrc);
+    DWORD *pDest_Pair = reinterpret_cast<DWORD*>(pDest);
+
+    for (DWORD i = 0; i < cPairs; i++)
+    {
+        pDest_Pair[i] = (pSrc_Pair[i] & dwLumaMask) | dwGrayChroma;
+    }
+}
+
+#if defined(CPU_FEATURES_X86)
+
+inline void MaskPixelPairs_SSE2(
+    _Out_writes_bytes_(cPairs * 4) BYTE *pDest,
+    _In_reads_bytes_(cPairs * 4) const BYTE *pSrc,
+    DWORD cPairs,
+    DWORD dwLumaMask,
+    DWORD dwGrayChroma)
+{
+    const __m128i mask = _mm_set1_epi32(static_cast<int>(dwLumaMask));
+    const __m128i chroma = _mm_set1_epi32(static_cast<int>(dwGrayChroma));
+
+    for ( ; cPairs >= 16; cPairs -= 16)
+    {
+        const __m128i *pIn = reinterpret_cast<const __m128i*>(pSrc);
+        __m128i *pOut = reinterpret_cast<__m128i*>(pDest);
+
+        // Load everything first, so that the function also works in place.
+        __m128i v0 = _mm_loadu_si128(pIn + 0);
+        __m128i v1 = _mm_loadu_si128(pIn + 1);
+        __m128i v2 = _mm_loadu_si128(pIn + 2);
+        __m128i v3 = _mm_loadu_si128(pIn + 3);
+
+        _mm_storeu_si128(pOut + 0, _mm_or_si128(_mm_and_si128(v0, mask), chroma));
+        _mm_storeu_si128(pOut + 1, _mm_or_si128(_mm_and_si128(v1, mask), chroma));
+        _mm_storeu_si128(pOut + 2, _mm_or_si128(_mm_and_si128(v2, mask), chroma));
+        _mm_storeu_si128(pOut + 3, _mm_or_si128(_mm_and_si128(v3, mask), chroma));
+
+        pSrc += 64;
+        pDest += 64;
+    }
+
+    for ( ; cPairs >= 4; cPairs -= 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest), _mm_or_si128(_mm_and_si128(v, mask), chroma));
+
+        pSrc += 16;
+        pDest += 16;
+    }
+
+    MaskPixelPairs(pDest, pSrc, cPairs, dwLumaMask, dwGrayChroma);
+}
+
+CPU_TARGET_AVX2
+inline void MaskPixelPairs_AVX2(
+    _Out_writes_bytes_(cPairs * 4) BYTE *pDest,
+    _In_reads_bytes_(cPairs * 4) const BYTE *pSrc,
+    DWORD cPairs,
+    DWORD dwLumaMask,
+    DWORD dwGrayChroma)
+{
+    const __m256i mask = _mm256_set1_epi32(static_cast<int>(dwLumaMask));
+    const __m256i chroma = _mm256_set1_epi32(static_cast<int>(dwGrayChroma));
+
+    for ( ; cPairs >= 16; cPairs -= 16)
+    {
+        const __m256i *pIn = reinterpret_cast<const __m256i*>(pSrc);
+        __m256i *pOut = reinterpret_cast<__m256i*>(pDest);
+
+        __m256i v0 = _mm256_loadu_si256(pIn + 0);
+        __m256i v1 = _mm256_loadu_si256(pIn + 1);
+
+        _mm256_storeu_si256(pOut + 0, _mm256_or_si256(_mm256_and_si256(v0, mask), chroma));
+        _mm256_storeu_si256(pOut + 1, _mm256_or_si256(_mm256_and_si256(v1, mask), chroma));
+
+        pSrc += 64;
+        pDest += 64;
+    }
+
+    // Fewer than 64 bytes left.
+    MaskPixelPairs_SSE2(pDest, pSrc, cPairs, dwLumaMask, dwGrayChroma);
+}
+
+#elif defined(CPU_FEATURES_ARM)
+
+inline void MaskPixelPairs_NEON(
+    _Out_writes_bytes_(cPairs * 4) BYTE *pDest,
+    _In_reads_bytes_(cPairs * 4) const BYTE *pSrc,
+    DWORD cPairs,
+    DWORD dwLumaMask,
+    DWORD dwGrayChroma)
+{
+    const uint32x4_t mask = vdupq_n_u32(dwLumaMask);
+    const uint32x4_t chroma = vdupq_n_u32(dwGrayChroma);
+
+    for ( ; cPairs >= 16; cPairs -= 16)
+    {
+        const uint32_t *pIn = reinterpret_cast<const uint32_t*>(pSrc);
+        uint32_t *pOut = reinterpret_cast<uint32_t*>(pDest);
+
+        uint32x4_t v0 = vld1q_u32(pIn + 0);
+        uint32x4_t v1 = vld1q_u32(pIn + 4);
+        uint32x4_t v2 = vld1q_u32(pIn + 8);
+        uint32x4_t v3 = vld1q_u32(pIn + 12);
+
+        vst1q_u32(pOut + 0, vorrq_u32(vandq_u32(v0, mask), chroma));
+        vst1q_u32(pOut + 4, vorrq_u32(vandq_u32(v1, mask), chroma));
+        vst1q_u32(pOut + 8, vorrq_u32(vandq_u32(v2, mask), chroma));
+        vst1q_u32(pOut + 12, vorrq_u32(vandq_u32(v3, mask), chroma));
+
+        pSrc += 64;
+        pDest += 64;
+    }
+
+    MaskPixelPairs(pDest, pSrc, cPairs, dwLumaMask, dwGrayChroma);
+}
+
+#endif
+
+// Convert a packed 4:2:2 image, using the specified function for the
+// pixels inside the destination rectangle.
+
+template <DWORD dwLumaMask, DWORD dwGrayChroma, PIXEL_PAIR_FN pfnMaskPixelPairs>
+void TransformImage_422(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    DWORD y = dwRowBegin;
+    // Round left down and right up to the even value, so that a pixel
+    // pair is converted if either of its pixels is inside rcDest.
+    const UINT32 right = min((min(rcDest.right, dwWidthInPixels) + 1) & ~(1), dwWidthInPixels & ~(1));
+    const UINT32 left = min(rcDest.left & ~(1), right);
+    const DWORD yTop = min(rcDest.top, dwRowEnd);
+    const DWORD y0 = min(min(rcDest.bottom, dwHeightInPixels), dwRowEnd);
+
+    pSrc += lSrcStride * static_cast<LONG>(dwRowBegin);
+    pDest += lDestStride * static_cast<LONG>(dwRowBegin);
+
+    // Lines above the destination rectangle.
+    for ( ; y < yTop; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+
+    // Lines within the destination rectangle.
+    for ( ; y < y0; y++)
+    {
+        CopyMemory(pDest, pSrc, left * 2);
+        if (right > left)
+        {
+            pfnMaskPixelPairs(pDest + (left * 2), pSrc + (left * 2), (right - left) / 2, dwLumaMask, dwGrayChroma);
+        }
+        CopyMemory(pDest + (right * 2), pSrc + (right * 2), (dwWidthInPixels - right) * 2);
+
+        pDest += lDestStride;
+        pSrc += lSrcStride;
+    }
+
+    // Lines below the destination rectangle.
+    for ( ; y < dwRowEnd; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels * 2);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+}
+
+// Returns the fastest packed 4:2:2 conversion for this CPU. The scalar
+// function is used if the CPU has no supported SIMD instruction set.
+
+template <DWORD dwLumaMask, DWORD dwGrayChroma>
+IMAGE_TRANSFORM_FN SelectTransform_422(IMAGE_TRANSFORM_FN pfnScalar)
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+        return TransformImage_422<dwLumaMask, dwGrayChroma, MaskPixelPairs_AVX2>;
+
+    case CpuSimd_SSE2:
+        return TransformImage_422<dwLumaMask, dwGrayChroma, MaskPixelPairs_SSE2>;
+#elif defined(CPU_FEATURES_ARM)
+    case CpuSimd_NEON:
+        return TransformImage_422<dwLumaMask, dwGrayChroma, MaskPixelPairs_NEON>;
+#endif
+
+    default:
+        return pfnScalar;
+    }
+}
+
+//-------------------------------------------------------------------
+// Functions to convert a YUV image to grayscale in place.
+//
+// These functions write only the chroma values inside the destination
+// rectangle. The rest of the image is already correct.
+//-------------------------------------------------------------------
+
+// Convert a packed 4:2:2 image (UYVY, YUY2) in place.
+
+template <DWORD dwLumaMask, DWORD dwGrayChroma, PIXEL_PAIR_FN pfnMaskPixelPairs>
+void TransformImageInPlace_422(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(lStride * dwHeightInPixels)) BYTE *pData, 
+    _In_ LONG lStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    // Round left down and right up to the even value, so that a pixel
+    // pair is converted if either of its pixels is inside rcDest.
+    const UINT32 right = min((min(rcDest.right, dwWidthInPixels) + 1) & ~(1), dwWidthInPixels & ~(1));
+    const UINT32 left = min(rcDest.left & ~(1), right);
+    const DWORD yTop = max(rcDest.top, dwRowBegin);
+    const DWORD y0 = min(min(rcDest.bottom, dwHeightInPixels), dwRowEnd);
+
+    if (right <= left)
+    {
+        return;
+    }
+
+    pData += lStride * static_cast<LONG>(yTop);
+
+    for (DWORD y = yTop; y < y0; y++)
+    {
+        pfnMaskPixelPairs(pData + (left * 2), pData + (left * 2), (right - left) / 2, dwLumaMask, dwGrayChroma);
+        pData += lStride;
+    }
+}
+
+// Convert NV12 image in place.
+
+inline void TransformImageInPlace_NV12(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(2 * lStride * dwHeightInPixels)) BYTE *pData, 
+    _In_ LONG lStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    // Round out to whole U-V pairs and 2x2 pixel blocks, as in
+    // TransformImage_NV12.
+    const UINT32 right = min((min(rcDest.right, dwWidthInPixels) + 1) & ~(1), dwWidthInPixels & ~(1));
+    const UINT32 left = rcDest.left & ~(1);
+    const DWORD yTop = max(rcDest.top/2, dwRowBegin/2);
+    const DWORD y0 = min(min((rcDest.bottom + 1)/2, dwHeightInPixels/2), dwRowEnd/2);
+
+    if (right <= left)
+    {
+        return;
+    }
+
+    // Skip the Y plane. The U-V plane has 1/2 the number of lines as the Y plane.
+    pData += lStride * static_cast<LONG>(dwHeightInPixels + yTop);
+
+    for (DWORD y = yTop; y < y0; y++)
+    {
+        FillMemory(pData + left, right - left, 128);
+        pData += lStride;
+    }
+}
+
+// Returns the fastest in-place packed 4:2:2 conversion for this CPU.
+
+template <DWORD dwLumaMask, DWORD dwGrayChroma>
+IMAGE_TRANSFORM_IN_PLACE_FN SelectTransformInPlace_422()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+        return TransformImageInPlace_422<dwLumaMask, dwGrayChroma, MaskPixelPairs_AVX2>;
+
+    case CpuSimd_SSE2:
+        return TransformImageInPlace_422<dwLumaMask, dwGrayChroma, MaskPixelPairs_SSE2>;
+#elif defined(CPU_FEATURES_ARM)
+    case CpuSimd_NEON:
+        return TransformImageInPlace_422<dwLumaMask, dwGrayChroma, MaskPixelPairs_NEON>;
+#endif
+
+    default:
+        return TransformImageInPlace_422<dwLumaMask, dwGrayChroma, MaskPixelPairs>;
+    }
+}
+
+//-------------------------------------------------------------------
+// Functions to convert planar 4:2:0 images (I420, IYUV, YV12).
+//
+// The Y plane is followed by two chroma planes, each with half the
+// width, half the height and half the stride of the Y plane. I420
+// and IYUV store U before V, YV12 stores V before U. The grayscale
+// conversion sets both planes to 128, so the same functions handle
+// all three formats.
+//-------------------------------------------------------------------
+
+// Copy chroma rows [dwRowBegin, dwRowEnd) of one chroma plane, and
+// set the samples inside rcGray (in chroma samples) to 128. pDest and
+// pSrc point to the start of the plane.
+
+inline void TransformChromaPlane_420(
+    const D2D_RECT_U &rcGray,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwRowEnd)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwRowEnd)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD cbRow,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    DWORD y = dwRowBegin;
+    const DWORD yTop = min(rcGray.top, dwRowEnd);
+    const DWORD y0 = min(rcGray.bottom, dwRowEnd);
+
+    pDest += lDestStride * static_cast<LONG>(dwRowBegin);
+    pSrc += lSrcStride * static_cast<LONG>(dwRowBegin);
+
+    // Lines above the destination rectangle.
+    for ( ; y < yTop; y++)
+    {
+        CopyMemory(pDest, pSrc, cbRow);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+
+    // Lines within the destination rectangle.
+    for ( ; y < y0; y++)
+    {
+        CopyMemory(pDest, pSrc, rcGray.left);
+        FillMemory(pDest + rcGray.left, rcGray.right - rcGray.left, 128);
+        CopyMemory(pDest + rcGray.right, pSrc + rcGray.right, cbRow - rcGray.right);
+        pDest += lDestStride;
+        pSrc += lSrcStride;
+    }
+
+    // Lines below the destination rectangle.
+    for ( ; y < dwRowEnd; y++)
+    {
+        CopyMemory(pDest, pSrc, cbRow);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+}
+
+// Returns the destination rectangle in chroma samples. A chroma sample
+// is included if any of the pixels that share it are inside rcDest.
+
+inline D2D_RECT_U GetChromaRect_420(const D2D_RECT_U &rcDest, DWORD dwWidthInPixels, DWORD dwHeightInPixels)
+{
+    D2D_RECT_U rcGray;
+
+    rcGray.left = min(rcDest.left, dwWidthInPixels) / 2;
+    rcGray.right = max(rcGray.left, (min(rcDest.right, dwWidthInPixels) + 1) / 2);
+    rcGray.right = min(rcGray.right, dwWidthInPixels / 2);
+    rcGray.top = rcDest.top / 2;
+    rcGray.bottom = min((rcDest.bottom + 1) / 2, dwHeightInPixels / 2);
+
+    return rcGray;
+}
+
+// Convert I420, IYUV or YV12 image.
+
+inline void TransformImage_YV12(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(2 * lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(2 * lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    // Y plane
+    BYTE *pDest_Y = pDest + lDestStride * static_cast<LONG>(dwRowBegin);
+    const BYTE *pSrc_Y = pSrc + lSrcStride * static_cast<LONG>(dwRowBegin);
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        CopyMemory(pDest_Y, pSrc_Y, dwWidthInPixels);
+        pDest_Y += lDestStride;
+        pSrc_Y += lSrcStride;
+    }
+
+    // Chroma planes
+
+    const D2D_RECT_U rcGray = GetChromaRect_420(rcDest, dwWidthInPixels, dwHeightInPixels);
+    const LONG lDestStride_C = lDestStride / 2;
+    const LONG lSrcStride_C = lSrcStride / 2;
+
+    BYTE *pDest_C = pDest + lDestStride * static_cast<LONG>(dwHeightInPixels);
+    const BYTE *pSrc_C = pSrc + lSrcStride * static_cast<LONG>(dwHeightInPixels);
+
+    for (int iPlane = 0; iPlane < 2; iPlane++)
+    {
+        TransformChromaPlane_420(rcGray, pDest_C, lDestStride_C, pSrc_C, lSrcStride_C, dwWidthInPixels / 2, dwRowBegin / 2, dwRowEnd / 2);
+
+        pDest_C += lDestStride_C * static_cast<LONG>(dwHeightInPixels / 2);
+        pSrc_C += lSrcStride_C * static_cast<LONG>(dwHeightInPixels / 2);
+    }
+}
+
+// Convert I420, IYUV or YV12 image in place.
+
+inline void TransformImageInPlace_YV12(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(2 * lStride * dwHeightInPixels)) BYTE *pData, 
+    _In_ LONG lStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const D2D_RECT_U rcGray = GetChromaRect_420(rcDest, dwWidthInPixels, dwHeightInPixels);
+    const LONG lStride_C = lStride / 2;
+    const DWORD yTop = max(rcGray.top, dwRowBegin / 2);
+    const DWORD y0 = min(rcGray.bottom, dwRowEnd / 2);
+
+    if (rcGray.right <= rcGray.left)
+    {
+        return;
+    }
+
+    // Skip the Y plane.
+    BYTE *pData_C = pData + lStride * static_cast<LONG>(dwHeightInPixels);
+
+    for (int iPlane = 0; iPlane < 2; iPlane++)
+    {
+        BYTE *pRow = pData_C + lStride_C * static_cast<LONG>(yTop);
+
+        for (DWORD y = yTop; y < y0; y++)
+        {
+            FillMemory(pRow + rcGray.left, rcGray.right - rcGray.left, 128);
+            pRow += lStride_C;
+        }
+
+        pData_C += lStride_C * static_cast<LONG>(dwHeightInPixels / 2);
+    }
+}
+
+//-------------------------------------------------------------------
+// Functions to convert RGB32 images.
+//
+// Each pixel is replaced by its luma, computed with 8-bit fixed-point
+// BT.601 weights:
+//
+//     Y = (77 * R + 150 * G + 29 * B + 128) >> 8
+//
+// The alpha (or padding) byte is kept. The GrayPixels_RGB32_xxx
+// functions convert one run of pixels and give the same result as the
+// scalar version.
+//-------------------------------------------------------------------
+
+const UINT32 LUMA_WEIGHT_R = 77;
+const UINT32 LUMA_WEIGHT_G = 150;
+const UINT32 LUMA_WEIGHT_B = 29;
+
+// Function pointer for the function that converts a run of RGB32 pixels.
+typedef void (*RGB32_PIXEL_FN)(
+    BYTE*       pDest,          // Destination pixels.
+    const BYTE* pSrc,           // Source pixels.
+    DWORD       cPixels         // Number of pixels.
+    );
+
+inline void GrayPixels_RGB32(
+    _Out_writes_bytes_(cPixels * 4) BYTE *pDest,
+    _In_reads_bytes_(cPixels * 4) const BYTE *pSrc,
+    DWORD cPixels)
+{
+    const DWORD *pSrc_Pixel = reinterpret_cast<const DWORD*>(pSrc);
+    DWORD *pDest_Pixel = reinterpret_cast<DWORD*>(pDest);
+
+    for (DWORD i = 0; i < cPixels; i++)
+    {
+        // Byte order is B G R A
+        DWORD tmp = pSrc_Pixel[i];
+        DWORD luma = (LUMA_WEIGHT_B * (tmp & 0xFF) + 
+                      LUMA_WEIGHT_G * ((tmp >> 8) & 0xFF) + 
+                      LUMA_WEIGHT_R * ((tmp >> 16) & 0xFF) + 128) >> 8;
+
+        pDest_Pixel[i] = (tmp & 0xFF000000) | (luma * 0x00010101);
+    }
+}
+
+#if defined(CPU_FEATURES_X86)
+
+inline void GrayPixels_RGB32_SSE2(
+    _Out_writes_bytes_(cPixels * 4) BYTE *pDest,
+    _In_reads_bytes_(cPixels * 4) const BYTE *pSrc,
+    DWORD cPixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_set_epi16(0, LUMA_WEIGHT_R, LUMA_WEIGHT_G, LUMA_WEIGHT_B, 0, LUMA_WEIGHT_R, LUMA_WEIGHT_G, LUMA_WEIGHT_B);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+
+    for ( ; cPixels >= 4; cPixels -= 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+
+        // Widen to 16 bits and multiply. Each 32-bit lane holds B*wB + G*wG or R*wR.
+        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights);    // Pixels 0, 1
+        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights);    // Pixels 2, 3
+
+        // Add the two halves of each pixel, then round.
+        lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+        hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+        lo = _mm_srli_epi32(_mm_add_epi32(lo, round), 8);
+        hi = _mm_srli_epi32(_mm_add_epi32(hi, round), 8);
+
+        // One luma value per 32-bit lane.
+        __m128i luma = _mm_unpacklo_epi64(_mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0)));
+
+        // Copy the luma into B, G and R, and keep alpha.
+        luma = _mm_or_si128(_mm_or_si128(luma, _mm_slli_epi32(luma, 8)), _mm_slli_epi32(luma, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest), _mm_or_si128(luma, _mm_and_si128(v, alpha)));
+
+        pSrc += 16;
+        pDest += 16;
+    }
+
+    GrayPixels_RGB32(pDest, pSrc, cPixels);
+}
+
+CPU_TARGET_AVX2
+inline void GrayPixels_RGB32_AVX2(
+    _Out_writes_bytes_(cPixels * 4) BYTE *pDest,
+    _In_reads_bytes_(cPixels * 4) const BYTE *pSrc,
+    DWORD cPixels)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i weights = _mm256_set_epi16(0, LUMA_WEIGHT_R, LUMA_WEIGHT_G, LUMA_WEIGHT_B, 0, LUMA_WEIGHT_R, LUMA_WEIGHT_G, LUMA_WEIGHT_B,
+                                             0, LUMA_WEIGHT_R, LUMA_WEIGHT_G, LUMA_WEIGHT_B, 0, LUMA_WEIGHT_R, LUMA_WEIGHT_G, LUMA_WEIGHT_B);
+    const __m256i round = _mm256_set1_epi32(128);
+    const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+
+    // Same steps as the SSE2 version. All of them work within each
+    // 128-bit lane, so the pixels stay in order.
+    for ( ; cPixels >= 8; cPixels -= 8)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc));
+
+        __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(v, zero), weights);
+        __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(v, zero), weights);
+
+        lo = _mm256_add_epi32(lo, _mm256_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+        hi = _mm256_add_epi32(hi, _mm256_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+        lo = _mm256_srli_epi32(_mm256_add_epi32(lo, round), 8);
+        hi = _mm256_srli_epi32(_mm256_add_epi32(hi, round), 8);
+
+        __m256i luma = _mm256_unpacklo_epi64(_mm256_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0)), _mm256_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0)));
+
+        luma = _mm256_or_si256(_mm256_or_si256(luma, _mm256_slli_epi32(luma, 8)), _mm256_slli_epi32(luma, 16));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDest), _mm256_or_si256(luma, _mm256_and_si256(v, alpha)));
+
+        pSrc += 32;
+        pDest += 32;
+    }
+
+    // Fewer than 8 pixels left.
+    GrayPixels_RGB32_SSE2(pDest, pSrc, cPixels);
+}
+
+#elif defined(CPU_FEATURES_ARM)
+
+inline void GrayPixels_RGB32_NEON(
+    _Out_writes_bytes_(cPixels * 4) BYTE *pDest,
+    _In_reads_bytes_(cPixels * 4) const BYTE *pSrc,
+    DWORD cPixels)
+{
+    const uint8x8_t weightR = vdup_n_u8(LUMA_WEIGHT_R);
+    const uint8x8_t weightG = vdup_n_u8(LUMA_WEIGHT_G);
+    const uint8x8_t weightB = vdup_n_u8(LUMA_WEIGHT_B);
+
+    for ( ; cPixels >= 8; cPixels -= 8)
+    {
+        // Load 8 pixels into separate B, G, R and A vectors.
+        uint8x8x4_t v = vld4_u8(pSrc);
+
+        uint16x8_t sum = vmull_u8(v.val[0], weightB);
+        sum = vmlal_u8(sum, v.val[1], weightG);
+        sum = vmlal_u8(sum, v.val[2], weightR);
+
+        // Rounding shift: (sum + 128) >> 8
+        uint8x8_t luma = vrshrn_n_u16(sum, 8);
+
+        v.val[0] = luma;
+        v.val[1] = luma;
+        v.val[2] = luma;
+        vst4_u8(pDest, v);
+
+        pSrc += 32;
+        pDest += 32;
+    }
+
+    GrayPixels_RGB32(pDest, pSrc, cPixels);
+}
+
+#endif
+
+// Convert RGB32 image, using the specified function for the pixels
+// inside the destination rectangle.
+
+template <RGB32_PIXEL_FN pfnGrayPixels>
+void TransformImage_RGB32(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    DWORD y = dwRowBegin;
+    const UINT32 right = min(rcDest.right, dwWidthInPixels);
+    const UINT32 left = min(rcDest.left, right);
+    const DWORD yTop = min(rcDest.top, dwRowEnd);
+    const DWORD y0 = min(min(rcDest.bottom, dwHeightInPixels), dwRowEnd);
+
+    pSrc += lSrcStride * static_cast<LONG>(dwRowBegin);
+    pDest += lDestStride * static_cast<LONG>(dwRowBegin);
+
+    // Lines above the destination rectangle.
+    for ( ; y < yTop; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels * 4);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+
+    // Lines within the destination rectangle.
+    for ( ; y < y0; y++)
+    {
+        CopyMemory(pDest, pSrc, left * 4);
+        pfnGrayPixels(pDest + (left * 4), pSrc + (left * 4), right - left);
+        CopyMemory(pDest + (right * 4), pSrc + (right * 4), (dwWidthInPixels - right) * 4);
+
+        pDest += lDestStride;
+        pSrc += lSrcStride;
+    }
+
+    // Lines below the destination rectangle.
+    for ( ; y < dwRowEnd; y++)
+    {
+        CopyMemory(pDest, pSrc, dwWidthInPixels * 4);
+        pSrc += lSrcStride;
+        pDest += lDestStride;
+    }
+}
+
+// Convert RGB32 image in place.
+
+template <RGB32_PIXEL_FN pfnGrayPixels>
+void TransformImageInPlace_RGB32(
+    const D2D_RECT_U &rcDest,
+    _Inout_updates_(_Inexpressible_(lStride * dwHeightInPixels)) BYTE *pData, 
+    _In_ LONG lStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const UINT32 right = min(rcDest.right, dwWidthInPixels);
+    const UINT32 left = min(rcDest.left, right);
+    const DWORD yTop = max(rcDest.top, dwRowBegin);
+    const DWORD y0 = min(min(rcDest.bottom, dwHeightInPixels), dwRowEnd);
+
+    pData += lStride * static_cast<LONG>(yTop);
+
+    for (DWORD y = yTop; y < y0; y++)
+    {
+        pfnGrayPixels(pData + (left * 4), pData + (left * 4), right - left);
+        pData += lStride;
+    }
+}
+
+// Returns the fastest RGB32 conversion for this CPU.
+
+inline IMAGE_TRANSFORM_FN SelectTransform_RGB32()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+        return TransformImage_RGB32<GrayPixels_RGB32_AVX2>;
+
+    case CpuSimd_SSE2:
+        return TransformImage_RGB32<GrayPixels_RGB32_SSE2>;
+#elif defined(CPU_FEATURES_ARM)
+    case CpuSimd_NEON:
+        return TransformImage_RGB32<GrayPixels_RGB32_NEON>;
+#endif
+
+    default:
+        return TransformImage_RGB32<GrayPixels_RGB32>;
+    }
+}
+
+// Returns the fastest in-place RGB32 conversion for this CPU.
+
+inline IMAGE_TRANSFORM_IN_PLACE_FN SelectTransformInPlace_RGB32()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+        return TransformImageInPlace_RGB32<GrayPixels_RGB32_AVX2>;
+
+    case CpuSimd_SSE2:
+        return TransformImageInPlace_RGB32<GrayPixels_RGB32_SSE2>;
+#elif defined(CPU_FEATURES_ARM)
+    case CpuSimd_NEON:
+        return TransformImageInPlace_RGB32<GrayPixels_RGB32_NEON>;
+#endif
+
+    default:
+        return TransformImageInPlace_RGB32<GrayPixels_RGB32>;
+    }
+}
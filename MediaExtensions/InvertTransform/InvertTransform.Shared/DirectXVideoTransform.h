@@ -20,4 +20,18 @@ internal:
     // pInput and pOutput are both DXGI_FORMAT_B8G8R8X8_UNORM textures with uiWidth,uiHeight as given by Initialize
     // uiInIndex and uiOutIndex are the subresource indices
     virtual void ProcessFrame(ID3D11Device *pDevice, ID3D11Texture2D *pInput, UINT uiInIndex, ID3D11Texture2D *pOutput, UINT uiOutIndex) = 0;
+
+    // Returns true if the transform can process video data in system memory (see ProcessBuffer)
+    // When there is no hardware device, such transforms are initialized with pDevice == nullptr, and
+    // ProcessBuffer is called instead of ProcessFrame. The others are run on a WARP device.
+    virtual bool CanProcessBuffer() { return false; }
+
+    // Called to process video data in system memory
+    // pSrc and pDest are DXGI_FORMAT_B8G8R8X8_UNORM images with uiWidth,uiHeight as given by Initialize
+    // Only rows [uiRowBegin, uiRowEnd) are written, so that several threads can process bands of the same frame
+    // Transforms that return true from CanProcessBuffer must override it; the default fails with E_NOTIMPL
+    virtual void ProcessBuffer(BYTE *pDest, LONG lDestStride, const BYTE *pSrc, LONG lSrcStride, UINT uiRowBegin, UINT uiRowEnd)
+    {
+        throw ref new Platform::NotImplementedException();
+    }
 };
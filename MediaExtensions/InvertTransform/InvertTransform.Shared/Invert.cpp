@@ -647,6 +647,9 @@ HRESULT CInvert::ProcessMessage(
 
                     UpdateDX11Device();
 
+                    // Initialize the transform for the new device.
+                    m_fStreamingInitialized = false;
+
                     if (m_spOutputSampleAllocator != nullptr)
                     {
                         ThrowIfError(m_spOutputSampleAllocator->SetDirectXManager(spManagerUnk.Get()));
@@ -657,6 +660,9 @@ HRESULT CInvert::ProcessMessage(
             {
                 InvalidateDX11Resources();
                 m_spDX11Manager = nullptr;
+
+                // Initialize the transform again, without the device.
+                m_fStreamingInitialized = false;
             }
             break;
 
@@ -1041,7 +1047,9 @@ void CInvert::BeginStreaming()
 {
     if (!m_fStreamingInitialized)
     {
-        if( m_spDevice == nullptr )
+        // Without a DirectX manager, transforms that can process system
+        // memory do so, instead of going through a WARP device.
+        if( m_spDevice == nullptr && (m_spDX11Manager != nullptr || !m_transform->CanProcessBuffer()) )
         {
             UpdateDX11Device();
         }
@@ -1109,6 +1117,20 @@ ComPtr<ID3D11Texture2D> BufferToDXType(IMFMediaBuffer *pBuffer, _Out_ UINT *uiVi
 // Generate output data.
 void CInvert::OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut)
 {
+    if (m_spDevice == nullptr)
+    {
+        // Only transforms that can process system memory run without a
+        // device. For the others, BeginStreaming creates a WARP device, and
+        // if that failed there is nothing that can write the output frame.
+        if (!m_transform->CanProcessBuffer())
+        {
+            ThrowException(MF_E_UNEXPECTED);
+        }
+
+        OnProcessOutputInMemory(pIn, pOut);
+        return;
+    }
+
     ComPtr<ID3D11Texture2D> spInTex;
     ComPtr<ID3D11Texture2D> spOutTex;
     UINT uiInIndex = 0;
@@ -1251,6 +1273,28 @@ void CInvert::OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut)
     }
 }
 
+// Generate output data in system memory, when there is no device.
+void CInvert::OnProcessOutputInMemory(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut)
+{
+    // Stride if the buffer does not support IMF2DBuffer
+    const LONG lDefaultStride = GetDefaultStride(m_spInputType.Get());
+
+    VideoBufferLock inputLock(pIn, MF2DBuffer_LockFlags_Read, m_imageHeightInPixels, lDefaultStride);
+    VideoBufferLock outputLock(pOut, MF2DBuffer_LockFlags_Write, m_imageHeightInPixels, lDefaultStride);
+
+    BYTE *pDest = outputLock.GetTopRow();
+    const LONG lDestStride = outputLock.GetStride();
+    const BYTE *pSrc = inputLock.GetTopRow();
+    const LONG lSrcStride = inputLock.GetStride();
+
+    DirectXVideoTransform ^transform = m_transform;
+
+    m_threadPool.Run(m_imageHeightInPixels, 1, lDestStride, [&](DWORD yBegin, DWORD yEnd)
+    {
+        transform->ProcessBuffer(pDest, lDestStride, pSrc, lSrcStride, yBegin, yEnd);
+    });
+}
+
 // Update the format information. This method is called whenever the
 // input type is set.
 void CInvert::UpdateFormatInfo()
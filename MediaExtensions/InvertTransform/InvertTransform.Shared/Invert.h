@@ -7,6 +7,7 @@
 
 #pragma once
 #include "CritSec.h"
+#include "RowBandThreadPool.h"
 #include "DirectXVideoTransform.h"
 
 using namespace Microsoft::WRL;
@@ -161,6 +162,7 @@ private:
     void OnCheckMediaType(IMFMediaType *pmt);
     void BeginStreaming();
     void OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut);
+    void OnProcessOutputInMemory(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut);
     void UpdateFormatInfo();
     void UpdateDX11Device();
     void CheckDX11Device();
@@ -198,4 +200,5 @@ private:
 
     // Transform
     DirectXVideoTransform ^m_transform;
+    RowBandThreadPool m_threadPool;             // Runs the transform on bands of rows in system memory.
 };
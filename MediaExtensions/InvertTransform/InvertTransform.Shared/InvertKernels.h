@@ -0,0 +1,139 @@
+// Image processing kernels for the invert transform.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+// Note: The kernels do not depend on COM or Direct3D, so that the tests
+// can build them with GCC or Clang (see CMakeLists.txt).
+
+#include "PortableTypes.h"
+#include "CpuFeatures.h"
+
+// Function pointer for the function that inverts a run of B8G8R8X8 pixels.
+typedef void (*INVERT_PIXELS_FN)(
+    BYTE*       pDest,          // Destination pixels.
+    const BYTE* pSrc,           // Source pixels.
+    UINT        cPixels         // Number of pixels.
+    );
+
+//-------------------------------------------------------------------
+// Functions to invert B8G8R8X8 pixels in system memory.
+//
+// These give the same result as the pixel shader: each of B, G and R
+// becomes 255 - x, which is x XOR 0xFF, and the fourth byte is kept.
+// The SIMD versions process the pixels that are left with the next
+// narrower version.
+//-------------------------------------------------------------------
+
+const UINT32 INVERT_MASK = 0x00FFFFFF;
+
+inline void InvertPixels(
+    _Out_writes_bytes_(cPixels * 4) BYTE *pDest,
+    _In_reads_bytes_(cPixels * 4) const BYTE *pSrc,
+    UINT cPixels)
+{
+    const UINT32 *pSrc_Pixel = reinterpret_cast<const UINT32*>(pSrc);
+    UINT32 *pDest_Pixel = reinterpret_cast<UINT32*>(pDest);
+
+    for (UINT i = 0; i < cPixels; i++)
+    {
+        pDest_Pixel[i] = pSrc_Pixel[i] ^ INVERT_MASK;
+    }
+}
+
+#if defined(CPU_FEATURES_X86)
+
+inline void InvertPixels_SSE2(
+    _Out_writes_bytes_(cPixels * 4) BYTE *pDest,
+    _In_reads_bytes_(cPixels * 4) const BYTE *pSrc,
+    UINT cPixels)
+{
+    const __m128i mask = _mm_set1_epi32(INVERT_MASK);
+
+    for ( ; cPixels >= 4; cPixels -= 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest), _mm_xor_si128(v, mask));
+
+        pSrc += 16;
+        pDest += 16;
+    }
+
+    InvertPixels(pDest, pSrc, cPixels);
+}
+
+CPU_TARGET_AVX2
+inline void InvertPixels_AVX2(
+    _Out_writes_bytes_(cPixels * 4) BYTE *pDest,
+    _In_reads_bytes_(cPixels * 4) const BYTE *pSrc,
+    UINT cPixels)
+{
+    const __m256i mask = _mm256_set1_epi32(INVERT_MASK);
+
+    // Two vectors per iteration, to keep more loads in flight.
+    for ( ; cPixels >= 16; cPixels -= 16)
+    {
+        __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc));
+        __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDest), _mm256_xor_si256(v0, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDest + 32), _mm256_xor_si256(v1, mask));
+
+        pSrc += 64;
+        pDest += 64;
+    }
+
+    InvertPixels_SSE2(pDest, pSrc, cPixels);
+}
+
+#elif defined(CPU_FEATURES_ARM)
+
+inline void InvertPixels_NEON(
+    _Out_writes_bytes_(cPixels * 4) BYTE *pDest,
+    _In_reads_bytes_(cPixels * 4) const BYTE *pSrc,
+    UINT cPixels)
+{
+    const uint32x4_t mask = vdupq_n_u32(INVERT_MASK);
+
+    for ( ; cPixels >= 8; cPixels -= 8)
+    {
+        uint32x4_t v0 = vld1q_u32(reinterpret_cast<const uint32_t*>(pSrc));
+        uint32x4_t v1 = vld1q_u32(reinterpret_cast<const uint32_t*>(pSrc + 16));
+        vst1q_u32(reinterpret_cast<uint32_t*>(pDest), veorq_u32(v0, mask));
+        vst1q_u32(reinterpret_cast<uint32_t*>(pDest + 16), veorq_u32(v1, mask));
+
+        pSrc += 32;
+        pDest += 32;
+    }
+
+    InvertPixels(pDest, pSrc, cPixels);
+}
+
+#endif
+
+// Returns the fastest pixel inversion for this CPU.
+
+inline INVERT_PIXELS_FN SelectInvertPixels()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+        return InvertPixels_AVX2;
+
+    case CpuSimd_SSE2:
+        return InvertPixels_SSE2;
+#elif defined(CPU_FEATURES_ARM)
+    case CpuSimd_NEON:
+        return InvertPixels_NEON;
+#endif
+
+    default:
+        return InvertPixels;
+    }
+}
@@ -30,6 +30,13 @@ void CInvertModule::Initialize(ID3D11Device *pDevice, UINT uiWidth, UINT uiHeigh
     {
         m_uiWidth = uiWidth;
         m_uiHeight = uiHeight;
+        m_pfnInvertPixels = SelectInvertPixels();
+
+        if (pDevice == nullptr)
+        {
+            // Frames are processed in system memory. (See ProcessBuffer.)
+            return;
+        }
 
         if (m_spScreenQuadVB == nullptr)
         {
@@ -245,4 +252,17 @@ void CInvertModule::ProcessFrame(ID3D11Device *pDevice, ID3D11Texture2D *pInput,
     spd3dImmediateContext->RSSetViewports(nViewPorts, vpOld);
     spd3dImmediateContext->PSSetShaderResources(0, 1, rgpOrigSRV.GetAddressOf());
     spd3dImmediateContext->OMSetRenderTargets(1, rgpOrigRTV.GetAddressOf(), pOrigDSV.Get()); 
+}
+
+void CInvertModule::ProcessBuffer(BYTE *pDest, LONG lDestStride, const BYTE *pSrc, LONG lSrcStride, UINT uiRowBegin, UINT uiRowEnd)
+{
+    pDest += lDestStride * static_cast<LONG>(uiRowBegin);
+    pSrc += lSrcStride * static_cast<LONG>(uiRowBegin);
+
+    for (UINT y = uiRowBegin; y < uiRowEnd; y++)
+    {
+        m_pfnInvertPixels(pDest, pSrc, m_uiWidth);
+        pDest += lDestStride;
+        pSrc += lSrcStride;
+    }
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "DirectXVideoTransform.h"
+#include "InvertKernels.h"
 
 ref class CInvertModule sealed: public DirectXVideoTransform 
 {
@@ -15,10 +16,13 @@ internal:
     void Invalidate() override;
     void Initialize(ID3D11Device *pDevice, UINT uiWidth, UINT uiHeight) override;
     void ProcessFrame(ID3D11Device *pDevice, ID3D11Texture2D *pInput, UINT uiInIndex, ID3D11Texture2D *pOutput, UINT uiOutIndex) override;
+    bool CanProcessBuffer() override { return true; }
+    void ProcessBuffer(BYTE *pDest, LONG lDestStride, const BYTE *pSrc, LONG lSrcStride, UINT uiRowBegin, UINT uiRowEnd) override;
 
 private:
     UINT m_uiWidth;
     UINT m_uiHeight;
+    INVERT_PIXELS_FN m_pfnInvertPixels;         // Inverts a run of pixels in system memory.
     ComPtr<ID3D11Buffer> m_spScreenQuadVB;
     ComPtr<ID3D11SamplerState> m_spSampleStateLinear;
     ComPtr<ID3D11InputLayout> m_spQuadLayout;
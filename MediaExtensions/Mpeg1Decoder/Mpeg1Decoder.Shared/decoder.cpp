@@ -200,10 +200,13 @@ HRESULT CDecoder::GetOutputStreamInfo(
     //       member of MFT_OUTPUT_STREAM_INFO. The other members depend on having a
     //       a valid media type.
 
+    // The decoder provides its output samples, from a pool of samples that
+    // are reused once the client releases them (see OutputSamplePool.h).
     pStreamInfo->dwFlags =
         MFT_OUTPUT_STREAM_WHOLE_SAMPLES |
         MFT_OUTPUT_STREAM_SINGLE_SAMPLE_PER_BUFFER |
-        MFT_OUTPUT_STREAM_FIXED_SAMPLE_SIZE ;
+        MFT_OUTPUT_STREAM_FIXED_SAMPLE_SIZE |
+        MFT_OUTPUT_STREAM_PROVIDES_SAMPLES ;
 
     if (m_spOutputType == nullptr)
     {
@@ -836,16 +839,13 @@ HRESULT CDecoder::ProcessOutput(
             throw ref new InvalidArgumentException();
         }
 
-        // It must contain a sample.
-        if (pOutputSamples[0].pSample == nullptr)
-        {
-            throw ref new InvalidArgumentException();
-        }
-
         AutoLock lock(m_critSec);
 
         DWORD cbData = 0;
 
+        // The decoder provides the output sample. If the client passes a
+        // sample anyway, that one is used.
+        ComPtr<IMFSample> spOutputSample = pOutputSamples[0].pSample;
         ComPtr<IMFMediaBuffer> spOutput;
 
         // If we don't have an input sample, we need some input before
@@ -855,8 +855,13 @@ HRESULT CDecoder::ProcessOutput(
             return MF_E_TRANSFORM_NEED_MORE_INPUT;
         }
 
+        if (spOutputSample == nullptr)
+        {
+            spOutputSample = m_outputSamples.AllocateSample(m_spOutputType.Get());
+        }
+
         // Get the output buffer.
-        ThrowIfError(pOutputSamples[0].pSample->GetBufferByIndex(0, &spOutput));
+        ThrowIfError(spOutputSample->GetBufferByIndex(0, &spOutput));
         ThrowIfError(spOutput->GetMaxLength(&cbData));
 
         if (cbData < m_cbImageSize)
@@ -864,7 +869,13 @@ HRESULT CDecoder::ProcessOutput(
             throw ref new InvalidArgumentException();
         }
 
-        InternalProcessOutput(pOutputSamples[0].pSample, spOutput.Get());
+        InternalProcessOutput(spOutputSample.Get(), spOutput.Get());
+
+        // Return the sample that we provided. The client releases it.
+        if (pOutputSamples[0].pSample == nullptr)
+        {
+            pOutputSamples[0].pSample = spOutputSample.Detach();
+        }
 
         //  Update our state
         m_fPicture = false;
@@ -1067,6 +1078,7 @@ void CDecoder::OnCheckOutputType(IMFMediaType *pmt)
 
 void CDecoder::OnSetOutputType(IMFMediaType *pmt)
 {
+    m_outputSamples.Uninitialize();
     m_spOutputType = pmt;
 }
 
@@ -1079,7 +1091,7 @@ void CDecoder::AllocateStreamingResources()
 
 void CDecoder::FreeStreamingResources()
 {
-
+    m_outputSamples.Uninitialize();
 }
 
 void CDecoder::OnDiscontinuity()
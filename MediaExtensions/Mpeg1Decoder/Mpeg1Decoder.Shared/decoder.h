@@ -14,6 +14,7 @@
 
 #pragma once
 #include <CritSec.h>
+#include <OutputSamplePool.h>
 
 const DWORD MPEG1_VIDEO_SEQ_HEADER_MIN_SIZE = 12;       // Minimum length of the video sequence header.
 static const REFERENCE_TIME INVALID_TIME = _I64_MAX;    //  Not really invalid but unlikely enough for sample code.
@@ -270,4 +271,6 @@ protected:
     CStreamState m_StreamState;
     bool m_fPicture;
     bool m_fLowLatencyMode;
+
+    OutputSamplePool m_outputSamples;       // Output samples that the decoder provides.
 };
@@ -17,6 +17,8 @@
 #include "MPEG1ByteStreamHandler.h"
 #include <wrl\module.h>
 
+using namespace Windows::Foundation::Collections;
+
 ActivatableClass(CMPEG1ByteStreamHandler);
 
 //-------------------------------------------------------------------
@@ -27,6 +29,8 @@ ActivatableClass(CMPEG1ByteStreamHandler);
 //-------------------------------------------------------------------
 
 CMPEG1ByteStreamHandler::CMPEG1ByteStreamHandler()
+    : m_fVideoFraming(false)
+    , m_cbQueueBudget(DEFAULT_QUEUE_BUDGET)
 {
 }
 
@@ -45,10 +49,41 @@ CMPEG1ByteStreamHandler::~CMPEG1ByteStreamHandler()
 //-------------------------------------------------------------------
 // SetProperties
 // Sets the configuration of the media byte stream handler
+//
+// "VideoFraming" (Boolean): If true, the source delivers one video
+// sample per coded picture, with the picture type and temporal
+// reference attached as sample attributes.
+//
+// "QueueMemoryBudget" (UInt32): Total number of bytes the source's
+// streams may hold in their sample queues.
 //-------------------------------------------------------------------
 IFACEMETHODIMP CMPEG1ByteStreamHandler::SetProperties (ABI::Windows::Foundation::Collections::IPropertySet *pConfiguration)
 {
-    return S_OK;
+    HRESULT hr = S_OK;
+
+    try
+    {
+        if (pConfiguration != nullptr)
+        {
+            IPropertySet ^configuration = reinterpret_cast<IPropertySet^>(pConfiguration);
+
+            if (configuration->HasKey(L"VideoFraming"))
+            {
+                m_fVideoFraming = safe_cast<bool>(configuration->Lookup(L"VideoFraming"));
+            }
+
+            if (configuration->HasKey(L"QueueMemoryBudget"))
+            {
+                m_cbQueueBudget = safe_cast<UINT32>(configuration->Lookup(L"QueueMemoryBudget"));
+            }
+        }
+    }
+    catch (Exception ^exc)
+    {
+        hr = exc->HResult;
+    }
+
+    return hr;
 }
 
 //-------------------------------------------------------------------
@@ -90,6 +125,8 @@ HRESULT CMPEG1ByteStreamHandler::BeginCreateObject(
 
         ComPtr<IMFAsyncResult> spResult;
         ComPtr<CMPEG1Source> spSource = CMPEG1Source::CreateInstance();
+        spSource->SetVideoFraming(m_fVideoFraming);
+        spSource->SetQueueBudget(m_cbQueueBudget);
 
         ComPtr<IUnknown> spSourceUnk;
         ThrowIfError(spSource.As(&spSourceUnk));
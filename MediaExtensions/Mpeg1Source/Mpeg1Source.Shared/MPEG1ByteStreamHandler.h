@@ -63,4 +63,8 @@ public:
 
     STDMETHODIMP CancelObjectCreation(IUnknown *pIUnknownCancelCookie);
     STDMETHODIMP GetMaxNumberOfBytesRequiredForResolution(QWORD *pqwBytes);
+
+private:
+    bool m_fVideoFraming;   // Deliver video as one sample per coded picture.
+    DWORD m_cbQueueBudget;  // Memory budget for the source's sample queues, in bytes.
 };
@@ -0,0 +1,794 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MPEG1ParseCore.cpp
+// Portable MPEG-1 systems-layer parsing code, with MPEG-2 program
+// stream support.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Note: This file does not use the precompiled header, so that it can be
+// built outside of the Windows project.
+#include "MPEG1ParseCore.h"
+
+
+//-------------------------------------------------------------------
+// MPEG1SystemsParser class
+//-------------------------------------------------------------------
+
+
+MPEG1SystemsParser::MPEG1SystemsParser()
+    : m_SCR(0)
+    , m_muxRate(0)
+    , m_bMPEG2(false)
+    , m_bHasPacketHeader(false)
+    , m_bEOS(false)
+{
+    memset(&m_curPacketHeader, 0, sizeof(m_curPacketHeader));
+}
+
+
+//-------------------------------------------------------------------
+// ParseBytes
+// Parses as much data as possible from the pData buffer, and returns
+// the amount of data parsed in pAte (*pAte <= cbLen).
+//
+// Return values:
+//      MPEG1_PARSE_OK: The method consumed some data (*pAte > 0).
+//      MPEG1_PARSE_NEED_MORE_DATA: The method did not consume any
+//          data (*pAte == 0). The caller must pass in more data.
+//      Other values: The stream is not valid.
+//-------------------------------------------------------------------
+
+MPEG1ParseStatus MPEG1SystemsParser::ParseBytes(const BYTE *pData, DWORD cbLen, DWORD *pAte)
+{
+    *pAte = 0;
+
+    if (cbLen < 4)
+    {
+        return MPEG1_PARSE_NEED_MORE_DATA;
+    }
+
+    DWORD cbLengthToStartCode = 0;  // How much we skip to reach the next start code.
+    DWORD cbParsed = 0;             // How much we parse after the start code.
+
+    m_bHasPacketHeader = false;
+
+    MPEG1ParseStatus status = MPEG1FindNextStartCode(pData, cbLen, &cbLengthToStartCode);
+
+    if (status == MPEG1_PARSE_OK)
+    {
+        cbLen -= cbLengthToStartCode;
+        pData += cbLengthToStartCode;
+
+        switch (MAKE_DWORD(pData))
+        {
+        case MPEG1_PACK_START_CODE:
+            // Start of pack.
+            status = ParsePackHeader(pData, cbLen, &cbParsed);
+            break;
+
+        case MPEG1_SYSTEM_HEADER_CODE:
+            // Start of system header.
+            status = ParseSystemHeader(pData, cbLen, &cbParsed);
+            break;
+
+        case MPEG1_STOP_CODE:
+            // Stop code, end of stream.
+            cbParsed = sizeof(DWORD);
+            OnEndOfStream();
+            break;
+
+        default:
+            // Start of packet.
+            status = ParsePacketHeader(pData, cbLen, &cbParsed);
+            break;
+        }
+    }
+
+    if (status == MPEG1_PARSE_OK)
+    {
+        *pAte = cbLengthToStartCode + cbParsed;
+    }
+    return status;
+}
+
+
+//-------------------------------------------------------------------
+// ParsePackHeader
+// Parses the start of a pack.
+//
+// The bits after the pack start code are '0010' for an MPEG-1 pack
+// and '01' for an MPEG-2 program stream pack.
+//-------------------------------------------------------------------
+
+MPEG1ParseStatus MPEG1SystemsParser::ParsePackHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte)
+{
+    if (cbLen < MPEG1_PACK_HEADER_SIZE)
+    {
+        return MPEG1_PARSE_NEED_MORE_DATA;
+    }
+
+    if ((pData[4] & 0xC0) == 0x40)
+    {
+        return ParseMPEG2PackHeader(pData, cbLen, pAte);
+    }
+
+    // Check marker bits
+    if ( ((pData[4] & 0xF1) != 0x21) ||
+        ((pData[6] & 0x01) != 0x01) ||
+        ((pData[8] & 0x01) != 0x01) ||
+        ((pData[9] & 0x80) != 0x80) ||
+        ((pData[11] & 0x01) != 0x01) )
+    {
+        return MPEG1_PARSE_INVALID_FORMAT;
+    }
+
+    // Calculate the SCR.
+    LONGLONG scr = ( (pData[8] & 0xFE) >> 1) |
+        ( (pData[7]) << 7) |
+        ( (pData[6] & 0xFE) << 14) |
+        ( (pData[5]) << 22) |
+        ( static_cast<LONGLONG>(pData[4] & 0x0E) << 29);
+
+    DWORD muxRate = ( (pData[11] & 0xFE) >> 1) |
+        ( (pData[10]) << 7) |
+        ( (pData[9] & 0x7F) << 15);
+
+    m_SCR = scr;
+    m_muxRate = muxRate;
+    m_bMPEG2 = false;
+
+    *pAte = MPEG1_PACK_HEADER_SIZE;
+
+    return MPEG1_PARSE_OK;
+}
+
+
+//-------------------------------------------------------------------
+// ParseMPEG2PackHeader
+// Parses the start of an MPEG-2 program stream pack.
+//
+// See ISO/IEC 13818-1, sec 2.5.3.3
+//-------------------------------------------------------------------
+
+MPEG1ParseStatus MPEG1SystemsParser::ParseMPEG2PackHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte)
+{
+    if (cbLen < MPEG2_PACK_HEADER_MIN_SIZE)
+    {
+        return MPEG1_PARSE_NEED_MORE_DATA;
+    }
+
+    // Check marker bits
+    if ( ((pData[4] & 0x04) != 0x04) ||
+        ((pData[6] & 0x04) != 0x04) ||
+        ((pData[8] & 0x04) != 0x04) ||
+        ((pData[9] & 0x01) != 0x01) ||
+        ((pData[12] & 0x03) != 0x03) )
+    {
+        return MPEG1_PARSE_INVALID_FORMAT;
+    }
+
+    // The pack header ends with up to 7 stuffing bytes.
+    DWORD cbHeader = MPEG2_PACK_HEADER_MIN_SIZE + (pData[13] & 0x07);
+
+    if (cbLen < cbHeader)
+    {
+        return MPEG1_PARSE_NEED_MORE_DATA;
+    }
+
+    // Calculate the SCR. We keep the 33-bit base (90 kHz clock) and
+    // ignore the 27 MHz extension.
+    LONGLONG scr = ( (pData[8] & 0xF8) >> 3) |
+        ( (pData[7]) << 5) |
+        ( (pData[6] & 0x03) << 13) |
+        ( (pData[6] & 0xF8) << 12) |
+        ( (pData[5]) << 20) |
+        ( static_cast<LONGLONG>(pData[4] & 0x03) << 28) |
+        ( static_cast<LONGLONG>(pData[4] & 0x38) << 27);
+
+    DWORD muxRate = ( (pData[12] & 0xFC) >> 2) |
+        ( (pData[11]) << 6) |
+        ( (pData[10]) << 14);
+
+    m_SCR = scr;
+    m_muxRate = muxRate;
+    m_bMPEG2 = true;
+
+    *pAte = cbHeader;
+
+    return MPEG1_PARSE_OK;
+}
+
+
+//-------------------------------------------------------------------
+// ParseSystemHeader.
+// Parses the MPEG-1 system header.
+//
+// NOTES:
+// The system header optionally appears after the pack header.
+// The first pack must contain a system header.
+// Subsequent packs may contain a system header.
+//-------------------------------------------------------------------
+
+MPEG1ParseStatus MPEG1SystemsParser::ParseSystemHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte)
+{
+    if (cbLen < MPEG1_SYSTEM_HEADER_MIN_SIZE)
+    {
+        return MPEG1_PARSE_NEED_MORE_DATA;
+    }
+
+    // Find the total header length.
+    DWORD cbHeaderLen = MPEG1_SYSTEM_HEADER_PREFIX + MAKE_WORD(pData[4], pData[5]);
+
+    if (cbHeaderLen < MPEG1_SYSTEM_HEADER_MIN_SIZE)
+    {
+        return MPEG1_PARSE_INVALID_FORMAT;
+    }
+
+    if (cbLen < cbHeaderLen)
+    {
+        return MPEG1_PARSE_NEED_MORE_DATA;
+    }
+
+    // We have enough data to parse the header.
+
+    // Did we already see a system header?
+    if (!HasSystemHeader())
+    {
+        // This is the first time we've seen the header. Parse it.
+
+        // Calculate the number of stream info's in the header.
+        DWORD cStreamInfo = (cbHeaderLen - MPEG1_SYSTEM_HEADER_MIN_SIZE) / MPEG1_SYSTEM_HEADER_STREAM;
+
+        // Calculate the structure size.
+        DWORD cbSize = sizeof(MPEG1SystemHeader);
+        if (cStreamInfo > 1)
+        {
+            cbSize += sizeof(MPEG1StreamHeader) * (cStreamInfo - 1);
+        }
+
+        // Check marker bits
+        if (((pData[6] & 0x80) != 0x80) ||
+            ((pData[8] & 0x01) != 0x01) ||
+            ((pData[10] & 0x20) != 0x20) ||
+            (pData[11] != 0xFF))
+        {
+            return MPEG1_PARSE_INVALID_FORMAT;
+        }
+
+        std::vector<BYTE> header(cbSize, 0);
+        MPEG1SystemHeader *pHeader = reinterpret_cast<MPEG1SystemHeader*>(&header[0]);
+
+        pHeader->cbSize = cbSize;
+        pHeader->rateBound = ((pData[6] & 0x7F) << 16) | (pData[7] << 8) | (pData[8] >> 1);
+        pHeader->cAudioBound = pData[9] >> 2;
+        pHeader->bFixed = HAS_FLAG(pData[9], 0x02);
+        pHeader->bCSPS = HAS_FLAG(pData[9], 0x01);
+        pHeader->bAudioLock = HAS_FLAG(pData[10], 0x80);
+        pHeader->bVideoLock = HAS_FLAG(pData[10], 0x40);
+        pHeader->cVideoBound = pData[10] & 0x1F;
+        pHeader->cStreams = cStreamInfo;
+
+        // Parse the stream information.
+        const BYTE *pStreamInfo = pData + MPEG1_SYSTEM_HEADER_MIN_SIZE;
+
+        for (DWORD i = 0; i < cStreamInfo; i++)
+        {
+            MPEG1ParseStatus status = MPEG1ParseStreamData(pStreamInfo, pHeader->streams[i]);
+            if (status != MPEG1_PARSE_OK)
+            {
+                return status;
+            }
+
+            pStreamInfo += MPEG1_SYSTEM_HEADER_STREAM;
+        }
+
+        // Keep the header only if all of it is valid.
+        m_header.swap(header);
+    }
+
+    *pAte = cbHeaderLen;
+
+    return MPEG1_PARSE_OK;
+}
+
+
+//-------------------------------------------------------------------
+// ParsePacketHeader
+//
+// Parses the packet header.
+//
+// If the method returns MPEG1_PARSE_OK, then HasPacket() returns true
+// and the caller can start parsing the packet.
+//
+// Packets in an MPEG-2 program stream use the PES header syntax
+// (ISO/IEC 13818-1, sec 2.4.3.6), which starts with the bits '10'.
+// That syntax is only accepted after an MPEG-2 pack header; in an
+// MPEG-1 pack, '10' is not a valid header field.
+//-------------------------------------------------------------------
+
+MPEG1ParseStatus MPEG1SystemsParser::ParsePacketHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte)
+{
+    if (!HasSystemHeader())
+    {
+        return MPEG1_PARSE_NO_SYSTEM_HEADER; // We should not get a packet before the first system header.
+    }
+
+    if (cbLen < MPEG1_PACKET_HEADER_MIN_SIZE)
+    {
+        return MPEG1_PARSE_NEED_MORE_DATA;
+    }
+
+    // Before we parse anything else in the packet header, look for the header length.
+    DWORD cbPacketLen = MAKE_WORD(pData[4], pData[5]) + MPEG1_PACKET_HEADER_MIN_SIZE;
+
+    // We want enough data for the maximum packet header OR the total packet size, whichever is less.
+    if (cbLen < cbPacketLen && cbLen < MPEG1_PACKET_HEADER_MAX_SIZE)
+    {
+        return MPEG1_PARSE_NEED_MORE_DATA;
+    }
+
+    // Make sure the start code is 0x000001xx
+    if ((MAKE_DWORD(pData) & 0xFFFFFF00) != MPEG1_START_CODE_PREFIX)
+    {
+        return MPEG1_PARSE_INVALID_FORMAT;
+    }
+
+    BYTE id = 0;
+    StreamType type = StreamType_Unknown;
+    BYTE num = 0;
+    bool bHasPTS = false;
+    bool bHasDTS = false;
+
+    memset(&m_curPacketHeader, 0, sizeof(m_curPacketHeader));
+
+    // Find the stream ID.
+    id = pData[3];
+    MPEG1ParseStatus status = MPEG1ParseStreamId(id, &type, &num);
+    if (status != MPEG1_PARSE_OK)
+    {
+        return status;
+    }
+
+    DWORD cbLeft = cbPacketLen - MPEG1_PACKET_HEADER_MIN_SIZE;
+    pData = pData + MPEG1_PACKET_HEADER_MIN_SIZE;
+    LONGLONG pts = 0;
+    LONGLONG dts = 0;
+
+    if (m_bMPEG2 && !MPEG2HasPESHeader(id))
+    {
+        // The rest of the packet is payload (or padding bytes).
+    }
+    else if (m_bMPEG2 && (cbLeft > 0) && ((*pData & 0xC0) == 0x80))
+    {
+        // MPEG-2 PES header:
+        // '10' + flags (1 byte)
+        // PTS_DTS_flags + flags (1 byte)
+        // PES_header_data_length (1 byte)
+        // PES_header_data_length bytes: PTS, DTS, other fields, stuffing
+        if (cbLeft < MPEG2_PES_HEADER_MIN_SIZE - MPEG1_PACKET_HEADER_MIN_SIZE)
+        {
+            return MPEG1_PARSE_INVALID_FORMAT;
+        }
+
+        DWORD cbHeaderData = pData[2];
+        DWORD cbHeader = (MPEG2_PES_HEADER_MIN_SIZE - MPEG1_PACKET_HEADER_MIN_SIZE) + cbHeaderData;
+
+        if (cbLeft < cbHeader)
+        {
+            return MPEG1_PARSE_INVALID_FORMAT;
+        }
+
+        // The header can be longer than MPEG1_PACKET_HEADER_MAX_SIZE.
+        if (cbLen < MPEG1_PACKET_HEADER_MIN_SIZE + cbHeader)
+        {
+            return MPEG1_PARSE_NEED_MORE_DATA;
+        }
+
+        BYTE ptsDtsFlags = pData[1] >> 6;
+        const BYTE *pHeaderData = pData + 3;
+
+        if (ptsDtsFlags == 0x02)
+        {
+            // PTS only
+            if ((cbHeaderData < 5) || ((pHeaderData[0] & 0xF0) != 0x20))
+            {
+                return MPEG1_PARSE_INVALID_FORMAT;
+            }
+
+            status = MPEG1ParsePTS(pHeaderData, &pts);
+            bHasPTS = true;
+        }
+        else if (ptsDtsFlags == 0x03)
+        {
+            // PTS + DTS
+            if ((cbHeaderData < 10) ||
+                ((pHeaderData[0] & 0xF0) != 0x30) ||
+                ((pHeaderData[5] & 0xF0) != 0x10))
+            {
+                return MPEG1_PARSE_INVALID_FORMAT;
+            }
+
+            status = MPEG1ParsePTS(pHeaderData, &pts);
+            bHasPTS = true;
+
+            if (status == MPEG1_PARSE_OK)
+            {
+                status = MPEG1ParsePTS(pHeaderData + 5, &dts);
+                bHasDTS = true;
+            }
+        }
+        else if (ptsDtsFlags == 0x01)
+        {
+            return MPEG1_PARSE_INVALID_FORMAT; // Forbidden value.
+        }
+
+        pData += cbHeader;
+        cbLeft -= cbHeader;
+    }
+    else
+    {
+        DWORD cbPadding = 0;
+
+        // Go past the stuffing bytes. Stop as soon as there are too many, so that
+        // we never read past the maximum header size.
+        while ((cbLeft > 0) && (*pData == 0xFF) && (cbPadding <= MPEG1_PACKET_HEADER_MAX_STUFFING_BYTE))
+        {
+            ++pData;
+            --cbLeft;
+            ++cbPadding;
+        }
+
+        // Check for invalid number of stuffing bytes.
+        if (cbPadding > MPEG1_PACKET_HEADER_MAX_STUFFING_BYTE)
+        {
+            return MPEG1_PARSE_INVALID_FORMAT;
+        }
+
+        // The next bits are:
+        // (optional) STD buffer size (2 bytes)
+        // union
+        // {
+        //      PTS (5 bytes)
+        //      PTS + DTS (10 bytes)
+        //      '0000 1111' (1 bytes)
+        // }
+
+        if (cbLeft < 1)
+        {
+            return MPEG1_PARSE_INVALID_FORMAT;
+        }
+
+        if ((*pData & 0xC0) == 0x40)
+        {
+            // Skip STD buffer size.
+            if (cbLeft < 2)
+            {
+                return MPEG1_PARSE_INVALID_FORMAT;
+            }
+            pData += 2;
+            cbLeft -= 2;
+        }
+
+        if (cbLeft < 1)
+        {
+            return MPEG1_PARSE_INVALID_FORMAT;
+        }
+
+        if ((*pData & 0xF1) == 0x21)
+        {
+            // PTS
+            if (cbLeft < 5)
+            {
+                return MPEG1_PARSE_INVALID_FORMAT;
+            }
+
+            status = MPEG1ParsePTS(pData, &pts);
+            bHasPTS = true;
+
+            pData += 5;
+            cbLeft -= 5;
+        }
+        else if ((*pData & 0xF1) == 0x31)
+        {
+            // PTS + DTS
+            if (cbLeft < 10)
+            {
+                return MPEG1_PARSE_INVALID_FORMAT;
+            }
+
+            // The DTS uses the same 33-bit layout as the PTS, with a '0001' prefix.
+            if ((pData[5] & 0xF1) != 0x11)
+            {
+                return MPEG1_PARSE_INVALID_FORMAT;
+            }
+
+            status = MPEG1ParsePTS(pData, &pts);
+            bHasPTS = true;
+
+            if (status == MPEG1_PARSE_OK)
+            {
+                status = MPEG1ParsePTS(pData + 5, &dts);
+                bHasDTS = true;
+            }
+
+            pData += 10;
+            cbLeft -= 10;
+        }
+        else if ((*pData) == 0x0F)
+        {
+            pData += 1;
+            cbLeft -= 1;
+        }
+        else
+        {
+            return MPEG1_PARSE_INVALID_FORMAT; // Unexpected bit field
+        }
+    }
+
+    if (status != MPEG1_PARSE_OK)
+    {
+        return status;
+    }
+
+    m_curPacketHeader.stream_id = id;
+    m_curPacketHeader.type = type;
+    m_curPacketHeader.number = num;
+    m_curPacketHeader.cbPacketSize = cbPacketLen;
+    m_curPacketHeader.cbPayload = cbLeft;
+    m_curPacketHeader.bHasPTS = bHasPTS;
+    m_curPacketHeader.PTS = pts;
+    m_curPacketHeader.bHasDTS = bHasDTS;
+    m_curPacketHeader.DTS = dts;
+
+    // Client can read the packet now.
+    m_bHasPacketHeader = true;
+
+    *pAte = cbPacketLen - cbLeft;
+
+    return MPEG1_PARSE_OK;
+}
+
+
+//-------------------------------------------------------------------
+// OnEndOfStream
+// Called when the parser reaches the MPEG-1 stop code.
+//
+// Note: Obviously the parser is not guaranteed to see a stop code
+// before the client reaches the end of the source data. The client
+// must be prepared to handle that case.
+//-------------------------------------------------------------------
+
+void MPEG1SystemsParser::OnEndOfStream()
+{
+    m_bEOS = true;
+    ClearPacket();
+}
+
+
+//-------------------------------------------------------------------
+// Static functions
+//-------------------------------------------------------------------
+
+
+//-------------------------------------------------------------------
+// MPEG1FindNextStartCode
+// Looks for the next start code in the buffer.
+//
+// pData: Pointer to the buffer.
+// cbLen: Size of the buffer.
+// pAte: Receives the number of bytes *before *the start code.
+//
+// If no start code is found, the function returns
+// MPEG1_PARSE_NEED_MORE_DATA.
+//-------------------------------------------------------------------
+
+MPEG1ParseStatus MPEG1FindNextStartCode(const BYTE *pData, DWORD cbLen, DWORD *pAte)
+{
+    MPEG1ParseStatus status = MPEG1_PARSE_NEED_MORE_DATA;
+
+    DWORD cbLeft = cbLen;
+
+    while (cbLeft > 4)
+    {
+        if ((pData[0] == 0x00) && (pData[1] == 0x00) && (pData[2] == 0x01))
+        {
+            status = MPEG1_PARSE_OK;
+            break;
+        }
+
+        cbLeft -= 4;
+        pData += 4;
+    }
+    *pAte = (cbLen - cbLeft);
+    return status;
+}
+
+
+//-------------------------------------------------------------------
+// MPEG1ParsePTS
+// Parse a 33-bit Presentation Time Stamp (PTS) or Decoding Time
+// Stamp (DTS).
+//
+// The caller checks the 4-bit prefix: '0010' or '0011' for a PTS,
+// '0001' for a DTS.
+//-------------------------------------------------------------------
+
+MPEG1ParseStatus MPEG1ParsePTS(const BYTE *pData, LONGLONG *pPTS)
+{
+    BYTE byte1 = pData[0];
+    WORD word1 = MAKE_WORD(pData[1], pData[2]);
+    WORD word2 = MAKE_WORD(pData[3], pData[4]);
+
+    // Check marker bits.
+    if (((byte1 & 0x01) != 0x01) ||
+        ((word1 & 0x01) != 0x01) ||
+        ((word2 & 0x01) != 0x01) )
+    {
+        return MPEG1_PARSE_INVALID_FORMAT;
+    }
+
+    // The PTS is 33 bits: bits 32..30 come from byte1, 29..15 from word1,
+    // and 14..0 from word2.
+    *pPTS = (static_cast<LONGLONG>(byte1 & 0x0E) << 29) |
+        (static_cast<LONGLONG>(word1 & 0xFFFE) << 14) |
+        (static_cast<LONGLONG>(word2) >> 1);
+
+    return MPEG1_PARSE_OK;
+}
+
+
+//-------------------------------------------------------------------
+// MPEG2HasPESHeader
+// Returns true if packets with this stream ID carry the PES header
+// fields (flags, time stamps) in an MPEG-2 program stream.
+//
+// See ISO/IEC 13818-1, sec 2.4.3.6
+//-------------------------------------------------------------------
+
+bool MPEG2HasPESHeader(BYTE id)
+{
+    switch (id)
+    {
+    case MPEG1_STREAMTYPE_RESERVED:     // program_stream_map
+    case MPEG1_STREAMTYPE_PADDING:
+    case MPEG1_STREAMTYPE_PRIVATE2:
+    case MPEG2_STREAMTYPE_ECM:
+    case MPEG2_STREAMTYPE_EMM:
+    case MPEG2_STREAMTYPE_DSMCC:
+    case MPEG2_STREAMTYPE_H222_TYPE_E:
+    case MPEG2_STREAMTYPE_DIRECTORY:
+        return false;
+
+    default:
+        return true;
+    }
+}
+
+
+//-------------------------------------------------------------------
+// MPEG1ParseStreamData
+// Parses the stream information (for one stream) in the system
+// header.
+//-------------------------------------------------------------------
+
+MPEG1ParseStatus MPEG1ParseStreamData(const BYTE *pStreamInfo, MPEG1StreamHeader &header)
+{
+    // Check marker bits.
+    if ( (pStreamInfo[1] & 0xC0) != 0xC0 )
+    {
+        return MPEG1_PARSE_INVALID_FORMAT; // Invalid bits
+    }
+
+    BYTE id = 0;
+    BYTE num = 0;
+    DWORD bound = 0;
+    StreamType type = StreamType_Unknown;
+
+    // The id is a stream code plus (for some types) a stream number, bitwise-OR'd.
+
+    id = pStreamInfo[0];
+
+    MPEG1ParseStatus status = MPEG1ParseStreamId(id, &type, &num);
+    if (status != MPEG1_PARSE_OK)
+    {
+        return status;
+    }
+
+    // Calculate STD bound.
+    bound = pStreamInfo[2] | ((pStreamInfo[1] & 0x1F) << 8);
+
+    if (pStreamInfo[1] & 0x20)
+    {
+        bound *= 1024;
+    }
+    else
+    {
+        bound *= 128;
+    }
+
+    header.stream_id = id;
+    header.type = type;
+    header.number = num;
+    header.sizeBound = bound;
+
+    return MPEG1_PARSE_OK;
+}
+
+
+//-------------------------------------------------------------------
+// MPEG1ParseStreamId
+// Parses an MPEG-1 stream ID.
+//
+// Note:
+// The id is a stream code, plus (for some types) a stream number,
+// bitwise-OR'd. This function returns the type and the stream number.
+//
+// See ISO/EIC 11172-1, sec 2.4.4.2
+//-------------------------------------------------------------------
+
+MPEG1ParseStatus MPEG1ParseStreamId(BYTE id, StreamType *pType, BYTE *pStreamNum)
+{
+    StreamType type = StreamType_Unknown;
+    BYTE num = 0;
+
+    switch (id)
+    {
+    case MPEG1_STREAMTYPE_ALL_AUDIO:
+        type = StreamType_AllAudio;
+        break;
+
+    case MPEG1_STREAMTYPE_ALL_VIDEO:
+        type = StreamType_AllVideo;
+        break;
+
+    case MPEG1_STREAMTYPE_RESERVED:
+        type = StreamType_Reserved;
+        break;
+
+    case MPEG1_STREAMTYPE_PRIVATE1:
+        type = StreamType_Private1;
+        break;
+
+    case MPEG1_STREAMTYPE_PADDING:
+        type = StreamType_Padding;
+        break;
+
+    case MPEG1_STREAMTYPE_PRIVATE2:
+        type = StreamType_Private2;
+        break;
+
+    default:
+        if ((id & 0xE0) == MPEG1_STREAMTYPE_AUDIO_MASK)
+        {
+            type = StreamType_Audio;
+            num = id & 0x1F;
+        }
+        else if ((id & 0xF0) == MPEG1_STREAMTYPE_VIDEO_MASK)
+        {
+            type = StreamType_Video;
+            num = id & 0x0F;
+        }
+        else if ((id & 0xF0) == MPEG1_STREAMTYPE_DATA_MASK)
+        {
+            type = StreamType_Data;
+            num = id & 0x0F;
+        }
+        else
+        {
+            return MPEG1_PARSE_INVALID_FORMAT; // Unknown stream ID code.
+        }
+    }
+
+    *pType = type;
+    *pStreamNum = num;
+
+    return MPEG1_PARSE_OK;
+}
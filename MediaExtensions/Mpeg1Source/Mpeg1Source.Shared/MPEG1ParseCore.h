@@ -0,0 +1,230 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MPEG1ParseCore.h
+// Portable MPEG-1 systems-layer parsing code (pack, system header and
+// packet headers). Also parses MPEG-2 program stream pack and PES
+// headers.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Note: This header and MPEG1ParseCore.cpp do not depend on C++/CX, COM, or
+// Media Foundation, so they can be compiled on any platform with a standard
+// C++ compiler. Errors are returned as MPEG1ParseStatus codes instead of
+// exceptions. The Parser class in Parse.h wraps this code for the source.
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <stdint.h>
+
+typedef uint8_t     BYTE;
+typedef uint16_t    WORD;
+typedef uint32_t    DWORD;
+typedef int64_t     LONGLONG;
+#endif
+
+#include <string.h>
+#include <vector>
+
+// Sizes
+const DWORD MPEG1_MAX_PACKET_SIZE = 65535 + 6;          // Maximum packet size.
+const DWORD MPEG1_PACK_HEADER_SIZE = 12;                // Pack header.
+
+const DWORD MPEG1_SYSTEM_HEADER_MIN_SIZE = 12;          // System header, excluding the stream info.
+const DWORD MPEG1_SYSTEM_HEADER_PREFIX = 6;             // This value + header length = total size of the system header.
+const DWORD MPEG1_SYSTEM_HEADER_STREAM = 3;             // Size of each stream info in the system header.
+
+const DWORD MPEG1_PACKET_HEADER_MIN_SIZE = 6;           // Minimum amount to read in the packet header. (Up to the variable-sized padding bytes)
+const DWORD MPEG1_PACKET_HEADER_MAX_STUFFING_BYTE = 16; // Maximum number of stuffing bytes in a packet header.
+const DWORD MPEG1_PACKET_HEADER_MAX_SIZE = 34;          // Maximum size of a packet header.
+
+const DWORD MPEG2_PACK_HEADER_MIN_SIZE = 14;            // MPEG-2 pack header, excluding the stuffing bytes.
+const DWORD MPEG2_PES_HEADER_MIN_SIZE = 9;              // MPEG-2 PES header, up to and including PES_header_data_length.
+const DWORD MPEG2_PES_HEADER_MAX_SIZE = 9 + 255;        // Maximum size of an MPEG-2 PES header.
+
+
+// Codes
+const DWORD MPEG1_START_CODE_PREFIX     = 0x00000100;
+const DWORD MPEG1_PACK_START_CODE       = 0x000001BA;
+const DWORD MPEG1_SYSTEM_HEADER_CODE    = 0x000001BB;
+const DWORD MPEG1_SEQUENCE_HEADER_CODE  = 0x000001B3;
+const DWORD MPEG1_SEQUENCE_END_CODE     = 0x000001B7;
+const DWORD MPEG1_GOP_START_CODE        = 0x000001B8;
+const DWORD MPEG1_PICTURE_START_CODE    = 0x00000100;
+const DWORD MPEG1_SLICE_START_CODE      = 0x00000101;    // First slice start code. The last is 0x000001AF.
+const DWORD MPEG1_USER_DATA_START_CODE  = 0x000001B2;
+const DWORD MPEG1_STOP_CODE             = 0x000001B9;
+const DWORD MPEG2_EXTENSION_START_CODE  = 0x000001B5;
+
+// Stream ID codes
+const BYTE MPEG1_STREAMTYPE_ALL_AUDIO = 0xB8;
+const BYTE MPEG1_STREAMTYPE_ALL_VIDEO = 0xB9;
+const BYTE MPEG1_STREAMTYPE_RESERVED = 0xBC;
+const BYTE MPEG1_STREAMTYPE_PRIVATE1 = 0xBD;
+const BYTE MPEG1_STREAMTYPE_PADDING = 0xBE;
+const BYTE MPEG1_STREAMTYPE_PRIVATE2 = 0xBF;
+const BYTE MPEG1_STREAMTYPE_AUDIO_MASK = 0xC0;
+const BYTE MPEG1_STREAMTYPE_VIDEO_MASK = 0xE0;
+const BYTE MPEG1_STREAMTYPE_DATA_MASK = 0xF0;
+
+// MPEG-2 stream IDs whose packets have no PES header extension.
+const BYTE MPEG2_STREAMTYPE_ECM = 0xF0;
+const BYTE MPEG2_STREAMTYPE_EMM = 0xF1;
+const BYTE MPEG2_STREAMTYPE_DSMCC = 0xF2;
+const BYTE MPEG2_STREAMTYPE_H222_TYPE_E = 0xF8;
+const BYTE MPEG2_STREAMTYPE_DIRECTORY = 0xFF;
+
+
+// HAS_FLAG: Test if 'b' contains a specified bit flag
+#define HAS_FLAG(b, flag) (((b) & (flag)) == (flag))
+
+// MAKE_WORD: Convert two bytes into a WORD
+inline WORD MAKE_WORD(BYTE b1, BYTE b2)
+{
+    return static_cast<WORD>((b1 << 8) | b2);
+}
+
+// MAKE_DWORD:
+// Convert the first 4 bytes of an array into a DWORD in MPEG-1 stream byte order.
+inline DWORD MAKE_DWORD(const BYTE *pData)
+{
+    return (static_cast<DWORD>(pData[0]) << 24) |
+        (static_cast<DWORD>(pData[1]) << 16) |
+        (static_cast<DWORD>(pData[2]) << 8) |
+        static_cast<DWORD>(pData[3]);
+}
+
+
+// Result of a parsing function.
+enum MPEG1ParseStatus
+{
+    MPEG1_PARSE_OK = 0,             // The data was parsed.
+    MPEG1_PARSE_NEED_MORE_DATA,     // Not enough data yet. Nothing was consumed.
+    MPEG1_PARSE_INVALID_FORMAT,     // The data is not a valid MPEG-1 system stream or MPEG-2 program stream.
+    MPEG1_PARSE_NO_SYSTEM_HEADER    // A packet was found before the first system header.
+};
+
+
+// Systems layer
+
+enum StreamType
+{
+    StreamType_Unknown,
+    StreamType_AllAudio,
+    StreamType_AllVideo,
+    StreamType_Reserved,
+    StreamType_Private1,
+    StreamType_Padding,
+    StreamType_Private2,
+    StreamType_Audio,   // ISO/IEC 11172-3
+    StreamType_Video,   // ISO/IEC 11172-2
+    StreamType_Data
+};
+
+struct MPEG1StreamHeader
+{
+    BYTE        stream_id;  // Raw stream_id field.
+    StreamType  type;       // Stream type (audio, video, etc)
+    BYTE        number;     // Index within the stream type (audio 0, audio 1, etc)
+    DWORD       sizeBound;
+};
+
+// MPEG1SystemHeader
+// Holds information from the system header. This structure is variable
+// length, because the last field is an array of stream headers.
+struct MPEG1SystemHeader
+{
+    DWORD   cbSize;     // Size of this structure, including the streams array.
+    DWORD   rateBound;
+    BYTE    cAudioBound;
+    bool    bFixed;
+    bool    bCSPS;
+    bool    bAudioLock;
+    bool    bVideoLock;
+    BYTE    cVideoBound;
+    DWORD   cStreams;
+    MPEG1StreamHeader streams[1];   // Array of 1 or more stream headers.
+};
+
+struct MPEG1PacketHeader
+{
+    BYTE        stream_id;      // Raw stream_id field.
+    StreamType  type;           // Stream type (audio, video, etc)
+    BYTE        number;         // Index within the stream type (audio 0, audio 1, etc)
+    DWORD       cbPacketSize;   // Size of the entire packet (header + payload).
+    DWORD       cbPayload;      // Size of the packet payload (packet size - header size).
+    bool        bHasPTS;        // Did the packet header contain a Presentation Time Stamp (PTS)?
+    LONGLONG    PTS;            // Presentation Time Stamp (in 90 kHz clock)
+    bool        bHasDTS;        // Did the packet header contain a Decoding Time Stamp (DTS)?
+    LONGLONG    DTS;            // Decoding Time Stamp (in 90 kHz clock)
+};
+
+
+// MPEG1SystemsParser class:
+// Parses an MPEG-1 systems-layer stream or an MPEG-2 program stream.
+// The caller feeds data through ParseBytes and reads the packet payloads
+// itself; see the Parser class in Parse.h.
+class MPEG1SystemsParser
+{
+public:
+    MPEG1SystemsParser();
+
+    // ParseBytes: Parses the next start code and the header that follows it.
+    // On MPEG1_PARSE_OK, *pAte receives the number of bytes consumed (> 0).
+    MPEG1ParseStatus ParseBytes(const BYTE *pData, DWORD cbLen, DWORD *pAte);
+
+    bool HasSystemHeader() const { return !m_header.empty(); }
+
+    // SystemHeader: The first system header. Do not call unless HasSystemHeader() is true.
+    const MPEG1SystemHeader *SystemHeader() const { return reinterpret_cast<const MPEG1SystemHeader*>(&m_header[0]); }
+
+    bool HasPacket() const { return m_bHasPacketHeader; }
+    const MPEG1PacketHeader &PacketHeader() const { return m_curPacketHeader; }
+    void ClearPacket() { m_bHasPacketHeader = false; }
+
+    bool IsEndOfStream() const { return m_bEOS; }
+
+    // IsMPEG2: True if the last pack header used the MPEG-2 program stream syntax.
+    bool IsMPEG2() const { return m_bMPEG2; }
+
+    LONGLONG SCR() const { return m_SCR; }
+    DWORD MuxRate() const { return m_muxRate; }
+
+private:
+
+    MPEG1ParseStatus ParsePackHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte);
+    MPEG1ParseStatus ParseMPEG2PackHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte);
+    MPEG1ParseStatus ParseSystemHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte);
+    MPEG1ParseStatus ParsePacketHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte);
+    void OnEndOfStream();
+
+private:
+
+    LONGLONG m_SCR;
+    DWORD m_muxRate;
+    bool m_bMPEG2;
+
+    std::vector<BYTE> m_header;         // MPEG1SystemHeader, plus the extra stream headers.
+    // Note: Size of header = sizeof(MPEG1SystemHeader) + (sizeof(MPEG1StreamHeader) * (cStreams - 1))
+
+    bool m_bHasPacketHeader;
+    MPEG1PacketHeader m_curPacketHeader;  // Most recent packet header.
+
+    bool m_bEOS;
+};
+
+
+MPEG1ParseStatus MPEG1FindNextStartCode(const BYTE *pData, DWORD cbLen, DWORD *pAte);
+MPEG1ParseStatus MPEG1ParseStreamData(const BYTE *pStreamInfo, MPEG1StreamHeader &header);
+MPEG1ParseStatus MPEG1ParseStreamId(BYTE id, StreamType *pType, BYTE *pStreamNum);
+MPEG1ParseStatus MPEG1ParsePTS(const BYTE *pData, LONGLONG *pPTS);
+bool MPEG2HasPESHeader(BYTE id);
@@ -13,6 +13,7 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include "pch.h"
+#include <initguid.h>
 #include "MPEG1Source.h"
 
 //-------------------------------------------------------------------
@@ -712,7 +713,9 @@ CMPEG1Source::CMPEG1Source() :
     m_state(STATE_INVALID),
     m_cRestartCounter(0),
     m_OnByteStreamRead(this, &CMPEG1Source::OnByteStreamRead),
-    m_flRate(1.0f)
+    m_flRate(1.0f),
+    m_fVideoFraming(false),
+    m_cbQueueBudget(DEFAULT_QUEUE_BUDGET)
 {
     auto module = ::Microsoft::WRL::GetModuleBase();
     if (module != nullptr)
@@ -1387,6 +1390,11 @@ void CMPEG1Source::OnEndOfStream(SourceOp *pOp)
             // No more streams. Send the end-of-presentation event.
             ThrowIfError(m_spEventQueue->QueueEventParamVar(MEEndOfPresentation, GUID_NULL, S_OK, nullptr));
         }
+        else
+        {
+            // Give the budget of the finished stream to the others.
+            BalanceQueueBudget();
+        }
     }
     catch (Exception ^exc)
     {
@@ -1453,6 +1461,40 @@ void CMPEG1Source::SelectStreams(
             wpStream->Start(varStart);
         }
     }
+
+    BalanceQueueBudget();
+}
+
+
+//-------------------------------------------------------------------
+// BalanceQueueBudget
+// Splits the queue memory budget evenly between the active streams
+// that have not reached the end of the stream. Called when streams
+// are selected and when a stream ends.
+//-------------------------------------------------------------------
+
+void CMPEG1Source::BalanceQueueBudget()
+{
+    DWORD cStreams = 0;
+
+    for (DWORD i = 0; i < m_streams.GetCount(); i++)
+    {
+        if (m_streams[i]->IsActive() && !m_streams[i]->IsEndOfStream())
+        {
+            cStreams++;
+        }
+    }
+
+    if (cStreams > 0)
+    {
+        for (DWORD i = 0; i < m_streams.GetCount(); i++)
+        {
+            if (m_streams[i]->IsActive() && !m_streams[i]->IsEndOfStream())
+            {
+                m_streams[i]->SetQueueBudget(m_cbQueueBudget / cStreams);
+            }
+        }
+    }
 }
 
 
@@ -1634,6 +1676,20 @@ void CMPEG1Source::EndOfMPEGStream()
     {
         if (m_streams[i]->IsActive())
         {
+            // Deliver the last picture, which has no start code after it,
+            // and the last audio frame, which has no header after it.
+            VideoFramer ^framer = m_streams[i]->GetVideoFramer();
+            if (framer != nullptr)
+            {
+                DeliverAccessUnits(m_streams[i], framer, true);
+            }
+
+            AudioFramer ^audioFramer = m_streams[i]->GetAudioFramer();
+            if (audioFramer != nullptr)
+            {
+                DeliverAudioFrames(m_streams[i], audioFramer, true);
+            }
+
             m_streams[i]->EndOfStream();
         }
     }
@@ -1691,9 +1747,7 @@ void CMPEG1Source::DeliverPayload()
     MPEG1PacketHeader packetHdr;
     CMPEG1Stream *wpStream = nullptr;   // not AddRef'd
 
-    ComPtr<IMFMediaBuffer> spBuffer;
     ComPtr<IMFSample> spSample;
-    BYTE *pData = nullptr;              // Pointer to the IMFMediaBuffer data.
 
     packetHdr = m_parser->PacketHeader;
 
@@ -1712,38 +1766,136 @@ void CMPEG1Source::DeliverPayload()
     wpStream = m_streams.Find(packetHdr.stream_id);
     assert(wpStream != nullptr);
 
-    // Create a media buffer for the payload.
-    ThrowIfError(MFCreateMemoryBuffer(packetHdr.cbPayload, &spBuffer));
+    AudioFramer ^audioFramer = wpStream->GetAudioFramer();
+    VideoFramer ^videoFramer = wpStream->GetVideoFramer();
+    if (videoFramer != nullptr)
+    {
+        // Video: Deliver one sample per coded picture.
+        videoFramer->AddPayload(m_ReadBuffer->DataPtr, packetHdr.cbPayload, packetHdr);
 
-    ThrowIfError(spBuffer->Lock(&pData, nullptr, nullptr));
+        DeliverAccessUnits(wpStream, videoFramer, false);
+    }
+    else if (audioFramer != nullptr)
+    {
+        // Audio: Deliver one sample per complete audio frame.
+        audioFramer->AddPayload(m_ReadBuffer->DataPtr, packetHdr.cbPayload, packetHdr);
 
-    CopyMemory(pData, m_ReadBuffer->DataPtr, packetHdr.cbPayload);
+        DeliverAudioFrames(wpStream, audioFramer, false);
+    }
+    else
+    {
+        spSample = CreatePayloadSample(m_ReadBuffer->DataPtr, packetHdr.cbPayload);
 
-    ThrowIfError(spBuffer->Unlock());
+        if (packetHdr.bHasPTS)
+        {
+            LONGLONG hnsStart = packetHdr.PTS * 10000ll / 90ll;
 
-    ThrowIfError(spBuffer->SetCurrentLength(packetHdr.cbPayload));
+            ThrowIfError(spSample->SetSampleTime(hnsStart));
+        }
+
+        // Deliver the payload to the stream.
+        wpStream->DeliverPayload(spSample.Get());
+    }
+
+    // If the open operation is still pending, check if we're done.
+    if (m_state == STATE_OPENING)
+    {
+        InitPresentationDescriptor();
+    }
+}
 
-    ThrowIfError(MFCreateSample(&spSample));
-    ThrowIfError(spSample->AddBuffer(spBuffer.Get()));
 
-    if (packetHdr.bHasPTS)
+
+//-------------------------------------------------------------------
+// DeliverAccessUnits:
+// Delivers the complete access units held by a video framer.
+//
+// bFlush: If true, also deliver the final, unterminated access unit.
+//-------------------------------------------------------------------
+
+void CMPEG1Source::DeliverAccessUnits(CMPEG1Stream *pStream, VideoFramer ^framer, bool bFlush)
+{
+    MPEG1VideoAccessUnit au;
+
+    while (framer->NextAccessUnit(au, bFlush))
     {
-        LONGLONG hnsStart = packetHdr.PTS * 10000ll / 90ll;
+        ComPtr<IMFSample> spSample = CreatePayloadSample(au.pData, au.cbSize);
+
+        if (au.bHasPTS)
+        {
+            ThrowIfError(spSample->SetSampleTime(au.PTS * 10000ll / 90ll));
+        }
+        if (au.bHasDTS)
+        {
+            ThrowIfError(spSample->SetUINT64(MFSampleExtension_DecodeTimestamp, au.DTS * 10000ll / 90ll));
+        }
+
+        ThrowIfError(spSample->SetUINT32(MFSampleExtension_MPEG1_PictureType, au.pictureType));
+        ThrowIfError(spSample->SetUINT32(MFSampleExtension_MPEG1_TemporalReference, au.temporalReference));
+
+        // Only I pictures can be decoded independently.
+        ThrowIfError(spSample->SetUINT32(MFSampleExtension_CleanPoint, au.pictureType == MPEG1_Picture_I));
 
-        ThrowIfError(spSample->SetSampleTime(hnsStart));
+        pStream->DeliverPayload(spSample.Get());
     }
+}
 
-    // Deliver the payload to the stream.
-    wpStream->DeliverPayload(spSample.Get());
 
-    // If the open operation is still pending, check if we're done.
-    if (m_state == STATE_OPENING)
+//-------------------------------------------------------------------
+// DeliverAudioFrames:
+// Delivers the complete audio frames held by an audio framer.
+//
+// bFlush: If true, also deliver the last frame, which has no frame
+//         header after it.
+//-------------------------------------------------------------------
+
+void CMPEG1Source::DeliverAudioFrames(CMPEG1Stream *pStream, AudioFramer ^framer, bool bFlush)
+{
+    MPEG1AudioFrame frame;
+
+    while (framer->NextFrame(frame, bFlush))
     {
-        InitPresentationDescriptor();
+        ComPtr<IMFSample> spSample = CreatePayloadSample(frame.pData, frame.cbSize);
+
+        if (frame.bHasTime)
+        {
+            ThrowIfError(spSample->SetSampleTime(frame.hnsTime));
+            ThrowIfError(spSample->SetSampleDuration(frame.hnsDuration));
+        }
+
+        pStream->DeliverPayload(spSample.Get());
     }
 }
 
 
+//-------------------------------------------------------------------
+// CreatePayloadSample:
+// Creates a media sample that holds a copy of the given data.
+//-------------------------------------------------------------------
+
+ComPtr<IMFSample> CMPEG1Source::CreatePayloadSample(const BYTE *pData, DWORD cbData)
+{
+    ComPtr<IMFMediaBuffer> spBuffer;
+    ComPtr<IMFSample> spSample;
+    BYTE *pBuffer = nullptr;            // Pointer to the IMFMediaBuffer data.
+
+    // Create a media buffer for the payload.
+    ThrowIfError(MFCreateMemoryBuffer(cbData, &spBuffer));
+
+    ThrowIfError(spBuffer->Lock(&pBuffer, nullptr, nullptr));
+
+    CopyMemory(pBuffer, pData, cbData);
+
+    ThrowIfError(spBuffer->Unlock());
+
+    ThrowIfError(spBuffer->SetCurrentLength(cbData));
+
+    ThrowIfError(MFCreateSample(&spSample));
+    ThrowIfError(spSample->AddBuffer(spBuffer.Get()));
+
+    return spSample;
+}
+
 
 //-------------------------------------------------------------------
 // CreateStream:
@@ -1811,6 +1963,18 @@ void CMPEG1Source::CreateStream(const MPEG1PacketHeader &packetHdr)
     }
     spStream->Initialize();
 
+    // Split video into pictures, if the application asked for it.
+    if (packetHdr.type == StreamType_Video && m_fVideoFraming)
+    {
+        spStream->SetVideoFramer(ref new VideoFramer());
+    }
+
+    // Split audio into frames, unless it is free format (unknown frame size).
+    if (packetHdr.type == StreamType_Audio && cbAte > 0 && audioFrameHeader.cbFrameSize > 0)
+    {
+        spStream->SetAudioFramer(ref new AudioFramer());
+    }
+
     // Add the stream to the array.
     ThrowIfError(m_streams.AddStream(packetHdr.stream_id, spStream.Get()));
 }
@@ -2091,7 +2255,7 @@ ComPtr<IMFMediaType> CreateVideoMediaType(const MPEG1VideoSeqHeader &videoSeqHdr
 
     ThrowIfError(spType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
 
-    ThrowIfError(spType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_MPG1));
+    ThrowIfError(spType->SetGUID(MF_MT_SUBTYPE, videoSeqHdr.bMPEG2 ? MFVideoFormat_MPEG2 : MFVideoFormat_MPG1));
 
     // Format details.
 
@@ -2122,8 +2286,10 @@ ComPtr<IMFMediaType> CreateVideoMediaType(const MPEG1VideoSeqHeader &videoSeqHdr
     // Average bit rate
     ThrowIfError(spType->SetUINT32(MF_MT_AVG_BITRATE, videoSeqHdr.bitRate));
 
-    // Interlacing (progressive frames)
-    ThrowIfError(spType->SetUINT32(MF_MT_INTERLACE_MODE, (UINT32)MFVideoInterlace_Progressive));
+    // Interlacing. MPEG-1 frames are progressive. An MPEG-2 sequence
+    // that is not progressive can have both kinds of frame.
+    ThrowIfError(spType->SetUINT32(MF_MT_INTERLACE_MODE, videoSeqHdr.bProgressive ?
+        (UINT32)MFVideoInterlace_Progressive : (UINT32)MFVideoInterlace_MixedInterlaceOrProgressive));
 
     // Sequence header.
     ThrowIfError(spType->SetBlob(
@@ -2224,8 +2390,12 @@ ComPtr<IMFMediaType> CreateAudioMediaType(const MPEG1AudioFrameHeader &audioHead
 
     // The flags translate directly.
     format.fwHeadFlags = audioHeader.wFlags;
-    // Add the "MPEG-1" flag, although it's somewhat redundant.
-    format.fwHeadFlags |= ACM_MPEG_ID_MPEG1;
+    // Add the "MPEG-1" flag, although it's somewhat redundant. It is not
+    // set for the MPEG-2 low sampling frequencies.
+    if (!audioHeader.bLSF)
+    {
+        format.fwHeadFlags |= ACM_MPEG_ID_MPEG1;
+    }
 
     // Use the structure to initialize the Media Foundation media type.
     ThrowIfError(MFCreateMediaType(&spType));
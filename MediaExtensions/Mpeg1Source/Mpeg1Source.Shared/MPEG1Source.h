@@ -45,6 +45,30 @@ enum SourceState
 
 const UINT32 MAX_STREAMS = 32;
 
+// Sample attributes set when video access-unit framing is enabled.
+
+// MFSampleExtension_MPEG1_PictureType {92866E1C-DB41-428E-A667-8930D653DC31}
+// Type: UINT32 (MPEG1PictureType)
+DEFINE_GUID(MFSampleExtension_MPEG1_PictureType,
+0x92866e1c, 0xdb41, 0x428e, 0xa6, 0x67, 0x89, 0x30, 0xd6, 0x53, 0xdc, 0x31);
+
+// MFSampleExtension_MPEG1_TemporalReference {821D50B3-3C75-45B4-B2A9-8433AA59FF9F}
+// Type: UINT32
+DEFINE_GUID(MFSampleExtension_MPEG1_TemporalReference,
+0x821d50b3, 0x3c75, 0x45b4, 0xb2, 0xa9, 0x84, 0x33, 0xaa, 0x59, 0xff, 0x9f);
+
+// Sample attributes set on every sample, to monitor the sample queue of the stream.
+
+// MFSampleExtension_MPEG1_QueuedBytes {66B15E6A-6A5C-4AC8-895B-259E017FA85C}
+// Type: UINT32 (Bytes still queued by the stream after this sample.)
+DEFINE_GUID(MFSampleExtension_MPEG1_QueuedBytes,
+0x66b15e6a, 0x6a5c, 0x4ac8, 0x89, 0x5b, 0x25, 0x9e, 0x01, 0x7f, 0xa8, 0x5c);
+
+// MFSampleExtension_MPEG1_StarvationCount {45AB95FA-465F-4665-9917-124593B16741}
+// Type: UINT32 (Requests that found the queue empty since the stream was created.)
+DEFINE_GUID(MFSampleExtension_MPEG1_StarvationCount,
+0x45ab95fa, 0x465f, 0x4665, 0x99, 0x17, 0x12, 0x45, 0x93, 0xb1, 0x67, 0x41);
+
 class StreamList sealed
 {
     ComPtr<CMPEG1Stream>  m_streams[MAX_STREAMS];
@@ -132,7 +156,9 @@ public:
 
 const DWORD INITIAL_BUFFER_SIZE = 4 * 1024; // Initial size of the read buffer. (The buffer expands dynamically.)
 const DWORD READ_SIZE = 4 * 1024;           // Size of each read request.
-const DWORD SAMPLE_QUEUE = 2;               // How many samples does each stream try to hold in its queue?
+const DWORD MIN_SAMPLE_QUEUE = 2;           // Minimum number of samples each stream tries to hold in its queue.
+const DWORD MAX_SAMPLE_QUEUE = 64;          // Upper limit for the adaptive queue depth of a stream.
+const DWORD DEFAULT_QUEUE_BUDGET = 8 * 1024 * 1024; // Default memory budget for all stream queues, in bytes.
 
 // Represents a request for an asynchronous operation.
 
@@ -243,6 +269,12 @@ public:
     // Called by the byte stream handler.
     concurrency::task<void> OpenAsync(IMFByteStream *pStream);
 
+    // Deliver video as one sample per coded picture. Call before OpenAsync.
+    void SetVideoFraming(bool fEnable) { m_fVideoFraming = fEnable; }
+
+    // Total bytes the streams may hold in their sample queues. Call before OpenAsync.
+    void SetQueueBudget(DWORD cbBudget) { m_cbQueueBudget = cbBudget; }
+
     // Queues an asynchronous operation, specify by op-type.
     // (This method is public because the streams call it.)
     HRESULT QueueAsyncOperation(SourceOp::Operation OpType);
@@ -285,11 +317,15 @@ private:
 
     void        InitPresentationDescriptor();
     void        SelectStreams(IMFPresentationDescriptor *pPD, const PROPVARIANT varStart);
+    void        BalanceQueueBudget();
 
     void        RequestData(DWORD cbRequest);
     void        ParseData();
     bool        ReadPayload(DWORD *pcbAte, DWORD *pcbNextRequest);
     void        DeliverPayload();
+    ComPtr<IMFSample> CreatePayloadSample(const BYTE *pData, DWORD cbData);
+    void        DeliverAccessUnits(CMPEG1Stream *pStream, VideoFramer ^framer, bool bFlush);
+    void        DeliverAudioFrames(CMPEG1Stream *pStream, AudioFramer ^framer, bool bFlush);
     void        EndOfMPEGStream();
 
     void        CreateStream(const MPEG1PacketHeader &packetHdr);
@@ -334,6 +370,9 @@ private:
     AsyncCallback<CMPEG1Source>  m_OnByteStreamRead;
 
     float                       m_flRate;
+
+    bool                        m_fVideoFraming;            // Split video into access units?
+    DWORD                       m_cbQueueBudget;            // Memory budget for the stream queues, in bytes.
 };
 
 
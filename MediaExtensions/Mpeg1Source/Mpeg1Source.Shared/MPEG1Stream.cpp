@@ -289,6 +289,9 @@ HRESULT CMPEG1Stream::RequestSample(IUnknown *pToken)
         goto done;
     }
 
+    // Grow or shrink the sample queue before queuing the request.
+    UpdateQueueDepth();
+
     hr = m_Requests.InsertBack(pToken);
     if (FAILED(hr))
     {
@@ -321,6 +324,14 @@ CMPEG1Stream::CMPEG1Stream(CMPEG1Source *pSource, IMFStreamDescriptor *pSD) :
     m_fActive(false),
     m_fEOS(false),
     m_flRate(1.0f),
+    m_cTargetQueue(MIN_SAMPLE_QUEUE),
+    m_cbQueued(0),
+    m_cbQueueBudget(DEFAULT_QUEUE_BUDGET),
+    m_cbAvgSample(0),
+    m_cMinQueued(MAXDWORD),
+    m_cWindowRequests(0),
+    m_cStarvations(0),
+    m_fFirstRequest(true),
     m_spSource(pSource),
     m_spStreamDescriptor(pSD)
 {
@@ -367,7 +378,7 @@ void CMPEG1Stream::Activate(bool fActive)
 
     if (!fActive)
     {
-        m_Samples.Clear();
+        ClearSamples();
         m_Requests.Clear();
     }
 }
@@ -390,6 +401,10 @@ void CMPEG1Stream::Start(const PROPVARIANT &varStart)
 
     m_state = STATE_STARTED;
 
+    // The queue is empty after a seek, so the first request cannot find a
+    // sample waiting. It does not mean that the queue is too short.
+    m_fFirstRequest = true;
+
     // If we are restarting from paused, there may be
     // queue sample requests. Dispatch them now.
     DispatchSamples();
@@ -421,7 +436,18 @@ void CMPEG1Stream::Stop()
     ThrowIfError(CheckShutdown());
 
     m_Requests.Clear();
-    m_Samples.Clear();
+    ClearSamples();
+
+    // The source restarts from the beginning of the file, so drop any
+    // partial audio frame or picture.
+    if (m_audioFramer != nullptr)
+    {
+        m_audioFramer->Reset();
+    }
+    if (m_videoFramer != nullptr)
+    {
+        m_videoFramer->Reset();
+    }
 
     m_state = STATE_STOPPED;
        
@@ -472,11 +498,13 @@ void CMPEG1Stream::Shutdown()
         }
 
         // Release objects.
-        m_Samples.Clear();
+        ClearSamples();
         m_Requests.Clear();
 
         m_spStreamDescriptor.Reset();
         m_spEventQueue.Reset();
+        m_audioFramer = nullptr;
+        m_videoFramer = nullptr;
 
         // NOTE:
         // Do NOT release the source pointer here, because the stream uses
@@ -498,10 +526,19 @@ void CMPEG1Stream::Shutdown()
 
 bool CMPEG1Stream::NeedsData()
 {
-    // Note: The stream tries to keep a minimum number of samples
-    // queued ahead.
+    // Note: The stream tries to keep a number of samples queued ahead.
+    // It always asks for the minimum; beyond that, it stops at the
+    // target depth or when the memory budget is used up.
 
-    return (m_fActive && !m_fEOS && (m_Samples.GetCount() < SAMPLE_QUEUE));
+    if (!m_fActive || m_fEOS)
+    {
+        return false;
+    }
+
+    DWORD cSamples = m_Samples.GetCount();
+
+    return (cSamples < MIN_SAMPLE_QUEUE) ||
+        ((cSamples < m_cTargetQueue) && (m_cbQueued < m_cbQueueBudget));
 }
 
 
@@ -512,9 +549,25 @@ bool CMPEG1Stream::NeedsData()
 
 void CMPEG1Stream::DeliverPayload(IMFSample *pSample)
 {
+    DWORD cbSample = 0;
+
+    ThrowIfError(pSample->GetTotalLength(&cbSample));
+
     // Queue the sample.
     ThrowIfError(m_Samples.InsertBack(pSample));
 
+    m_cbQueued += cbSample;
+
+    // Keep a running average of the sample size (weight 1/8 for the new sample).
+    if (m_cbAvgSample == 0)
+    {
+        m_cbAvgSample = cbSample;
+    }
+    else
+    {
+        m_cbAvgSample = (m_cbAvgSample * 7 + cbSample) / 8;
+    }
+
     // Deliver the sample if there is an outstanding request.
     DispatchSamples();
 }
@@ -543,9 +596,17 @@ void CMPEG1Stream::DispatchSamples() throw()
             ComPtr<IMFSample> spSample;
             ComPtr<IUnknown> spToken;
 
+            DWORD cbSample = 0;
+
             // Pull the next sample from the queue.
             ThrowIfError(m_Samples.RemoveFront(&spSample));
 
+            ThrowIfError(spSample->GetTotalLength(&cbSample));
+            m_cbQueued -= min(cbSample, m_cbQueued);
+
+            ThrowIfError(spSample->SetUINT32(MFSampleExtension_MPEG1_QueuedBytes, m_cbQueued));
+            ThrowIfError(spSample->SetUINT32(MFSampleExtension_MPEG1_StarvationCount, m_cStarvations));
+
             // Pull the next request token from the queue. Tokens can be nullptr.
             ThrowIfError(m_Requests.RemoveFront(&spToken));
 
@@ -588,4 +649,70 @@ void CMPEG1Stream::DispatchSamples() throw()
     }
 }
 
+//-------------------------------------------------------------------
+// UpdateQueueDepth
+// Adjusts the target queue depth. Called for each sample request.
+//
+// If a request finds the queue empty, the stream is starving, so the
+// target depth is doubled. If the queue never ran low during the
+// last few requests, the target is reduced by one. The target never
+// exceeds what the memory budget allows at the average sample size.
+// The first request after Start is not counted.
+//-------------------------------------------------------------------
+
+void CMPEG1Stream::UpdateQueueDepth()
+{
+    if (m_fFirstRequest)
+    {
+        m_fFirstRequest = false;
+        return;
+    }
+
+    DWORD cSamples = m_Samples.GetCount();
+    DWORD cMaxQueue = MAX_SAMPLE_QUEUE;
+
+    if (m_cbAvgSample > 0)
+    {
+        cMaxQueue = min(cMaxQueue, max(MIN_SAMPLE_QUEUE, m_cbQueueBudget / m_cbAvgSample));
+    }
+
+    if (cSamples == 0 && !m_fEOS)
+    {
+        ++m_cStarvations;
+
+        m_cTargetQueue = min(m_cTargetQueue * 2, cMaxQueue);
+
+        m_cMinQueued = MAXDWORD;
+        m_cWindowRequests = 0;
+    }
+    else
+    {
+        m_cMinQueued = min(m_cMinQueued, cSamples);
+
+        if (++m_cWindowRequests >= m_cTargetQueue * 2)
+        {
+            if (m_cMinQueued > 1 && m_cTargetQueue > MIN_SAMPLE_QUEUE)
+            {
+                --m_cTargetQueue;
+            }
+
+            m_cMinQueued = MAXDWORD;
+            m_cWindowRequests = 0;
+        }
+
+        m_cTargetQueue = min(m_cTargetQueue, cMaxQueue);
+    }
+}
+
+//-------------------------------------------------------------------
+// ClearSamples
+// Releases all queued samples.
+//-------------------------------------------------------------------
+
+void CMPEG1Stream::ClearSamples()
+{
+    m_Samples.Clear();
+    m_cbQueued = 0;
+}
+
 #pragma warning( pop )
\ No newline at end of file
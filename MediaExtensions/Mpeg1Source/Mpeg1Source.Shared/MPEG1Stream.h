@@ -51,10 +51,24 @@ public:
     void     Shutdown();
 
     bool      IsActive() const { return m_fActive; }
+    bool      IsEndOfStream() const { return m_fEOS; }
     bool      NeedsData();
 
+    // Queue depth adapts to the consumption rate, within a memory budget.
+    // Each sample carries the queued bytes and the starvation count
+    // (MFSampleExtension_MPEG1_QueuedBytes and _StarvationCount).
+    void      SetQueueBudget(DWORD cbBudget) { m_cbQueueBudget = cbBudget; }
+
     void   DeliverPayload(IMFSample *pSample);
 
+    // Audio streams are split into frames before they are delivered.
+    AudioFramer ^GetAudioFramer() const { return m_audioFramer; }
+    void   SetAudioFramer(AudioFramer ^framer) { m_audioFramer = framer; }
+
+    // Video streams are split into access units if video framing is enabled.
+    VideoFramer ^GetVideoFramer() const { return m_videoFramer; }
+    void   SetVideoFramer(VideoFramer ^framer) { m_videoFramer = framer; }
+
     // Callbacks
     HRESULT     OnDispatchSamples(IMFAsyncResult *pResult);
 
@@ -81,6 +95,8 @@ private:
         return ( m_state == STATE_SHUTDOWN ? MF_E_SHUTDOWN : S_OK );
     }
     void DispatchSamples() throw();
+    void UpdateQueueDepth();
+    void ClearSamples();
 
 
 private:
@@ -98,6 +114,18 @@ private:
     TokenList           m_Requests;             // Sample requests, waiting to be dispatched.
 
     float               m_flRate;
+
+    DWORD               m_cTargetQueue;         // How many samples the stream tries to hold in its queue.
+    DWORD               m_cbQueued;             // Total size of the queued samples, in bytes.
+    DWORD               m_cbQueueBudget;        // Most bytes this stream may queue.
+    DWORD               m_cbAvgSample;          // Running average of the sample size.
+    DWORD               m_cMinQueued;           // Smallest queue depth seen by a request in this window.
+    DWORD               m_cWindowRequests;      // Requests seen in this window.
+    DWORD               m_cStarvations;         // Requests that found the queue empty.
+    bool                m_fFirstRequest;        // Is the next request the first since Start?
+
+    AudioFramer         ^m_audioFramer;         // Audio frame splitter (audio streams only)
+    VideoFramer         ^m_videoFramer;         // Access unit splitter (video streams, optional)
 };
 
 
@@ -0,0 +1,1241 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MPEG1StreamGenerator.cpp
+// Portable generator of synthetic MPEG-1 system streams and MPEG-2
+// program streams.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Note: This file does not use the precompiled header, so that it can be
+// built outside of the Windows project.
+#include "MPEG1StreamGenerator.h"
+
+
+const LONGLONG MPEG1_GENERATOR_START_TIME = 45000;  // Time stamp of the first unit (90 kHz clock). Leaves time to fill the decoder buffers.
+const DWORD MPEG1_GENERATOR_QUANTIZER_SCALE = 8;    // quantizer_scale of the slices.
+const DWORD MPEG1_AUDIO_BUFFER_BOUND = 32;          // STD buffer size bound of the audio streams, in units of 128 bytes.
+const DWORD MPEG1_GENERATOR_MAX_SLICES = 0xAF;      // Slice start codes are 0x00000101 - 0x000001AF.
+const DWORD MPEG1_GENERATOR_SEQUENCE_HEADER_SIZE = 12;  // Sequence header, without quantizer matrices.
+const DWORD MPEG1_GENERATOR_GOP_HEADER_SIZE = 8;
+const DWORD MPEG2_GENERATOR_SEQUENCE_EXTENSION_SIZE = 10;
+const DWORD MPEG2_GENERATOR_PROFILE_AND_LEVEL = 0x48;   // Main Profile at Main Level.
+const DWORD MPEG2_GENERATOR_PSTD_EXTENSION_SIZE = 3;    // PES extension flags and the P-STD buffer size.
+const DWORD MPEG2_GENERATOR_PACK_MAX_STUFFING = 7;
+
+// Largest PES header: the time stamps, the PES extension, and the stuffing bytes.
+const DWORD MPEG2_GENERATOR_PES_HEADER_MAX_SIZE =
+    MPEG2_PES_HEADER_MIN_SIZE + 10 + MPEG2_GENERATOR_PSTD_EXTENSION_SIZE + MPEG1_PACKET_HEADER_MAX_STUFFING_BYTE;
+
+// Relative size of I, P and B pictures.
+const DWORD MPEG1_GENERATOR_PICTURE_WEIGHT[3] = { 5, 3, 1 };
+
+// Frame rates, from the picture_rate field. See ISO/IEC 11172-2, 2.4.3.2
+const DWORD MPEG1_GENERATOR_FRAME_RATE[9][2] =
+{
+    { 0, 0 },           // forbidden
+    { 24000, 1001 },    // 23.976 fps
+    { 24, 1 },
+    { 25, 1 },
+    { 30000, 1001 },    // 29.97 fps
+    { 30, 1 },
+    { 50, 1 },
+    { 60000, 1001 },    // 59.94 fps
+    { 60, 1 }
+};
+
+// Layer II bit rates, in Kbits per second. See ISO/IEC 11172-3, 2.4.2.3
+const DWORD MPEG1_GENERATOR_AUDIO_BIT_RATE[15] =
+{
+    0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384
+};
+
+// Layer II bit rates at the low sampling frequencies. See ISO/IEC 13818-3, 2.4.2.3
+const DWORD MPEG2_GENERATOR_LSF_AUDIO_BIT_RATE[15] =
+{
+    0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160
+};
+
+// Sampling frequencies, in the order of the sampling_frequency codes.
+const DWORD MPEG1_GENERATOR_SAMPLING_FREQUENCY[3] = { 44100, 48000, 32000 };
+const DWORD MPEG2_GENERATOR_LSF_SAMPLING_FREQUENCY[3] = { 22050, 24000, 16000 };
+
+const DWORD MPEG1_AUDIO_LAYER2_SAMPLES_PER_FRAME = 1152;
+
+
+//-------------------------------------------------------------------
+// BitWriter class
+// Appends bit fields to a byte array, most significant bit first.
+//-------------------------------------------------------------------
+
+class BitWriter
+{
+public:
+    BitWriter(std::vector<BYTE> &data) : m_data(data), m_bits(0), m_cBits(0)
+    {
+    }
+
+    void Put(DWORD value, DWORD cBits)
+    {
+        while (cBits > 0)
+        {
+            --cBits;
+            m_bits = static_cast<BYTE>((m_bits << 1) | ((value >> cBits) & 1));
+            if (++m_cBits == 8)
+            {
+                m_data.push_back(m_bits);
+                m_bits = 0;
+                m_cBits = 0;
+            }
+        }
+    }
+
+    // Align: Pads the last byte with zero bits.
+    void Align()
+    {
+        if (m_cBits > 0)
+        {
+            Put(0, 8 - m_cBits);
+        }
+    }
+
+private:
+    std::vector<BYTE> &m_data;
+    BYTE m_bits;
+    DWORD m_cBits;
+};
+
+
+static void PutWORD(std::vector<BYTE> &data, DWORD value)
+{
+    data.push_back(static_cast<BYTE>(value >> 8));
+    data.push_back(static_cast<BYTE>(value));
+}
+
+static void PutDWORD(std::vector<BYTE> &data, DWORD value)
+{
+    PutWORD(data, value >> 16);
+    PutWORD(data, value & 0xFFFF);
+}
+
+//-------------------------------------------------------------------
+// PutTimeStamp
+// Writes a 33-bit time stamp (SCR, PTS or DTS) with a 4-bit prefix.
+// This is the layout that MPEG1ParsePTS reads.
+//-------------------------------------------------------------------
+
+static void PutTimeStamp(std::vector<BYTE> &data, BYTE prefix, LONGLONG time)
+{
+    data.push_back(static_cast<BYTE>((prefix << 4) | ((time >> 29) & 0x0E) | 0x01));
+    data.push_back(static_cast<BYTE>(time >> 22));
+    data.push_back(static_cast<BYTE>(((time >> 14) & 0xFE) | 0x01));
+    data.push_back(static_cast<BYTE>(time >> 7));
+    data.push_back(static_cast<BYTE>(((time << 1) & 0xFE) | 0x01));
+}
+
+//-------------------------------------------------------------------
+// PutAddressIncrement
+// Writes a macroblock_address_increment.
+//
+// See ISO/IEC 11172-2, Annex B, Table B.1
+//-------------------------------------------------------------------
+
+static void PutAddressIncrement(BitWriter &bits, DWORD increment)
+{
+    static const BYTE codes[34][2] =    // { code, length }
+    {
+        { 0, 0 }, { 1, 1 }, { 3, 3 }, { 2, 3 }, { 3, 4 }, { 2, 4 }, { 3, 5 }, { 2, 5 },
+        { 7, 7 }, { 6, 7 }, { 11, 8 }, { 10, 8 }, { 9, 8 }, { 8, 8 }, { 7, 8 }, { 6, 8 },
+        { 23, 10 }, { 22, 10 }, { 21, 10 }, { 20, 10 }, { 19, 10 }, { 18, 10 },
+        { 35, 11 }, { 34, 11 }, { 33, 11 }, { 32, 11 }, { 31, 11 }, { 30, 11 },
+        { 29, 11 }, { 28, 11 }, { 27, 11 }, { 26, 11 }, { 25, 11 }, { 24, 11 }
+    };
+
+    while (increment > 33)
+    {
+        bits.Put(0x08, 11);     // macroblock_escape
+        increment -= 33;
+    }
+
+    bits.Put(codes[increment][0], codes[increment][1]);
+}
+
+//-------------------------------------------------------------------
+// PutMotionOnlyMacroblock
+// Writes a macroblock of a P or B picture that has a zero motion
+// vector and no coefficients.
+//-------------------------------------------------------------------
+
+static void PutMotionOnlyMacroblock(BitWriter &bits, DWORD increment, BYTE type)
+{
+    PutAddressIncrement(bits, increment);
+
+    if (type == 'P')
+    {
+        bits.Put(1, 3);         // macroblock_type: forward motion, not coded
+        bits.Put(1, 1);         // motion_horizontal_forward_code: 0
+        bits.Put(1, 1);         // motion_vertical_forward_code: 0
+    }
+    else
+    {
+        bits.Put(2, 2);         // macroblock_type: forward and backward motion, not coded
+        bits.Put(0x0F, 4);      // Forward and backward motion codes: 0
+    }
+}
+
+//-------------------------------------------------------------------
+// WriteSlices
+// Writes the slices of a flat grey picture, one slice per row of
+// macroblocks.
+//
+// In an I picture, each block has only a DC coefficient that equals
+// the predictor. In a P or B picture, the first and last macroblocks
+// of each row have a zero motion vector, and the ones between them are
+// skipped.
+//-------------------------------------------------------------------
+
+static void WriteSlices(std::vector<BYTE> &data, BYTE type, DWORD mbWidth, DWORD mbHeight)
+{
+    for (DWORD row = 0; row < mbHeight; row++)
+    {
+        PutDWORD(data, MPEG1_SLICE_START_CODE + row);
+
+        BitWriter bits(data);
+        bits.Put(MPEG1_GENERATOR_QUANTIZER_SCALE, 5);
+        bits.Put(0, 1);         // extra_bit_slice
+
+        if (type == 'I')
+        {
+            for (DWORD mb = 0; mb < mbWidth; mb++)
+            {
+                bits.Put(1, 1);     // macroblock_address_increment: 1
+                bits.Put(1, 1);     // macroblock_type: intra
+
+                for (DWORD block = 0; block < 4; block++)
+                {
+                    bits.Put(4, 3); // dct_dc_size_luminance: 0
+                    bits.Put(2, 2); // end_of_block
+                }
+                for (DWORD block = 0; block < 2; block++)
+                {
+                    bits.Put(0, 2); // dct_dc_size_chrominance: 0
+                    bits.Put(2, 2); // end_of_block
+                }
+            }
+        }
+        else
+        {
+            PutMotionOnlyMacroblock(bits, 1, type);
+            if (mbWidth > 1)
+            {
+                PutMotionOnlyMacroblock(bits, mbWidth - 1, type);
+            }
+        }
+
+        bits.Align();
+    }
+}
+
+static DWORD TypeIndex(BYTE type)
+{
+    switch (type)
+    {
+    case 'I':
+        return 0;
+    case 'P':
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+//-------------------------------------------------------------------
+// Random
+// Returns the next number of a xorshift sequence.
+//-------------------------------------------------------------------
+
+static DWORD Random(DWORD &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+
+//-------------------------------------------------------------------
+// MPEG1GetDefaultGeneratorSettings
+//-------------------------------------------------------------------
+
+void MPEG1GetDefaultGeneratorSettings(MPEG1GeneratorSettings *pSettings)
+{
+    memset(pSettings, 0, sizeof(*pSettings));
+
+    pSettings->mpegVersion = 1;
+    pSettings->width = 352;
+    pSettings->height = 240;
+    pSettings->frameRateCode = 4;
+    pSettings->videoBitRate = 1150000;
+    pSettings->gopStructure = "IBBPBBPBBPBBPBB";
+    pSettings->cVideoStreams = 1;
+    pSettings->cAudioStreams = 1;
+    pSettings->audioBitRate = 224;
+    pSettings->audioSamplesPerSec = 44100;
+    pSettings->cbPacketSize = 2324;
+    pSettings->cPacketsPerPack = 1;
+    pSettings->cFrames = 300;
+    pSettings->misalignment = MPEG1_MISALIGN_NONE;
+    pSettings->seed = 1;
+}
+
+
+//-------------------------------------------------------------------
+// MPEG1StreamGenerator class
+//-------------------------------------------------------------------
+
+
+MPEG1StreamGenerator::MPEG1StreamGenerator()
+    : m_gopWeight(0)
+    , m_reorderDelay(0)
+    , m_lastAnchor(0)
+    , m_vbvBufferSize(0)
+    , m_cAudioFrames(0)
+    , m_audioBitRateIndex(0)
+    , m_samplingIndex(0)
+    , m_bLSF(false)
+    , m_muxRate(0)
+    , m_cbOutputRead(0)
+    , m_cbWritten(0)
+    , m_bSystemHeader(false)
+    , m_bEOS(true)
+{
+    memset(&m_settings, 0, sizeof(m_settings));
+    memset(m_cbPictureHeader, 0, sizeof(m_cbPictureHeader));
+}
+
+
+//-------------------------------------------------------------------
+// Initialize
+// Checks the settings and prepares the start of the stream.
+//-------------------------------------------------------------------
+
+MPEG1GenerateStatus MPEG1StreamGenerator::Initialize(const MPEG1GeneratorSettings &settings)
+{
+    const DWORD mbWidth = (settings.width + 15) / 16;
+    const DWORD mbHeight = (settings.height + 15) / 16;
+
+    // Check the settings against the sizes of the header fields.
+    if ((settings.mpegVersion < 1) || (settings.mpegVersion > 2) ||
+        (settings.width == 0) || (settings.width > 0xFFF) ||
+        (settings.height == 0) || (mbHeight > MPEG1_GENERATOR_MAX_SLICES) ||
+        (settings.frameRateCode < 1) || (settings.frameRateCode > 8) ||
+        (settings.videoBitRate == 0) || ((settings.videoBitRate + 399) / 400 >= 0x3FFFF) ||
+        (settings.gopStructure == nullptr) ||
+        (settings.cVideoStreams > MPEG1_GENERATOR_MAX_VIDEO_STREAMS) ||
+        (settings.cAudioStreams > MPEG1_GENERATOR_MAX_AUDIO_STREAMS) ||
+        (settings.cVideoStreams + settings.cAudioStreams == 0) ||
+        (settings.cbPacketSize < MPEG1_GENERATOR_MIN_PACKET_SIZE) ||
+        (settings.cbPacketSize > MPEG1_MAX_PACKET_SIZE) ||
+        (settings.cPacketsPerPack == 0) ||
+        (settings.cFrames == 0))
+    {
+        return MPEG1_GENERATE_INVALID_SETTINGS;
+    }
+
+    // The GOP starts with an I picture, and temporal_reference has 10 bits.
+    std::string gop(settings.gopStructure);
+
+    if (gop.empty() || (gop.size() > 1024) || (gop[0] != 'I') ||
+        (gop.find_first_not_of("IPB") != std::string::npos))
+    {
+        return MPEG1_GENERATE_INVALID_SETTINGS;
+    }
+
+    m_audioBitRateIndex = 0;
+    m_samplingIndex = 0;
+    m_bLSF = false;
+
+    if (settings.cAudioStreams > 0)
+    {
+        // The low sampling frequencies have their own bit rates.
+        m_bLSF = (settings.audioSamplesPerSec < MPEG1_GENERATOR_SAMPLING_FREQUENCY[2]);
+
+        const DWORD *bitRates = m_bLSF ? MPEG2_GENERATOR_LSF_AUDIO_BIT_RATE : MPEG1_GENERATOR_AUDIO_BIT_RATE;
+        const DWORD *frequencies = m_bLSF ? MPEG2_GENERATOR_LSF_SAMPLING_FREQUENCY : MPEG1_GENERATOR_SAMPLING_FREQUENCY;
+
+        while ((m_audioBitRateIndex < 15) && (bitRates[m_audioBitRateIndex] != settings.audioBitRate))
+        {
+            ++m_audioBitRateIndex;
+        }
+        while ((m_samplingIndex < 3) && (frequencies[m_samplingIndex] != settings.audioSamplesPerSec))
+        {
+            ++m_samplingIndex;
+        }
+
+        if ((settings.audioBitRate == 0) || (m_audioBitRateIndex == 15) || (m_samplingIndex == 3))
+        {
+            return MPEG1_GENERATE_INVALID_SETTINGS;
+        }
+    }
+
+    m_settings = settings;
+    m_settings.gopStructure = nullptr;
+    m_gop.swap(gop);
+
+    // Make the slices, and find the size of the picture headers.
+    m_gopWeight = 0;
+    m_reorderDelay = 0;
+
+    for (DWORD i = 0; i < 3; i++)
+    {
+        const BYTE type = "IPB"[i];
+        std::vector<BYTE> header;
+
+        m_slices[i].clear();
+        WriteSlices(m_slices[i], type, mbWidth, mbHeight);
+
+        m_cbPictureHeader[i] = WritePictureHeader(header, type, 0);
+    }
+
+    for (size_t i = 0; i < m_gop.size(); i++)
+    {
+        m_gopWeight += MPEG1_GENERATOR_PICTURE_WEIGHT[TypeIndex(m_gop[i])];
+
+        if (m_gop[i] == 'B')
+        {
+            m_reorderDelay = 1;
+        }
+    }
+
+    // B pictures after the last I or P picture are made into P pictures.
+    m_lastAnchor = m_settings.cFrames - 1;
+    while (m_gop[m_lastAnchor % m_gop.size()] == 'B')
+    {
+        --m_lastAnchor;
+    }
+
+    // Size the video buffer for two I pictures.
+    m_vbvBufferSize = (2 * PictureSize('I') + 2047) / 2048;
+    if (m_vbvBufferSize > 0x3FF)
+    {
+        m_vbvBufferSize = 0x3FF;
+    }
+
+    // Length of the audio streams, rounded up to whole frames.
+    m_cAudioFrames = static_cast<DWORD>(
+        (FrameTime(m_settings.cFrames) * m_settings.audioSamplesPerSec + (90000 * MPEG1_AUDIO_LAYER2_SAMPLES_PER_FRAME - 1)) /
+        (90000 * MPEG1_AUDIO_LAYER2_SAMPLES_PER_FRAME));
+
+    // Find the mux rate from the average size of the elementary streams,
+    // plus the largest packet and pack headers.
+    const DWORD *frameRate = MPEG1_GENERATOR_FRAME_RATE[m_settings.frameRateCode];
+    LONGLONG cbGOP = 0;
+    for (size_t i = 0; i < m_gop.size(); i++)
+    {
+        cbGOP += PictureSize(m_gop[i]);
+    }
+
+    LONGLONG cbPerSecond = m_settings.cVideoStreams * cbGOP * frameRate[0] / (frameRate[1] * static_cast<LONGLONG>(m_gop.size())) +
+        m_settings.cAudioStreams * (m_settings.audioBitRate * 1000LL / 8);
+
+    // The smallest payload follows the largest header. (Half of the room
+    // after the header without time stamps, with MPEG1_MISALIGN_PAYLOAD_SIZE.)
+    const bool bMPEG2 = (m_settings.mpegVersion == 2);
+    const DWORD cbPackHeader = bMPEG2 ? MPEG2_PACK_HEADER_MIN_SIZE + MPEG2_GENERATOR_PACK_MAX_STUFFING : MPEG1_PACK_HEADER_SIZE;
+
+    LONGLONG cbMinPayload = m_settings.cbPacketSize - (bMPEG2 ? MPEG2_GENERATOR_PES_HEADER_MAX_SIZE : MPEG1_PACKET_HEADER_MAX_SIZE);
+    if (HAS_FLAG(m_settings.misalignment, MPEG1_MISALIGN_PAYLOAD_SIZE))
+    {
+        cbMinPayload = (cbMinPayload + 10) / 2 - 10;
+    }
+
+    LONGLONG muxRate = cbPerSecond * (m_settings.cbPacketSize * m_settings.cPacketsPerPack + cbPackHeader) /
+        (cbMinPayload * m_settings.cPacketsPerPack * 50) + 1;
+
+    if (muxRate > 0x3FFFFF)
+    {
+        return MPEG1_GENERATE_INVALID_SETTINGS;
+    }
+    m_muxRate = static_cast<DWORD>(muxRate);
+
+    // Set up the streams: video first, then audio.
+    m_streams.clear();
+    m_streams.resize(m_settings.cVideoStreams + m_settings.cAudioStreams);
+
+    for (size_t i = 0; i < m_streams.size(); i++)
+    {
+        MPEG1GeneratorStream &stream = m_streams[i];
+
+        stream.bVideo = (i < m_settings.cVideoStreams);
+        stream.stream_id = static_cast<BYTE>(stream.bVideo ?
+            MPEG1_STREAMTYPE_VIDEO_MASK + i :
+            MPEG1_STREAMTYPE_AUDIO_MASK + (i - m_settings.cVideoStreams));
+        stream.random = (m_settings.seed ^ (0x9E3779B9 * static_cast<DWORD>(i + 1))) | 1;
+        stream.cbConsumed = 0;
+        stream.cbPosition = 0;
+        stream.nextUnit = 0;
+        stream.bEnded = false;
+        stream.bFirstPacket = true;
+        stream.nextDisplay = 0;
+        stream.gopStart = 0;
+    }
+
+    m_output.clear();
+    m_cbOutputRead = 0;
+    m_cbWritten = 0;
+    m_bSystemHeader = false;
+    m_bEOS = false;
+
+    return MPEG1_GENERATE_OK;
+}
+
+
+//-------------------------------------------------------------------
+// Read
+// Copies the next cbLen bytes of the stream to pData, making packs
+// as needed.
+//-------------------------------------------------------------------
+
+DWORD MPEG1StreamGenerator::Read(BYTE *pData, DWORD cbLen)
+{
+    DWORD cbRead = 0;
+
+    while (cbRead < cbLen)
+    {
+        if (m_cbOutputRead == m_output.size())
+        {
+            if (m_bEOS)
+            {
+                break;
+            }
+
+            m_output.clear();
+            m_cbOutputRead = 0;
+            WritePack();
+        }
+
+        size_t cbCopy = m_output.size() - m_cbOutputRead;
+        if (cbCopy > cbLen - cbRead)
+        {
+            cbCopy = cbLen - cbRead;
+        }
+
+        memcpy(pData + cbRead, &m_output[m_cbOutputRead], cbCopy);
+        m_cbOutputRead += cbCopy;
+        cbRead += static_cast<DWORD>(cbCopy);
+    }
+
+    return cbRead;
+}
+
+
+//-------------------------------------------------------------------
+// WritePack
+// Writes the next pack to m_output. The first pack carries the system
+// header, and the last one ends with the stop code.
+//-------------------------------------------------------------------
+
+void MPEG1StreamGenerator::WritePack()
+{
+    MPEG1GeneratorStream *pStream = NextStream();
+
+    if (pStream != nullptr)
+    {
+        // The SCR is the time at which the pack starts to arrive, at the mux rate.
+        const LONGLONG scr = m_cbWritten * 90000 / (m_muxRate * 50LL);
+
+        if (m_settings.mpegVersion == 2)
+        {
+            DWORD cbStuffing = 0;
+            if (HAS_FLAG(m_settings.misalignment, MPEG1_MISALIGN_STUFFING))
+            {
+                cbStuffing = Random(pStream->random) % (MPEG2_GENERATOR_PACK_MAX_STUFFING + 1);
+            }
+
+            WriteMPEG2PackHeader(scr, cbStuffing);
+        }
+        else
+        {
+            PutDWORD(m_output, MPEG1_PACK_START_CODE);
+            PutTimeStamp(m_output, 0x02, scr);
+            m_output.push_back(static_cast<BYTE>(0x80 | (m_muxRate >> 15)));
+            m_output.push_back(static_cast<BYTE>(m_muxRate >> 7));
+            m_output.push_back(static_cast<BYTE>((m_muxRate << 1) | 0x01));
+        }
+
+        if (!m_bSystemHeader)
+        {
+            WriteSystemHeader();
+            m_bSystemHeader = true;
+        }
+
+        for (DWORD i = 0; (i < m_settings.cPacketsPerPack) && (pStream != nullptr); i++)
+        {
+            WritePacket(*pStream);
+            pStream = NextStream();
+        }
+    }
+
+    if (pStream == nullptr)
+    {
+        PutDWORD(m_output, MPEG1_STOP_CODE);
+        m_bEOS = true;
+    }
+
+    m_cbWritten += m_output.size();
+}
+
+
+//-------------------------------------------------------------------
+// WriteMPEG2PackHeader
+// Writes an MPEG-2 program stream pack header. The SCR extension (the
+// 27 MHz part of the clock) is zero.
+//
+// See ISO/IEC 13818-1, 2.5.3.3
+//-------------------------------------------------------------------
+
+void MPEG1StreamGenerator::WriteMPEG2PackHeader(LONGLONG scr, DWORD cbStuffing)
+{
+    PutDWORD(m_output, MPEG1_PACK_START_CODE);
+
+    BitWriter bits(m_output);
+    bits.Put(1, 2);                                     // '01'
+    bits.Put(static_cast<DWORD>(scr >> 30) & 0x07, 3);  // system_clock_reference_base [32..30]
+    bits.Put(1, 1);                                     // marker_bit
+    bits.Put(static_cast<DWORD>(scr >> 15) & 0x7FFF, 15);   // [29..15]
+    bits.Put(1, 1);                                     // marker_bit
+    bits.Put(static_cast<DWORD>(scr) & 0x7FFF, 15);     // [14..0]
+    bits.Put(1, 1);                                     // marker_bit
+    bits.Put(0, 9);                                     // system_clock_reference_extension
+    bits.Put(1, 1);                                     // marker_bit
+    bits.Put(m_muxRate, 22);                            // program_mux_rate
+    bits.Put(3, 2);                                     // marker_bit, marker_bit
+    bits.Put(0x1F, 5);                                  // reserved
+    bits.Put(cbStuffing, 3);                            // pack_stuffing_length
+
+    m_output.insert(m_output.end(), cbStuffing, 0xFF);
+}
+
+
+//-------------------------------------------------------------------
+// WriteSystemHeader
+// Writes the system header, which lists all of the streams. MPEG-2
+// program streams use the same syntax.
+//
+// See ISO/IEC 11172-1, 2.4.3.2
+//-------------------------------------------------------------------
+
+void MPEG1StreamGenerator::WriteSystemHeader()
+{
+    PutDWORD(m_output, MPEG1_SYSTEM_HEADER_CODE);
+    PutWORD(m_output, MPEG1_SYSTEM_HEADER_MIN_SIZE - MPEG1_SYSTEM_HEADER_PREFIX +
+        MPEG1_SYSTEM_HEADER_STREAM * static_cast<DWORD>(m_streams.size()));
+
+    BitWriter bits(m_output);
+    bits.Put(1, 1);                                 // marker_bit
+    bits.Put(m_muxRate, 22);                        // rate_bound
+    bits.Put(1, 1);                                 // marker_bit
+    bits.Put(m_settings.cAudioStreams, 6);          // audio_bound
+    bits.Put(0, 1);                                 // fixed_flag
+    bits.Put(0, 1);                                 // CSPS_flag
+    bits.Put(0, 1);                                 // system_audio_lock_flag
+    bits.Put(0, 1);                                 // system_video_lock_flag
+    bits.Put(1, 1);                                 // marker_bit
+    bits.Put(m_settings.cVideoStreams, 5);          // video_bound
+    bits.Put(0xFF, 8);                              // reserved_byte
+
+    for (size_t i = 0; i < m_streams.size(); i++)
+    {
+        bits.Put(m_streams[i].stream_id, 8);
+        bits.Put(3, 2);
+        bits.Put(m_streams[i].bVideo ? 1 : 0, 1);   // STD_buffer_bound_scale
+        bits.Put(SizeBound(m_streams[i]), 13);      // STD_buffer_size_bound
+    }
+}
+
+
+//-------------------------------------------------------------------
+// WritePacket
+// Writes the next packet of a stream to m_output.
+//
+// The packet has the time stamps of the first unit that starts in
+// it, if any. In an MPEG-2 program stream, the packet has a PES header,
+// and the STD buffer size of the first packet is in a PES extension.
+//
+// See ISO/IEC 11172-1, 2.4.3.3, and ISO/IEC 13818-1, 2.4.3.6
+//-------------------------------------------------------------------
+
+void MPEG1StreamGenerator::WritePacket(MPEG1GeneratorStream &stream)
+{
+    FillStream(stream);
+
+    const LONGLONG cbPosition = stream.cbPosition + stream.cbConsumed;
+    const DWORD cbAvailable = static_cast<DWORD>(stream.data.size() - stream.cbConsumed);
+
+    const bool bMPEG2 = (m_settings.mpegVersion == 2);
+
+    DWORD cbStuffing = 0;
+    if (HAS_FLAG(m_settings.misalignment, MPEG1_MISALIGN_STUFFING))
+    {
+        cbStuffing = Random(stream.random) % (MPEG1_PACKET_HEADER_MAX_STUFFING_BYTE + 1);
+    }
+
+    // Header, without the time stamps.
+    const DWORD cbHeader = bMPEG2 ?
+        MPEG2_PES_HEADER_MIN_SIZE + cbStuffing + (stream.bFirstPacket ? MPEG2_GENERATOR_PSTD_EXTENSION_SIZE : 0) :
+        MPEG1_PACKET_HEADER_MIN_SIZE + cbStuffing + (stream.bFirstPacket ? 2 : 0);
+
+    // Room for the time stamps and the payload.
+    DWORD cbRoom = m_settings.cbPacketSize - cbHeader;
+    if (HAS_FLAG(m_settings.misalignment, MPEG1_MISALIGN_PAYLOAD_SIZE))
+    {
+        cbRoom = cbRoom / 2 + Random(stream.random) % (cbRoom - cbRoom / 2 + 1);
+    }
+
+    // Find the first unit that starts in the packet, assuming the largest
+    // time stamps.
+    const MPEG1GeneratorUnit *pUnit = nullptr;
+    LONGLONG cbNextUnit = -1;     // Offset of the first unit after cbPosition.
+
+    for (size_t i = 0; i < stream.units.size(); i++)
+    {
+        if (stream.units[i].cbPosition >= cbPosition)
+        {
+            cbNextUnit = stream.units[i].cbPosition - cbPosition;
+            if (cbNextUnit < cbRoom - 10 && cbNextUnit < cbAvailable)
+            {
+                pUnit = &stream.units[i];
+            }
+            break;
+        }
+    }
+
+    DWORD cbTimeStamps = bMPEG2 ? 0 : 1;  // MPEG-1 has a byte that says there are none.
+    if (pUnit != nullptr)
+    {
+        cbTimeStamps = (pUnit->DTS != pUnit->PTS) ? 10 : 5;
+    }
+
+    DWORD cbPayload = cbRoom - cbTimeStamps;
+    if (cbPayload > cbAvailable)
+    {
+        cbPayload = cbAvailable;
+    }
+
+    if ((pUnit == nullptr) && (cbNextUnit >= 0) && (cbNextUnit < cbPayload))
+    {
+        // The smaller header leaves room for the start of a unit. End the
+        // packet before it, so that the unit gets its time stamps.
+        cbPayload = static_cast<DWORD>(cbNextUnit);
+    }
+    else if ((pUnit != nullptr) && (cbNextUnit > 0) &&
+        HAS_FLAG(m_settings.misalignment, MPEG1_MISALIGN_START_CODES))
+    {
+        // End the packet 1 to 3 bytes into the start code or frame header.
+        const DWORD cbSplit = static_cast<DWORD>(cbNextUnit) + 1 + Random(stream.random) % 3;
+        if (cbSplit < cbPayload)
+        {
+            cbPayload = cbSplit;
+        }
+    }
+
+    // Packet header.
+    PutDWORD(m_output, MPEG1_START_CODE_PREFIX | stream.stream_id);
+    PutWORD(m_output, cbHeader + cbTimeStamps + cbPayload - MPEG1_PACKET_HEADER_MIN_SIZE);
+
+    // STD buffer size (MPEG-1) or P-STD buffer size (MPEG-2) fields.
+    const DWORD bound = SizeBound(stream);
+    const BYTE stdBuffer[2] =
+    {
+        static_cast<BYTE>(0x40 | (stream.bVideo ? 0x20 : 0x00) | (bound >> 8)),
+        static_cast<BYTE>(bound)
+    };
+
+    if (bMPEG2)
+    {
+        // '10', not scrambled. Then PTS_DTS_flags and PES_extension_flag,
+        // and PES_header_data_length.
+        const BYTE ptsDtsFlags = (pUnit == nullptr) ? 0x00 : ((cbTimeStamps == 5) ? 0x02 : 0x03);
+
+        m_output.push_back(0x80);
+        m_output.push_back(static_cast<BYTE>((ptsDtsFlags << 6) | (stream.bFirstPacket ? 0x01 : 0x00)));
+        m_output.push_back(static_cast<BYTE>(cbHeader + cbTimeStamps - MPEG2_PES_HEADER_MIN_SIZE));
+    }
+    else
+    {
+        m_output.insert(m_output.end(), cbStuffing, 0xFF);
+
+        if (stream.bFirstPacket)
+        {
+            m_output.insert(m_output.end(), stdBuffer, stdBuffer + 2);
+        }
+    }
+
+    if (pUnit == nullptr)
+    {
+        if (!bMPEG2)
+        {
+            m_output.push_back(0x0F);
+        }
+    }
+    else if (cbTimeStamps == 5)
+    {
+        PutTimeStamp(m_output, 0x02, pUnit->PTS);
+    }
+    else
+    {
+        PutTimeStamp(m_output, 0x03, pUnit->PTS);
+        PutTimeStamp(m_output, 0x01, pUnit->DTS);
+    }
+
+    if (bMPEG2)
+    {
+        if (stream.bFirstPacket)
+        {
+            // PES extension with only the P-STD_buffer_flag set, and the
+            // reserved bits.
+            m_output.push_back(0x1E);
+            m_output.insert(m_output.end(), stdBuffer, stdBuffer + 2);
+        }
+
+        m_output.insert(m_output.end(), cbStuffing, 0xFF);
+    }
+
+    stream.bFirstPacket = false;
+
+    // Payload.
+    const BYTE *pPayload = &stream.data[stream.cbConsumed];
+    m_output.insert(m_output.end(), pPayload, pPayload + cbPayload);
+    stream.cbConsumed += cbPayload;
+
+    // Keep the unit that holds the next byte, for NextStream.
+    const LONGLONG cbEnd = cbPosition + cbPayload;
+    while ((stream.units.size() > 1) && (stream.units[1].cbPosition <= cbEnd))
+    {
+        stream.units.pop_front();
+    }
+}
+
+
+//-------------------------------------------------------------------
+// NextStream
+// Returns the stream with the earliest data that is not in a packet
+// yet, or nullptr if all of the streams are done.
+//-------------------------------------------------------------------
+
+MPEG1StreamGenerator::MPEG1GeneratorStream *MPEG1StreamGenerator::NextStream()
+{
+    MPEG1GeneratorStream *pNext = nullptr;
+
+    for (size_t i = 0; i < m_streams.size(); i++)
+    {
+        MPEG1GeneratorStream &stream = m_streams[i];
+
+        FillStream(stream);
+
+        if (stream.cbConsumed == stream.data.size())
+        {
+            continue;   // Nothing left.
+        }
+
+        if ((pNext == nullptr) || (stream.units.front().DTS < pNext->units.front().DTS))
+        {
+            pNext = &stream;
+        }
+    }
+
+    return pNext;
+}
+
+
+//-------------------------------------------------------------------
+// FillStream
+// Makes units until the stream has data for a whole packet, or until
+// the end of the stream.
+//-------------------------------------------------------------------
+
+void MPEG1StreamGenerator::FillStream(MPEG1GeneratorStream &stream)
+{
+    if (stream.bEnded || (stream.data.size() - stream.cbConsumed >= m_settings.cbPacketSize))
+    {
+        return;
+    }
+
+    // Discard the data that is in packets. Less than one packet is left.
+    stream.data.erase(stream.data.begin(), stream.data.begin() + stream.cbConsumed);
+    stream.cbPosition += stream.cbConsumed;
+    stream.cbConsumed = 0;
+
+    while (!stream.bEnded && (stream.data.size() < m_settings.cbPacketSize))
+    {
+        if (stream.bVideo)
+        {
+            WritePicture(stream);
+        }
+        else
+        {
+            WriteAudioFrame(stream);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// WritePicture
+// Appends the next picture, in decoding order, to a video stream.
+//
+// An I picture starts a GOP, and is preceded by a sequence header (and,
+// in MPEG-2, a sequence extension). The B pictures that are displayed
+// before it belong to its GOP, so only the first GOP is closed.
+//-------------------------------------------------------------------
+
+void MPEG1StreamGenerator::WritePicture(MPEG1GeneratorStream &stream)
+{
+    if (stream.order.empty())
+    {
+        // Put the next I or P picture first, then the B pictures before it.
+        DWORD anchor = stream.nextDisplay;
+        while (PictureType(anchor) == 'B')
+        {
+            ++anchor;
+        }
+
+        stream.order.push_back(anchor);
+        for (DWORD i = stream.nextDisplay; i < anchor; i++)
+        {
+            stream.order.push_back(i);
+        }
+        stream.nextDisplay = anchor + 1;
+    }
+
+    const DWORD displayIndex = stream.order.front();
+    const BYTE type = PictureType(displayIndex);
+    stream.order.pop_front();
+
+    if (type == 'I')
+    {
+        stream.gopStart = displayIndex - static_cast<DWORD>(stream.order.size());
+
+        // Sequence header. See ISO/IEC 11172-2, 2.4.2.3
+        PutDWORD(stream.data, MPEG1_SEQUENCE_HEADER_CODE);
+
+        BitWriter bits(stream.data);
+        bits.Put(m_settings.width, 12);
+        bits.Put(m_settings.height, 12);
+        bits.Put(1, 4);                                 // pel_aspect_ratio: 1.0
+        bits.Put(m_settings.frameRateCode, 4);
+        bits.Put((m_settings.videoBitRate + 399) / 400, 18);
+        bits.Put(1, 1);                                 // marker_bit
+        bits.Put(m_vbvBufferSize, 10);
+        bits.Put(0, 1);                                 // constrained_parameters_flag
+        bits.Put(0, 1);                                 // load_intra_quantizer_matrix
+        bits.Put(0, 1);                                 // load_non_intra_quantizer_matrix
+
+        if (m_settings.mpegVersion == 2)
+        {
+            // Sequence extension: progressive 4:2:0, with no size, bit rate or
+            // frame rate extension. See ISO/IEC 13818-2, 6.2.2.3
+            PutDWORD(stream.data, MPEG2_EXTENSION_START_CODE);
+            bits.Put(1, 4);                             // extension_start_code_identifier: sequence extension
+            bits.Put(MPEG2_GENERATOR_PROFILE_AND_LEVEL, 8);
+            bits.Put(1, 1);                             // progressive_sequence
+            bits.Put(1, 2);                             // chroma_format: 4:2:0
+            bits.Put(0, 2);                             // horizontal_size_extension
+            bits.Put(0, 2);                             // vertical_size_extension
+            bits.Put(0, 12);                            // bit_rate_extension
+            bits.Put(1, 1);                             // marker_bit
+            bits.Put(0, 8);                             // vbv_buffer_size_extension
+            bits.Put(0, 1);                             // low_delay
+            bits.Put(0, 2);                             // frame_rate_extension_n
+            bits.Put(0, 5);                             // frame_rate_extension_d
+        }
+
+        // GOP header, with the time code of the first picture displayed.
+        const DWORD *frameRate = MPEG1_GENERATOR_FRAME_RATE[m_settings.frameRateCode];
+        const DWORD fps = (frameRate[0] + frameRate[1] - 1) / frameRate[1];
+        const DWORD seconds = stream.gopStart / fps;
+
+        PutDWORD(stream.data, MPEG1_GOP_START_CODE);
+        bits.Put(0, 1);                                 // drop_frame_flag
+        bits.Put((seconds / 3600) % 24, 5);
+        bits.Put((seconds / 60) % 60, 6);
+        bits.Put(1, 1);                                 // marker_bit
+        bits.Put(seconds % 60, 6);
+        bits.Put(stream.gopStart % fps, 6);
+        bits.Put(stream.order.empty() ? 1 : 0, 1);      // closed_gop
+        bits.Put(0, 1);                                 // broken_link
+        bits.Align();
+    }
+
+    MPEG1GeneratorUnit unit;
+    unit.cbPosition = stream.cbPosition + stream.data.size();
+    unit.PTS = MPEG1_GENERATOR_START_TIME + FrameTime(displayIndex + m_reorderDelay);
+    unit.DTS = MPEG1_GENERATOR_START_TIME + FrameTime(stream.nextUnit);
+    stream.units.push_back(unit);
+
+    const DWORD iType = TypeIndex(type);
+    WritePictureHeader(stream.data, type, displayIndex - stream.gopStart);
+
+    // Pad the picture to its share of the bit rate.
+    const DWORD cbMin = m_cbPictureHeader[iType] + static_cast<DWORD>(m_slices[iType].size());
+    const DWORD cbTarget = TargetPictureSize(type);
+
+    if (cbTarget > cbMin + sizeof(DWORD))
+    {
+        PutDWORD(stream.data, MPEG1_USER_DATA_START_CODE);
+        PutUserData(stream, cbTarget - cbMin - sizeof(DWORD));
+    }
+
+    stream.data.insert(stream.data.end(), m_slices[iType].begin(), m_slices[iType].end());
+
+    if (++stream.nextUnit == m_settings.cFrames)
+    {
+        PutDWORD(stream.data, MPEG1_SEQUENCE_END_CODE);
+        stream.bEnded = true;
+    }
+}
+
+
+//-------------------------------------------------------------------
+// WritePictureHeader
+// Writes a picture header (and, in MPEG-2, a picture coding extension),
+// and returns its size.
+//
+// The slices are the same in both formats: in MPEG-2, frame pictures
+// with frame_pred_frame_dct set use the MPEG-1 macroblock syntax.
+//
+// See ISO/IEC 11172-2, 2.4.2.5, and ISO/IEC 13818-2, 6.2.3.1
+//-------------------------------------------------------------------
+
+DWORD MPEG1StreamGenerator::WritePictureHeader(std::vector<BYTE> &data, BYTE type, DWORD temporalReference)
+{
+    const size_t cbStart = data.size();
+
+    PutDWORD(data, MPEG1_PICTURE_START_CODE);
+
+    BitWriter bits(data);
+    bits.Put(temporalReference, 10);
+    bits.Put(TypeIndex(type) + 1, 3);   // picture_coding_type
+    bits.Put(0xFFFF, 16);               // vbv_delay: variable bit rate
+
+    // In MPEG-2, the f_codes are in the picture coding extension, and
+    // these fields are fixed.
+    const bool bMPEG2 = (m_settings.mpegVersion == 2);
+
+    if (type != 'I')
+    {
+        bits.Put(0, 1);                 // full_pel_forward_vector
+        bits.Put(bMPEG2 ? 7 : 1, 3);    // forward_f_code
+    }
+    if (type == 'B')
+    {
+        bits.Put(0, 1);                 // full_pel_backward_vector
+        bits.Put(bMPEG2 ? 7 : 1, 3);    // backward_f_code
+    }
+
+    bits.Put(0, 1);                     // extra_bit_picture
+    bits.Align();
+
+    if (bMPEG2)
+    {
+        // f_code 15 means the motion vectors are not used.
+        const DWORD forwardCode = (type != 'I') ? 1 : 15;
+        const DWORD backwardCode = (type == 'B') ? 1 : 15;
+
+        PutDWORD(data, MPEG2_EXTENSION_START_CODE);
+        bits.Put(8, 4);                 // extension_start_code_identifier: picture coding extension
+        bits.Put(forwardCode, 4);       // f_code[0][0]
+        bits.Put(forwardCode, 4);       // f_code[0][1]
+        bits.Put(backwardCode, 4);      // f_code[1][0]
+        bits.Put(backwardCode, 4);      // f_code[1][1]
+        bits.Put(0, 2);                 // intra_dc_precision: 8 bits
+        bits.Put(3, 2);                 // picture_structure: frame
+        bits.Put(0, 1);                 // top_field_first
+        bits.Put(1, 1);                 // frame_pred_frame_dct
+        bits.Put(0, 1);                 // concealment_motion_vectors
+        bits.Put(0, 1);                 // q_scale_type
+        bits.Put(0, 1);                 // intra_vlc_format
+        bits.Put(0, 1);                 // alternate_scan
+        bits.Put(0, 1);                 // repeat_first_field
+        bits.Put(1, 1);                 // chroma_420_type
+        bits.Put(1, 1);                 // progressive_frame
+        bits.Put(0, 1);                 // composite_display_flag
+        bits.Align();
+    }
+
+    return static_cast<DWORD>(data.size() - cbStart);
+}
+
+
+//-------------------------------------------------------------------
+// PutUserData
+// Appends random bytes to a video stream. None of the bytes is zero,
+// so they never look like a start code.
+//-------------------------------------------------------------------
+
+void MPEG1StreamGenerator::PutUserData(MPEG1GeneratorStream &stream, DWORD cbUserData)
+{
+    const size_t cbStart = stream.data.size();
+    stream.data.resize(cbStart + cbUserData);
+
+    BYTE *pData = &stream.data[cbStart];
+    DWORD value = 0;
+
+    for (DWORD i = 0; i < cbUserData; i++)
+    {
+        if ((i & 3) == 0)
+        {
+            value = Random(stream.random);
+        }
+
+        BYTE b = static_cast<BYTE>(value >> ((i & 3) * 8));
+        pData[i] = (b != 0) ? b : 0xFF;
+    }
+}
+
+
+//-------------------------------------------------------------------
+// WriteAudioFrame
+// Appends the next frame to an audio stream. The frames are silent:
+// no subband has any bits allocated.
+//
+// See ISO/IEC 11172-3, 2.4.1.3
+//-------------------------------------------------------------------
+
+void MPEG1StreamGenerator::WriteAudioFrame(MPEG1GeneratorStream &stream)
+{
+    const DWORD frame = stream.nextUnit;
+    const LONGLONG cbNominal = 144LL * m_settings.audioBitRate * 1000;  // Frame size, times the sampling frequency.
+    const LONGLONG rest = cbNominal % m_settings.audioSamplesPerSec;
+
+    // Add a padding byte each time the fractions of a byte add up to one.
+    const bool bPadding =
+        (frame + 1) * rest / m_settings.audioSamplesPerSec != frame * rest / m_settings.audioSamplesPerSec;
+    const DWORD cbFrame = static_cast<DWORD>(cbNominal / m_settings.audioSamplesPerSec) + (bPadding ? 1 : 0);
+
+    // Stereo, except for the bit rates that Layer II allows only in mono.
+    // (At the low sampling frequencies, every mode is allowed.)
+    const bool bMono = !m_bLSF && ((m_settings.audioBitRate < 64) || (m_settings.audioBitRate == 80));
+
+    MPEG1GeneratorUnit unit;
+    unit.cbPosition = stream.cbPosition + stream.data.size();
+    unit.PTS = MPEG1_GENERATOR_START_TIME +
+        static_cast<LONGLONG>(frame) * MPEG1_AUDIO_LAYER2_SAMPLES_PER_FRAME * 90000 / m_settings.audioSamplesPerSec;
+    unit.DTS = unit.PTS;
+    stream.units.push_back(unit);
+
+    const size_t cbStart = stream.data.size();
+    stream.data.resize(cbStart + cbFrame, 0);
+
+    BYTE *pHeader = &stream.data[cbStart];
+    pHeader[0] = 0xFF;                      // syncword
+    pHeader[1] = m_bLSF ? 0xF5 : 0xFD;      // syncword, ID: MPEG-1 (or LSF), layer: II, no CRC
+    pHeader[2] = static_cast<BYTE>((m_audioBitRateIndex << 4) | (m_samplingIndex << 2) | (bPadding ? 0x02 : 0x00));
+    pHeader[3] = bMono ? 0xC0 : 0x00;       // mode
+
+    if (++stream.nextUnit == m_cAudioFrames)
+    {
+        stream.bEnded = true;
+    }
+}
+
+
+//-------------------------------------------------------------------
+// PictureType
+// Returns the type ('I', 'P' or 'B') of the picture at a display
+// index.
+//-------------------------------------------------------------------
+
+BYTE MPEG1StreamGenerator::PictureType(DWORD displayIndex) const
+{
+    BYTE type = m_gop[displayIndex % m_gop.size()];
+
+    if ((type == 'B') && (displayIndex > m_lastAnchor))
+    {
+        type = 'P';     // No I or P picture follows.
+    }
+    return type;
+}
+
+
+//-------------------------------------------------------------------
+// TargetPictureSize
+// Returns the size of a picture type at the video bit rate, with the
+// relative sizes in MPEG1_GENERATOR_PICTURE_WEIGHT.
+//-------------------------------------------------------------------
+
+DWORD MPEG1StreamGenerator::TargetPictureSize(BYTE type) const
+{
+    const DWORD *frameRate = MPEG1_GENERATOR_FRAME_RATE[m_settings.frameRateCode];
+    const LONGLONG cbFrame = static_cast<LONGLONG>(m_settings.videoBitRate / 8) * frameRate[1];
+
+    return static_cast<DWORD>(cbFrame * static_cast<LONGLONG>(m_gop.size()) * MPEG1_GENERATOR_PICTURE_WEIGHT[TypeIndex(type)] /
+        (static_cast<LONGLONG>(frameRate[0]) * m_gopWeight));
+}
+
+
+//-------------------------------------------------------------------
+// PictureSize
+// Returns the size of a picture type, including the sequence header,
+// sequence extension and GOP header in front of an I picture.
+//-------------------------------------------------------------------
+
+DWORD MPEG1StreamGenerator::PictureSize(BYTE type) const
+{
+    const DWORD iType = TypeIndex(type);
+    DWORD cbSize = m_cbPictureHeader[iType] + static_cast<DWORD>(m_slices[iType].size());
+
+    const DWORD cbTarget = TargetPictureSize(type);
+    if (cbTarget > cbSize + sizeof(DWORD))
+    {
+        cbSize = cbTarget;
+    }
+
+    if (type == 'I')
+    {
+        cbSize += MPEG1_GENERATOR_SEQUENCE_HEADER_SIZE + MPEG1_GENERATOR_GOP_HEADER_SIZE;
+
+        if (m_settings.mpegVersion == 2)
+        {
+            cbSize += MPEG2_GENERATOR_SEQUENCE_EXTENSION_SIZE;
+        }
+    }
+    return cbSize;
+}
+
+
+//-------------------------------------------------------------------
+// FrameTime
+// Returns the time of a number of video frames, in the 90 kHz clock.
+//-------------------------------------------------------------------
+
+LONGLONG MPEG1StreamGenerator::FrameTime(LONGLONG cFrames) const
+{
+    const DWORD *frameRate = MPEG1_GENERATOR_FRAME_RATE[m_settings.frameRateCode];
+    return cFrames * 90000 * frameRate[1] / frameRate[0];
+}
+
+
+//-------------------------------------------------------------------
+// SizeBound
+// Returns the STD buffer size of a stream, in units of 1024 bytes for
+// video and 128 bytes for audio.
+//-------------------------------------------------------------------
+
+DWORD MPEG1StreamGenerator::SizeBound(const MPEG1GeneratorStream &stream) const
+{
+    if (stream.bVideo)
+    {
+        return m_vbvBufferSize * 2;     // vbv_buffer_size is in units of 2048 bytes.
+    }
+    else
+    {
+        return MPEG1_AUDIO_BUFFER_BOUND;
+    }
+}
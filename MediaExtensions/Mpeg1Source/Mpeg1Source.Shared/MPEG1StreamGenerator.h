@@ -0,0 +1,184 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MPEG1StreamGenerator.h
+// Portable generator of synthetic MPEG-1 system streams and MPEG-2
+// program streams, for testing and benchmarking the source and the
+// decoder.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Note: Like MPEG1ParseCore.h, this header and MPEG1StreamGenerator.cpp do
+// not depend on C++/CX, COM, or Media Foundation.
+//
+// The generated stream is fully determined by the settings: the same
+// settings always give the same bytes. The video streams contain flat grey
+// pictures (intra-coded I pictures, and P and B pictures of skipped
+// macroblocks), padded to the bit rate with user data. The audio streams
+// contain silent Layer II frames.
+//
+// An MPEG-2 program stream has MPEG-2 pack headers and PES headers (the
+// first packet of each stream carries the P-STD buffer size in a PES
+// extension), and MPEG-2 video: each sequence header is followed by a
+// sequence extension, and each picture header by a picture coding
+// extension. The audio uses the MPEG-2 low sampling frequencies (LSF) if
+// the sampling rate is 16000, 22050, or 24000, in either format.
+
+#include "MPEG1ParseCore.h"
+#include <deque>
+#include <string>
+
+const DWORD MPEG1_GENERATOR_MAX_VIDEO_STREAMS = 16;     // Stream IDs 0xE0 - 0xEF
+const DWORD MPEG1_GENERATOR_MAX_AUDIO_STREAMS = 32;     // Stream IDs 0xC0 - 0xDF
+const DWORD MPEG1_GENERATOR_MIN_PACKET_SIZE = 64;       // Smallest packet, including the header.
+
+
+// Result of a generator function.
+enum MPEG1GenerateStatus
+{
+    MPEG1_GENERATE_OK = 0,
+    MPEG1_GENERATE_INVALID_SETTINGS     // The settings are out of range.
+};
+
+// Ways to misalign the data, to test the code that reassembles it.
+// (Bitwise OR of these flags.)
+enum MPEG1GeneratorMisalignment
+{
+    MPEG1_MISALIGN_NONE         = 0x00,
+    MPEG1_MISALIGN_PAYLOAD_SIZE = 0x01, // Vary the payload size of the packets (between 1/2 and all of the packet size).
+    MPEG1_MISALIGN_STUFFING     = 0x02, // Add 0 to 16 stuffing bytes to the packet headers.
+    MPEG1_MISALIGN_START_CODES  = 0x04  // End packets inside picture start codes and audio frame headers.
+};
+
+struct MPEG1GeneratorSettings
+{
+    BYTE        mpegVersion;        // 1 = MPEG-1 system stream, 2 = MPEG-2 program stream.
+    WORD        width;              // Picture size, in pixels.
+    WORD        height;
+    BYTE        frameRateCode;      // picture_rate field of the sequence header (1 - 8).
+    DWORD       videoBitRate;       // Bits per second, for each video stream.
+    const char  *gopStructure;      // Picture types of a GOP, in display order. For example "IBBPBBPBBPBB".
+    DWORD       cVideoStreams;
+    DWORD       cAudioStreams;
+    DWORD       audioBitRate;       // Kbits per second, for each audio stream. (A Layer II bit rate, or an LSF bit rate.)
+    DWORD       audioSamplesPerSec; // 32000, 44100, or 48000. (LSF: 16000, 22050, or 24000.)
+    DWORD       cbPacketSize;       // Size of each packet, including the packet header.
+    DWORD       cPacketsPerPack;
+    DWORD       cFrames;            // Length of the stream, in video frames (also when there is no video).
+    DWORD       misalignment;       // Bitwise OR of MPEG1GeneratorMisalignment flags.
+    DWORD       seed;               // Seed for the user data and the misalignment.
+};
+
+// MPEG1GetDefaultGeneratorSettings:
+// 352x240 at 29.97 fps and 1.15 Mbps, with one 224 Kbps audio stream: the
+// Video CD format, for 10 seconds.
+void MPEG1GetDefaultGeneratorSettings(MPEG1GeneratorSettings *pSettings);
+
+
+// MPEG1StreamGenerator class:
+// Writes an MPEG-1 system stream or an MPEG-2 program stream. The stream
+// is made one pack at a time, as the caller reads it, so it can be much
+// larger than the memory.
+class MPEG1StreamGenerator
+{
+public:
+    MPEG1StreamGenerator();
+
+    MPEG1GenerateStatus Initialize(const MPEG1GeneratorSettings &settings);
+
+    // Read: Copies up to cbLen bytes of the stream to pData, and returns
+    // the number of bytes copied. Returns less than cbLen only at the end
+    // of the stream.
+    DWORD Read(BYTE *pData, DWORD cbLen);
+
+    bool IsEndOfStream() const { return m_bEOS && (m_cbOutputRead == m_output.size()); }
+
+    // BytesRead: Number of bytes returned by Read so far.
+    LONGLONG BytesRead() const { return m_cbWritten - (m_output.size() - m_cbOutputRead); }
+
+    DWORD MuxRate() const { return m_muxRate; }    // In units of 50 bytes / second.
+
+private:
+
+    // MPEG1GeneratorUnit:
+    // A coded picture or audio frame, and the time stamps for the packet
+    // in which it starts.
+    struct MPEG1GeneratorUnit
+    {
+        LONGLONG    cbPosition;     // Stream position of the picture start code or frame header.
+        LONGLONG    PTS;
+        LONGLONG    DTS;            // Same as the PTS if the packet needs no DTS.
+    };
+
+    // MPEG1GeneratorStream:
+    // State of one elementary stream.
+    struct MPEG1GeneratorStream
+    {
+        BYTE        stream_id;
+        bool        bVideo;
+        DWORD       random;         // Random number state (user data and misalignment).
+        std::vector<BYTE> data;     // Elementary stream data that is not in a packet yet.
+        DWORD       cbConsumed;     // Bytes at the start of data that are in packets.
+        LONGLONG    cbPosition;     // Stream position of data[0].
+        std::deque<MPEG1GeneratorUnit> units;
+        DWORD       nextUnit;       // Next picture (in decoding order) or audio frame to make.
+        bool        bEnded;         // All units have been made.
+        bool        bFirstPacket;   // The next packet is the first (it carries the STD buffer size).
+
+        // Video only
+        std::deque<DWORD> order;    // Display indexes of the next pictures, in decoding order.
+        DWORD       nextDisplay;    // Next display index to put in decoding order.
+        DWORD       gopStart;       // Display index of the first picture of the current GOP.
+    };
+
+private:
+
+    void WritePack();
+    void WriteMPEG2PackHeader(LONGLONG scr, DWORD cbStuffing);
+    void WriteSystemHeader();
+    void WritePacket(MPEG1GeneratorStream &stream);
+    MPEG1GeneratorStream *NextStream();
+    void FillStream(MPEG1GeneratorStream &stream);
+    void WritePicture(MPEG1GeneratorStream &stream);
+    DWORD WritePictureHeader(std::vector<BYTE> &data, BYTE type, DWORD temporalReference);
+    void WriteAudioFrame(MPEG1GeneratorStream &stream);
+    void PutUserData(MPEG1GeneratorStream &stream, DWORD cbUserData);
+
+    BYTE PictureType(DWORD displayIndex) const;
+    DWORD TargetPictureSize(BYTE type) const;
+    DWORD PictureSize(BYTE type) const;
+    LONGLONG FrameTime(LONGLONG cFrames) const;
+    DWORD SizeBound(const MPEG1GeneratorStream &stream) const;
+
+private:
+
+    MPEG1GeneratorSettings m_settings;
+    std::string m_gop;
+
+    std::vector<MPEG1GeneratorStream> m_streams;
+    std::vector<BYTE> m_slices[3];      // Slices of an I, P and B picture.
+    DWORD m_cbPictureHeader[3];         // Size of the picture header of an I, P and B picture.
+    DWORD m_gopWeight;                  // Sum of the picture weights in one GOP.
+    DWORD m_reorderDelay;               // 1 if there are B pictures, in frames.
+    DWORD m_lastAnchor;                 // Display index of the last I or P picture.
+    DWORD m_vbvBufferSize;              // vbv_buffer_size field of the sequence header.
+    DWORD m_cAudioFrames;               // Number of frames in each audio stream.
+    DWORD m_audioBitRateIndex;          // bitrate_index field of the audio frame headers.
+    DWORD m_samplingIndex;              // sampling_frequency field of the audio frame headers.
+    bool m_bLSF;                        // The audio uses the MPEG-2 low sampling frequencies.
+    DWORD m_muxRate;
+
+    std::vector<BYTE> m_output;         // The current pack.
+    size_t m_cbOutputRead;              // Bytes of m_output returned by Read.
+    LONGLONG m_cbWritten;               // Size of the stream, up to the end of m_output.
+    bool m_bSystemHeader;               // Was the system header written?
+    bool m_bEOS;
+};
@@ -16,78 +16,14 @@
 #include "MPEG1Source.h"
 #include "Parse.h"
 
-// HAS_FLAG: Test if 'b' contains a specified bit flag
-#define HAS_FLAG(b, flag) (((b) & (flag)) == (flag))
-
-#define htonl(x)   ((((x) >> 24) & 0x000000FFL) | \
-    (((x) >>  8) & 0x0000FF00L) | \
-    (((x) <<  8) & 0x00FF0000L) | \
-    (((x) << 24) & 0xFF000000L))
-
-// MAKE_WORD: Convert two bytes into a WORD
-inline WORD MAKE_WORD(BYTE b1, BYTE b2)
-{
-    return ((b1 << 8) | b2);
-}
-
-// MAKE_DWORD_HOSTORDER:
-// Convert the first 4 bytes of an array into a DWORD in host order (ie, no byte swapping).
-inline DWORD MAKE_DWORD_HOSTORDER(const BYTE *pData)
-{
-    return ((DWORD*)pData)[0];
-}
-
-// MAKE_DWORD:
-// Convert the first 4 bytes of an array into a DWORD in MPEG-1 stream byte order.
-inline DWORD MAKE_DWORD(const BYTE *pData)
-{
-    return htonl( MAKE_DWORD_HOSTORDER(pData) );
-}
-
-
-//-------------------------------------------------------------------
-// AdvanceBufferPointer
-// Advances a byte array pointer.
-//
-// pData: The array pointer.
-// cbBufferSize: The array size. On output, the size remaining.
-// cbAdvance: Number of bytes to advance the pointer.
-//
-// This function is just a helper for keeping a valid pointer as we
-// walk through a buffer.
-//-------------------------------------------------------------------
-
-inline void AdvanceBufferPointer(const BYTE* &pData, DWORD &cbBufferSize, DWORD cbAdvance)
-{
-    assert(cbBufferSize >= cbAdvance);
-    if (cbBufferSize < cbAdvance)
-    {
-        throw ref new InvalidArgumentException();
-    }
-    cbBufferSize -= cbAdvance;
-    pData += cbAdvance;
-}
-
-// ValidateBufferSize:
-// Fails if cbBufferSize < cbMinRequiredSize.
-inline void ValidateBufferSize(DWORD cbBufferSize, DWORD cbMinRequiredSize)
-{
-    if (cbBufferSize < cbMinRequiredSize)
-    {
-        ThrowException(MF_E_INVALID_FORMAT);
-    }
-}
-
 // Forward declarations.
-void ParseStreamData(const BYTE *pData, MPEG1StreamHeader &header);
-void ParseStreamId(BYTE id, StreamType *pType, BYTE *pStreamNum);
-LONGLONG ParsePTS(const BYTE *pData);
-
 MFRatio GetFrameRate(BYTE frameRateCode);
 MFRatio GetPixelAspectRatio(BYTE pixelAspectCode);
+MFRatio GetMPEG2PixelAspectRatio(BYTE aspectCode, DWORD width, DWORD height);
+void ReadSequenceExtension(const BYTE *pHeader, const BYTE *pExtension, MPEG1VideoSeqHeader &seqHeader);
 
-DWORD GetAudioBitRate(MPEG1AudioLayer layer, BYTE index);
-DWORD GetSamplingFrequency(BYTE code);
+DWORD GetAudioBitRate(MPEG1AudioLayer layer, bool bLSF, BYTE index);
+DWORD GetSamplingFrequency(bool bLSF, BYTE code);
 
 
 //-------------------------------------------------------------------
@@ -258,13 +194,33 @@ DWORD Buffer::CurrentFreeSize::get() const
 //-------------------------------------------------------------------
 
 
-Parser::Parser() 
-    : m_SCR(0)
-    , m_muxRate(0)
-    , m_bHasPacketHeader(false)
-    , m_bEOS(false)
+// CheckParseStatus:
+// Converts the status of a MPEG1SystemsParser call. Returns true if
+// data was parsed, false if more data is needed, and throws if the
+// stream is not valid.
+inline bool CheckParseStatus(MPEG1ParseStatus status)
+{
+    switch (status)
+    {
+    case MPEG1_PARSE_OK:
+        return true;
+
+    case MPEG1_PARSE_NEED_MORE_DATA:
+        return false;
+
+    case MPEG1_PARSE_NO_SYSTEM_HEADER:
+        ThrowException(MF_E_INVALIDREQUEST); // We should not get a packet before the first system header.
+
+    default:
+        ThrowException(MF_E_INVALID_FORMAT);
+    }
+
+    return false;
+}
+
+
+Parser::Parser()
 {
-    ZeroMemory(&m_curPacketHeader, sizeof(m_curPacketHeader));
 }
 
 //-------------------------------------------------------------------
@@ -272,9 +228,6 @@ Parser::Parser()
 //
 // Returns a copy of the system header.
 // Do not call this method unless HasSystemHeader() returns true.
-//
-// The caller must free the returned structure by calling
-// CoTaskMemFree.
 //-------------------------------------------------------------------
 
 ExpandableStruct<MPEG1SystemHeader> ^Parser::GetSystemHeader()
@@ -284,11 +237,13 @@ ExpandableStruct<MPEG1SystemHeader> ^Parser::GetSystemHeader()
         ThrowException(MF_INVALID_STATE_ERR);
     }
 
-    assert(m_header->Size > 0);
+    const MPEG1SystemHeader *pHeader = m_parser.SystemHeader();
+
+    assert(pHeader->cbSize > 0);
 
-    auto header = ref new ExpandableStruct<MPEG1SystemHeader>(m_header);
+    auto header = ref new ExpandableStruct<MPEG1SystemHeader>(pHeader->cbSize);
 
-    header->CopyFrom(m_header);
+    CopyMemory(header->Get(), pHeader, pHeader->cbSize);
 
     return header;
 }
@@ -303,694 +258,287 @@ ExpandableStruct<MPEG1SystemHeader> ^Parser::GetSystemHeader()
 //      true: The method consumed some data (*pAte > 0).
 //      false: The method did not consume any data (*pAte == 0).
 //
-// If the method returns S_FALSE, the caller must allocate a larger
+// If the method returns false, the caller must allocate a larger
 // buffer and pass in more data.
 //-------------------------------------------------------------------
 
 bool Parser::ParseBytes(const BYTE *pData, DWORD cbLen, DWORD *pAte)
 {
-    *pAte = 0;
-
-    if (cbLen < 4)
-    {
-        return false;
-    }
-
-    DWORD cbLengthToStartCode = 0;  // How much we skip to reach the next start code.
-    DWORD cbParsed = 0;             // How much we parse after the start code.
-
-    m_bHasPacketHeader = false;
-
-    bool result = FindNextStartCode(pData, cbLen, &cbLengthToStartCode);
-
-    if (result)
-    {
-        cbLen -= cbLengthToStartCode;
-        pData += cbLengthToStartCode;
-
-        switch (MAKE_DWORD(pData))
-        {
-        case MPEG1_PACK_START_CODE:
-            // Start of pack.
-            result = ParsePackHeader(pData, cbLen, &cbParsed);
-            break;
-
-        case MPEG1_SYSTEM_HEADER_CODE:
-            // Start of system header.
-            result = ParseSystemHeader(pData, cbLen, &cbParsed);
-            break;
-
-        case MPEG1_STOP_CODE:
-            // Stop code, end of stream.
-            cbParsed = sizeof(DWORD);
-            OnEndOfStream();
-            break;
-
-        default:
-            // Start of packet.
-            result = ParsePacketHeader(pData, cbLen, &cbParsed);
-            break;
-
-        }
-    }
-
-    if (result)
-    {
-        *pAte = cbLengthToStartCode + cbParsed;
-    }
-    return result;
-};
+    return CheckParseStatus(m_parser.ParseBytes(pData, cbLen, pAte));
+}
 
 
 //-------------------------------------------------------------------
-// FindNextStartCode
-// Looks for the next start code in the buffer.
-//
-// pData: Pointer to the buffer.
-// cbLen: Size of the buffer.
-// pAte: Receives the number of bytes *before *the start code.
+// ReadVideoSequenceHeader
+// Parses a video sequence header.
 //
-// If no start code is found, the method returns S_FALSE.
+// Call Parser::HasPacket() to ensure that pData points to the start
+// of a payload, and call Parser::PacketHeader() to verify it is a
+// video packet.
 //-------------------------------------------------------------------
 
-bool Parser::FindNextStartCode(const BYTE *pData, DWORD cbLen, DWORD *pAte)
+DWORD ReadVideoSequenceHeader(
+    _In_reads_bytes_(cbData) const BYTE *pData,
+    DWORD cbData,
+    MPEG1VideoSeqHeader &seqHeader
+    )
 {
-    bool result = false;
-
-    DWORD cbLeft = cbLen;
+    DWORD cbPadding = 0;
 
-    while (cbLeft > 4)
+    if (pData == nullptr)
     {
-        if ( (MAKE_DWORD_HOSTORDER(pData) & 0x00FFFFFF) == 0x00010000 )
-        {
-            result = true;
-            break;
-        }
+        throw ref new InvalidArgumentException();
+    }
 
-        cbLeft -= 4;
+    // Skip to the sequence header code.
+    while ( (cbPadding + 4) <= cbData && ((DWORD*)pData)[0] == 0 )
+    {
         pData += 4;
+        cbPadding += 4;
     }
-    *pAte = (cbLen - cbLeft);
-    return result;
-}
-
-
-//-------------------------------------------------------------------
-// ParsePackHeader
-// Parses the start of an MPEG-1 pack.
-//-------------------------------------------------------------------
 
-bool Parser::ParsePackHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte)
-{
-    assert( MAKE_DWORD(pData) == MPEG1_PACK_START_CODE );
+    cbData -= cbPadding;
 
-    if (cbLen < MPEG1_PACK_HEADER_SIZE)
+    // Check for the minimum size buffer.
+    if (cbData < MPEG1_VIDEO_SEQ_HEADER_MIN_SIZE)
     {
-        return false; // Not enough data yet.
+        return cbPadding;
     }
 
-    // Check marker bits
-    if ( ((pData[4] & 0xF1) != 0x21) ||
-        ((pData[6] & 0x01) != 0x01) ||
-        ((pData[8] & 0x01) != 0x01) ||
-        ((pData[9] & 0x80) != 0x80) ||
-        ((pData[11] & 0x01) != 0x01) )
+    // Validate the sequence header code.
+    if (MAKE_DWORD(pData) != MPEG1_SEQUENCE_HEADER_CODE)
     {
         ThrowException(MF_E_INVALID_FORMAT);
     }
 
+    // Calculate the actual required size.
+    DWORD cbRequired = MPEG1_VIDEO_SEQ_HEADER_MIN_SIZE;
 
-    // Calculate the SCR.
-    LONGLONG scr = ( (pData[8] & 0xFE) >> 1) |
-        ( (pData[7]) << 7) |
-        ( (pData[6] & 0xFE) << 14) |
-        ( (pData[5]) << 22) |
-        ( (pData[4] & 0x0E) << 29);
-
-    DWORD muxRate = ( (pData[11] & 0xFE) >> 1) |
-        ( (pData[10]) << 7) |
-        ( (pData[9] & 0x7F) << 15);
-
+    // Look for quantization matrices.
+    if ( HAS_FLAG(pData[11], 0x02) )
+    {
+        // Intra quantization matrix is true.
+        cbRequired += 64;
+    }
+    // Intra is false, look for non-intra flag
+    else if ( HAS_FLAG(pData[11], 0x01) )
+    {
+        cbRequired += 64;
+    }
 
-    m_SCR = scr;
-    m_muxRate = muxRate;
+    if (cbData < cbRequired)
+    {
+        return cbPadding;
+    }
 
-    *pAte = MPEG1_PACK_HEADER_SIZE;
+    ZeroMemory(&seqHeader, sizeof(seqHeader));
 
-    return true;
-}
+    // Check the marker bit.
+    if ( !HAS_FLAG(pData[10], 0x20) )
+    {
+        ThrowException(MF_E_INVALID_FORMAT);
+    }
 
+    BYTE parCode = pData[7] >> 4;
+    BYTE frameRateCode = pData[7] & 0x0F;
 
-//-------------------------------------------------------------------
-// ParseSystemHeader.
-// Parses the MPEG-1 system header.
-//
-// NOTES:
-// The system header optionally appears after the pack header.
-// The first pack must contain a system header.
-// Subsequent packs may contain a system header.
-//-------------------------------------------------------------------
+    seqHeader.frameRate = GetFrameRate(frameRateCode);
 
-bool Parser::ParseSystemHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte)
-{
-    assert( MAKE_DWORD(pData) == MPEG1_SYSTEM_HEADER_CODE );
+    seqHeader.width = (pData[4] << 4) | (pData[5] >> 4) ;
+    seqHeader.height = ((pData[5] & 0x0F) << 8) | (pData[6]);
+    seqHeader.bitRate = (pData[8] << 10) | (pData[9] << 2) | (pData[10] >> 6);
 
-    if (cbLen < MPEG1_SYSTEM_HEADER_MIN_SIZE)
+    if (seqHeader.bitRate == 0)
     {
-        return false; // Not enough data yet.
+        ThrowException(MF_E_INVALID_FORMAT); // Not allowed.
     }
-
-    // Find the total header length.
-    DWORD cbHeaderLen = MPEG1_SYSTEM_HEADER_PREFIX +  MAKE_WORD(pData[4], pData[5]);
-
-    if (cbHeaderLen < MPEG1_SYSTEM_HEADER_MIN_SIZE - MPEG1_SYSTEM_HEADER_PREFIX)
+    else if (seqHeader.bitRate == 0x3FFFF)
     {
-        ThrowException(MF_E_INVALID_FORMAT);
+        seqHeader.bitRate = 0; // Variable bit-rate.
     }
-
-    if (cbLen < cbHeaderLen)
+    else
     {
-        return false; // Not enough data yet.
+        seqHeader.bitRate = seqHeader.bitRate * 400; // Units of 400 bps
     }
 
-    // We have enough data to parse the header.
+    seqHeader.cbVBV_Buffer = ( ((pData[10] & 0x1F) << 5) | (pData[11] >> 3) ) * 2048;
+    seqHeader.bConstrained = HAS_FLAG(pData[11], 0x04);
 
-    // Did we already see a system header?
-    if (!HasSystemHeader)
-    {
-        // This is the first time we've seen the header. Parse it.
+    seqHeader.bProgressive = true;
 
-        // Calculate the number of stream info's in the header.
-        DWORD cStreamInfo = (cbHeaderLen - MPEG1_SYSTEM_HEADER_MIN_SIZE) / MPEG1_SYSTEM_HEADER_STREAM;
+    // An MPEG-2 video sequence header is followed by a sequence extension.
+    seqHeader.bMPEG2 = (cbData >= cbRequired + 4) &&
+        (MAKE_DWORD(pData + cbRequired) == MPEG2_EXTENSION_START_CODE);
 
-        // Calculate the structure size.
-        DWORD cbSize = sizeof(MPEG1SystemHeader);
-        if (cStreamInfo > 1)
+    if (seqHeader.bMPEG2)
+    {
+        // The extension is part of the media type, so it must be in the
+        // same payload as the sequence header.
+        if (cbData < cbRequired + MPEG2_SEQUENCE_EXTENSION_SIZE)
         {
-            cbSize += sizeof(MPEG1StreamHeader) * (cStreamInfo - 1);
+            ThrowException(MF_E_INVALID_FORMAT);
         }
 
-        // Allocate room for the header.
-        m_header = ref new ExpandableStruct<MPEG1SystemHeader>(cbSize);
-        try
-        {
-            m_header->Get()->cbSize = cbSize;
-
-            // Check marker bits
-            if (((pData[6] & 0x80) != 0x80) ||
-                ((pData[8] & 0x01) != 0x01) ||
-                ((pData[10] & 0x20) != 0x20) ||
-                (pData[11] != 0xFF))
-            {
-                ThrowException(MF_E_INVALID_FORMAT);
-            }
-
-            m_header->Get()->rateBound = ((pData[6] & 0x7F) << 16) | (pData[7] << 8) | (pData[8] >> 1);
-            m_header->Get()->cAudioBound = pData[9] >> 2;
-            m_header->Get()->bFixed = HAS_FLAG(pData[9], 0x02);
-            m_header->Get()->bCSPS = HAS_FLAG(pData[9], 0x01);
-            m_header->Get()->bAudioLock = HAS_FLAG(pData[10], 0x80);
-            m_header->Get()->bVideoLock = HAS_FLAG(pData[10], 0x40);
-            m_header->Get()->cVideoBound = pData[10] & 0x1F;
-            m_header->Get()->cStreams = cStreamInfo;
+        ReadSequenceExtension(pData, pData + cbRequired, seqHeader);
 
-            // Parse the stream information.
-            const BYTE *pStreamInfo = pData + MPEG1_SYSTEM_HEADER_MIN_SIZE;
-
-            for (DWORD i = 0; i < cStreamInfo; i++)
-            {
-                ParseStreamData(pStreamInfo, m_header->Get()->streams[i]);
+        // In MPEG-2, the code gives the display aspect ratio.
+        seqHeader.pixelAspectRatio = GetMPEG2PixelAspectRatio(parCode, seqHeader.width, seqHeader.height);
 
-                pStreamInfo += MPEG1_SYSTEM_HEADER_STREAM;
-            }
-        }
-        catch (Exception^)
-        {
-            m_header = nullptr;
-            throw;
-        }
+        // MF_MT_MPEG_SEQUENCE_HEADER holds the sequence header and the
+        // sequence extension.
+        cbRequired += MPEG2_SEQUENCE_EXTENSION_SIZE;
+    }
+    else
+    {
+        seqHeader.pixelAspectRatio = GetPixelAspectRatio(parCode);
     }
 
-    *pAte = cbHeaderLen;
+    seqHeader.cbHeader = cbRequired;
+    CopyMemory(seqHeader.header, pData, cbRequired);
 
-    return true;
+    return cbRequired + cbPadding;
 }
 
+
 //-------------------------------------------------------------------
-// ParsePacketHeader
+// ReadSequenceExtension
+// Applies an MPEG-2 sequence extension to the fields of the sequence
+// header: the high bits of the size and bit rate, the frame rate
+// multiplier, and the progressive_sequence flag.
 //
-// Parses the packet header.
+// pHeader points to the sequence header code, and pExtension to the
+// extension start code that follows it.
 //
-// If the method returns S_OK, then HasPacket() returns true and the
-// caller can start parsing the packet.
+// See ISO/IEC 13818-2, 6.2.2.3 "Sequence extension"
 //-------------------------------------------------------------------
 
-bool Parser::ParsePacketHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte)
+void ReadSequenceExtension(const BYTE *pHeader, const BYTE *pExtension, MPEG1VideoSeqHeader &seqHeader)
 {
-    if (!HasSystemHeader)
-    {
-        ThrowException(MF_E_INVALIDREQUEST); // We should not get a packet before the first system header.
-    }
-
-    if (cbLen < MPEG1_PACKET_HEADER_MIN_SIZE)
-    {
-        return false; // Not enough data yet.
-    }
-
-    // Before we parse anything else in the packet header, look for the header length.
-    DWORD cbPacketLen = MAKE_WORD(pData[4], pData[5]) + MPEG1_PACKET_HEADER_MIN_SIZE;
-
-    // We want enough data for the maximum packet header OR the total packet size, whichever is less.
-    if (cbLen < cbPacketLen && cbLen < MPEG1_PACKET_HEADER_MAX_SIZE)
-    {
-        return false; // Not enough data yet.
-    }
-
-    // Make sure the start code is 0x000001xx
-    if ((MAKE_DWORD(pData) & 0xFFFFFF00) != MPEG1_START_CODE_PREFIX)
+    // extension_start_code_identifier: '0001' = Sequence Extension ID.
+    // Check the marker bit too.
+    if ( ((pExtension[4] >> 4) != 0x01) || !HAS_FLAG(pExtension[7], 0x01) )
     {
         ThrowException(MF_E_INVALID_FORMAT);
     }
 
-    BYTE id = 0;
-    StreamType type = StreamType_Unknown;
-    BYTE num = 0;
-    bool bHasPTS = false;
+    const DWORD horizontalExt = ((pExtension[5] & 0x01) << 1) | (pExtension[6] >> 7);
+    const DWORD verticalExt = (pExtension[6] >> 5) & 0x03;
+    const DWORD bitRateExt = ((pExtension[6] & 0x1F) << 7) | (pExtension[7] >> 1);
+    const DWORD frameRateExtN = (pExtension[9] >> 5) & 0x03;
+    const DWORD frameRateExtD = pExtension[9] & 0x1F;
 
-    ZeroMemory(&m_curPacketHeader, sizeof(m_curPacketHeader));
+    seqHeader.bProgressive = HAS_FLAG(pExtension[5], 0x08);
 
-    // Find the stream ID.
-    id = pData[3];
-    ParseStreamId(id, &type, &num);
-
-    DWORD cbLeft = cbPacketLen - MPEG1_PACKET_HEADER_MIN_SIZE;
-    pData = pData + MPEG1_PACKET_HEADER_MIN_SIZE;
-    DWORD cbPadding = 0;
-    LONGLONG pts = 0;
-
-    // Go past the stuffing bytes.
-    while ((cbLeft > 0) && (*pData == 0xFF))
-    {
-        AdvanceBufferPointer(pData, cbLeft, 1);
-        ++cbPadding;
-    }
-
-    // Check for invalid number of stuffing bytes.
-    if (cbPadding > MPEG1_PACKET_HEADER_MAX_STUFFING_BYTE)
-    {
-        ThrowException(MF_E_INVALID_FORMAT);
-    }
+    seqHeader.width = static_cast<WORD>(seqHeader.width | (horizontalExt << 12));
+    seqHeader.height = static_cast<WORD>(seqHeader.height | (verticalExt << 12));
 
-    // The next bits are:
-    // (optional) STD buffer size (2 bytes)
-    // union
-    // {
-    //      PTS (5 bytes)
-    //      PTS + DTS (10 bytes)
-    //      '0000 1111' (1 bytes)
-    // }
+    // The bit rate is 30 bits, in units of 400 bps. Unlike MPEG-1, the
+    // value 0x3FFFF in the sequence header does not mean variable rate.
+    const DWORD bitRateValue = (pHeader[8] << 10) | (pHeader[9] << 2) | (pHeader[10] >> 6);
+    const ULONGLONG bitRate = ((static_cast<ULONGLONG>(bitRateExt) << 18) | bitRateValue) * 400;
 
-    ValidateBufferSize(cbLeft, 1);
+    seqHeader.bitRate = (bitRate > MAXDWORD) ? MAXDWORD : static_cast<DWORD>(bitRate);
 
-    if ((*pData & 0xC0) == 0x40)
-    {
-        // Skip STD buffer size.
-        AdvanceBufferPointer(pData, cbLeft, 2);
-    }
+    // frame_rate = frame_rate_value * (frame_rate_extension_n + 1) / (frame_rate_extension_d + 1)
+    seqHeader.frameRate.Numerator *= (frameRateExtN + 1);
+    seqHeader.frameRate.Denominator *= (frameRateExtD + 1);
+}
 
-    ValidateBufferSize(cbLeft, 1);
 
-    if ((*pData & 0xF1) == 0x21)
-    {
-        // PTS
-        ValidateBufferSize(cbLeft, 5);
 
-        pts = ParsePTS(pData);
-        bHasPTS = true;
+//-------------------------------------------------------------------
+// GetFrameRate
+// Returns the frame rate from the picture_rate field of the sequence
+// header.
+//
+// See ISO/IEC 11172-2, 2.4.3.2 "Sequence Header"
+//-------------------------------------------------------------------
 
-        AdvanceBufferPointer(pData, cbLeft, 5);
-    }
-    else if ((*pData & 0xF1) == 0x31)
+MFRatio GetFrameRate(BYTE frameRateCode)
+{
+    MFRatio frameRates[] =
     {
-        // PTS + DTS
-        ValidateBufferSize(cbLeft, 10);
-
-        // Parse PTS but skip DTS.
-        pts = ParsePTS(pData);
-        bHasPTS = true;
+        { 0, 0 },           // invalid
+        { 24000, 1001 },    // 23.976 fps
+        { 24, 1 },
+        { 25, 1 },
+        { 30000, 1001 },    // 29.97 fps
+        { 50, 1 },
+        { 60000, 1001 },    // 59.94 fps
+        { 60, 1 }
+    };
 
-        AdvanceBufferPointer(pData, cbLeft, 10);
-    }
-    else if ((*pData) == 0x0F)
-    {
-        AdvanceBufferPointer(pData, cbLeft, 1);
-    }
-    else
+    if (frameRateCode < 1 || frameRateCode >= ARRAYSIZE(frameRates))
     {
-        ThrowException(MF_E_INVALID_FORMAT); // Unexpected bit field
+        ThrowException(MF_E_INVALIDTYPE);
     }
 
-    m_curPacketHeader.stream_id = id;
-    m_curPacketHeader.type = type;
-    m_curPacketHeader.number = num;
-    m_curPacketHeader.cbPacketSize = cbPacketLen;
-    m_curPacketHeader.cbPayload = cbLeft;
-    m_curPacketHeader.bHasPTS = bHasPTS;
-    m_curPacketHeader.PTS = pts;
-
-    // Client can read the packet now.
-    m_bHasPacketHeader = true;
-
-    *pAte = cbPacketLen - cbLeft;
-
-    return true;
+    MFRatio result = { frameRates[frameRateCode].Numerator, frameRates[frameRateCode].Denominator };
+    return result;
 }
 
 //-------------------------------------------------------------------
-// OnEndOfStream
-// Called when the parser reaches the MPEG-1 stop code.
+// GetPixelAspectRatio
+// Returns the pixel aspect ratio (PAR) from the pel_aspect_ratio
+// field of the sequence header.
 //
-// Note: Obviously the parser is not guaranteed to see a stop code
-// before the client reaches the end of the source data. The client
-// must be prepared to handle that case.
+// See ISO/IEC 11172-2, 2.4.3.2 "Sequence Header"
 //-------------------------------------------------------------------
 
-void Parser::OnEndOfStream()
+MFRatio GetPixelAspectRatio(BYTE pixelAspectCode)
 {
-    m_bEOS = true;
-    ClearPacket();
-}
+    DWORD height[] = { 0, 10000, 6735, 7031, 7615, 8055, 8437, 8935, 9157,
+        9815, 10255, 10695, 10950, 11575, 12015 };
 
+    const DWORD width = 10000;
 
-//-------------------------------------------------------------------
-// Static functions
-//-------------------------------------------------------------------
+    if (pixelAspectCode < 1 || pixelAspectCode >= ARRAYSIZE(height))
+    {
+        ThrowException(MF_E_INVALIDTYPE);
+    }
+
+    MFRatio result = { height[pixelAspectCode], width };
+    return result;
+}
 
 
 //-------------------------------------------------------------------
-// ParsePTS
-// Parse the 33-bit Presentation Time Stamp (PTS)
+// GetMPEG2PixelAspectRatio
+// Returns the pixel aspect ratio from an MPEG-2 aspect_ratio_information
+// code. Codes 2 to 4 give the display aspect ratio of the whole frame.
+//
+// See ISO/IEC 13818-2, 6.3.3 "Sequence header"
 //-------------------------------------------------------------------
 
-LONGLONG ParsePTS(const BYTE *pData)
+MFRatio GetMPEG2PixelAspectRatio(BYTE aspectCode, DWORD width, DWORD height)
 {
-    BYTE byte1 = pData[0];
-    WORD word1 = MAKE_WORD(pData[1], pData[2]);
-    WORD word2 = MAKE_WORD(pData[3], pData[4]);
-
-    // Check marker bits.
-    // The first byte can be '0010xxx1' or '0x11xxxx1'
-    if (((byte1 & 0xE1) != 0x21) ||
-        ((word1 & 0x01) != 0x01) ||
-        ((word2 & 0x01) != 0x01) )
+    // Display aspect ratios, indexed by code.
+    const MFRatio displayAspect[] = { { 0, 0 }, { 0, 0 }, { 4, 3 }, { 16, 9 }, { 221, 100 } };
+
+    MFRatio result = { 1, 1 };
+
+    if (aspectCode < 1 || aspectCode >= ARRAYSIZE(displayAspect))
     {
-        ThrowException(MF_E_INVALID_FORMAT);
+        ThrowException(MF_E_INVALIDTYPE);
     }
 
-    LARGE_INTEGER li;
-
-    // The PTS is 33 bits, so bit 32 goes in the high-order DWORD
-    li.HighPart = (byte1 & 0x08) >> 3;
+    if (aspectCode > 1 && width > 0 && height > 0)
+    {
+        // PAR = DAR * height / width
+        const ULONGLONG numerator = static_cast<ULONGLONG>(displayAspect[aspectCode].Numerator) * height;
+        const ULONGLONG denominator = static_cast<ULONGLONG>(displayAspect[aspectCode].Denominator) * width;
 
-    li.LowPart = (static_cast<DWORD>(byte1 & 0x06) << 29) |
-        (static_cast<DWORD>(word1 & 0xFFFE) << 14) |
-        (static_cast<DWORD>(word2) >> 1);
-
-    return li.QuadPart;
-}
-
-
-//-------------------------------------------------------------------
-// ParseStreamData
-// Parses the stream information (for one stream) in the system
-// header.
-//-------------------------------------------------------------------
-
-void ParseStreamData(const BYTE *pStreamInfo, MPEG1StreamHeader &header)
-{
-    // Check marker bits.
-    if ( (pStreamInfo[1] & 0xC0) != 0xC0 )
-    {
-        ThrowException(MF_E_INVALID_FORMAT); // Invalid bits
-    }
-
-    BYTE id = 0;
-    BYTE num = 0;
-    DWORD bound = 0;
-    StreamType type = StreamType_Unknown;
-
-    // The id is a stream code plus (for some types) a stream number, bitwise-OR'd.
-
-    id = pStreamInfo[0];
-
-    ParseStreamId(id, &type, &num);
-
-    // Calculate STD bound.
-    bound = pStreamInfo[2] | ((pStreamInfo[1] & 0x1F) << 8);
-
-    if (pStreamInfo[1] & 0x20)
-    {
-        bound *= 1024;
-    }
-    else
-    {
-        bound *= 128;
-    }
-
-    header.stream_id = id;
-    header.type = type;
-    header.number = num;
-    header.sizeBound = bound;
-}
-
-
-
-//-------------------------------------------------------------------
-// ParseStreamId
-// Parses an MPEG-1 stream ID.
-//
-// Note:
-// The id is a stream code, plus (for some types) a stream number,
-// bitwise-OR'd. This function returns the type and the stream number.
-//
-// See ISO/EIC 11172-1, sec 2.4.4.2
-//-------------------------------------------------------------------
-
-void ParseStreamId(BYTE id, StreamType *pType, BYTE *pStreamNum)
-{
-    StreamType type = StreamType_Unknown;
-    BYTE num = 0;
-
-    switch (id)
-    {
-    case MPEG1_STREAMTYPE_ALL_AUDIO:
-        type = StreamType_AllAudio;
-        break;
-
-    case MPEG1_STREAMTYPE_ALL_VIDEO:
-        type = StreamType_AllVideo;
-        break;
-
-    case MPEG1_STREAMTYPE_RESERVED:
-        type = StreamType_Reserved;
-        break;
-
-    case MPEG1_STREAMTYPE_PRIVATE1:
-        type = StreamType_Private1;
-        break;
-
-    case MPEG1_STREAMTYPE_PADDING:
-        type = StreamType_Padding;
-        break;
-
-    case MPEG1_STREAMTYPE_PRIVATE2:
-        type = StreamType_Private2;
-        break;
-
-    default:
-        if ((id & 0xE0) == MPEG1_STREAMTYPE_AUDIO_MASK)
-        {
-            type = StreamType_Audio;
-            num = id & 0x1F;
-        }
-        else if ((id & 0xF0) == MPEG1_STREAMTYPE_VIDEO_MASK)
-        {
-            type = StreamType_Video;
-            num = id & 0x0F;
-        }
-        else if ((id & 0xF0) == MPEG1_STREAMTYPE_DATA_MASK)
-        {
-            type = StreamType_Data;
-            num = id & 0x0F;
-        }
-        else
+        ULONGLONG a = numerator, b = denominator;
+        while (b != 0)
         {
-            ThrowException(MF_E_INVALID_FORMAT); // Unknown stream ID code.
+            const ULONGLONG t = a % b;
+            a = b;
+            b = t;
         }
-    }
-
-    *pType = type;
-    *pStreamNum = num;
-}
-
-
-//-------------------------------------------------------------------
-// ReadVideoSequenceHeader
-// Parses a video sequence header.
-//
-// Call Parser::HasPacket() to ensure that pData points to the start
-// of a payload, and call Parser::PacketHeader() to verify it is a
-// video packet.
-//-------------------------------------------------------------------
-
-DWORD ReadVideoSequenceHeader(
-    _In_reads_bytes_(cbData) const BYTE *pData,
-    DWORD cbData,
-    MPEG1VideoSeqHeader &seqHeader
-    )
-{
-    DWORD cbPadding = 0;
-
-    if (pData == nullptr)
-    {
-        throw ref new InvalidArgumentException();
-    }
 
-    // Skip to the sequence header code.
-    while ( (cbPadding + 4) <= cbData && ((DWORD*)pData)[0] == 0 )
-    {
-        pData += 4;
-        cbPadding += 4;
-    }
-
-    cbData -= cbPadding;
-
-    // Check for the minimum size buffer.
-    if (cbData < MPEG1_VIDEO_SEQ_HEADER_MIN_SIZE)
-    {
-        return cbPadding;
-    }
-
-    // Validate the sequence header code.
-    if (MAKE_DWORD(pData) != MPEG1_SEQUENCE_HEADER_CODE)
-    {
-        ThrowException(MF_E_INVALID_FORMAT);
-    }
-
-    // Calculate the actual required size.
-    DWORD cbRequired = MPEG1_VIDEO_SEQ_HEADER_MIN_SIZE;
-
-    // Look for quantization matrices.
-    if ( HAS_FLAG(pData[11], 0x02) )
-    {
-        // Intra quantization matrix is true.
-        cbRequired += 64;
-    }
-    // Intra is false, look for non-intra flag
-    else if ( HAS_FLAG(pData[11], 0x01) )
-    {
-        cbRequired += 64;
-    }
-
-    if (cbData < cbRequired)
-    {
-        return cbPadding;
-    }
-
-    ZeroMemory(&seqHeader, sizeof(seqHeader));
-
-    // Check the marker bit.
-    if ( !HAS_FLAG(pData[10], 0x20) )
-    {
-        ThrowException(MF_E_INVALID_FORMAT);
-    }
-
-    BYTE parCode = pData[7] >> 4;
-    BYTE frameRateCode = pData[7] & 0x0F;
-
-    seqHeader.pixelAspectRatio = GetPixelAspectRatio(parCode);
-    seqHeader.frameRate = GetFrameRate(frameRateCode);
-
-    seqHeader.width = (pData[4] << 4) | (pData[5] >> 4) ;
-    seqHeader.height = ((pData[5] & 0x0F) << 8) | (pData[6]);
-    seqHeader.bitRate = (pData[8] << 10) | (pData[9] << 2) | (pData[10] >> 6);
-
-    if (seqHeader.bitRate == 0)
-    {
-        ThrowException(MF_E_INVALID_FORMAT); // Not allowed.
-    }
-    else if (seqHeader.bitRate == 0x3FFFF)
-    {
-        seqHeader.bitRate = 0; // Variable bit-rate.
-    }
-    else
-    {
-        seqHeader.bitRate = seqHeader.bitRate * 400; // Units of 400 bps
-    }
-
-    seqHeader.cbVBV_Buffer = ( ((pData[10] & 0x1F) << 5) | (pData[11] >> 3) ) * 2048;
-    seqHeader.bConstrained = HAS_FLAG(pData[11], 0x04);
-
-    seqHeader.cbHeader = cbRequired;
-    CopyMemory(seqHeader.header, pData, cbRequired);
-
-    return cbRequired + cbPadding;
-}
-
-
-
-//-------------------------------------------------------------------
-// GetFrameRate
-// Returns the frame rate from the picture_rate field of the sequence
-// header.
-//
-// See ISO/IEC 11172-2, 2.4.3.2 "Sequence Header"
-//-------------------------------------------------------------------
-
-MFRatio GetFrameRate(BYTE frameRateCode)
-{
-    MFRatio frameRates[] =
-    {
-        { 0, 0 },           // invalid
-        { 24000, 1001 },    // 23.976 fps
-        { 24, 1 },
-        { 25, 1 },
-        { 30000, 1001 },    // 29.97 fps
-        { 50, 1 },
-        { 60000, 1001 },    // 59.94 fps
-        { 60, 1 }
-    };
-
-    if (frameRateCode < 1 || frameRateCode >= ARRAYSIZE(frameRates))
-    {
-        ThrowException(MF_E_INVALIDTYPE);
-    }
-
-    MFRatio result = { frameRates[frameRateCode].Numerator, frameRates[frameRateCode].Denominator };
-    return result;
-}
-
-//-------------------------------------------------------------------
-// GetPixelAspectRatio
-// Returns the pixel aspect ratio (PAR) from the pel_aspect_ratio
-// field of the sequence header.
-//
-// See ISO/IEC 11172-2, 2.4.3.2 "Sequence Header"
-//-------------------------------------------------------------------
-
-MFRatio GetPixelAspectRatio(BYTE pixelAspectCode)
-{
-    DWORD height[] = { 0, 10000, 6735, 7031, 7615, 8055, 8437, 8935, 9157,
-        9815, 10255, 10695, 10950, 11575, 12015 };
-
-    const DWORD width = 10000;
-
-    if (pixelAspectCode < 1 || pixelAspectCode >= ARRAYSIZE(height))
-    {
-        ThrowException(MF_E_INVALIDTYPE);
+        result.Numerator = static_cast<UINT32>(numerator / a);
+        result.Denominator = static_cast<UINT32>(denominator / a);
     }
-
-    MFRatio result = { height[pixelAspectCode], width };
     return result;
 }
 
@@ -1027,11 +575,15 @@ DWORD ReadAudioFrameHeader(
         ThrowException(MF_E_INVALID_FORMAT);
     }
 
-    if (!HAS_FLAG(pData[1], 0xF8))
+    // Sync word. The ID bit (0x08) is 0 for the MPEG-2 low sampling
+    // frequency extension (ISO/IEC 13818-3).
+    if (!HAS_FLAG(pData[1], 0xF0))
     {
         ThrowException(MF_E_INVALID_FORMAT);
     }
 
+    header.bLSF = !HAS_FLAG(pData[1], 0x08);
+
     // Layer bits
     switch (pData[1] & 0x06)
     {
@@ -1060,10 +612,10 @@ DWORD ReadAudioFrameHeader(
     // Bit rate.
     // Note: Accoring to ISO/IEC 11172-3, some combinations of bitrate and
     // mode are not valid. However, this is up to the decoder to validate.
-    header.dwBitRate = GetAudioBitRate(header.layer, bitRateIndex);
+    header.dwBitRate = GetAudioBitRate(header.layer, header.bLSF, bitRateIndex);
 
     // Sampling frequency.
-    header.dwSamplesPerSec = GetSamplingFrequency(samplingIndex);
+    header.dwSamplesPerSec = GetSamplingFrequency(header.bLSF, samplingIndex);
 
     header.mode = static_cast<MPEG1AudioMode>((pData[3] & 0xC0) >> 6);
     header.modeExtension = (pData[3] & 0x30) >> 4;
@@ -1098,6 +650,38 @@ DWORD ReadAudioFrameHeader(
 
     header.nBlockAlign = 1;
 
+    // Frame size. See ISO/IEC 11172-3, 2.4.3.1, "Audio sequence general"
+    // A bit rate of zero means free format, where the frame size is not
+    // given by the header.
+    if (header.layer == MPEG1_Audio_Layer1)
+    {
+        header.dwSamplesPerFrame = 384;
+        if (header.dwBitRate > 0)
+        {
+            header.cbFrameSize = ((12 * header.dwBitRate * 1000) / header.dwSamplesPerSec) * 4;
+            if (HAS_FLAG(pData[2], 0x02))
+            {
+                header.cbFrameSize += 4;    // Padding slot is 4 bytes in Layer I.
+            }
+        }
+    }
+    else
+    {
+        // At the low sampling frequencies, a Layer III frame has half as
+        // many samples. See ISO/IEC 13818-3, 2.4.3.1.
+        const bool bHalfFrame = header.bLSF && (header.layer == MPEG1_Audio_Layer3);
+
+        header.dwSamplesPerFrame = bHalfFrame ? 576 : 1152;
+        if (header.dwBitRate > 0)
+        {
+            header.cbFrameSize = ((bHalfFrame ? 72 : 144) * header.dwBitRate * 1000) / header.dwSamplesPerSec;
+            if (HAS_FLAG(pData[2], 0x02))
+            {
+                header.cbFrameSize += 1;
+            }
+        }
+    }
+
     CopyMemory(&audioHeader, &header, sizeof(audioHeader));
     return 4;
 };
@@ -1108,10 +692,11 @@ DWORD ReadAudioFrameHeader(
 // Returns the audio bit rate in KBits per second, from the
 // bitrate_index field of the audio frame header.
 //
-// See ISO/IEC 11172-3, 2.4.2.3, "Header"
+// See ISO/IEC 11172-3, 2.4.2.3, "Header", and ISO/IEC 13818-3,
+// 2.4.2.3 for the low sampling frequencies.
 //-------------------------------------------------------------------
 
-DWORD GetAudioBitRate(MPEG1AudioLayer layer, BYTE index)
+DWORD GetAudioBitRate(MPEG1AudioLayer layer, bool bLSF, BYTE index)
 {
     const DWORD MAX_BITRATE_INDEX = 14;
 
@@ -1123,6 +708,14 @@ DWORD GetAudioBitRate(MPEG1AudioLayer layer, BYTE index)
         { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 }         // Layer III
     };
 
+    // Low sampling frequencies. Layers II and III share a table.
+    const DWORD bitrateLSF[3][ (MAX_BITRATE_INDEX+1) ] =
+    {
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },       // Layer I
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },            // Layer II
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }             // Layer III
+    };
+
     if (layer < MPEG1_Audio_Layer1 || layer > MPEG1_Audio_Layer3)
     {
         ThrowException(MF_E_INVALID_FORMAT);
@@ -1132,31 +725,467 @@ DWORD GetAudioBitRate(MPEG1AudioLayer layer, BYTE index)
         ThrowException(MF_E_INVALID_FORMAT);
     }
 
-    return bitrate[layer][index];
+    return bLSF ? bitrateLSF[layer][index] : bitrate[layer][index];
 }
 
 //-------------------------------------------------------------------
 // GetSamplingFrequency
 // Returns the sampling frequency in samples per second, from the
-// sampling_frequency field of the audio frame header.
+// sampling_frequency field of the audio frame header. The low
+// sampling frequencies of MPEG-2 are half of the MPEG-1 values.
 //
 // See ISO/IEC 11172-3, 2.4.2.3, "Header"
 //-------------------------------------------------------------------
 
-DWORD GetSamplingFrequency(BYTE code)
+DWORD GetSamplingFrequency(bool bLSF, BYTE code)
 {
+    DWORD dwSamplesPerSec = 0;
+
     switch (code)
     {
     case 0:
-        return 44100;
+        dwSamplesPerSec = 44100;
+        break;
     case 1:
-        return 48000;
+        dwSamplesPerSec = 48000;
+        break;
     case 2:
-        return 32000;
+        dwSamplesPerSec = 32000;
+        break;
     default:
         ThrowException(MF_E_INVALID_FORMAT);
     }
 
-    return 0;
+    return bLSF ? dwSamplesPerSec / 2 : dwSamplesPerSec;
+}
+
+
+
+//-------------------------------------------------------------------
+// AudioFramer class
+//-------------------------------------------------------------------
+
+AudioFramer::AudioFramer()
+    : m_buffer(ref new Buffer(MPEG1_MAX_PACKET_SIZE))
+{
+    Reset();
+}
+
+//-------------------------------------------------------------------
+// Reset
+// Discards any buffered data and time stamp state.
+//-------------------------------------------------------------------
+
+void AudioFramer::Reset()
+{
+    m_buffer->MoveStart(m_buffer->DataSize);
+    m_cbLastFrame = 0;
+    m_cbPosition = 0;
+    m_bPendingPTS = false;
+    m_pendingPTS = 0;
+    m_cbPendingPTSPos = 0;
+    m_bHasAnchor = false;
+    m_hnsAnchor = 0;
+    m_cSamplesSinceAnchor = 0;
+}
+
+//-------------------------------------------------------------------
+// AddPayload
+// Appends the payload of an audio packet to the framer.
+//
+// pData:     Packet payload.
+// cbData:    Size of the payload.
+// packetHdr: Packet header; supplies the PTS, if present.
+//-------------------------------------------------------------------
+
+void AudioFramer::AddPayload(const BYTE *pData, DWORD cbData, const MPEG1PacketHeader &packetHdr)
+{
+    // Release the frame that was returned by the last NextFrame call.
+    m_buffer->MoveStart(m_cbLastFrame);
+    m_cbPosition += m_cbLastFrame;
+    m_cbLastFrame = 0;
+
+    if (packetHdr.bHasPTS)
+    {
+        // The PTS belongs to the first frame that starts in this payload.
+        m_bPendingPTS = true;
+        m_pendingPTS = packetHdr.PTS;
+        m_cbPendingPTSPos = m_cbPosition + m_buffer->DataSize;
+    }
+
+    m_buffer->Reserve(cbData);
+    CopyMemory(m_buffer->DataPtr + m_buffer->DataSize, pData, cbData);
+    m_buffer->MoveEnd(cbData);
+}
+
+//-------------------------------------------------------------------
+// NextFrame
+// Returns the next complete audio frame, if there is one.
+//
+// frame: Receives the frame. frame.pData is valid until the next
+//        call to AddPayload or NextFrame.
+//
+// bFlush: If true, there is no more data, so the last frame is
+//        returned without a following header to confirm it.
+//
+// Returns false if the framer needs more data.
+//-------------------------------------------------------------------
+
+bool AudioFramer::NextFrame(MPEG1AudioFrame &frame, bool bFlush)
+{
+    MPEG1AudioFrameHeader header;
+
+    // Release the previous frame.
+    m_buffer->MoveStart(m_cbLastFrame);
+    m_cbPosition += m_cbLastFrame;
+    m_cbLastFrame = 0;
+
+    if (!FindFrameSync(header, bFlush))
+    {
+        return false;
+    }
+
+    if (m_buffer->DataSize < header.cbFrameSize)
+    {
+        // Wait for the rest of the frame.
+        return false;
+    }
+
+    if (m_bPendingPTS && m_cbPendingPTSPos <= m_cbPosition)
+    {
+        // This is the first frame that starts in the packet with the PTS.
+        m_bHasAnchor = true;
+        m_hnsAnchor = m_pendingPTS * 10000ll / 90ll;
+        m_cSamplesSinceAnchor = 0;
+        m_bPendingPTS = false;
+    }
+
+    ZeroMemory(&frame, sizeof(frame));
+
+    frame.pData = m_buffer->DataPtr;
+    frame.cbSize = header.cbFrameSize;
+
+    if (m_bHasAnchor)
+    {
+        // Compute both ends of the frame from the sample count, so that the
+        // rounding error does not accumulate.
+        LONGLONG hnsStart = (m_cSamplesSinceAnchor * 10000000ll) / header.dwSamplesPerSec;
+
+        m_cSamplesSinceAnchor += header.dwSamplesPerFrame;
+
+        LONGLONG hnsEnd = (m_cSamplesSinceAnchor * 10000000ll) / header.dwSamplesPerSec;
+
+        frame.bHasTime = true;
+        frame.hnsTime = m_hnsAnchor + hnsStart;
+        frame.hnsDuration = hnsEnd - hnsStart;
+    }
+
+    m_cbLastFrame = header.cbFrameSize;
+
+    return true;
 }
 
+//-------------------------------------------------------------------
+// IsAudioFrameSync
+// Checks the sync word, and rejects the reserved and free-format
+// values, so that ReadAudioFrameHeader does not throw.
+//-------------------------------------------------------------------
+
+static bool IsAudioFrameSync(const BYTE *p)
+{
+    return (p[0] == 0xFF) && HAS_FLAG(p[1], 0xF0) &&
+        ((p[1] & 0x06) != 0x00) &&
+        ((p[2] & 0xF0) != 0x00) && ((p[2] & 0xF0) != 0xF0) &&
+        ((p[2] & 0x0C) != 0x0C);
+}
+
+//-------------------------------------------------------------------
+// FindFrameSync (private)
+// Skips to the next valid audio frame header.
+//
+// header: Receives the frame header.
+// bFlush: If true, there is no more data.
+//
+// A sync word can also occur inside the audio data. So a header is
+// accepted only if another header with the same layer and sampling
+// frequency follows it at the frame size, or, when bFlush is true, if
+// the frame is complete at the end of the data.
+//
+// Returns false if the buffer does not contain a confirmed header. Any
+// bytes in front of the first possible header are discarded.
+//-------------------------------------------------------------------
+
+bool AudioFramer::FindFrameSync(MPEG1AudioFrameHeader &header, bool bFlush)
+{
+    const BYTE *pData = m_buffer->DataPtr;
+    DWORD cbData = m_buffer->DataSize;
+    DWORD cbSkip = 0;
+    bool bFound = false;
+
+    while (cbData - cbSkip >= MPEG1_AUDIO_FRAME_HEADER_SIZE)
+    {
+        const BYTE *p = pData + cbSkip;
+        DWORD cbLeft = cbData - cbSkip;
+
+        if (IsAudioFrameSync(p))
+        {
+            ReadAudioFrameHeader(p, cbLeft, header);
+
+            if (cbLeft >= header.cbFrameSize + MPEG1_AUDIO_FRAME_HEADER_SIZE)
+            {
+                // Check the header of the next frame.
+                const BYTE *pNext = p + header.cbFrameSize;
+
+                if (IsAudioFrameSync(pNext) &&
+                    ((pNext[1] & 0xFE) == (p[1] & 0xFE)) &&
+                    ((pNext[2] & 0x0C) == (p[2] & 0x0C)))
+                {
+                    bFound = true;
+                    break;
+                }
+            }
+            else if (bFlush)
+            {
+                // Last frame. Accept it only if it is complete.
+                bFound = (cbLeft >= header.cbFrameSize);
+                if (bFound)
+                {
+                    break;
+                }
+            }
+            else
+            {
+                // Wait for the next header.
+                break;
+            }
+        }
+
+        ++cbSkip;
+    }
+
+    m_buffer->MoveStart(cbSkip);
+    m_cbPosition += cbSkip;
+
+    return bFound;
+}
+
+
+//-------------------------------------------------------------------
+// VideoFramer class
+//-------------------------------------------------------------------
+
+VideoFramer::VideoFramer()
+    : m_buffer(ref new Buffer(MPEG1_MAX_PACKET_SIZE))
+{
+    Reset();
+}
+
+//-------------------------------------------------------------------
+// Reset
+// Discards any buffered data and pending time stamps.
+//-------------------------------------------------------------------
+
+void VideoFramer::Reset()
+{
+    m_buffer->MoveStart(m_buffer->DataSize);
+    m_cbLastUnit = 0;
+    m_cbPosition = 0;
+    m_cbScanned = 0;
+    m_bHasPicture = false;
+    m_cbPictureOffset = 0;
+    m_pictureType = MPEG1_Picture_Unknown;
+    m_temporalReference = 0;
+    m_cStamps = 0;
+}
+
+//-------------------------------------------------------------------
+// AddPayload
+// Appends the payload of a video packet to the framer.
+//
+// pData:     Packet payload.
+// cbData:    Size of the payload.
+// packetHdr: Packet header; supplies the PTS and DTS, if present.
+//-------------------------------------------------------------------
+
+void VideoFramer::AddPayload(const BYTE *pData, DWORD cbData, const MPEG1PacketHeader &packetHdr)
+{
+    ReleaseAccessUnit();
+
+    if (packetHdr.bHasPTS)
+    {
+        if (m_cStamps == MPEG1_MAX_PENDING_TIME_STAMPS)
+        {
+            // Too many packets without a picture. Drop the oldest time stamp.
+            MoveMemory(&m_stamps[0], &m_stamps[1], sizeof(MPEG1TimeStamps) * (MPEG1_MAX_PENDING_TIME_STAMPS - 1));
+            --m_cStamps;
+        }
+
+        MPEG1TimeStamps &stamps = m_stamps[m_cStamps++];
+
+        stamps.cbPosition = m_cbPosition + m_buffer->DataSize;
+        stamps.bHasPTS = packetHdr.bHasPTS;
+        stamps.PTS = packetHdr.PTS;
+        stamps.bHasDTS = packetHdr.bHasDTS;
+        stamps.DTS = packetHdr.DTS;
+    }
+
+    m_buffer->Reserve(cbData);
+    CopyMemory(m_buffer->DataPtr + m_buffer->DataSize, pData, cbData);
+    m_buffer->MoveEnd(cbData);
+}
+
+//-------------------------------------------------------------------
+// NextAccessUnit
+// Returns the next complete access unit, if there is one.
+//
+// au:     Receives the access unit. au.pData is valid until the next
+//         call to AddPayload or NextAccessUnit.
+// bFlush: If true, return whatever is left as the last access unit.
+//
+// An access unit ends where the next picture, GOP header, or sequence
+// header starts. A sequence end code is kept with the last picture.
+//
+// Returns false if the framer needs more data.
+//-------------------------------------------------------------------
+
+bool VideoFramer::NextAccessUnit(MPEG1VideoAccessUnit &au, bool bFlush)
+{
+    ReleaseAccessUnit();
+
+    const BYTE *pData = m_buffer->DataPtr;
+    const DWORD cbData = m_buffer->DataSize;
+    DWORD cbUnit = 0;   // Size of the access unit, if we found the end.
+    DWORD i = m_cbScanned;
+
+    // Search for start codes. A start code needs 4 bytes; a picture start
+    // code needs 6 bytes so that we can read the picture header fields.
+    while (i + 4 <= cbData)
+    {
+        if (pData[i] != 0 || pData[i + 1] != 0 || pData[i + 2] != 1)
+        {
+            ++i;
+            continue;
+        }
+
+        DWORD code = MPEG1_START_CODE_PREFIX | pData[i + 3];
+
+        if (m_bHasPicture)
+        {
+            if (code == MPEG1_PICTURE_START_CODE ||
+                code == MPEG1_GOP_START_CODE ||
+                code == MPEG1_SEQUENCE_HEADER_CODE)
+            {
+                cbUnit = i;
+                break;
+            }
+            else if (code == MPEG1_SEQUENCE_END_CODE)
+            {
+                cbUnit = i + 4;
+                break;
+            }
+        }
+        else if (code == MPEG1_PICTURE_START_CODE)
+        {
+            if (i + 6 > cbData)
+            {
+                break;  // Need the rest of the picture header.
+            }
+
+            // temporal_reference (10 bits), picture_coding_type (3 bits)
+            m_bHasPicture = true;
+            m_cbPictureOffset = i;
+            m_temporalReference = static_cast<WORD>((pData[i + 4] << 2) | (pData[i + 5] >> 6));
+            m_pictureType = static_cast<MPEG1PictureType>((pData[i + 5] >> 3) & 0x07);
+        }
+
+        i += 4;
+    }
+
+    if (cbUnit == 0)
+    {
+        // Resume the search where we stopped. The bytes after this point
+        // might be the start of a start code that is split across payloads.
+        m_cbScanned = i;
+
+        if (!bFlush || !m_bHasPicture)
+        {
+            return false;
+        }
+
+        cbUnit = cbData;
+    }
+
+    ZeroMemory(&au, sizeof(au));
+
+    au.pData = pData;
+    au.cbSize = cbUnit;
+    au.pictureType = m_pictureType;
+    au.temporalReference = m_temporalReference;
+
+    ApplyTimeStamps(au);
+
+    m_cbLastUnit = cbUnit;
+
+    return true;
+}
+
+//-------------------------------------------------------------------
+// ReleaseAccessUnit (private)
+// Removes the access unit returned by the last NextAccessUnit call
+// from the buffer.
+//-------------------------------------------------------------------
+
+void VideoFramer::ReleaseAccessUnit()
+{
+    if (m_cbLastUnit == 0)
+    {
+        return;
+    }
+
+    m_buffer->MoveStart(m_cbLastUnit);
+    m_cbPosition += m_cbLastUnit;
+    m_cbLastUnit = 0;
+
+    m_cbScanned = 0;
+    m_bHasPicture = false;
+    m_cbPictureOffset = 0;
+    m_pictureType = MPEG1_Picture_Unknown;
+    m_temporalReference = 0;
+}
+
+//-------------------------------------------------------------------
+// ApplyTimeStamps (private)
+// Sets the time stamps of an access unit.
+//
+// The time stamps of a packet belong to the first picture start code
+// in that packet, so use the most recent time stamps that arrived at
+// or before the picture start code. Older ones are discarded.
+//-------------------------------------------------------------------
+
+void VideoFramer::ApplyTimeStamps(MPEG1VideoAccessUnit &au)
+{
+    LONGLONG cbPicturePos = m_cbPosition + m_cbPictureOffset;
+    DWORD cUsed = 0;
+
+    while (cUsed < m_cStamps && m_stamps[cUsed].cbPosition <= cbPicturePos)
+    {
+        ++cUsed;
+    }
+
+    if (cUsed == 0)
+    {
+        return;
+    }
+
+    const MPEG1TimeStamps &stamps = m_stamps[cUsed - 1];
+
+    au.bHasPTS = stamps.bHasPTS;
+    au.PTS = stamps.PTS;
+
+    // If the packet has only a PTS, then the DTS is the same.
+    au.bHasDTS = stamps.bHasPTS;
+    au.DTS = stamps.bHasDTS ? stamps.DTS : stamps.PTS;
+
+    MoveMemory(&m_stamps[0], &m_stamps[cUsed], sizeof(MPEG1TimeStamps) * (m_cStamps - cUsed));
+    m_cStamps -= cUsed;
+}
@@ -21,96 +21,16 @@
 //    - Use of the MFRatio structure to describe ratios.
 //    - The MPEG1AudioFlags enum defined here maps directly to the equivalent DirectShow flags.
 
-// Sizes
-const DWORD MPEG1_MAX_PACKET_SIZE = 65535 + 6;          // Maximum packet size.
-const DWORD MPEG1_PACK_HEADER_SIZE = 12;                // Pack header.
-
-const DWORD MPEG1_SYSTEM_HEADER_MIN_SIZE = 12;          // System header, excluding the stream info.
-const DWORD MPEG1_SYSTEM_HEADER_PREFIX = 6;             // This value + header length = total size of the system header.
-const DWORD MPEG1_SYSTEM_HEADER_STREAM = 3;             // Size of each stream info in the system header.
-
-const DWORD MPEG1_PACKET_HEADER_MIN_SIZE = 6;           // Minimum amount to read in the packet header. (Up to the variable-sized padding bytes)
-const DWORD MPEG1_PACKET_HEADER_MAX_STUFFING_BYTE = 16; // Maximum number of stuffing bytes in a packet header.
-const DWORD MPEG1_PACKET_HEADER_MAX_SIZE = 34;          // Maximum size of a packet header.
+#include "MPEG1ParseCore.h"     // Portable systems-layer parser
 
+// Sizes
 const DWORD MPEG1_VIDEO_SEQ_HEADER_MIN_SIZE = 12;       // Minimum length of the video sequence header.
 const DWORD MPEG1_VIDEO_SEQ_HEADER_MAX_SIZE = 140;      // Maximum length of the video sequence header.
+const DWORD MPEG2_SEQUENCE_EXTENSION_SIZE = 10;         // Length of the MPEG-2 sequence extension.
 
 const DWORD MPEG1_AUDIO_FRAME_HEADER_SIZE = 4;
 
 
-// Codes
-const DWORD MPEG1_START_CODE_PREFIX     = 0x00000100;
-const DWORD MPEG1_PACK_START_CODE       = 0x000001BA;
-const DWORD MPEG1_SYSTEM_HEADER_CODE    = 0x000001BB;
-const DWORD MPEG1_SEQUENCE_HEADER_CODE  = 0x000001B3;
-const DWORD MPEG1_STOP_CODE             = 0x000001B9;
-
-// Stream ID codes
-const BYTE MPEG1_STREAMTYPE_ALL_AUDIO = 0xB8;
-const BYTE MPEG1_STREAMTYPE_ALL_VIDEO = 0xB9;
-const BYTE MPEG1_STREAMTYPE_RESERVED = 0xBC;
-const BYTE MPEG1_STREAMTYPE_PRIVATE1 = 0xBD;
-const BYTE MPEG1_STREAMTYPE_PADDING = 0xBE;
-const BYTE MPEG1_STREAMTYPE_PRIVATE2 = 0xBF;
-const BYTE MPEG1_STREAMTYPE_AUDIO_MASK = 0xC0;
-const BYTE MPEG1_STREAMTYPE_VIDEO_MASK = 0xE0;
-const BYTE MPEG1_STREAMTYPE_DATA_MASK = 0xF0;
-
-
-
-// Systems layer
-
-enum StreamType
-{
-    StreamType_Unknown,
-    StreamType_AllAudio,
-    StreamType_AllVideo,
-    StreamType_Reserved,
-    StreamType_Private1,
-    StreamType_Padding,
-    StreamType_Private2,
-    StreamType_Audio,   // ISO/IEC 11172-3
-    StreamType_Video,   // ISO/IEC 11172-2
-    StreamType_Data
-};
-
-struct MPEG1StreamHeader
-{
-    BYTE        stream_id;  // Raw stream_id field.
-    StreamType  type;       // Stream type (audio, video, etc)
-    BYTE        number;     // Index within the stream type (audio 0, audio 1, etc)
-    DWORD       sizeBound;
-};
-
-// MPEG1SystemHeader
-// Holds information from the system header. This structure is variable
-// length, because the last field is an array of stream headers.
-struct MPEG1SystemHeader
-{
-    DWORD   cbSize;     // Size of this structure, including the streams array.
-    DWORD   rateBound;
-    BYTE    cAudioBound;
-    bool    bFixed;
-    bool    bCSPS;
-    bool    bAudioLock;
-    bool    bVideoLock;
-    BYTE    cVideoBound;
-    DWORD   cStreams;
-    MPEG1StreamHeader streams[1];   // Array of 1 or more stream headers.
-};
-
-struct MPEG1PacketHeader
-{
-    BYTE        stream_id;      // Raw stream_id field.
-    StreamType  type;           // Stream type (audio, video, etc)
-    BYTE        number;         // Index within the stream type (audio 0, audio 1, etc)
-    DWORD       cbPacketSize;   // Size of the entire packet (header + payload).
-    DWORD       cbPayload;      // Size of the packet payload (packet size - header size).
-    bool        bHasPTS;        // Did the packet header contain a Presentation Time Stamp (PTS)?
-    LONGLONG    PTS;            // Presentation Time Stamp (in 90 kHz clock)
-};
-
 // Video
 
 struct MPEG1VideoSeqHeader
@@ -122,8 +42,34 @@ struct MPEG1VideoSeqHeader
     DWORD       bitRate;
     WORD        cbVBV_Buffer;
     bool        bConstrained;
+    bool        bMPEG2;         // MPEG-2 video (the header is followed by a sequence extension).
+    bool        bProgressive;   // progressive_sequence flag of the sequence extension. (Always true for MPEG-1.)
     DWORD       cbHeader;
-    BYTE        header[MPEG1_VIDEO_SEQ_HEADER_MAX_SIZE];    // Raw header.
+    BYTE        header[MPEG1_VIDEO_SEQ_HEADER_MAX_SIZE + MPEG2_SEQUENCE_EXTENSION_SIZE];  // Raw header, and the sequence extension for MPEG-2.
+};
+
+enum MPEG1PictureType
+{
+    MPEG1_Picture_Unknown = 0,
+    MPEG1_Picture_I = 1,
+    MPEG1_Picture_P = 2,
+    MPEG1_Picture_B = 3,
+    MPEG1_Picture_D = 4
+};
+
+// MPEG1VideoAccessUnit
+// Describes one coded picture returned by the VideoFramer class. The access
+// unit includes any sequence header or GOP header in front of the picture.
+struct MPEG1VideoAccessUnit
+{
+    const BYTE      *pData;             // Start of the access unit.
+    DWORD           cbSize;             // Size of the access unit, in bytes.
+    MPEG1PictureType pictureType;       // picture_coding_type field.
+    WORD            temporalReference;  // temporal_reference field.
+    bool            bHasPTS;
+    LONGLONG        PTS;                // Presentation Time Stamp (in 90 kHz clock)
+    bool            bHasDTS;
+    LONGLONG        DTS;                // Decoding Time Stamp (in 90 kHz clock)
 };
 
 // Audio
@@ -157,6 +103,7 @@ enum MPEG1AudioFlags
 struct  MPEG1AudioFrameHeader
 {
     MPEG1AudioLayer     layer;
+    bool                bLSF;             // MPEG-2 low sampling frequency extension (ID bit = 0).
     DWORD               dwBitRate;        // Bit rate in Kbits / sec
     DWORD               dwSamplesPerSec;
     WORD                nBlockAlign;
@@ -165,6 +112,19 @@ struct  MPEG1AudioFrameHeader
     BYTE                modeExtension;
     BYTE                emphasis;
     WORD                wFlags;    // bitwise OR of MPEG1AudioFlags
+    DWORD               cbFrameSize;        // Size of the frame, including the header. (0 = free format)
+    DWORD               dwSamplesPerFrame;  // Number of samples per channel in one frame.
+};
+
+// MPEG1AudioFrame
+// Describes one complete audio frame returned by the AudioFramer class.
+struct MPEG1AudioFrame
+{
+    const BYTE  *pData;         // Start of the frame (the frame header).
+    DWORD       cbSize;         // Size of the frame, in bytes.
+    bool        bHasTime;       // Are hnsTime and hnsDuration valid?
+    LONGLONG    hnsTime;        // Presentation time, in 100-nanosecond units.
+    LONGLONG    hnsDuration;    // Duration, in 100-nanosecond units.
 };
 
 // ExpandableStruct class:
@@ -246,7 +206,8 @@ private:
 
 
 // Parser class:
-// Parses an MPEG-1 systems-layer stream.
+// Parses an MPEG-1 systems-layer stream. This is a thin wrapper around
+// MPEG1SystemsParser that reports errors as exceptions.
 ref class Parser sealed
 {
 internal:
@@ -254,38 +215,118 @@ internal:
 
     bool ParseBytes(const BYTE *pData, DWORD cbLen, DWORD *pAte);
 
-    property bool HasSystemHeader{bool get() const { return m_header != nullptr; }}
+    property bool HasSystemHeader{bool get() const { return m_parser.HasSystemHeader(); }}
     ExpandableStruct<MPEG1SystemHeader> ^GetSystemHeader();
 
-    property bool HasPacket {bool get() const { return m_bHasPacketHeader; }}
-    property const MPEG1PacketHeader &PacketHeader { const MPEG1PacketHeader &get() { assert(m_bHasPacketHeader); return m_curPacketHeader; } }
+    property bool HasPacket {bool get() const { return m_parser.HasPacket(); }}
+    property const MPEG1PacketHeader &PacketHeader { const MPEG1PacketHeader &get() { assert(m_parser.HasPacket()); return m_parser.PacketHeader(); } }
 
-    property DWORD PayloadSize{DWORD get() const { assert(m_bHasPacketHeader); return m_curPacketHeader.cbPayload; }}
-    void ClearPacket() { m_bHasPacketHeader = false; }
+    property DWORD PayloadSize{DWORD get() const { assert(m_parser.HasPacket()); return m_parser.PacketHeader().cbPayload; }}
+    void ClearPacket() { m_parser.ClearPacket(); }
 
-    property bool IsEndOfStream {bool get() const { return m_bEOS; }}
+    property bool IsEndOfStream {bool get() const { return m_parser.IsEndOfStream(); }}
 
 private:
 
-    bool FindNextStartCode(const BYTE *pData, DWORD cbLen, DWORD *pAte);
-    bool ParsePackHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte);
-    bool ParseSystemHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte);
-    bool ParsePacketHeader(const BYTE *pData, DWORD cbLen, DWORD *pAte);
-    void OnEndOfStream();
+    MPEG1SystemsParser m_parser;
+};
+
+
+const DWORD MPEG1_MAX_PENDING_TIME_STAMPS = 8;   // Packet time stamps held by VideoFramer.
+
+// MPEG1TimeStamps
+// Time stamps of a packet, waiting to be matched with a picture.
+struct MPEG1TimeStamps
+{
+    LONGLONG    cbPosition;     // Stream position of the packet payload.
+    bool        bHasPTS;
+    LONGLONG    PTS;
+    bool        bHasDTS;
+    LONGLONG    DTS;
+};
+
+// VideoFramer class:
+// Splits the payloads of an MPEG-1 video stream into access units (one coded
+// picture each).
+//
+// The time stamps of a packet apply to the first picture that starts in that
+// packet. Pictures without time stamps are returned with bHasPTS = false.
+ref class VideoFramer sealed
+{
+internal:
+    VideoFramer();
+
+    // AddPayload: Appends the payload of the next video packet.
+    void AddPayload(const BYTE *pData, DWORD cbData, const MPEG1PacketHeader &packetHdr);
+
+    // NextAccessUnit: Gets the next complete access unit. Returns false if more
+    // data is needed. If bFlush is true, the remaining data is returned as the
+    // last access unit. The data is valid until the next call to AddPayload or
+    // NextAccessUnit.
+    bool NextAccessUnit(MPEG1VideoAccessUnit &au, bool bFlush);
+
+    // Reset: Discards any buffered data, e.g. after the source seeks.
+    void Reset();
+
+private:
+    void ReleaseAccessUnit();
+    void ApplyTimeStamps(MPEG1VideoAccessUnit &au);
 
 private:
+    Buffer ^m_buffer;
+    DWORD m_cbLastUnit;         // Size of the access unit returned by NextAccessUnit, not yet released.
 
-    LONGLONG m_SCR;
-    DWORD m_muxRate;
-    Array<BYTE> ^m_data;
+    LONGLONG m_cbPosition;      // Stream position of the first byte in m_buffer.
+    DWORD m_cbScanned;          // How far the current access unit has been searched for start codes.
 
-    ExpandableStruct<MPEG1SystemHeader> ^m_header;
-    // Note: Size of header = sizeof(MPEG1SystemHeader) + (sizeof(MPEG1StreamHeader) * (cStreams - 1))
+    bool m_bHasPicture;         // Was a picture start code found in the current access unit?
+    DWORD m_cbPictureOffset;    // Offset of the picture start code.
+    MPEG1PictureType m_pictureType;
+    WORD m_temporalReference;
+
+    MPEG1TimeStamps m_stamps[MPEG1_MAX_PENDING_TIME_STAMPS];
+    DWORD m_cStamps;
+};
+
+
+// AudioFramer class:
+// Splits the payloads of an MPEG-1 audio stream into individual audio frames.
+//
+// The PTS of a packet applies to the first frame that starts in that packet.
+// Frames that follow are stamped by counting samples from that PTS, so every
+// frame gets an exact time stamp and duration.
+ref class AudioFramer sealed
+{
+internal:
+    AudioFramer();
+
+    // AddPayload: Appends the payload of the next audio packet.
+    void AddPayload(const BYTE *pData, DWORD cbData, const MPEG1PacketHeader &packetHdr);
+
+    // NextFrame: Gets the next complete frame. Returns false if more data is needed.
+    // A frame is returned once the header of the next frame confirms it, or, if
+    // bFlush is true, at the end of the data. The frame data is valid until the
+    // next call to AddPayload or NextFrame.
+    bool NextFrame(MPEG1AudioFrame &frame, bool bFlush);
+
+    // Reset: Discards any buffered data, e.g. after the source seeks.
+    void Reset();
+
+private:
+    bool FindFrameSync(MPEG1AudioFrameHeader &header, bool bFlush);
+
+private:
+    Buffer ^m_buffer;
+    DWORD m_cbLastFrame;        // Size of the frame returned by NextFrame, not yet released.
 
-    bool m_bHasPacketHeader;
-    MPEG1PacketHeader m_curPacketHeader;  // Most recent packet header.
+    LONGLONG m_cbPosition;      // Stream position of the first byte in m_buffer.
+    bool m_bPendingPTS;         // Is there a PTS that has not been applied yet?
+    LONGLONG m_pendingPTS;
+    LONGLONG m_cbPendingPTSPos; // Stream position of the packet that carried m_pendingPTS.
 
-    bool m_bEOS;
+    bool m_bHasAnchor;          // Do we have a time stamp to count samples from?
+    LONGLONG m_hnsAnchor;       // Time of the frame that carried the last PTS.
+    LONGLONG m_cSamplesSinceAnchor;
 };
 
 
@@ -0,0 +1,241 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MPEG1DemuxBench.cpp
+// Command-line benchmark for the portable MPEG-1 systems-layer parser.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Usage: mpeg1bench [-n iterations] [-b buffer size] file|- [file|-...]
+//
+// Reads each file (or standard input, for "-") into memory, and then
+// demuxes it the given number of times, feeding the parser one buffer at
+// a time and copying each payload the way the source does. Prints the
+// packets and payload bytes of each stream, and the demux rate. Returns 1
+// if a stream is empty or not valid, or if it has data after the last
+// packet that is not a stop code.
+
+#include "MPEG1ParseCore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+const DWORD DEFAULT_BUFFER_SIZE = 64 * 1024;    // Same as the read size of CMPEG1Source.
+
+struct DemuxStats
+{
+    LONGLONG    cPacks;
+    LONGLONG    cPackets[256];      // By stream_id.
+    LONGLONG    cbPayload[256];
+    bool        bMPEG2;
+    bool        bEOS;
+};
+
+
+//-------------------------------------------------------------------
+// ReadInput
+// Reads a whole file, or standard input if the name is "-".
+//-------------------------------------------------------------------
+
+static bool ReadInput(const char *pszName, std::vector<BYTE> &data)
+{
+    FILE *pFile = (strcmp(pszName, "-") == 0) ? stdin : fopen(pszName, "rb");
+    if (pFile == nullptr)
+    {
+        fprintf(stderr, "Cannot open %s\n", pszName);
+        return false;
+    }
+
+    BYTE buffer[65536];
+    size_t cbRead = 0;
+
+    while ((cbRead = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + cbRead);
+    }
+
+    if (pFile != stdin)
+    {
+        fclose(pFile);
+    }
+    return true;
+}
+
+
+//-------------------------------------------------------------------
+// Demux
+// Parses a stream, revealing cbBuffer more bytes to the parser each
+// time it needs more data.
+//-------------------------------------------------------------------
+
+static MPEG1ParseStatus Demux(const std::vector<BYTE> &data, DWORD cbBuffer, DemuxStats *pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+
+    MPEG1SystemsParser parser;
+
+    const BYTE *pData = data.data();
+    const DWORD cbData = static_cast<DWORD>(data.size());
+
+    if (cbData == 0)
+    {
+        return MPEG1_PARSE_INVALID_FORMAT;
+    }
+
+    DWORD cbParsed = 0;
+    DWORD cbAvailable = 0;
+
+    std::vector<BYTE> payload(MPEG1_MAX_PACKET_SIZE);
+
+    while (!parser.IsEndOfStream())
+    {
+        DWORD cbAte = 0;
+        MPEG1ParseStatus status = parser.ParseBytes(pData + cbParsed, cbAvailable - cbParsed, &cbAte);
+
+        if (status == MPEG1_PARSE_NEED_MORE_DATA)
+        {
+            if (cbAvailable == cbData)
+            {
+                break;
+            }
+            cbAvailable = (cbData - cbAvailable > cbBuffer) ? cbAvailable + cbBuffer : cbData;
+            continue;
+        }
+        else if (status != MPEG1_PARSE_OK)
+        {
+            return status;
+        }
+
+        // Valid streams have no data between the headers and packets.
+        if ((cbAte >= 4) && (MAKE_DWORD(pData + cbParsed) == MPEG1_PACK_START_CODE))
+        {
+            pStats->cPacks++;
+        }
+
+        cbParsed += cbAte;
+
+        if (parser.HasPacket())
+        {
+            const MPEG1PacketHeader &packetHdr = parser.PacketHeader();
+
+            // Like the source, skip the payload even if it is not all in the
+            // buffer yet. A packet cannot run past the end of the stream.
+            if (packetHdr.cbPayload > cbData - cbParsed)
+            {
+                return MPEG1_PARSE_INVALID_FORMAT;
+            }
+
+            memcpy(payload.data(), pData + cbParsed, packetHdr.cbPayload);
+
+            pStats->cPackets[packetHdr.stream_id]++;
+            pStats->cbPayload[packetHdr.stream_id] += packetHdr.cbPayload;
+
+            cbParsed += packetHdr.cbPayload;
+            if (cbAvailable < cbParsed)
+            {
+                cbAvailable = cbParsed;
+            }
+
+            parser.ClearPacket();
+        }
+    }
+
+    pStats->bMPEG2 = parser.IsMPEG2();
+    pStats->bEOS = parser.IsEndOfStream();
+
+    // The parser does not see a stop code in the last 4 bytes of the
+    // buffer; the source ends the stream at the end of the file anyway.
+    if (!pStats->bEOS && (cbData - cbParsed == 4) && (MAKE_DWORD(pData + cbParsed) == MPEG1_STOP_CODE))
+    {
+        pStats->bEOS = true;
+        cbParsed = cbData;
+    }
+
+    if (cbParsed != cbData)
+    {
+        return MPEG1_PARSE_INVALID_FORMAT;
+    }
+
+    return MPEG1_PARSE_OK;
+}
+
+
+int main(int argc, char **argv)
+{
+    int cIterations = 1;
+    DWORD cbBuffer = DEFAULT_BUFFER_SIZE;
+    int result = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+        {
+            cIterations = atoi(argv[++i]);
+            continue;
+        }
+        if ((strcmp(argv[i], "-b") == 0) && (i + 1 < argc))
+        {
+            cbBuffer = static_cast<DWORD>(atoi(argv[++i]));
+            continue;
+        }
+
+        std::vector<BYTE> data;
+        if (!ReadInput(argv[i], data))
+        {
+            return 1;
+        }
+
+        if ((cIterations < 1) || (cbBuffer < 1))
+        {
+            fprintf(stderr, "Invalid -n or -b value\n");
+            return 1;
+        }
+
+        DemuxStats stats;
+        MPEG1ParseStatus status = MPEG1_PARSE_OK;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (int j = 0; (j < cIterations) && (status == MPEG1_PARSE_OK); j++)
+        {
+            status = Demux(data, cbBuffer, &stats);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (status != MPEG1_PARSE_OK)
+        {
+            fprintf(stderr, "%s: not a valid stream (status %d)\n", argv[i], status);
+            result = 1;
+            continue;
+        }
+
+        printf("%s: %zu bytes, %s, %lld packs%s\n", argv[i], data.size(),
+            stats.bMPEG2 ? "MPEG-2 program stream" : "MPEG-1 system stream",
+            static_cast<long long>(stats.cPacks), stats.bEOS ? ", stop code" : "");
+
+        for (int id = 0; id < 256; id++)
+        {
+            if (stats.cPackets[id] > 0)
+            {
+                printf("  stream 0x%02X: %lld packets, %lld payload bytes\n", id,
+                    static_cast<long long>(stats.cPackets[id]), static_cast<long long>(stats.cbPayload[id]));
+            }
+        }
+
+        if (seconds > 0)
+        {
+            printf("  %d iterations in %.3f s: %.1f MB/s\n", cIterations, seconds,
+                (static_cast<double>(data.size()) * cIterations) / seconds / 1e6);
+        }
+    }
+
+    return result;
+}
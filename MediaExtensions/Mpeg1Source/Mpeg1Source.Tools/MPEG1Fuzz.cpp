@@ -0,0 +1,109 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MPEG1Fuzz.cpp
+// libFuzzer target for the portable MPEG-1 systems-layer parser.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Note: The input is parsed the way the Parser class in Parse.h drives
+// MPEG1SystemsParser: one header at a time, skipping each packet payload.
+// The first byte of the input selects how the rest is split into
+// buffers, so that the fuzzer also covers headers that straddle a
+// buffer boundary (MPEG1_PARSE_NEED_MORE_DATA).
+
+#include "MPEG1ParseCore.h"
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 1)
+    {
+        return 0;
+    }
+
+    // 0 = whole input in one buffer, otherwise the buffer grows by this many bytes at a time.
+    const DWORD cbStep = data[0];
+
+    data++;
+    size--;
+
+    MPEG1SystemsParser parser;
+
+    DWORD cbParsed = 0;
+    DWORD cbAvailable = (cbStep == 0) ? static_cast<DWORD>(size) : 0;
+
+    while (cbParsed < size)
+    {
+        DWORD cbAte = 0;
+        MPEG1ParseStatus status = parser.ParseBytes(data + cbParsed, cbAvailable - cbParsed, &cbAte);
+
+        if (status == MPEG1_PARSE_NEED_MORE_DATA)
+        {
+            if (cbAvailable == size)
+            {
+                break;
+            }
+            cbAvailable = (size - cbAvailable > cbStep) ? cbAvailable + cbStep : static_cast<DWORD>(size);
+            continue;
+        }
+        else if (status != MPEG1_PARSE_OK)
+        {
+            break;
+        }
+
+        // The parser must make progress and stay inside the buffer.
+        if (cbAte == 0 || cbAte > cbAvailable - cbParsed)
+        {
+            __builtin_trap();
+        }
+
+        cbParsed += cbAte;
+
+        if (parser.HasSystemHeader())
+        {
+            const MPEG1SystemHeader *pHeader = parser.SystemHeader();
+
+            for (DWORD i = 0; i < pHeader->cStreams; i++)
+            {
+                // Touch every stream header, so that ASan checks the size of the header.
+                volatile BYTE id = pHeader->streams[i].stream_id;
+                (void)id;
+            }
+        }
+
+        if (parser.HasPacket())
+        {
+            const MPEG1PacketHeader &packetHdr = parser.PacketHeader();
+
+            if (packetHdr.cbPayload > packetHdr.cbPacketSize)
+            {
+                __builtin_trap();
+            }
+
+            if (packetHdr.cbPayload > size - cbParsed)
+            {
+                break;
+            }
+
+            cbParsed += packetHdr.cbPayload;
+            cbAvailable = (cbAvailable > cbParsed) ? cbAvailable : cbParsed;
+
+            parser.ClearPacket();
+        }
+
+        if (parser.IsEndOfStream())
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MPEG1FuzzDriver.cpp
+// Runs the fuzz target in MPEG1Fuzz.cpp on files, for compilers that
+// do not have libFuzzer.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Usage: mpeg1fuzz file [file...]
+//
+// Each file is a stream (not a fuzzer input). It is parsed whole, and
+// then in buffers of 1, 7 and 188 bytes, by putting the buffer step in
+// front of it the way the fuzz target expects.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int main(int argc, char **argv)
+{
+    const uint8_t steps[] = { 0, 1, 7, 188 };
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *pFile = fopen(argv[i], "rb");
+        if (pFile == nullptr)
+        {
+            fprintf(stderr, "Cannot open %s\n", argv[i]);
+            return 1;
+        }
+
+        std::vector<uint8_t> input(1);
+        uint8_t buffer[65536];
+        size_t cbRead = 0;
+
+        while ((cbRead = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+        {
+            input.insert(input.end(), buffer, buffer + cbRead);
+        }
+        fclose(pFile);
+
+        for (uint8_t step : steps)
+        {
+            input[0] = step;
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+        }
+
+        printf("%s: %zu bytes\n", argv[i], input.size() - 1);
+    }
+
+    return 0;
+}
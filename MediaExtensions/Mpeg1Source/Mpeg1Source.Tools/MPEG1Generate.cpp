@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MPEG1Generate.cpp
+// Command-line tool that writes a synthetic MPEG-1 system stream or
+// MPEG-2 program stream.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Usage: mpeg1gen [options] [-o file]
+//
+// Writes the stream to the file, or to standard output, so that it can be
+// piped into mpeg1bench:
+//
+//     mpeg1gen -frames 300 -misalign 7 | mpeg1bench -
+//     mpeg1gen -mpeg 2 -samplerate 24000 -abitrate 64 | mpeg1bench -
+//
+// Each option sets one field of MPEG1GeneratorSettings. The fields that
+// are not set keep the values from MPEG1GetDefaultGeneratorSettings.
+
+#include "MPEG1StreamGenerator.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct GeneratorOption
+{
+    const char  *pszName;
+    size_t      offset;         // Offset of the field in MPEG1GeneratorSettings.
+    size_t      cbField;
+    const char  *pszHelp;
+};
+
+#define GENERATOR_OPTION(name, field, help) \
+    { name, offsetof(MPEG1GeneratorSettings, field), sizeof(MPEG1GeneratorSettings::field), help }
+
+static const GeneratorOption g_Options[] =
+{
+    GENERATOR_OPTION("-mpeg", mpegVersion, "1 = MPEG-1 system stream, 2 = MPEG-2 program stream."),
+    GENERATOR_OPTION("-width", width, "Picture width, in pixels."),
+    GENERATOR_OPTION("-height", height, "Picture height, in pixels."),
+    GENERATOR_OPTION("-rate", frameRateCode, "picture_rate code (1 - 8). 4 = 29.97 fps."),
+    GENERATOR_OPTION("-vbitrate", videoBitRate, "Video bits per second."),
+    GENERATOR_OPTION("-video", cVideoStreams, "Number of video streams."),
+    GENERATOR_OPTION("-audio", cAudioStreams, "Number of audio streams."),
+    GENERATOR_OPTION("-abitrate", audioBitRate, "Audio Kbits per second (a Layer II bit rate, or an LSF bit rate)."),
+    GENERATOR_OPTION("-samplerate", audioSamplesPerSec, "32000, 44100, or 48000. LSF: 16000, 22050, or 24000."),
+    GENERATOR_OPTION("-packet", cbPacketSize, "Packet size, including the header."),
+    GENERATOR_OPTION("-packets", cPacketsPerPack, "Packets in each pack."),
+    GENERATOR_OPTION("-frames", cFrames, "Length of the stream, in video frames."),
+    GENERATOR_OPTION("-misalign", misalignment, "Misalignment flags: 1 = payload size, 2 = stuffing, 4 = start codes."),
+    GENERATOR_OPTION("-seed", seed, "Seed for the user data and the misalignment."),
+};
+
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: mpeg1gen [options] [-o file]\n");
+    fprintf(stderr, "  -o file       Output file. Default: standard output.\n");
+    fprintf(stderr, "  -gop string   Picture types of a GOP, in display order. Default: IBBPBBPBBPBB.\n");
+
+    for (const GeneratorOption &option : g_Options)
+    {
+        fprintf(stderr, "  %-13s %s\n", option.pszName, option.pszHelp);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    MPEG1GeneratorSettings settings;
+    MPEG1GetDefaultGeneratorSettings(&settings);
+
+    const char *pszOutput = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        if (strcmp(argv[i], "-o") == 0)
+        {
+            pszOutput = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-gop") == 0)
+        {
+            settings.gopStructure = argv[++i];
+            continue;
+        }
+
+        const GeneratorOption *pOption = nullptr;
+
+        for (const GeneratorOption &option : g_Options)
+        {
+            if (strcmp(argv[i], option.pszName) == 0)
+            {
+                pOption = &option;
+            }
+        }
+
+        if (pOption == nullptr)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        unsigned long value = strtoul(argv[++i], nullptr, 0);
+        BYTE *pField = reinterpret_cast<BYTE*>(&settings) + pOption->offset;
+
+        switch (pOption->cbField)
+        {
+        case sizeof(BYTE):
+            *pField = static_cast<BYTE>(value);
+            break;
+        case sizeof(WORD):
+            *reinterpret_cast<WORD*>(pField) = static_cast<WORD>(value);
+            break;
+        default:
+            *reinterpret_cast<DWORD*>(pField) = static_cast<DWORD>(value);
+            break;
+        }
+    }
+
+    MPEG1StreamGenerator generator;
+
+    if (generator.Initialize(settings) != MPEG1_GENERATE_OK)
+    {
+        fprintf(stderr, "The settings are out of range.\n");
+        return 1;
+    }
+
+    FILE *pFile = (pszOutput != nullptr) ? fopen(pszOutput, "wb") : stdout;
+    if (pFile == nullptr)
+    {
+        fprintf(stderr, "Cannot create %s\n", pszOutput);
+        return 1;
+    }
+
+    BYTE buffer[64 * 1024];
+
+    while (!generator.IsEndOfStream())
+    {
+        DWORD cbRead = generator.Read(buffer, sizeof(buffer));
+
+        if (fwrite(buffer, 1, cbRead, pFile) != cbRead)
+        {
+            fprintf(stderr, "Write failed.\n");
+            return 1;
+        }
+    }
+
+    if (pFile != stdout)
+    {
+        fclose(pFile);
+    }
+    else
+    {
+        fflush(stdout);
+    }
+
+    fprintf(stderr, "%lld bytes, mux rate %u bytes/s\n",
+        static_cast<long long>(generator.BytesRead()), generator.MuxRate() * 50);
+    return 0;
+}
@@ -8,8 +8,10 @@
 #include "pch.h"
 #include "PolarEffect.h"
 #include "VideoBufferLock.h"
+#include "CpuFeatures.h"
 #include <wrl\module.h>
 
+using namespace Windows::Foundation;
 using namespace Windows::Foundation::Collections;
 
 #pragma comment(lib, "d2d1")
@@ -38,6 +40,11 @@ Warp
     var effect = new Windows.Foundation.Collections.PropertySet();
     effect["effect"] = "Warp";
 
+By default, each output pixel pair is copied from the nearest source pixel
+pair. For smoother edges, select bilinear sampling:
+
+    effect["Sampling"] = "Bilinear";
+
 
 These effects are based on polar transformation.
 
@@ -60,7 +67,8 @@ Warp
 
 Before the first video frame is processed, a lookup table is created to store
 the result of the polar transformation. Then, the same lookup table is used
-until the end of the streaming session.
+until the end of the streaming session. For bilinear sampling, the lookup table
+holds the source pixel pair and 8-bit weights for the neighboring pairs.
 
 
 NOTES ON THE MFT IMPLEMENTATION
@@ -98,6 +106,73 @@ NOTES ON THE MFT IMPLEMENTATION
    client changes the attributes during streaming, the change is ignored until 
    streaming is stopped (either by changing the media types or by sending the 
    MFT_MESSAGE_NOTIFY_END_STREAMING message) and then restarted.
+
+10. Each frame is split into horizontal bands of rows, which are transformed in
+    parallel on worker threads that all the effects in the DLL share (see
+    RowBandThreadPool.h). The "ThreadCount" property limits the number of
+    threads that work on one frame (0 = one thread per logical processor,
+    1 = transform on the calling thread only).
+
+11. The "Sampling" property selects "Nearest" (the default) or "Bilinear"
+    sampling. Bilinear sampling uses its own lookup table, which is created in
+    BeginStreaming like the nearest-neighbor table.
+
+12. The nearest-neighbor table holds the byte offset of the source pixel pair
+    for each output pixel pair, for the default stride of the input type. If a
+    buffer has a different stride, the table is built again for that stride.
+    The "LookupEncoding" property selects "Offset" (the default, 32 bits per
+    pixel pair) or "Delta" (16-bit differences between neighboring entries,
+    about half the size, at a small decoding cost).
+
+13. Lookup tables are shared by all the instances in the process that use the
+    same frame size, format, stride, effect and table type (see
+    LookupTableCache.h). The first instance creates the table, and the others
+    reuse it. A table is released when no instance uses it.
+
+14. The "TileWidth" property sets the width, in pixels, of the tiles in which
+    the nearest-neighbor functions write the output (32 rows high). Narrow
+    tiles keep the source pixels that are read close together, which can
+    reduce cache and TLB misses at high resolutions on processors with small
+    caches. By default (0), whole rows are written in order, which suits the
+    hardware prefetchers of most processors better.
+
+15. The "Chain" property applies several effects in a single pass over the
+    frame, instead of one MFT per effect. It is an ordered, comma-separated
+    list of "Grayscale", "Invert" and at most one polar effect:
+
+        effect["Chain"] = "Grayscale, Fisheye, Invert";
+
+    Grayscale and Invert change each byte on its own, so they are combined
+    into lookup tables that are applied to the bytes as the polar effect
+    copies them (see EffectChain.h). A chain without a polar effect maps
+    the frame directly. If "Chain" is set, "effect" is optional; the polar
+    effect in the chain replaces it, and an empty chain is "effect" alone.
+    The steps apply to the whole frame.
+
+16. The MFT provides its output samples (MFT_OUTPUT_STREAM_PROVIDES_SAMPLES).
+    They come from a pool, and a sample is reused once the client releases
+    it, so that no frame buffer is allocated per frame (see
+    OutputSamplePool.h).
+
+17. The "Strength" (0 = no effect, 1 = the full effect, the default),
+    "CenterX" and "CenterY" (the centre of the effect, as a fraction of the
+    width and height, 0.5 by default) properties animate the effect. Unlike
+    the other properties, they are read again for each frame, so the app
+    can change them while the video plays:
+
+        effect["Strength"] = 0.5;
+        effect["CenterX"] = 0.25;
+
+    If any of them is set, the source pixels are computed for each frame
+    from a table with one entry per radius, which is rebuilt (in a few
+    microseconds) only when the strength changes, instead of from the
+    lookup table, which takes several milliseconds to build.
+
+    The values can be any numeric type. They are cached, and updated when
+    the property set raises MapChanged, so the frames do not look them up.
+    Animated effects use nearest-neighbor sampling: SetProperties fails if
+    they are set together with "Sampling" = "Bilinear", and they are
+    ignored if they are added later.
    
 */
 
@@ -116,6 +191,11 @@ const GUID g_MediaSubtypes[] =
 
 DWORD GetImageSize(DWORD fcc, UINT32 width, UINT32 height);
 LONG GetDefaultStride(IMFMediaType *pType);
+static bool ReadAnimatedProperties(IMap<String^, Object^> ^configuration, DOUBLE adValues[3]);
+static void SetAnimatedProperties(POLAR_ANIMATED_PROPERTIES *pAnimated, bool fAnimated, const DOUBLE adValues[3]);
+
+// Lookup tables shared by all the instances in the process.
+static LookupTableCache<POLAR_LOOKUP_KEY, POLAR_LOOKUP_TABLE> g_lookupCache;
 
 //-------------------------------------------------------------------
 // Functions to apply the lookup table to YUV images.
@@ -123,166 +203,237 @@ LONG GetDefaultStride(IMFMediaType *pType);
 // In all cases, the same transformation is applied to the YUV
 // image, but the pixel layout in memory differs. The transformation
 // is applied to the pair of pixels which share the UV component.
+// Each pixel pair is copied as a whole, so the same functions handle
+// UYVY and YUY2.
 //
 // The image conversion functions take the following parameters:
 //
-// pLookup          Pointer to the lookup table.
+// pLookup          Pointer to the lookup table. (See POLAR_LOOKUP.)
 // pDest             Pointer to the destination buffer.
 // lDestStride       Stride of the destination buffer, in bytes.
 // pSrc              Pointer to the source buffer.
 // lSrcStride        Stride of the source buffer, in bytes.
 // dwWidthInPixels   Frame width in pixels.
 // dwHeightInPixels  Frame height, in pixels.
+// dwRowBegin        First destination row to write.
+// dwRowEnd          Row after the last destination row to write.
+//
+// pDest always points to the start of the frame. Only the destination
+// rows [dwRowBegin, dwRowEnd) are written, so that several threads can
+// transform different bands of the same frame. For NV12, dwRowBegin
+// must be even.
+//
+// The lookup table holds byte offsets that were computed for
+// lSrcStride, so the functions do not need to divide by the width.
+// It maps pixels outside the source image to pixel 0, which must be
+// set to black first (see the SetBlackPixel functions).
+//
+// The destination is written in tiles of pLookup->cTilePairs pixel
+// pairs by POLAR_TILE_ROWS rows. Neighboring output pixels come from
+// nearby source pixels, so a narrow tile reads a small area of the
+// source, while a whole output row can sweep across most of the source
+// image (for example, a circle for Warp). When cTilePairs is the width
+// of the image, the rows are written in order.
+//
+// If pLookup->pPointTables is not nullptr, the bytes of each copied
+// entry are mapped through the point tables of the effect chain, so
+// that the point steps cost no extra pass over the frame.
 //-------------------------------------------------------------------
 
-// Convert UYVY image.
+// Convert UYVY or YUY2 image.
 
-void TransformImage_UYVY(
-    _In_reads_(_Inexpressible_(dwWidthInPixels * dwHeightInPixels)) const UINT32 *pLookup,
+void TransformImage_422(
+    _In_ const POLAR_LOOKUP *pLookup,
     _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
     _In_ LONG lDestStride, 
     _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
     _In_ LONG lSrcStride, 
     _In_ DWORD dwWidthInPixels, 
-    _In_ DWORD dwHeightInPixels)
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
 {
-    DWORD *pSrc_UYVY = (DWORD*) pSrc;
-
-    // Byte order is U0 Y0 V0 Y1
-    // Windows is little-endian so the order appears reversed.
-
-    pSrc_UYVY[0] = 0x00800080;  // black
-
-    for (DWORD y = 0; y < dwHeightInPixels; y++)
-    {
-        DWORD *pDest_UYVY = (DWORD*) pDest;
-
-        for (DWORD x = 0; (x + 1) < dwWidthInPixels; x += 2)
-        {
-#pragma warning(push)
-#pragma warning(disable: 6385) 
-#pragma warning(disable: 6386) 
-            UINT32 uOffset = (pLookup[x] % dwWidthInPixels) * sizeof(WORD) + (pLookup[x] / dwWidthInPixels) * lSrcStride;
-            pDest_UYVY[x/2] = pSrc_UYVY[uOffset/sizeof(DWORD)];
-#pragma warning(pop)
-        }
-        pDest += lDestStride;
-        pLookup += dwWidthInPixels;
-    }
+    GatherRows<DWORD>(pDest, lDestStride, pSrc, pLookup->pOffsets, pLookup->pPointTables, dwWidthInPixels / 2, pLookup->cTilePairs, dwRowBegin, dwRowEnd);
 }
 
 
-// Convert YUY2 image.
+// Convert NV12 image
 
-void TransformImage_YUY2(
-    _In_reads_(_Inexpressible_(dwWidthInPixels * dwHeightInPixels)) const UINT32 *pLookup,
+void TransformImage_NV12(
+    _In_ const POLAR_LOOKUP *pLookup,
     _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
     _In_ LONG lDestStride, 
     _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
     _In_ LONG lSrcStride, 
     _In_ DWORD dwWidthInPixels, 
-    _In_ DWORD dwHeightInPixels)
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
 {
-    DWORD *pSrc_UYVY = (DWORD*) pSrc;
+    // NV12 is planar: Y plane, followed by packed U-V plane.
 
-    // Byte order is Y0 U0 Y1 V0
-    // Windows is little-endian so the order appears reversed.
+    const DWORD cPairs = dwWidthInPixels / 2;
 
-    pSrc_UYVY[0] = 0x80008000;  // black
+    // Y plane
 
-    for (DWORD y = 0; y < dwHeightInPixels; y++)
-    {
-        DWORD *pDest_UYVY = (DWORD*) pDest;
+    GatherRows<WORD>(pDest, lDestStride, pSrc, pLookup->pOffsets, pLookup->pPointTables, cPairs, pLookup->cTilePairs, dwRowBegin, dwRowEnd);
 
-        for (DWORD x = 0; (x + 1) < dwWidthInPixels; x += 2)
-        {
-#pragma warning(push)
-#pragma warning(disable: 6385) 
-#pragma warning(disable: 6386) 
-            UINT32 uOffset = (pLookup[x] % dwWidthInPixels) * sizeof(WORD) + (pLookup[x] / dwWidthInPixels) * lSrcStride;
-            pDest_UYVY[x/2] = pSrc_UYVY[uOffset/sizeof(DWORD)];
-#pragma warning(pop)
-        }
-        pDest += lDestStride;
-        pLookup += dwWidthInPixels;
-    }
+    // U-V plane
+
+    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    // The U-V rows of the lookup table follow the Y rows.
+
+    GatherRows<WORD>(
+        pDest + lDestStride * (LONG) dwHeightInPixels,
+        lDestStride,
+        pSrc + lSrcStride * dwHeightInPixels,
+        pLookup->pOffsets + cPairs * dwHeightInPixels,
+        GetChromaTables(pLookup->pPointTables),
+        cPairs,
+        pLookup->cTilePairs,
+        dwRowBegin / 2,
+        (dwRowEnd + 1) / 2
+        );
 }
 
 
-// Convert NV12 image
+// Convert UYVY or YUY2 image, with a delta-encoded lookup table.
 
-void TransformImage_NV12(
-    _In_reads_(_Inexpressible_(dwWidthInPixels * dwHeightInPixels)) const UINT32 *pLookup,
+void TransformImageDelta_422(
+    _In_ const POLAR_LOOKUP *pLookup,
     _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
     _In_ LONG lDestStride, 
     _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
     _In_ LONG lSrcStride, 
     _In_ DWORD dwWidthInPixels, 
-    _In_ DWORD dwHeightInPixels)
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
 {
-    // NV12 is planar: Y plane, followed by packed U-V plane.
+    GatherRowsDelta<DWORD>(pDest, lDestStride, pSrc, pLookup->pDeltas, pLookup->pRowStarts, pLookup->pPointTables, dwWidthInPixels / 2, pLookup->cTilePairs, dwRowBegin, dwRowEnd);
+}
 
-    // Y plane
 
-    UINT32 *pLookup_Y = (UINT32*) pLookup;
-    WORD *pSrc_Y = (WORD*) pSrc;
-    pSrc_Y[0] = 0x0000;    // black
+// Convert NV12 image, with a delta-encoded lookup table.
 
-    for (DWORD y = 0; y < dwHeightInPixels; y++)
-    {
-        WORD *pDest_Y = (WORD*) pDest;
+void TransformImageDelta_NV12(
+    _In_ const POLAR_LOOKUP *pLookup,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const DWORD cPairs = dwWidthInPixels / 2;
 
-        for (DWORD x = 0; (x + 1) < dwWidthInPixels; x += 2)
-        {
-#pragma warning(push)
-#pragma warning(disable: 6385) 
-#pragma warning(disable: 6386) 
-            UINT32 uOffset = (pLookup_Y[x] % dwWidthInPixels) + (pLookup_Y[x] / dwWidthInPixels) * lSrcStride;
-            pDest_Y[x/2] = pSrc_Y[uOffset/2];
-#pragma warning(pop)
-        }
-        pDest += lDestStride;
-        pLookup_Y += dwWidthInPixels;
-    }
+    // Y plane
+
+    GatherRowsDelta<WORD>(pDest, lDestStride, pSrc, pLookup->pDeltas, pLookup->pRowStarts, pLookup->pPointTables, cPairs, pLookup->cTilePairs, dwRowBegin, dwRowEnd);
 
     // U-V plane
 
-    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    GatherRowsDelta<WORD>(
+        pDest + lDestStride * (LONG) dwHeightInPixels,
+        lDestStride,
+        pSrc + lSrcStride * dwHeightInPixels,
+        pLookup->pDeltas,
+        pLookup->pRowStarts + dwHeightInPixels,
+        GetChromaTables(pLookup->pPointTables),
+        cPairs,
+        pLookup->cTilePairs,
+        dwRowBegin / 2,
+        (dwRowEnd + 1) / 2
+        );
+}
 
-    UINT32 *pLookup_UV = (UINT32*) pLookup;
-    WORD *pSrc_UV = (WORD*) (pSrc + lSrcStride * dwHeightInPixels);
-    pSrc_UV[0] = 0x8080;    // black
+//-------------------------------------------------------------------
+// Functions to set the first pixel of the source image to black.
+//
+// The lookup table points pixels that fall outside the source image
+// at pixel 0. These functions are called once per frame, before the
+// bands are transformed, so that no band reads pixel 0 while another
+// one writes it.
+//-------------------------------------------------------------------
 
-    for (DWORD y = 0; y < dwHeightInPixels; y += 2)
-    {
-        WORD *pDest_UV = (WORD*) pDest;
+void SetBlackPixel_UYVY(_Inout_ BYTE *pSrc, _In_ LONG lSrcStride, _In_ DWORD dwHeightInPixels)
+{
+    *((DWORD*) pSrc) = 0x00800080;  // black
+}
 
-        for (DWORD x = 0; x < dwWidthInPixels; x += 2)
-        {
-#pragma warning(push)
-#pragma warning(disable: 6385) 
-            UINT32 uOffset = (pLookup_UV[x] % dwWidthInPixels) + ((pLookup_UV[x] / dwWidthInPixels) / 2) * lSrcStride;
-#pragma warning(pop)
-            pDest_UV[x/2] = pSrc_UV[uOffset/2];
-        }
-        pDest += lDestStride;
-        pLookup_UV += dwWidthInPixels * 2;
-    }
+void SetBlackPixel_YUY2(_Inout_ BYTE *pSrc, _In_ LONG lSrcStride, _In_ DWORD dwHeightInPixels)
+{
+    *((DWORD*) pSrc) = 0x80008000;  // black
+}
+
+void SetBlackPixel_NV12(_Inout_ BYTE *pSrc, _In_ LONG lSrcStride, _In_ DWORD dwHeightInPixels)
+{
+    *((WORD*) pSrc) = 0x0000;                                   // black (Y)
+    *((WORD*) (pSrc + lSrcStride * dwHeightInPixels)) = 0x8080; // black (U-V)
+}
+
+//-------------------------------------------------------------------
+// Functions to set the first pixel of the source image to the fill
+// value of the effect chain.
+//
+// When the chain has point steps, the lookup table maps pixel 0
+// through them like any other pixel. The fill value is the one that
+// the point tables map to black as it looks after the point steps
+// that follow the polar effect, so the pixels outside the image get
+// the same value as with separate effects. (See BuildPointTables.)
+//-------------------------------------------------------------------
+
+void SetFillPixel_422(_Inout_ BYTE *pSrc, _In_ LONG lSrcStride, _In_ DWORD dwHeightInPixels, _In_reads_(8) const BYTE *pFill)
+{
+    CopyMemory(pSrc, pFill, 4);
+}
+
+void SetFillPixel_NV12(_Inout_ BYTE *pSrc, _In_ LONG lSrcStride, _In_ DWORD dwHeightInPixels, _In_reads_(8) const BYTE *pFill)
+{
+    CopyMemory(pSrc, pFill, 2);                                     // Y
+    CopyMemory(pSrc + lSrcStride * dwHeightInPixels, pFill + 4, 2); // U-V
 }
 
 CPolarEffect::CPolarEffect() 
     : m_pTransformFn(nullptr)
+    , m_pDeltaTransformFn(nullptr)
+    , m_pBilinearTransformFn(nullptr)
+    , m_pAnimatedTransformFn(nullptr)
+    , m_pSetBlackPixelFn(nullptr)
+    , m_pMapFn(nullptr)
+    , m_pSetFillPixelFn(nullptr)
     , m_imageWidthInPixels(0)
     , m_imageHeightInPixels(0)
     , m_cbImageSize(0)
     , m_fStreamingInitialized(false)
     , m_pRadiusTransformFn(CPolarEffect::DefaultRadius)
     , m_pThetaTransformFn(CPolarEffect::DefaultTheta)
+    , m_lookupKey()
+    , m_fDeltaLookup(false)
+    , m_fBilinear(false)
+    , m_dwTileWidth(0)
+    , m_fChainInitialized(false)
+    , m_fGather(true)
+    , m_fPointTables(false)
+    , m_mapChangedToken()
+    , m_spAnimated(std::make_shared<POLAR_ANIMATED_PROPERTIES>())
+    , m_fAnimated(false)
+    , m_dStrength(1.0)
+    , m_dCenterX(0.5)
+    , m_dCenterY(0.5)
+    , m_dRadialStrength(0.0)
 {
 }
 
 CPolarEffect::~CPolarEffect()
 {
+    if (m_spConfiguration != nullptr)
+    {
+        IPropertySet ^configuration = reinterpret_cast<IPropertySet^>(m_spConfiguration.Get());
+        configuration->MapChanged -= m_mapChangedToken;
+    }
 }
 
 // Initialize the instance.
@@ -306,26 +457,224 @@ HRESULT CPolarEffect::SetProperties(ABI::Windows::Foundation::Collections::IProp
     {
         IPropertySet ^configuration = reinterpret_cast<IPropertySet^>(pConfiguration);
 
-        String ^effect = safe_cast<String^>(configuration->Lookup(L"effect"));
-        if (wcscmp(effect->Data(), L"Fisheye") == 0)
+        // Read and check all the properties first, so that the effect is
+        // not left half configured if one of them is not valid.
+
+        // Number of threads that transform each frame. (0 = one per processor.)
+        const bool fThreadCount = configuration->HasKey(L"ThreadCount");
+        UINT32 cThreads = 0;
+
+        if (fThreadCount)
         {
-            m_pRadiusTransformFn = CPolarEffect::FisheyeRadius;
-            m_pThetaTransformFn = CPolarEffect::DefaultTheta;
+            cThreads = safe_cast<UINT32>(configuration->Lookup(L"ThreadCount"));
         }
-        else if (wcscmp(effect->Data(), L"Pinch") == 0)
+
+        // Sampling mode. (Takes effect when the lookup table is created.)
+        const bool fSampling = configuration->HasKey(L"Sampling");
+        bool fBilinear = false;
+
+        if (fSampling)
         {
-            m_pRadiusTransformFn = CPolarEffect::PinchRadius;
-            m_pThetaTransformFn = CPolarEffect::DefaultTheta;
+            String ^sampling = safe_cast<String^>(configuration->Lookup(L"Sampling"));
+
+            if (wcscmp(sampling->Data(), L"Bilinear") == 0)
+            {
+                fBilinear = true;
+            }
+            else if (wcscmp(sampling->Data(), L"Nearest") != 0)
+            {
+                throw ref new InvalidArgumentException();
+            }
+        }
+
+        // Encoding of the nearest-neighbor lookup table. (Takes effect when the table is created.)
+        const bool fEncoding = configuration->HasKey(L"LookupEncoding");
+        bool fDelta = false;
+
+        if (fEncoding)
+        {
+            String ^encoding = safe_cast<String^>(configuration->Lookup(L"LookupEncoding"));
+
+            if (wcscmp(encoding->Data(), L"Delta") == 0)
+            {
+                fDelta = true;
+            }
+            else if (wcscmp(encoding->Data(), L"Offset") != 0)
+            {
+                throw ref new InvalidArgumentException();
+            }
         }
-        else if (wcscmp(effect->Data(), L"Warp") == 0)
+
+        // Width of the nearest-neighbor tiles, in pixels. (0 = whole rows.)
+        const bool fTileWidth = configuration->HasKey(L"TileWidth");
+        UINT32 dwTileWidth = 0;
+
+        if (fTileWidth)
         {
-            m_pRadiusTransformFn = CPolarEffect::DefaultRadius;
-            m_pThetaTransformFn = CPolarEffect::WarpTheta;
+            dwTileWidth = safe_cast<UINT32>(configuration->Lookup(L"TileWidth"));
         }
-        else
+
+        // The polar effect. Optional if the effect chain is set.
+        const bool fChain = configuration->HasKey(L"Chain");
+        bool fTransformers = false;
+        PolarTransformer pfnRadius = nullptr;
+        PolarTransformer pfnTheta = nullptr;
+
+        if (!fChain || configuration->HasKey(L"effect"))
+        {
+            String ^effect = safe_cast<String^>(configuration->Lookup(L"effect"));
+            if (!GetPolarTransformers(effect->Data(), &pfnRadius, &pfnTheta))
+            {
+                throw ref new InvalidArgumentException();
+            }
+            fTransformers = true;
+        }
+
+        // Ordered, comma-separated list of effects that are applied in a
+        // single pass. (Takes effect when streaming starts.)
+        EffectChain chain;
+
+        if (fChain)
+        {
+            String ^chainList = safe_cast<String^>(configuration->Lookup(L"Chain"));
+            const wchar_t *psz = chainList->Data();
+
+            while (*psz != L'\0')
+            {
+                // Find the next name, without the spaces around it.
+                while (*psz == L' ')
+                {
+                    psz++;
+                }
+
+                const wchar_t *pszEnd = psz;
+                while (*pszEnd != L'\0' && *pszEnd != L',')
+                {
+                    pszEnd++;
+                }
+
+                size_t cch = pszEnd - psz;
+                while (cch > 0 && psz[cch - 1] == L' ')
+                {
+                    cch--;
+                }
+
+                wchar_t szName[16] = {};
+                if (cch == 0 || cch >= ARRAYSIZE(szName))
+                {
+                    throw ref new InvalidArgumentException();
+                }
+                wmemcpy(szName, psz, cch);
+
+                bool fAppended = false;
+
+                if (wcscmp(szName, L"Grayscale") == 0)
+                {
+                    fAppended = chain.Append(EffectChain_Grayscale);
+                }
+                else if (wcscmp(szName, L"Invert") == 0)
+                {
+                    fAppended = chain.Append(EffectChain_Invert);
+                }
+                else if (GetPolarTransformers(szName, &pfnRadius, &pfnTheta))
+                {
+                    // Fails for a second polar effect.
+                    fAppended = chain.Append(EffectChain_Gather);
+                    fTransformers = true;
+                }
+
+                if (!fAppended)
+                {
+                    throw ref new InvalidArgumentException();
+                }
+
+                psz = (*pszEnd == L',' ? pszEnd + 1 : pszEnd);
+            }
+        }
+
+        // Strength and centre of the effect. These are read again when
+        // the configuration changes, so that the app can animate them.
+        // (See note 17.)
+        DOUBLE adAnimated[3];
+        const bool fAnimated = ReadAnimatedProperties(configuration, adAnimated);
+
+        // Apply them all at once.
+        AutoLock lock(m_critSec);
+
+        // Animation is nearest-neighbor only. (See note 17.) This is the
+        // last check, and nothing has been changed yet if it fails.
+        if (!fSampling)
+        {
+            fBilinear = m_fBilinear;
+        }
+
+        if (fAnimated && fBilinear)
         {
             throw ref new InvalidArgumentException();
         }
+
+        if (fThreadCount)
+        {
+            m_threadPool.SetThreadCount(cThreads);
+        }
+
+        m_fBilinear = fBilinear;
+
+        if (fEncoding)
+        {
+            m_fDeltaLookup = fDelta;
+        }
+
+        if (fTileWidth)
+        {
+            m_dwTileWidth = dwTileWidth;
+        }
+
+        if (fTransformers)
+        {
+            m_pRadiusTransformFn = pfnRadius;
+            m_pThetaTransformFn = pfnTheta;
+        }
+
+        if (fChain)
+        {
+            m_chain = chain;
+        }
+
+        SetAnimatedProperties(m_spAnimated.get(), fAnimated, adAnimated);
+
+        if (m_spConfiguration != nullptr)
+        {
+            reinterpret_cast<IPropertySet^>(m_spConfiguration.Get())->MapChanged -= m_mapChangedToken;
+            m_spConfiguration = nullptr;
+        }
+
+        std::shared_ptr<POLAR_ANIMATED_PROPERTIES> spAnimated = m_spAnimated;
+
+        m_mapChangedToken = configuration->MapChanged += ref new MapChangedEventHandler<String^, Object^>(
+            [spAnimated, fBilinear](IObservableMap<String^, Object^> ^sender, IMapChangedEventArgs<String^> ^args)
+        {
+            try
+            {
+                DOUBLE adValues[3];
+                const bool fAnimated = ReadAnimatedProperties(sender, adValues);
+
+                // Animated properties that are added with bilinear sampling
+                // are ignored. (See note 17.)
+                if (!(fAnimated && fBilinear))
+                {
+                    SetAnimatedProperties(spAnimated.get(), fAnimated, adValues);
+                }
+            }
+            catch (Exception ^)
+            {
+                // Not a number. Keep the previous values.
+            }
+        });
+
+        m_spConfiguration = pConfiguration;
+        m_radial.clear();
+        GetAnimatedProperties();
     }
     catch(Exception ^exc)
     {
@@ -487,7 +836,8 @@ HRESULT CPolarEffect::GetOutputStreamInfo(
     pStreamInfo->dwFlags =
         MFT_OUTPUT_STREAM_WHOLE_SAMPLES |
         MFT_OUTPUT_STREAM_SINGLE_SAMPLE_PER_BUFFER |
-        MFT_OUTPUT_STREAM_FIXED_SAMPLE_SIZE ;
+        MFT_OUTPUT_STREAM_FIXED_SAMPLE_SIZE |
+        MFT_OUTPUT_STREAM_PROVIDES_SAMPLES ;
 
     if (m_spOutputType == nullptr)
     {
@@ -1156,11 +1506,9 @@ HRESULT CPolarEffect::ProcessOutput(
             throw ref new InvalidArgumentException();
         }
 
-        // It must contain a sample.
-        if (pOutputSamples[0].pSample == nullptr)
-        {
-            throw ref new InvalidArgumentException();
-        }
+        // The MFT provides the output sample (see note 16 at the top of this
+        // file). If the client passes a sample anyway, that one is used.
+        ComPtr<IMFSample> spOutputSample = pOutputSamples[0].pSample;
 
         ComPtr<IMFMediaBuffer> spInput;
         ComPtr<IMFMediaBuffer> spOutput;
@@ -1174,11 +1522,16 @@ HRESULT CPolarEffect::ProcessOutput(
         // Initialize streaming.
         BeginStreaming();
 
+        if (spOutputSample == nullptr)
+        {
+            spOutputSample = m_outputSamples.AllocateSample(m_spOutputType.Get());
+        }
+
         // Get the input buffer.
         ThrowIfError(m_spSample->ConvertToContiguousBuffer(&spInput));
 
         // Get the output buffer.
-        ThrowIfError(pOutputSamples[0].pSample->ConvertToContiguousBuffer(&spOutput));
+        ThrowIfError(spOutputSample->ConvertToContiguousBuffer(&spOutput));
 
         OnProcessOutput(spInput.Get(), spOutput.Get());
 
@@ -1194,12 +1547,18 @@ HRESULT CPolarEffect::ProcessOutput(
 
         if (SUCCEEDED(m_spSample->GetSampleDuration(&hnsDuration)))
         {
-            ThrowIfError(pOutputSamples[0].pSample->SetSampleDuration(hnsDuration));
+            ThrowIfError(spOutputSample->SetSampleDuration(hnsDuration));
         }
 
         if (SUCCEEDED(m_spSample->GetSampleTime(&hnsTime)))
         {
-            ThrowIfError(pOutputSamples[0].pSample->SetSampleTime(hnsTime));
+            ThrowIfError(spOutputSample->SetSampleTime(hnsTime));
+        }
+
+        // Return the sample that we provided. The client releases it.
+        if (pOutputSamples[0].pSample == nullptr)
+        {
+            pOutputSamples[0].pSample = spOutputSample.Detach();
         }
     }
     catch(Exception ^exc)
@@ -1370,17 +1729,56 @@ void CPolarEffect::BeginStreaming()
 {
     HRESULT hr = S_OK;
 
-    if (m_indexLookup == nullptr)
+    // The tables need the input type. If the client begins streaming
+    // before it sets the type, the tables are created with the first sample.
+    if (!m_fChainInitialized && m_spInputType != nullptr)
     {
-        const UINT32 unVideoArea = m_imageWidthInPixels * m_imageHeightInPixels;
+        GUID subtype = GUID_NULL;
+        POLAR_LOOKUP_KEY key = {};
+
+        ThrowIfError(m_spInputType->GetGUID(MF_MT_SUBTYPE, &subtype));
+
+        // An empty chain is the polar effect alone. A chain without a
+        // polar effect needs no lookup table.
+        m_fGather = (m_chain.IsEmpty() || m_chain.HasGather());
+        m_fPointTables = m_chain.HasPointSteps();
+
+        if (m_fPointTables)
+        {
+            InitPointTables(subtype);
+        }
+
+        key.unWidth = m_imageWidthInPixels;
+        key.unHeight = m_imageHeightInPixels;
+        key.pfnRadius = m_pRadiusTransformFn;
+        key.pfnTheta = m_pThetaTransformFn;
 
-        m_indexLookup = ref new Array<UINT32>(unVideoArea);
+        if (m_fBilinear)
+        {
+            // The bilinear table does not depend on the format or the stride.
+            key.type = PolarLookup_Bilinear;
+        }
+        else
+        {
+            // Build the table for the default stride. If a buffer has a
+            // different stride, OnProcessOutput gets the table for that one.
+            key.type = (m_fDeltaLookup ? PolarLookup_Delta : PolarLookup_Offset);
+            key.dwFormat = subtype.Data1;
+            key.lStride = GetDefaultStride(m_spInputType.Get());
+        }
 
-        ZeroMemory( m_indexLookup->Data, unVideoArea * sizeof(UINT32) );
+        // An animated effect does not use the table. If the animation
+        // stops, OnProcessOutput gets the table then.
+        if (m_fGather && !m_fAnimated)
+        {
+            AcquireLookupTable(key);
+        }
+        else
+        {
+            m_lookupKey = key;
+        }
 
-        GeneratePolarLookup( m_imageWidthInPixels, 
-                                m_imageHeightInPixels, 
-                                m_indexLookup);
+        m_fChainInitialized = true;
     }
 
     m_fStreamingInitialized = true;
@@ -1395,7 +1793,9 @@ void CPolarEffect::BeginStreaming()
 
 void CPolarEffect::EndStreaming()
 {
-    m_indexLookup = nullptr;
+    m_spLookup.reset();
+    m_outputSamples.Uninitialize();
+    m_fChainInitialized = false;
     m_fStreamingInitialized = false;
 }
 
@@ -1413,10 +1813,126 @@ void CPolarEffect::OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut)
     VideoBufferLock outputLock(pOut, MF2DBuffer_LockFlags_Write, m_imageHeightInPixels, lDefaultStride);
 
     // Invoke the image transform function.
-    assert (m_pTransformFn != nullptr);
-    if (m_pTransformFn)
+    assert (m_pTransformFn != nullptr && m_pDeltaTransformFn != nullptr && m_pBilinearTransformFn != nullptr && m_pAnimatedTransformFn != nullptr && m_pMapFn != nullptr);
+    if (m_pTransformFn && m_pDeltaTransformFn && m_pBilinearTransformFn && m_pAnimatedTransformFn && m_pMapFn)
     {
-        (*m_pTransformFn)(m_indexLookup->Data, outputLock.GetTopRow(), outputLock.GetStride(), inputLock.GetTopRow(), inputLock.GetStride(), m_imageWidthInPixels, m_imageHeightInPixels);
+        BYTE *pDest = outputLock.GetTopRow();
+        const LONG lDestStride = outputLock.GetStride();
+        BYTE *pSrc = inputLock.GetTopRow();
+        const LONG lSrcStride = inputLock.GetStride();
+
+        // Point tables of the effect chain, if it has point steps.
+        const BYTE (*pPointTables)[256] = (m_fPointTables ? m_pointTables : nullptr);
+
+        if (!m_fGather)
+        {
+            // The chain has only point steps: map the frame in one pass.
+            m_threadPool.Run(m_imageHeightInPixels, 2, lDestStride, [&](DWORD yBegin, DWORD yEnd)
+            {
+                (*m_pMapFn)(pPointTables, pDest, lDestStride, pSrc, lSrcStride, m_imageWidthInPixels, m_imageHeightInPixels, yBegin, yEnd);
+            });
+
+            ThrowIfError(pOut->SetCurrentLength(m_cbImageSize));
+            return;
+        }
+
+        if (pPointTables != nullptr)
+        {
+            (*m_pSetFillPixelFn)(pSrc, lSrcStride, m_imageHeightInPixels, m_fillPixel);
+        }
+        else
+        {
+            (*m_pSetBlackPixelFn)(pSrc, lSrcStride, m_imageHeightInPixels);
+        }
+
+        // Pick up the strength and centre for this frame.
+        GetAnimatedProperties();
+
+        // Transform bands of rows in parallel. Bands have an even number
+        // of rows, so that the NV12 chroma rows are not split.
+        //
+        // Use the type of lookup table that BeginStreaming selected, even
+        // if the sampling mode has been changed since.
+        if (m_fAnimated)
+        {
+            // The offsets are unsigned, as in the lookup table.
+            if (lSrcStride <= 0)
+            {
+                ThrowException(E_UNEXPECTED);
+            }
+
+            UpdateRadialProfile();
+
+            const POLAR_ANIMATION animation =
+            {
+                m_radial.data(),
+                static_cast<LONG>(m_radial.size() / 2 - 1),
+                static_cast<LONG>(m_dCenterX * m_imageWidthInPixels),
+                static_cast<LONG>(m_dCenterY * m_imageHeightInPixels),
+                pPointTables
+            };
+
+            m_threadPool.Run(m_imageHeightInPixels, 2, lDestStride, [&](DWORD yBegin, DWORD yEnd)
+            {
+                (*m_pAnimatedTransformFn)(&animation, pDest, lDestStride, pSrc, lSrcStride, m_imageWidthInPixels, m_imageHeightInPixels, yBegin, yEnd);
+            });
+        }
+        else if (m_lookupKey.type == PolarLookup_Bilinear)
+        {
+            if (m_spLookup == nullptr)
+            {
+                AcquireLookupTable(m_lookupKey);
+            }
+
+            const POLAR_BILINEAR_SAMPLE *pLookup = m_spLookup->bilinear.data();
+
+            m_threadPool.Run(m_imageHeightInPixels, 2, lDestStride, [&](DWORD yBegin, DWORD yEnd)
+            {
+                if (pPointTables == nullptr)
+                {
+                    (*m_pBilinearTransformFn)(pLookup, pDest, lDestStride, pSrc, lSrcStride, m_imageWidthInPixels, m_imageHeightInPixels, yBegin, yEnd);
+                    return;
+                }
+
+                // Blend a strip of rows, then run the point steps on it
+                // while it is still in the cache.
+                for (DWORD y0 = yBegin; y0 < yEnd; y0 += POLAR_TILE_ROWS)
+                {
+                    const DWORD y1 = min(y0 + POLAR_TILE_ROWS, yEnd);
+
+                    (*m_pBilinearTransformFn)(pLookup, pDest, lDestStride, pSrc, lSrcStride, m_imageWidthInPixels, m_imageHeightInPixels, y0, y1);
+                    (*m_pMapFn)(pPointTables, pDest, lDestStride, pDest, lDestStride, m_imageWidthInPixels, m_imageHeightInPixels, y0, y1);
+                }
+            });
+        }
+        else
+        {
+            // The offsets in the table depend on the source stride.
+            if (m_spLookup == nullptr || lSrcStride != m_lookupKey.lStride)
+            {
+                POLAR_LOOKUP_KEY key = m_lookupKey;
+
+                key.lStride = lSrcStride;
+                AcquireLookupTable(key);
+            }
+
+            const DWORD cPairs = m_imageWidthInPixels / 2;
+            DWORD cTilePairs = (m_dwTileWidth + 1) / 2;
+
+            if (cTilePairs == 0 || cTilePairs > cPairs)
+            {
+                cTilePairs = cPairs;
+            }
+
+            const POLAR_LOOKUP lookup = { m_spLookup->offsets.data(), m_spLookup->deltas.data(), m_spLookup->rowStarts.data(), cTilePairs, pPointTables };
+            const IMAGE_TRANSFORM_FN pfnTransform = (m_lookupKey.type == PolarLookup_Delta ? m_pDeltaTransformFn : m_pTransformFn);
+
+            // Bands start on a tile row.
+            m_threadPool.Run(m_imageHeightInPixels, POLAR_TILE_ROWS, lDestStride, [&](DWORD yBegin, DWORD yEnd)
+            {
+                (*pfnTransform)(&lookup, pDest, lDestStride, pSrc, lSrcStride, m_imageWidthInPixels, m_imageHeightInPixels, yBegin, yEnd);
+            });
+        }
     }
     else
     {
@@ -1449,21 +1965,48 @@ void CPolarEffect::UpdateFormatInfo()
     m_cbImageSize = 0;
 
     m_pTransformFn = nullptr;
+    m_pDeltaTransformFn = nullptr;
+    m_pBilinearTransformFn = nullptr;
+    m_pAnimatedTransformFn = nullptr;
+    m_pSetBlackPixelFn = nullptr;
+    m_pMapFn = nullptr;
+    m_pSetFillPixelFn = nullptr;
+
+    // The radial profile depends on the frame size.
+    m_radial.clear();
 
     if (m_spInputType != nullptr)
     {
         ThrowIfError(m_spInputType->GetGUID(MF_MT_SUBTYPE, &subtype));
         if (subtype == MFVideoFormat_YUY2)
         {
-            m_pTransformFn = TransformImage_YUY2;
+            m_pTransformFn = TransformImage_422;
+            m_pDeltaTransformFn = TransformImageDelta_422;
+            m_pBilinearTransformFn = SelectBilinearTransform_422();
+            m_pAnimatedTransformFn = SelectAnimatedTransform_422();
+            m_pSetBlackPixelFn = SetBlackPixel_YUY2;
+            m_pMapFn = MapImage_422;
+            m_pSetFillPixelFn = SetFillPixel_422;
         }
         else if (subtype == MFVideoFormat_UYVY)
         {
-            m_pTransformFn = TransformImage_UYVY;
+            m_pTransformFn = TransformImage_422;
+            m_pDeltaTransformFn = TransformImageDelta_422;
+            m_pBilinearTransformFn = SelectBilinearTransform_422();
+            m_pAnimatedTransformFn = SelectAnimatedTransform_422();
+            m_pSetBlackPixelFn = SetBlackPixel_UYVY;
+            m_pMapFn = MapImage_422;
+            m_pSetFillPixelFn = SetFillPixel_422;
         }
         else if (subtype == MFVideoFormat_NV12)
         {
             m_pTransformFn = TransformImage_NV12;
+            m_pDeltaTransformFn = TransformImageDelta_NV12;
+            m_pBilinearTransformFn = SelectBilinearTransform_NV12();
+            m_pAnimatedTransformFn = SelectAnimatedTransform_NV12();
+            m_pSetBlackPixelFn = SetBlackPixel_NV12;
+            m_pMapFn = MapImage_NV12;
+            m_pSetFillPixelFn = SetFillPixel_NV12;
         }
         else
         {
@@ -1478,70 +2021,378 @@ void CPolarEffect::UpdateFormatInfo()
 }
 
 
+// Get the lookup table for a key, from the tables shared by all the
+// instances. If no instance uses the table, it is created on this thread.
+
+void CPolarEffect::AcquireLookupTable(const POLAR_LOOKUP_KEY &key)
+{
+    m_spLookup = g_lookupCache.GetTable(key, [this, &key](POLAR_LOOKUP_TABLE &table)
+    {
+        if (key.type == PolarLookup_Bilinear)
+        {
+            GenerateBilinearLookup(key, m_threadPool, table.bilinear);
+        }
+        else
+        {
+            BuildOffsetLookup(key, m_threadPool, table);
+        }
+    });
+
+    m_lookupKey = key;
+}
+
+
+// Build the point tables and the fill pixel of the effect chain for a
+// format. (See BuildPointTables.)
+
+void CPolarEffect::InitPointTables(const GUID &subtype)
+{
+    const bool *pfChroma = POLAR_CHROMA_BYTES_NV12;
+
+    if (subtype == MFVideoFormat_YUY2)
+    {
+        pfChroma = POLAR_CHROMA_BYTES_YUY2;
+    }
+    else if (subtype == MFVideoFormat_UYVY)
+    {
+        pfChroma = POLAR_CHROMA_BYTES_UYVY;
+    }
+
+    BuildPointTables(m_chain, pfChroma, m_pointTables, m_fillPixel);
+}
+
+
+// Get the value of a numeric property as a DOUBLE. Returns false if the
+// value is not a number.
+
+static bool GetNumericValue(Object ^value, DOUBLE *pdValue)
+{
+    IPropertyValue ^propertyValue = dynamic_cast<IPropertyValue^>(value);
+
+    if (propertyValue == nullptr)
+    {
+        return false;
+    }
+
+    switch (propertyValue->Type)
+    {
+    case PropertyType::Double:  *pdValue = propertyValue->GetDouble(); break;
+    case PropertyType::Single:  *pdValue = propertyValue->GetSingle(); break;
+    case PropertyType::UInt8:   *pdValue = propertyValue->GetUInt8(); break;
+    case PropertyType::Int16:   *pdValue = propertyValue->GetInt16(); break;
+    case PropertyType::UInt16:  *pdValue = propertyValue->GetUInt16(); break;
+    case PropertyType::Int32:   *pdValue = propertyValue->GetInt32(); break;
+    case PropertyType::UInt32:  *pdValue = propertyValue->GetUInt32(); break;
+    case PropertyType::Int64:   *pdValue = static_cast<DOUBLE>(propertyValue->GetInt64()); break;
+    case PropertyType::UInt64:  *pdValue = static_cast<DOUBLE>(propertyValue->GetUInt64()); break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+
+// Read the animated parameters from the configuration: "Strength",
+// "CenterX" and "CenterY", in that order, with the defaults for the ones
+// that are not set. Returns true if any of them is set, which animates
+// the effect. Throws if a value is not a number.
+
+static bool ReadAnimatedProperties(IMap<String^, Object^> ^configuration, DOUBLE adValues[3])
+{
+    static const wchar_t *s_apszKeys[] = { L"Strength", L"CenterX", L"CenterY" };
+    static const DOUBLE s_adDefaults[] = { 1.0, 0.5, 0.5 };
+
+    bool fAnimated = false;
+
+    for (DWORD i = 0; i < ARRAYSIZE(s_apszKeys); i++)
+    {
+        adValues[i] = s_adDefaults[i];
+
+        if (configuration->HasKey(StringReference(s_apszKeys[i])))
+        {
+            if (!GetNumericValue(configuration->Lookup(StringReference(s_apszKeys[i])), &adValues[i]))
+            {
+                throw ref new InvalidArgumentException();
+            }
+            fAnimated = true;
+        }
+    }
+
+    return fAnimated;
+}
+
+
+// Store the animated parameters in the cache. Called from SetProperties,
+// and from the MapChanged handler of the configuration.
+
+static void SetAnimatedProperties(POLAR_ANIMATED_PROPERTIES *pAnimated, bool fAnimated, const DOUBLE adValues[3])
+{
+    AutoLock lock(pAnimated->critSec);
+
+    pAnimated->fAnimated = fAnimated;
+    pAnimated->dStrength = adValues[0];
+    pAnimated->dCenterX = min(max(adValues[1], 0.0), 1.0);
+    pAnimated->dCenterY = min(max(adValues[2], 0.0), 1.0);
+}
+
+
+// Copy the animated parameters for this frame. Called with the lock held.
+
+void CPolarEffect::GetAnimatedProperties()
+{
+    AutoLock lock(m_spAnimated->critSec);
+
+    m_fAnimated = m_spAnimated->fAnimated;
+    m_dStrength = m_spAnimated->dStrength;
+    m_dCenterX = m_spAnimated->dCenterX;
+    m_dCenterY = m_spAnimated->dCenterY;
+}
+
+
+// Build the radial profile of the effect for the current strength, if
+// the strength has changed since it was built. (See BuildRadialProfile.)
+
+void CPolarEffect::UpdateRadialProfile()
+{
+    if (!m_radial.empty() && m_dRadialStrength == m_dStrength)
+    {
+        return;
+    }
+
+    BuildRadialProfile(m_pRadiusTransformFn, m_pThetaTransformFn, m_imageWidthInPixels, m_imageHeightInPixels, m_dStrength, m_radial);
+
+    m_dRadialStrength = m_dStrength;
+}
+
+
+// Get the radius and angle transformations of a polar effect by name.
+// Returns false if the name is not a polar effect.
+
+bool CPolarEffect::GetPolarTransformers(
+    const wchar_t *pszEffect,
+    PolarTransformer *ppfnRadius,
+    PolarTransformer *ppfnTheta
+    )
+{
+    if (wcscmp(pszEffect, L"Fisheye") == 0)
+    {
+        *ppfnRadius = CPolarEffect::FisheyeRadius;
+        *ppfnTheta = CPolarEffect::DefaultTheta;
+    }
+    else if (wcscmp(pszEffect, L"Pinch") == 0)
+    {
+        *ppfnRadius = CPolarEffect::PinchRadius;
+        *ppfnTheta = CPolarEffect::DefaultTheta;
+    }
+    else if (wcscmp(pszEffect, L"Warp") == 0)
+    {
+        *ppfnRadius = CPolarEffect::DefaultRadius;
+        *ppfnTheta = CPolarEffect::WarpTheta;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
 // Create a lookup table which stores the result of polar transformation
 
 // By controlling the radius (m_pRadiusTransformFn) and angle
 // (m_pThetaTransformFn) functions, different effects can be created
 
+// The table has one entry for each output pixel pair, which holds the
+// index (y * width + x) of the source pixel for the left pixel of the
+// pair. BuildOffsetLookup converts the indexes to byte offsets. The
+// rows are generated in parallel on threadPool.
+
 void CPolarEffect::GeneratePolarLookup(
-    UINT32 unWidth, 
-    UINT32 unHeight, 
-    Array<UINT32> ^indexLookup 
+    const POLAR_LOOKUP_KEY &key, 
+    RowBandThreadPool &threadPool, 
+    std::vector<UINT32> &indexLookup 
     )
 {
-    LONG x, y;
-    LONG lMaxX, lMaxY;
-    LONG lHalfWidth, lHalfHeight;
-    LONG lTransDx, lTransDy;
-    DOUBLE dRadius, dMaxRadius, dNewRadius;
-    DOUBLE dTheta, dNewTheta;
+    const GENERATE_POLAR_ROWS_FN pfnGenerateRows = SelectGeneratePolarRows();
 
-    assert(m_pRadiusTransformFn != nullptr);
-    assert(m_pThetaTransformFn != nullptr);
+    assert(key.pfnRadius != nullptr);
+    assert(key.pfnTheta != nullptr);
 
-    lMaxX = (LONG)unWidth;
-    lMaxY = (LONG)unHeight;
-    lHalfWidth = unWidth / 2;
-    lHalfHeight = unHeight / 2;
-    dMaxRadius = floor( sqrtf( static_cast<float>(lHalfWidth*lHalfWidth+lHalfHeight*lHalfHeight) ) );
+    const UINT32 cPairs = key.unWidth / 2;
 
-    UINT32 nIndex = 0;
+    indexLookup.resize(cPairs * key.unHeight);
 
-    for(y = 0; y < lMaxY; y++)
+    UINT32 *pIndex = indexLookup.data();
+
+    threadPool.Run(key.unHeight, 1, static_cast<LONG>(cPairs * sizeof(UINT32)), [&](DWORD yBegin, DWORD yEnd)
     {
-        for(x = 0; x < lMaxX; x++, nIndex++)
-        {
-            lTransDx = lHalfWidth - x;
-            lTransDy = lHalfHeight - y;
+        (*pfnGenerateRows)(key, pIndex, yBegin, yEnd);
+    });
+}
+
+
+//-------------------------------------------------------------------
+// BuildOffsetLookup
+// Creates the nearest-neighbor lookup table for a format and a source
+// stride.
+//
+// The pixel indexes from GeneratePolarLookup are converted to byte
+// offsets once, here, instead of for every pixel of every frame.
+// PolarLookup_Delta tables use the delta encoding, which is about half
+// the size. (See POLAR_LOOKUP.)
+//-------------------------------------------------------------------
+
+void CPolarEffect::BuildOffsetLookup(
+    const POLAR_LOOKUP_KEY &key, 
+    RowBandThreadPool &threadPool, 
+    POLAR_LOOKUP_TABLE &table
+    )
+{
+    // The offsets are unsigned, so the stride must be positive. (It is,
+    // for YUV formats.)
+    if (key.lStride <= 0)
+    {
+        ThrowException(E_UNEXPECTED);
+    }
+
+    const bool fNV12 = (key.dwFormat == FOURCC_NV12);
+    const UINT32 cbPixel = (fNV12 ? 1 : 2);
+    const UINT32 unWidth = key.unWidth;
+    const UINT32 cPairs = unWidth / 2;
+    const UINT32 cRows = key.unHeight;
+    const UINT32 cChromaRows = (fNV12 ? (cRows + 1) / 2 : 0);
+    const UINT32 unStride = static_cast<UINT32>(key.lStride);
+
+    std::vector<UINT32> offsets;
 
-            dRadius = ceil( sqrtf( static_cast<float>(lTransDx*lTransDx + lTransDy*lTransDy) ) );
+    GeneratePolarLookup(key, threadPool, offsets);
 
-            if( dRadius < dMaxRadius )
+    // U-V rows, from the lookup row of the first of their two Y rows.
+    offsets.resize(cPairs * (cRows + cChromaRows));
+
+    UINT32 *pTable = offsets.data();
+
+    threadPool.Run(cChromaRows, 1, static_cast<LONG>(cPairs * sizeof(UINT32)), [&](DWORD yBegin, DWORD yEnd)
+    {
+        for (UINT32 y = yBegin; y < yEnd; y++)
+        {
+            const UINT32 *pIndex = &pTable[cPairs * (2 * y)];
+            UINT32 *pOffset = &pTable[cPairs * (cRows + y)];
+
+            for (UINT32 x = 0; x < cPairs; x++)
             {
-                dTheta = atan2f( static_cast<float> (lTransDy), static_cast<float> (lTransDx) );
+                pOffset[x] = (pIndex[x] / unWidth / 2) * unStride + (pIndex[x] % unWidth & ~1);
+            }
+        }
+    });
+
+    // Y rows (or 4:2:2 rows), in place.
+    threadPool.Run(cRows, 1, static_cast<LONG>(cPairs * sizeof(UINT32)), [&](DWORD yBegin, DWORD yEnd)
+    {
+        for (UINT32 i = cPairs * yBegin; i < cPairs * yEnd; i++)
+        {
+            pTable[i] = (pTable[i] / unWidth) * unStride + (pTable[i] % unWidth & ~1) * cbPixel;
+        }
+    });
+
+    if (key.type == PolarLookup_Delta)
+    {
+        EncodeLookupDelta(offsets.data(), cPairs, cRows + cChromaRows, table.deltas, table.rowStarts);
+        table.deltas.shrink_to_fit();
+    }
+    else
+    {
+        table.offsets.swap(offsets);
+    }
+}
 
-                dNewRadius = m_pRadiusTransformFn(dRadius, dMaxRadius, dTheta);
-                dNewTheta = m_pThetaTransformFn(dRadius, dMaxRadius, dTheta);
 
-                lTransDx = lHalfWidth - (LONG)(dNewRadius * cos(dNewTheta));
-                lTransDy = lHalfHeight - (LONG)(dNewRadius * sin(dNewTheta));
+//-------------------------------------------------------------------
+// GenerateBilinearLookup
+// Creates the lookup table for bilinear sampling.
+//
+// The mapping is the same as in GeneratePolarLookup, but the radius
+// and the source position are not rounded. The source position of each
+// output pixel pair is split into the top-left source pixel pair and
+// the weights of the right and bottom taps. Positions near the right
+// and bottom edges are clamped, so that all four taps are inside the
+// image. Positions outside the image map to pixel pair 0 with zero
+// weights, which gives black.
+//-------------------------------------------------------------------
 
-                if( 0 <= lTransDx && lTransDx < lMaxX &&
-                    0 <= lTransDy && lTransDy < lMaxY )
+void CPolarEffect::GenerateBilinearLookup(
+    const POLAR_LOOKUP_KEY &key, 
+    RowBandThreadPool &threadPool, 
+    std::vector<POLAR_BILINEAR_SAMPLE> &bilinearLookup
+    )
+{
+    const UINT32 unWidth = key.unWidth;
+    const UINT32 unHeight = key.unHeight;
+
+    const POLAR_BILINEAR_SAMPLE black = { 0, 0, 0, 0 };
+    const LONG cPairs = unWidth / 2;
+
+    assert(key.pfnRadius != nullptr);
+    assert(key.pfnTheta != nullptr);
+
+    bilinearLookup.assign(cPairs * unHeight, black);
+
+    // The taps need two pixel pairs and two rows. WORD coordinates
+    // limit the size of the source image.
+    if (cPairs < 2 || unHeight < 2 || unWidth > MAXWORD || unHeight > MAXWORD)
+    {
+        return;
+    }
+
+    const LONG lHalfWidth = unWidth / 2;
+    const LONG lHalfHeight = unHeight / 2;
+    const DOUBLE dMaxRadius = floor( sqrt( static_cast<DOUBLE>(lHalfWidth*lHalfWidth+lHalfHeight*lHalfHeight) ) );
+
+    POLAR_BILINEAR_SAMPLE *pTable = bilinearLookup.data();
+
+    threadPool.Run(unHeight, 1, static_cast<LONG>(cPairs * sizeof(POLAR_BILINEAR_SAMPLE)), [&](DWORD yBegin, DWORD yEnd)
+    {
+        for (LONG y = (LONG)yBegin; y < (LONG)yEnd; y++)
+        {
+            POLAR_BILINEAR_SAMPLE *pSample = pTable + cPairs * y;
+
+            for (LONG x = 0; x < cPairs; x++, pSample++)
+            {
+                // Left pixel of the output pair, as in the nearest-neighbor table.
+                const DOUBLE dTransDx = static_cast<DOUBLE>(lHalfWidth - 2 * x);
+                const DOUBLE dTransDy = static_cast<DOUBLE>(lHalfHeight - y);
+                const DOUBLE dRadius = sqrt( dTransDx*dTransDx + dTransDy*dTransDy );
+
+                if (dRadius >= dMaxRadius)
                 {
-                    indexLookup[nIndex] = lTransDy * lMaxX + lTransDx;
+                    continue;
                 }
-                else
+
+                const DOUBLE dTheta = atan2( dTransDy, dTransDx );
+                const DOUBLE dNewRadius = key.pfnRadius(dRadius, dMaxRadius, dTheta);
+                const DOUBLE dNewTheta = key.pfnTheta(dRadius, dMaxRadius, dTheta);
+
+                const DOUBLE dSrcX = lHalfWidth - dNewRadius * cos(dNewTheta);
+                const DOUBLE dSrcY = lHalfHeight - dNewRadius * sin(dNewTheta);
+
+                if (dSrcX < 0 || dSrcX >= unWidth || dSrcY < 0 || dSrcY >= unHeight)
                 {
-                    indexLookup[nIndex] = 0;
+                    continue;
                 }
-            }
-            else
-            {
-                indexLookup[nIndex] = 0;
+
+                // Source position in pixel pairs and rows.
+                const DOUBLE dPairX = dSrcX / 2;
+                const LONG lPairX = min((LONG)dPairX, cPairs - 2);
+                const LONG lRowY = min((LONG)dSrcY, (LONG)unHeight - 2);
+
+                pSample->x = static_cast<WORD>(lPairX);
+                pSample->y = static_cast<WORD>(lRowY);
+                pSample->weightX = static_cast<BYTE>(min((LONG)((dPairX - lPairX) * 256 + 0.5), 255L));
+                pSample->weightY = static_cast<BYTE>(min((LONG)((dSrcY - lRowY) * 256 + 0.5), 255L));
             }
         }
-    }
+    });
 }
 
 
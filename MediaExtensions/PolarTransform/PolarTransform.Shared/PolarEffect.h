@@ -10,23 +10,95 @@
 #ifndef POLAREFFECT_H
 #define POLAREFFECT_H
 #include <CritSec.h>
+#include <RowBandThreadPool.h>
+#include <LookupTableCache.h>
+#include <EffectChain.h>
+#include <OutputSamplePool.h>
+#include "PolarKernels.h"
+#include <vector>
+#include <tuple>
+#include <memory>
 //#include <math.h>
 
 // Note: The Direct2D helper library is included for its 2D matrix operations.
 //#include <D2d1helper.h>
 
+// Nearest-neighbor lookup table. There is one entry for each output pixel
+// pair: the byte offset of the source pixel pair, for the source stride that
+// the table was built for. The rows of the image (4:2:2), or of the Y plane
+// (NV12), come first. For NV12 they are followed by the rows of the U-V
+// plane, with offsets from the start of the U-V plane.
+//
+// The entries use one of two encodings:
+//
+// Offset:  pOffsets holds one UINT32 for each entry.
+// Delta:   pDeltas holds, for each entry, the difference from the previous
+//          entry in the same row (0 before the first entry). A difference
+//          that does not fit in an INT16 is stored as POLAR_DELTA_ESCAPE,
+//          followed by the low and high WORDs of the offset. pRowStarts
+//          holds the index in pDeltas of the first entry of each row.
+//
+// If pPointTables is not nullptr, each byte of a copied entry is mapped
+// through the table for its position in the entry: tables 0-3 for the
+// image (4:2:2) or the Y plane (NV12), and tables 4-5 for the U-V plane.
+struct POLAR_LOOKUP
+{
+    const UINT32            *pOffsets;       // Offset encoding.
+    const INT16             *pDeltas;        // Delta encoding.
+    const UINT32            *pRowStarts;     // Delta encoding: First entry of each row.
+    DWORD                   cTilePairs;      // Width of the destination tiles, in pixel pairs.
+    const BYTE              (*pPointTables)[256]; // Point steps of the effect chain, or nullptr.
+};
+
 // Function pointer for the function that transforms the image.
 typedef void (*IMAGE_TRANSFORM_FN)(
-    const UINT32            *pLookup,        // Lookup buffer.
+    const POLAR_LOOKUP      *pLookup,        // Lookup table.
     BYTE*                   pDest,           // Destination buffer.
     LONG                    lDestStride,     // Destination stride.
     const BYTE*             pSrc,            // Source buffer.
     LONG                    lSrcStride,      // Source stride.
     DWORD                   dwWidthInPixels, // Image width in pixels.
+    DWORD                   dwHeightInPixels,// Image height in pixels.
+    DWORD                   dwRowBegin,      // First destination row to transform.
+    DWORD                   dwRowEnd         // Row after the last destination row to transform.
+    );
+
+// Function pointer for the function that sets the first source pixel to black.
+typedef void (*SET_BLACK_PIXEL_FN)(
+    BYTE*                   pSrc,            // Source buffer.
+    LONG                    lSrcStride,      // Source stride.
     DWORD                   dwHeightInPixels // Image height in pixels.
     );
 
-typedef DOUBLE (*PolarTransformer)(DOUBLE, DOUBLE, DOUBLE);
+// Function pointer for the function that sets the first source pixel to
+// the fill value of the effect chain.
+typedef void (*SET_FILL_PIXEL_FN)(
+    BYTE*                   pSrc,            // Source buffer.
+    LONG                    lSrcStride,      // Source stride.
+    DWORD                   dwHeightInPixels,// Image height in pixels.
+    const BYTE*             pFill            // Fill bytes, in the order of the point tables.
+    );
+
+// Lookup table. Only the members for the type of the key are used.
+struct POLAR_LOOKUP_TABLE
+{
+    std::vector<UINT32>     offsets;         // Offset encoding. (See POLAR_LOOKUP.)
+    std::vector<INT16>      deltas;          // Delta encoding.
+    std::vector<UINT32>     rowStarts;       // Delta encoding: First entry of each row.
+    std::vector<POLAR_BILINEAR_SAMPLE> bilinear; // Bilinear sampling. (One entry per output pixel pair.)
+};
+
+// Animated parameters, cached from the configuration. The handler of the
+// MapChanged event of the configuration updates them, and the frames copy
+// them. The handler holds a reference to this structure, not to the MFT.
+struct POLAR_ANIMATED_PROPERTIES
+{
+    CritSec     critSec;
+    bool        fAnimated;                  // Strength or centre is set.
+    DOUBLE      dStrength;
+    DOUBLE      dCenterX;
+    DOUBLE      dCenterY;
+};
 
 // CPolarEffect class:
 // Implements a polar transformation video effect.
@@ -201,10 +273,29 @@ private:
     void OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut);
     void OnFlush();
     void UpdateFormatInfo();
-    void GeneratePolarLookup( 
-        UINT32 unWidth, 
-        UINT32 unHeight, 
-        Array<UINT32> ^indexLookup
+    void AcquireLookupTable(const POLAR_LOOKUP_KEY &key);
+    void InitPointTables(const GUID &subtype);
+    void GetAnimatedProperties();
+    void UpdateRadialProfile();
+    static bool GetPolarTransformers(
+        const wchar_t *pszEffect,
+        PolarTransformer *ppfnRadius,
+        PolarTransformer *ppfnTheta
+        );
+    static void GeneratePolarLookup( 
+        const POLAR_LOOKUP_KEY &key, 
+        RowBandThreadPool &threadPool, 
+        std::vector<UINT32> &indexLookup
+        );
+    static void BuildOffsetLookup(
+        const POLAR_LOOKUP_KEY &key, 
+        RowBandThreadPool &threadPool, 
+        POLAR_LOOKUP_TABLE &table
+        );
+    static void GenerateBilinearLookup( 
+        const POLAR_LOOKUP_KEY &key, 
+        RowBandThreadPool &threadPool, 
+        std::vector<POLAR_BILINEAR_SAMPLE> &bilinearLookup
         );
 
     CritSec m_critSec;
@@ -222,11 +313,45 @@ private:
 
     ComPtr<IMFAttributes> m_spAttributes;
 
-    // Image transform function. (Changes based on the media type.)
+    // Image transform functions. (Change based on the media type.)
     IMAGE_TRANSFORM_FN m_pTransformFn;
-
-    // Lookup table to store the result of polar transformation
-    Array<UINT32> ^m_indexLookup;
+    IMAGE_TRANSFORM_FN m_pDeltaTransformFn;
+    IMAGE_BILINEAR_TRANSFORM_FN m_pBilinearTransformFn;
+    IMAGE_ANIMATED_TRANSFORM_FN m_pAnimatedTransformFn;
+    SET_BLACK_PIXEL_FN m_pSetBlackPixelFn;
+    IMAGE_MAP_FN m_pMapFn;
+    SET_FILL_PIXEL_FN m_pSetFillPixelFn;
+
+    RowBandThreadPool m_threadPool;              // Runs the transform function on bands of rows.
+    OutputSamplePool m_outputSamples;            // Output samples that the MFT provides.
+
+    // Lookup table to store the result of polar transformation. Instances
+    // with the same key share the table. (See LookupTableCache.h.)
+    std::shared_ptr<const POLAR_LOOKUP_TABLE> m_spLookup;
+    POLAR_LOOKUP_KEY m_lookupKey;                // Key of m_spLookup.
+    bool m_fDeltaLookup;                         // Use the delta encoding for the next table.
+    bool m_fBilinear;                            // Use bilinear instead of nearest-neighbor sampling.
+    DWORD m_dwTileWidth;                         // Width of the nearest-neighbor tiles, in pixels. (0 = whole rows.)
+
+    // Effect chain. (See EffectChain.h.) BeginStreaming applies m_chain
+    // to the members that follow it.
+    EffectChain m_chain;                         // Effects from the "Chain" property. (Empty = polar effect only.)
+    bool m_fChainInitialized;                    // BeginStreaming has set up the chain and the lookup table.
+    bool m_fGather;                              // The chain has a polar effect. (False = point steps only.)
+    bool m_fPointTables;                         // The chain has point steps, in m_pointTables.
+    BYTE m_pointTables[8][256];                  // Point steps, for each byte of a lookup entry. (See POLAR_LOOKUP.)
+    BYTE m_fillPixel[8];                         // Source bytes for pixels outside the image.
+
+    // Animated parameters. (See note 17 in PolarEffect.cpp.)
+    ComPtr<ABI::Windows::Foundation::Collections::IPropertySet> m_spConfiguration; // Configuration that m_mapChangedToken is registered with.
+    Windows::Foundation::EventRegistrationToken m_mapChangedToken;
+    std::shared_ptr<POLAR_ANIMATED_PROPERTIES> m_spAnimated;   // Updated when the configuration changes.
+    bool m_fAnimated;                            // Strength or centre is set: evaluate the mapping for each frame. (Copied for each frame.)
+    DOUBLE m_dStrength;                          // 0 = no effect, 1 = full effect.
+    DOUBLE m_dCenterX;                           // Centre, as a fraction of the width.
+    DOUBLE m_dCenterY;                           // Centre, as a fraction of the height.
+    std::vector<float> m_radial;                 // Radial profile for m_dRadialStrength. (Empty = not built.)
+    DOUBLE m_dRadialStrength;
 
     // Polar transform function for specific effect
     PolarTransformer m_pRadiusTransformFn;       // Radius transformation
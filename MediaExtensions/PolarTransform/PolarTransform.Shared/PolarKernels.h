@@ -0,0 +1,1724 @@
+// Image processing kernels for the polar transform.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+// Note: The kernels do not depend on COM or Media Foundation, so that the
+// tests can build them with GCC or Clang (see CMakeLists.txt).
+
+#include "PortableTypes.h"
+#include "CpuFeatures.h"
+#include "EffectChain.h"
+#include <math.h>
+#include <tuple>
+#include <vector>
+
+// Entry of the bilinear lookup table. There is one entry for each pair of
+// output pixels. The four taps are the source pixel pairs (x, y), (x + 1, y),
+// (x, y + 1) and (x + 1, y + 1).
+struct POLAR_BILINEAR_SAMPLE
+{
+    WORD    x;                  // Source pixel pair of the left taps.
+    WORD    y;                  // Source row of the top taps.
+    BYTE    weightX;            // Weight of the right taps, in 1/256.
+    BYTE    weightY;            // Weight of the bottom taps, in 1/256.
+};
+
+typedef DOUBLE (*PolarTransformer)(DOUBLE, DOUBLE, DOUBLE);
+
+// Type of lookup table.
+enum POLAR_LOOKUP_TYPE
+{
+    PolarLookup_Offset,                      // Nearest-neighbor sampling, offset encoding.
+    PolarLookup_Delta,                       // Nearest-neighbor sampling, delta encoding.
+    PolarLookup_Bilinear                     // Bilinear sampling.
+};
+
+// Identifies a lookup table in the cache of tables that are shared by all
+// the instances of the effect.
+struct POLAR_LOOKUP_KEY
+{
+    POLAR_LOOKUP_TYPE       type;
+    UINT32                  unWidth;         // Image width in pixels.
+    UINT32                  unHeight;        // Image height in pixels.
+    DWORD                   dwFormat;        // FOURCC of the format. (0 for bilinear tables.)
+    LONG                    lStride;         // Source stride. (0 for bilinear tables.)
+    PolarTransformer        pfnRadius;       // Radius transformation.
+    PolarTransformer        pfnTheta;        // Angle transformation.
+
+    bool operator<(const POLAR_LOOKUP_KEY &other) const
+    {
+        return std::make_tuple(type, unWidth, unHeight, dwFormat, lStride, reinterpret_cast<UINT_PTR>(pfnRadius), reinterpret_cast<UINT_PTR>(pfnTheta)) <
+            std::make_tuple(other.type, other.unWidth, other.unHeight, other.dwFormat, other.lStride, reinterpret_cast<UINT_PTR>(other.pfnRadius), reinterpret_cast<UINT_PTR>(other.pfnTheta));
+    }
+};
+
+// Function pointer for the function that fills rows of the nearest-neighbor
+// lookup table with source pixel indexes.
+typedef void (*GENERATE_POLAR_ROWS_FN)(
+    const POLAR_LOOKUP_KEY  &key,            // Size and transformations.
+    UINT32*                 pIndex,          // Start of the table.
+    DWORD                   dwRowBegin,      // First row to generate.
+    DWORD                   dwRowEnd         // Row after the last row to generate.
+    );
+
+// Function pointer for the function that transforms the image with bilinear sampling.
+typedef void (*IMAGE_BILINEAR_TRANSFORM_FN)(
+    const POLAR_BILINEAR_SAMPLE *pLookup,    // Lookup buffer.
+    BYTE*                   pDest,           // Destination buffer.
+    LONG                    lDestStride,     // Destination stride.
+    const BYTE*             pSrc,            // Source buffer.
+    LONG                    lSrcStride,      // Source stride.
+    DWORD                   dwWidthInPixels, // Image width in pixels.
+    DWORD                   dwHeightInPixels,// Image height in pixels.
+    DWORD                   dwRowBegin,      // First destination row to transform.
+    DWORD                   dwRowEnd         // Row after the last destination row to transform.
+    );
+
+// Marks an entry of a delta-encoded lookup table that holds the offset
+// itself. (See POLAR_LOOKUP.)
+const INT16 POLAR_DELTA_ESCAPE = (-32767 - 1);
+
+// The nearest-neighbor functions write the destination in tiles of
+// cTilePairs pixel pairs by POLAR_TILE_ROWS rows. POLAR_TILE_ROWS is even,
+// so that a tile covers whole NV12 chroma rows.
+const DWORD POLAR_TILE_ROWS = 32;
+
+// Radial profile of a polar effect, to evaluate the mapping for each frame
+// instead of reading it from a lookup table. Entry r of pRadial describes
+// the output pixels at radius r (rounded up) from the centre: the radius of
+// their source pixel times the cosine and the sine of the angle change.
+// Output pixels at radius cRadii or more are black.
+struct POLAR_ANIMATION
+{
+    const float             *pRadial;        // Two floats per radius, and a zero entry at cRadii.
+    LONG                    cRadii;          // Number of radii.
+    LONG                    lCenterX;        // Centre of the effect, in pixels.
+    LONG                    lCenterY;
+    const BYTE              (*pPointTables)[256]; // Point steps of the effect chain, or nullptr. (See POLAR_LOOKUP.)
+};
+
+// Function pointer for the function that transforms the image with an animated effect.
+typedef void (*IMAGE_ANIMATED_TRANSFORM_FN)(
+    const POLAR_ANIMATION   *pAnimation,     // Radial profile.
+    BYTE*                   pDest,           // Destination buffer.
+    LONG                    lDestStride,     // Destination stride.
+    const BYTE*             pSrc,            // Source buffer.
+    LONG                    lSrcStride,      // Source stride.
+    DWORD                   dwWidthInPixels, // Image width in pixels.
+    DWORD                   dwHeightInPixels,// Image height in pixels.
+    DWORD                   dwRowBegin,      // First destination row to transform.
+    DWORD                   dwRowEnd         // Row after the last destination row to transform.
+    );
+
+// Function pointer for the function that maps each byte of the image
+// through the point tables of the effect chain. (See POLAR_LOOKUP.)
+// pDest and pSrc can be the same buffer.
+typedef void (*IMAGE_MAP_FN)(
+    const BYTE              (*pTables)[256], // Point tables.
+    BYTE*                   pDest,           // Destination buffer.
+    LONG                    lDestStride,     // Destination stride.
+    const BYTE*             pSrc,            // Source buffer.
+    LONG                    lSrcStride,      // Source stride.
+    DWORD                   dwWidthInPixels, // Image width in pixels.
+    DWORD                   dwHeightInPixels,// Image height in pixels.
+    DWORD                   dwRowBegin,      // First row to map.
+    DWORD                   dwRowEnd         // Row after the last row to map.
+    );
+
+//-------------------------------------------------------------------
+// Functions to apply the bilinear lookup table to YUV images.
+//
+// Each lookup entry gives the top-left source pixel pair and the
+// weights of the right and bottom taps, in 1/256. Every byte of the
+// output pixel pair is blended from the same byte of the four source
+// pixel pairs, in two fixed-point steps:
+//
+//     top    = (a * (256 - wx) + b * wx + 128) >> 8
+//     bottom = (c * (256 - wx) + d * wx + 128) >> 8
+//     result = (top * (256 - wy) + bottom * wy + 128) >> 8
+//
+// Because the bytes are blended independently, the same functions
+// handle UYVY and YUY2. The lookup table keeps all four taps inside
+// the image, so the functions do not clip. The SIMD versions give the
+// same result as the scalar versions.
+//
+// The parameters are the same as for the nearest-neighbor functions.
+//-------------------------------------------------------------------
+
+inline BYTE BlendBilinear(UINT32 a, UINT32 b, UINT32 c, UINT32 d, UINT32 wx, UINT32 wy)
+{
+    const UINT32 top = (a * (256 - wx) + b * wx + 128) >> 8;
+    const UINT32 bottom = (c * (256 - wx) + d * wx + 128) >> 8;
+
+    return static_cast<BYTE>((top * (256 - wy) + bottom * wy + 128) >> 8);
+}
+
+// Blends one output unit of cbUnit bytes. pTop points to the top-left
+// tap; the right taps follow it, and the bottom taps are lBottom bytes
+// further.
+
+inline void BlendBilinearUnit(
+    _Out_writes_bytes_(cbUnit) BYTE *pDest,
+    _In_ const BYTE *pTop,
+    _In_ LONG lBottom,
+    _In_ DWORD cbUnit,
+    _In_ UINT32 wx,
+    _In_ UINT32 wy)
+{
+    const BYTE *pBottom = pTop + lBottom;
+
+    for (DWORD i = 0; i < cbUnit; i++)
+    {
+        pDest[i] = BlendBilinear(pTop[i], pTop[cbUnit + i], pBottom[i], pBottom[cbUnit + i], wx, wy);
+    }
+}
+
+// Returns the chroma row, the weight of the row below it, and the
+// offset to the row below, for an entry of the luma lookup table.
+// The chroma row is at half the luma position.
+
+inline DWORD GetChromaRow(const POLAR_BILINEAR_SAMPLE &sample, LONG lStride, DWORD dwChromaRows, UINT32 *pWeightY, LONG *plBottom)
+{
+    const UINT32 uPos = (static_cast<UINT32>(sample.y) * 256 + sample.weightY) / 2;
+    const DWORD dwRow = uPos >> 8;
+
+    *pWeightY = uPos & 0xFF;
+    *plBottom = (dwRow + 1 < dwChromaRows) ? lStride : 0;
+
+    return dwRow;
+}
+
+// Convert UYVY or YUY2 image.
+
+inline void BilinearTransformImage_422(
+    _In_reads_(_Inexpressible_(dwWidthInPixels / 2 * dwHeightInPixels)) const POLAR_BILINEAR_SAMPLE *pLookup,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const DWORD cPairs = dwWidthInPixels / 2;
+
+    pDest += lDestStride * (LONG) dwRowBegin;
+    pLookup += cPairs * dwRowBegin;
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        for (DWORD x = 0; x < cPairs; x++)
+        {
+            const POLAR_BILINEAR_SAMPLE &sample = pLookup[x];
+            const BYTE *pTop = pSrc + sample.y * lSrcStride + sample.x * 4;
+
+            BlendBilinearUnit(pDest + x * 4, pTop, lSrcStride, 4, sample.weightX, sample.weightY);
+        }
+        pDest += lDestStride;
+        pLookup += cPairs;
+    }
+}
+
+// Convert NV12 image.
+
+inline void BilinearTransformImage_NV12(
+    _In_reads_(_Inexpressible_(dwWidthInPixels / 2 * dwHeightInPixels)) const POLAR_BILINEAR_SAMPLE *pLookup,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const DWORD cPairs = dwWidthInPixels / 2;
+
+    // Y plane. Each unit is a pair of Y samples.
+
+    const POLAR_BILINEAR_SAMPLE *pLookup_Y = pLookup + cPairs * dwRowBegin;
+    BYTE *pDest_Row = pDest + lDestStride * (LONG) dwRowBegin;
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        for (DWORD x = 0; x < cPairs; x++)
+        {
+            const POLAR_BILINEAR_SAMPLE &sample = pLookup_Y[x];
+            const BYTE *pTop = pSrc + sample.y * lSrcStride + sample.x * 2;
+
+            BlendBilinearUnit(pDest_Row + x * 2, pTop, lSrcStride, 2, sample.weightX, sample.weightY);
+        }
+        pDest_Row += lDestStride;
+        pLookup_Y += cPairs;
+    }
+
+    // U-V plane. Each unit is a U-V pair. Each U-V line uses the lookup
+    // row of the first of its two Y lines.
+
+    const DWORD dwChromaRows = dwHeightInPixels / 2;
+    const POLAR_BILINEAR_SAMPLE *pLookup_UV = pLookup + cPairs * dwRowBegin;
+    const BYTE *pSrc_UV = pSrc + lSrcStride * (LONG) dwHeightInPixels;
+    pDest_Row = pDest + lDestStride * (LONG) (dwHeightInPixels + dwRowBegin / 2);
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y += 2)
+    {
+        for (DWORD x = 0; x < cPairs; x++)
+        {
+            const POLAR_BILINEAR_SAMPLE &sample = pLookup_UV[x];
+            UINT32 wy = 0;
+            LONG lBottom = 0;
+            const DWORD dwRow = GetChromaRow(sample, lSrcStride, dwChromaRows, &wy, &lBottom);
+            const BYTE *pTop = pSrc_UV + dwRow * lSrcStride + sample.x * 2;
+
+            BlendBilinearUnit(pDest_Row + x * 2, pTop, lBottom, 2, sample.weightX, wy);
+        }
+        pDest_Row += lDestStride;
+        pLookup_UV += cPairs * 2;
+    }
+}
+
+#if defined(CPU_FEATURES_X86)
+
+// Blends 8 bytes from each tap, widened to 16 bits. wx and wy hold the
+// weight for each byte.
+
+inline __m128i BlendBilinear_SSE2(__m128i a, __m128i b, __m128i c, __m128i d, __m128i wx, __m128i wy)
+{
+    const __m128i w256 = _mm_set1_epi16(256);
+    const __m128i round = _mm_set1_epi16(128);
+
+    // The sums are at most 255 * 256 + 128, so they fit in 16 bits.
+    const __m128i wx0 = _mm_sub_epi16(w256, wx);
+    const __m128i wy0 = _mm_sub_epi16(w256, wy);
+
+    __m128i top = _mm_add_epi16(_mm_mullo_epi16(a, wx0), _mm_mullo_epi16(b, wx));
+    __m128i bottom = _mm_add_epi16(_mm_mullo_epi16(c, wx0), _mm_mullo_epi16(d, wx));
+    top = _mm_srli_epi16(_mm_add_epi16(top, round), 8);
+    bottom = _mm_srli_epi16(_mm_add_epi16(bottom, round), 8);
+
+    __m128i result = _mm_add_epi16(_mm_mullo_epi16(top, wy0), _mm_mullo_epi16(bottom, wy));
+    return _mm_srli_epi16(_mm_add_epi16(result, round), 8);
+}
+
+// Convert UYVY or YUY2 image, two pixel pairs at a time.
+
+inline void BilinearTransformImage_422_SSE2(
+    _In_reads_(_Inexpressible_(dwWidthInPixels / 2 * dwHeightInPixels)) const POLAR_BILINEAR_SAMPLE *pLookup,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const DWORD cPairs = dwWidthInPixels / 2;
+    const __m128i zero = _mm_setzero_si128();
+
+    pDest += lDestStride * (LONG) dwRowBegin;
+    pLookup += cPairs * dwRowBegin;
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        DWORD x = 0;
+
+        for ( ; x + 1 < cPairs; x += 2)
+        {
+            const POLAR_BILINEAR_SAMPLE &s0 = pLookup[x];
+            const POLAR_BILINEAR_SAMPLE &s1 = pLookup[x + 1];
+            const BYTE *pTop0 = pSrc + s0.y * lSrcStride + s0.x * 4;
+            const BYTE *pTop1 = pSrc + s1.y * lSrcStride + s1.x * 4;
+
+            // Each load gets the left and the right tap: a0 b0 a1 b1
+            __m128i ab = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pTop0)),
+                                            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pTop1)));
+            __m128i cd = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pTop0 + lSrcStride)),
+                                            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pTop1 + lSrcStride)));
+
+            // a0 a1 b0 b1
+            ab = _mm_shuffle_epi32(ab, _MM_SHUFFLE(3, 1, 2, 0));
+            cd = _mm_shuffle_epi32(cd, _MM_SHUFFLE(3, 1, 2, 0));
+
+            const __m128i wx = _mm_set_epi16(s1.weightX, s1.weightX, s1.weightX, s1.weightX, s0.weightX, s0.weightX, s0.weightX, s0.weightX);
+            const __m128i wy = _mm_set_epi16(s1.weightY, s1.weightY, s1.weightY, s1.weightY, s0.weightY, s0.weightY, s0.weightY, s0.weightY);
+
+            __m128i result = BlendBilinear_SSE2(_mm_unpacklo_epi8(ab, zero), _mm_unpackhi_epi8(ab, zero),
+                                                _mm_unpacklo_epi8(cd, zero), _mm_unpackhi_epi8(cd, zero), wx, wy);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(pDest + x * 4), _mm_packus_epi16(result, result));
+        }
+
+        for ( ; x < cPairs; x++)
+        {
+            const POLAR_BILINEAR_SAMPLE &sample = pLookup[x];
+            BlendBilinearUnit(pDest + x * 4, pSrc + sample.y * lSrcStride + sample.x * 4, lSrcStride, 4, sample.weightX, sample.weightY);
+        }
+
+        pDest += lDestStride;
+        pLookup += cPairs;
+    }
+}
+
+// Reads 4 bytes from any address. The compiler turns the copy into a
+// single load.
+inline int LoadUnaligned32(const BYTE *p)
+{
+    int value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Blends four units of two bytes (NV12 Y pairs or U-V pairs). pTop[i]
+// points to the top-left tap of unit i, and lBottom[i] is the offset
+// to its bottom taps.
+
+inline void BlendBilinearWords_SSE2(
+    _Out_writes_bytes_(8) BYTE *pDest,
+    const BYTE * const pTop[4],
+    const LONG lBottom[4],
+    const UINT32 wx[4],
+    const UINT32 wy[4])
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    // Each load gets the left and the right tap: a0 b0 | a1 b1 | a2 b2 | a3 b3
+    // The taps are only WORD aligned.
+    __m128i ab = _mm_set_epi32(LoadUnaligned32(pTop[3]), LoadUnaligned32(pTop[2]),
+                               LoadUnaligned32(pTop[1]), LoadUnaligned32(pTop[0]));
+    __m128i cd = _mm_set_epi32(LoadUnaligned32(pTop[3] + lBottom[3]), LoadUnaligned32(pTop[2] + lBottom[2]),
+                               LoadUnaligned32(pTop[1] + lBottom[1]), LoadUnaligned32(pTop[0] + lBottom[0]));
+
+    // a0 a1 a2 a3 b0 b1 b2 b3
+    ab = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(ab, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+    cd = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(cd, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+
+    const __m128i vwx = _mm_set_epi16(wx[3], wx[3], wx[2], wx[2], wx[1], wx[1], wx[0], wx[0]);
+    const __m128i vwy = _mm_set_epi16(wy[3], wy[3], wy[2], wy[2], wy[1], wy[1], wy[0], wy[0]);
+
+    __m128i result = BlendBilinear_SSE2(_mm_unpacklo_epi8(ab, zero), _mm_unpackhi_epi8(ab, zero),
+                                        _mm_unpacklo_epi8(cd, zero), _mm_unpackhi_epi8(cd, zero), vwx, vwy);
+
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(pDest), _mm_packus_epi16(result, result));
+}
+
+// Convert NV12 image, four pixel pairs at a time.
+
+inline void BilinearTransformImage_NV12_SSE2(
+    _In_reads_(_Inexpressible_(dwWidthInPixels / 2 * dwHeightInPixels)) const POLAR_BILINEAR_SAMPLE *pLookup,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const DWORD cPairs = dwWidthInPixels / 2;
+    const BYTE *pTop[4];
+    LONG lBottom[4];
+    UINT32 wx[4];
+    UINT32 wy[4];
+
+    // Y plane
+
+    const POLAR_BILINEAR_SAMPLE *pLookup_Y = pLookup + cPairs * dwRowBegin;
+    BYTE *pDest_Row = pDest + lDestStride * (LONG) dwRowBegin;
+
+    lBottom[0] = lBottom[1] = lBottom[2] = lBottom[3] = lSrcStride;
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        DWORD x = 0;
+
+        for ( ; x + 3 < cPairs; x += 4)
+        {
+            for (DWORD i = 0; i < 4; i++)
+            {
+                const POLAR_BILINEAR_SAMPLE &sample = pLookup_Y[x + i];
+                pTop[i] = pSrc + sample.y * lSrcStride + sample.x * 2;
+                wx[i] = sample.weightX;
+                wy[i] = sample.weightY;
+            }
+            BlendBilinearWords_SSE2(pDest_Row + x * 2, pTop, lBottom, wx, wy);
+        }
+
+        for ( ; x < cPairs; x++)
+        {
+            const POLAR_BILINEAR_SAMPLE &sample = pLookup_Y[x];
+            BlendBilinearUnit(pDest_Row + x * 2, pSrc + sample.y * lSrcStride + sample.x * 2, lSrcStride, 2, sample.weightX, sample.weightY);
+        }
+
+        pDest_Row += lDestStride;
+        pLookup_Y += cPairs;
+    }
+
+    // U-V plane
+
+    const DWORD dwChromaRows = dwHeightInPixels / 2;
+    const POLAR_BILINEAR_SAMPLE *pLookup_UV = pLookup + cPairs * dwRowBegin;
+    const BYTE *pSrc_UV = pSrc + lSrcStride * (LONG) dwHeightInPixels;
+    pDest_Row = pDest + lDestStride * (LONG) (dwHeightInPixels + dwRowBegin / 2);
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y += 2)
+    {
+        DWORD x = 0;
+
+        for ( ; x + 3 < cPairs; x += 4)
+        {
+            for (DWORD i = 0; i < 4; i++)
+            {
+                const POLAR_BILINEAR_SAMPLE &sample = pLookup_UV[x + i];
+                const DWORD dwRow = GetChromaRow(sample, lSrcStride, dwChromaRows, &wy[i], &lBottom[i]);
+                pTop[i] = pSrc_UV + dwRow * lSrcStride + sample.x * 2;
+                wx[i] = sample.weightX;
+            }
+            BlendBilinearWords_SSE2(pDest_Row + x * 2, pTop, lBottom, wx, wy);
+        }
+
+        for ( ; x < cPairs; x++)
+        {
+            const POLAR_BILINEAR_SAMPLE &sample = pLookup_UV[x];
+            UINT32 wyUV = 0;
+            LONG lBottomUV = 0;
+            const DWORD dwRow = GetChromaRow(sample, lSrcStride, dwChromaRows, &wyUV, &lBottomUV);
+
+            BlendBilinearUnit(pDest_Row + x * 2, pSrc_UV + dwRow * lSrcStride + sample.x * 2, lBottomUV, 2, sample.weightX, wyUV);
+        }
+
+        pDest_Row += lDestStride;
+        pLookup_UV += cPairs * 2;
+    }
+}
+
+#elif defined(CPU_FEATURES_ARM)
+
+// Blends 8 bytes from each tap, widened to 16 bits. wx and wy hold the
+// weight for each byte.
+
+inline uint16x8_t BlendBilinear_NEON(uint16x8_t a, uint16x8_t b, uint16x8_t c, uint16x8_t d, uint16x8_t wx, uint16x8_t wy)
+{
+    const uint16x8_t w256 = vdupq_n_u16(256);
+    const uint16x8_t wx0 = vsubq_u16(w256, wx);
+    const uint16x8_t wy0 = vsubq_u16(w256, wy);
+
+    // vrshrq_n_u16(v, 8) is (v + 128) >> 8.
+    const uint16x8_t top = vrshrq_n_u16(vmlaq_u16(vmulq_u16(a, wx0), b, wx), 8);
+    const uint16x8_t bottom = vrshrq_n_u16(vmlaq_u16(vmulq_u16(c, wx0), d, wx), 8);
+
+    return vrshrq_n_u16(vmlaq_u16(vmulq_u16(top, wy0), bottom, wy), 8);
+}
+
+// Convert UYVY or YUY2 image, two pixel pairs at a time.
+
+inline void BilinearTransformImage_422_NEON(
+    _In_reads_(_Inexpressible_(dwWidthInPixels / 2 * dwHeightInPixels)) const POLAR_BILINEAR_SAMPLE *pLookup,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const DWORD cPairs = dwWidthInPixels / 2;
+
+    pDest += lDestStride * (LONG) dwRowBegin;
+    pLookup += cPairs * dwRowBegin;
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        DWORD x = 0;
+
+        for ( ; x + 1 < cPairs; x += 2)
+        {
+            const POLAR_BILINEAR_SAMPLE &s0 = pLookup[x];
+            const POLAR_BILINEAR_SAMPLE &s1 = pLookup[x + 1];
+            const BYTE *pTop0 = pSrc + s0.y * lSrcStride + s0.x * 4;
+            const BYTE *pTop1 = pSrc + s1.y * lSrcStride + s1.x * 4;
+
+            // Each load gets the left and the right tap.
+            const uint16x8_t ab0 = vmovl_u8(vld1_u8(pTop0));
+            const uint16x8_t ab1 = vmovl_u8(vld1_u8(pTop1));
+            const uint16x8_t cd0 = vmovl_u8(vld1_u8(pTop0 + lSrcStride));
+            const uint16x8_t cd1 = vmovl_u8(vld1_u8(pTop1 + lSrcStride));
+
+            const uint16x8_t wx = vcombine_u16(vdup_n_u16(s0.weightX), vdup_n_u16(s1.weightX));
+            const uint16x8_t wy = vcombine_u16(vdup_n_u16(s0.weightY), vdup_n_u16(s1.weightY));
+
+            const uint16x8_t result = BlendBilinear_NEON(
+                vcombine_u16(vget_low_u16(ab0), vget_low_u16(ab1)), vcombine_u16(vget_high_u16(ab0), vget_high_u16(ab1)),
+                vcombine_u16(vget_low_u16(cd0), vget_low_u16(cd1)), vcombine_u16(vget_high_u16(cd0), vget_high_u16(cd1)),
+                wx, wy);
+
+            vst1_u8(pDest + x * 4, vmovn_u16(result));
+        }
+
+        for ( ; x < cPairs; x++)
+        {
+            const POLAR_BILINEAR_SAMPLE &sample = pLookup[x];
+            BlendBilinearUnit(pDest + x * 4, pSrc + sample.y * lSrcStride + sample.x * 4, lSrcStride, 4, sample.weightX, sample.weightY);
+        }
+
+        pDest += lDestStride;
+        pLookup += cPairs;
+    }
+}
+
+// Blends four units of two bytes (NV12 Y pairs or U-V pairs). pTop[i]
+// points to the top-left tap of unit i, and lBottom[i] is the offset
+// to its bottom taps.
+
+inline void BlendBilinearWords_NEON(
+    _Out_writes_bytes_(8) BYTE *pDest,
+    const BYTE * const pTop[4],
+    const LONG lBottom[4],
+    const UINT32 wx[4],
+    const UINT32 wy[4])
+{
+    // Each load gets the left and the right tap: a0 b0 | a1 b1 | a2 b2 | a3 b3
+    uint32x4_t ab = vdupq_n_u32(0);
+    uint32x4_t cd = vdupq_n_u32(0);
+
+    ab = vld1q_lane_u32(reinterpret_cast<const uint32_t*>(pTop[0]), ab, 0);
+    ab = vld1q_lane_u32(reinterpret_cast<const uint32_t*>(pTop[1]), ab, 1);
+    ab = vld1q_lane_u32(reinterpret_cast<const uint32_t*>(pTop[2]), ab, 2);
+    ab = vld1q_lane_u32(reinterpret_cast<const uint32_t*>(pTop[3]), ab, 3);
+    cd = vld1q_lane_u32(reinterpret_cast<const uint32_t*>(pTop[0] + lBottom[0]), cd, 0);
+    cd = vld1q_lane_u32(reinterpret_cast<const uint32_t*>(pTop[1] + lBottom[1]), cd, 1);
+    cd = vld1q_lane_u32(reinterpret_cast<const uint32_t*>(pTop[2] + lBottom[2]), cd, 2);
+    cd = vld1q_lane_u32(reinterpret_cast<const uint32_t*>(pTop[3] + lBottom[3]), cd, 3);
+
+    // Separate the left taps (even 16-bit units) from the right taps (odd units).
+    const uint16x8x2_t abSplit = vuzpq_u16(vreinterpretq_u16_u32(ab), vreinterpretq_u16_u32(ab));
+    const uint16x8x2_t cdSplit = vuzpq_u16(vreinterpretq_u16_u32(cd), vreinterpretq_u16_u32(cd));
+
+    const uint16_t awx[8] = { (uint16_t)wx[0], (uint16_t)wx[0], (uint16_t)wx[1], (uint16_t)wx[1], (uint16_t)wx[2], (uint16_t)wx[2], (uint16_t)wx[3], (uint16_t)wx[3] };
+    const uint16_t awy[8] = { (uint16_t)wy[0], (uint16_t)wy[0], (uint16_t)wy[1], (uint16_t)wy[1], (uint16_t)wy[2], (uint16_t)wy[2], (uint16_t)wy[3], (uint16_t)wy[3] };
+
+    const uint16x8_t result = BlendBilinear_NEON(
+        vmovl_u8(vreinterpret_u8_u16(vget_low_u16(abSplit.val[0]))), vmovl_u8(vreinterpret_u8_u16(vget_low_u16(abSplit.val[1]))),
+        vmovl_u8(vreinterpret_u8_u16(vget_low_u16(cdSplit.val[0]))), vmovl_u8(vreinterpret_u8_u16(vget_low_u16(cdSplit.val[1]))),
+        vld1q_u16(awx), vld1q_u16(awy));
+
+    vst1_u8(pDest, vmovn_u16(result));
+}
+
+// Convert NV12 image, four pixel pairs at a time.
+
+inline void BilinearTransformImage_NV12_NEON(
+    _In_reads_(_Inexpressible_(dwWidthInPixels / 2 * dwHeightInPixels)) const POLAR_BILINEAR_SAMPLE *pLookup,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const DWORD cPairs = dwWidthInPixels / 2;
+    const BYTE *pTop[4];
+    LONG lBottom[4];
+    UINT32 wx[4];
+    UINT32 wy[4];
+
+    // Y plane
+
+    const POLAR_BILINEAR_SAMPLE *pLookup_Y = pLookup + cPairs * dwRowBegin;
+    BYTE *pDest_Row = pDest + lDestStride * (LONG) dwRowBegin;
+
+    lBottom[0] = lBottom[1] = lBottom[2] = lBottom[3] = lSrcStride;
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        DWORD x = 0;
+
+        for ( ; x + 3 < cPairs; x += 4)
+        {
+            for (DWORD i = 0; i < 4; i++)
+            {
+                const POLAR_BILINEAR_SAMPLE &sample = pLookup_Y[x + i];
+                pTop[i] = pSrc + sample.y * lSrcStride + sample.x * 2;
+                wx[i] = sample.weightX;
+                wy[i] = sample.weightY;
+            }
+            BlendBilinearWords_NEON(pDest_Row + x * 2, pTop, lBottom, wx, wy);
+        }
+
+        for ( ; x < cPairs; x++)
+        {
+            const POLAR_BILINEAR_SAMPLE &sample = pLookup_Y[x];
+            BlendBilinearUnit(pDest_Row + x * 2, pSrc + sample.y * lSrcStride + sample.x * 2, lSrcStride, 2, sample.weightX, sample.weightY);
+        }
+
+        pDest_Row += lDestStride;
+        pLookup_Y += cPairs;
+    }
+
+    // U-V plane
+
+    const DWORD dwChromaRows = dwHeightInPixels / 2;
+    const POLAR_BILINEAR_SAMPLE *pLookup_UV = pLookup + cPairs * dwRowBegin;
+    const BYTE *pSrc_UV = pSrc + lSrcStride * (LONG) dwHeightInPixels;
+    pDest_Row = pDest + lDestStride * (LONG) (dwHeightInPixels + dwRowBegin / 2);
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y += 2)
+    {
+        DWORD x = 0;
+
+        for ( ; x + 3 < cPairs; x += 4)
+        {
+            for (DWORD i = 0; i < 4; i++)
+            {
+                const POLAR_BILINEAR_SAMPLE &sample = pLookup_UV[x + i];
+                const DWORD dwRow = GetChromaRow(sample, lSrcStride, dwChromaRows, &wy[i], &lBottom[i]);
+                pTop[i] = pSrc_UV + dwRow * lSrcStride + sample.x * 2;
+                wx[i] = sample.weightX;
+            }
+            BlendBilinearWords_NEON(pDest_Row + x * 2, pTop, lBottom, wx, wy);
+        }
+
+        for ( ; x < cPairs; x++)
+        {
+            const POLAR_BILINEAR_SAMPLE &sample = pLookup_UV[x];
+            UINT32 wyUV = 0;
+            LONG lBottomUV = 0;
+            const DWORD dwRow = GetChromaRow(sample, lSrcStride, dwChromaRows, &wyUV, &lBottomUV);
+
+            BlendBilinearUnit(pDest_Row + x * 2, pSrc_UV + dwRow * lSrcStride + sample.x * 2, lBottomUV, 2, sample.weightX, wyUV);
+        }
+
+        pDest_Row += lDestStride;
+        pLookup_UV += cPairs * 2;
+    }
+}
+
+#endif
+
+// Returns the fastest bilinear UYVY/YUY2 function for this CPU.
+
+inline IMAGE_BILINEAR_TRANSFORM_FN SelectBilinearTransform_422()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+    case CpuSimd_SSE2:
+        return BilinearTransformImage_422_SSE2;
+#elif defined(CPU_FEATURES_ARM)
+    case CpuSimd_NEON:
+        return BilinearTransformImage_422_NEON;
+#endif
+
+    default:
+        return BilinearTransformImage_422;
+    }
+}
+
+// Returns the fastest bilinear NV12 function for this CPU.
+
+inline IMAGE_BILINEAR_TRANSFORM_FN SelectBilinearTransform_NV12()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+    case CpuSimd_SSE2:
+        return BilinearTransformImage_NV12_SSE2;
+#elif defined(CPU_FEATURES_ARM)
+    case CpuSimd_NEON:
+        return BilinearTransformImage_NV12_NEON;
+#endif
+
+    default:
+        return BilinearTransformImage_NV12;
+    }
+}
+
+
+//-------------------------------------------------------------------
+// Functions to generate rows of the nearest-neighbor lookup table.
+//
+// Each function fills the rows [dwRowBegin, dwRowEnd) of the table
+// that GeneratePolarLookup describes. pIndex points to the start of
+// the table.
+//
+// The SSE2 version computes the radius exactly as the scalar version
+// does, and approximates atan2, sin and cos with polynomials (error
+// below 1e-5 radians). Its source positions are within 0.01 pixel of
+// the scalar ones at 4K. An entry can only differ where the position
+// falls that close to a pixel boundary, and then by one pixel.
+//-------------------------------------------------------------------
+
+inline void GeneratePolarRows(
+    _In_ const POLAR_LOOKUP_KEY &key,
+    _Inout_updates_(_Inexpressible_(key.unWidth / 2 * key.unHeight)) UINT32 *pIndex,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    LONG x, y;
+    LONG lMaxX, lMaxY;
+    LONG lHalfWidth, lHalfHeight;
+    LONG lTransDx, lTransDy;
+    DOUBLE dRadius, dMaxRadius, dNewRadius;
+    DOUBLE dTheta, dNewTheta;
+
+    lMaxX = (LONG)key.unWidth;
+    lMaxY = (LONG)key.unHeight;
+    lHalfWidth = key.unWidth / 2;
+    lHalfHeight = key.unHeight / 2;
+    dMaxRadius = floor( sqrtf( static_cast<float>(lHalfWidth*lHalfWidth+lHalfHeight*lHalfHeight) ) );
+
+    pIndex += (key.unWidth / 2) * dwRowBegin;
+
+    for(y = (LONG)dwRowBegin; y < (LONG)dwRowEnd; y++)
+    {
+        for(x = 0; (x + 1) < lMaxX; x += 2, pIndex++)
+        {
+            lTransDx = lHalfWidth - x;
+            lTransDy = lHalfHeight - y;
+
+            dRadius = ceil( sqrtf( static_cast<float>(lTransDx*lTransDx + lTransDy*lTransDy) ) );
+
+            if( dRadius < dMaxRadius )
+            {
+                dTheta = atan2f( static_cast<float> (lTransDy), static_cast<float> (lTransDx) );
+
+                dNewRadius = key.pfnRadius(dRadius, dMaxRadius, dTheta);
+                dNewTheta = key.pfnTheta(dRadius, dMaxRadius, dTheta);
+
+                lTransDx = lHalfWidth - (LONG)(dNewRadius * cos(dNewTheta));
+                lTransDy = lHalfHeight - (LONG)(dNewRadius * sin(dNewTheta));
+
+                if( 0 <= lTransDx && lTransDx < lMaxX &&
+                    0 <= lTransDy && lTransDy < lMaxY )
+                {
+                    *pIndex = lTransDy * lMaxX + lTransDx;
+                }
+                else
+                {
+                    *pIndex = 0;
+                }
+            }
+            else
+            {
+                *pIndex = 0;
+            }
+        }
+    }
+}
+
+#if defined(CPU_FEATURES_X86)
+
+// Select_SSE2: Returns a where mask is set, and b elsewhere.
+
+inline __m128 Select_SSE2(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Atan2_SSE2: Approximates atan2(y, x) for four values.
+
+inline __m128 Atan2_SSE2(__m128 y, __m128 x)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 ax = _mm_andnot_ps(signMask, x);
+    const __m128 ay = _mm_andnot_ps(signMask, y);
+    const __m128 mx = _mm_max_ps(ax, ay);
+
+    // atan(a) for a = min / max in [0, 1]. (a = 0 if x and y are 0.)
+    const __m128 a = _mm_and_ps(_mm_div_ps(_mm_min_ps(ax, ay), mx), _mm_cmpgt_ps(mx, _mm_setzero_ps()));
+    const __m128 s = _mm_mul_ps(a, a);
+
+    __m128 r = _mm_set1_ps(-0.01172120f);
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.05265332f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.11643287f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.19354346f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.33262347f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.99997726f));
+    r = _mm_mul_ps(r, a);
+
+    // Move the result to the right octant.
+    r = Select_SSE2(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(1.57079633f), r), r);
+    r = Select_SSE2(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(3.14159265f), r), r);
+
+    // r >= 0 here, so copying the sign of y negates r if y < 0.
+    return _mm_or_ps(r, _mm_and_ps(y, signMask));
+}
+
+// SinCos_SSE2: Approximates sin and cos of four values.
+
+inline void SinCos_SSE2(__m128 theta, __m128 *pSin, __m128 *pCos)
+{
+    // theta = y + q * pi/2, with y in [-pi/4, pi/4]. pi/2 is split in
+    // two parts to keep the precision of y.
+    const __m128i q = _mm_cvtps_epi32(_mm_mul_ps(theta, _mm_set1_ps(0.636619772f)));
+    const __m128 qf = _mm_cvtepi32_ps(q);
+
+    __m128 y = _mm_sub_ps(theta, _mm_mul_ps(qf, _mm_set1_ps(1.5707963705062866f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(qf, _mm_set1_ps(-4.371139000186243e-8f)));
+
+    const __m128 y2 = _mm_mul_ps(y, y);
+
+    __m128 sinY = _mm_set1_ps(-1.9515295891e-4f);
+    sinY = _mm_add_ps(_mm_mul_ps(sinY, y2), _mm_set1_ps(8.3321608736e-3f));
+    sinY = _mm_add_ps(_mm_mul_ps(sinY, y2), _mm_set1_ps(-1.6666654611e-1f));
+    sinY = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinY, y2), y), y);
+
+    __m128 cosY = _mm_set1_ps(2.443315711809948e-5f);
+    cosY = _mm_add_ps(_mm_mul_ps(cosY, y2), _mm_set1_ps(-1.388731625493765e-3f));
+    cosY = _mm_add_ps(_mm_mul_ps(cosY, y2), _mm_set1_ps(4.166664568298827e-2f));
+    cosY = _mm_mul_ps(_mm_mul_ps(cosY, y2), y2);
+    cosY = _mm_add_ps(_mm_sub_ps(cosY, _mm_mul_ps(y2, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+    // Odd quadrants swap sin and cos. sin is negated in quadrants 2
+    // and 3, and cos in quadrants 1 and 2.
+    const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+    const __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+    const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+
+    *pSin = _mm_xor_ps(Select_SSE2(swap, cosY, sinY), sinSign);
+    *pCos = _mm_xor_ps(Select_SSE2(swap, sinY, cosY), cosSign);
+}
+
+inline void GeneratePolarRows_SSE2(
+    _In_ const POLAR_LOOKUP_KEY &key,
+    _Inout_updates_(_Inexpressible_(key.unWidth / 2 * key.unHeight)) UINT32 *pIndex,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const LONG lMaxX = (LONG)key.unWidth;
+    const LONG lMaxY = (LONG)key.unHeight;
+    const LONG lHalfWidth = key.unWidth / 2;
+    const LONG lHalfHeight = key.unHeight / 2;
+    const LONG cPairs = key.unWidth / 2;
+    const DOUBLE dMaxRadius = floor( sqrtf( static_cast<float>(lHalfWidth*lHalfWidth+lHalfHeight*lHalfHeight) ) );
+
+    pIndex += cPairs * dwRowBegin;
+
+    for (LONG y = (LONG)dwRowBegin; y < (LONG)dwRowEnd; y++)
+    {
+        const __m128 dy = _mm_set1_ps(static_cast<float>(lHalfHeight - y));
+        const __m128 dy2 = _mm_mul_ps(dy, dy);
+
+        // Four output pixel pairs at a time.
+        for (LONG x = 0; x < cPairs; x += 4)
+        {
+            const __m128 dx = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_set1_epi32(lHalfWidth - 2 * x), _mm_set_epi32(6, 4, 2, 0)));
+
+            // Radius, rounded up as in the scalar version. The sum of the
+            // squares is exact, and _mm_sqrt_ps rounds like sqrtf.
+            const __m128 radius = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dy2));
+            const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(radius));
+            const __m128 ceiling = _mm_add_ps(truncated, _mm_and_ps(_mm_cmplt_ps(truncated, radius), _mm_set1_ps(1.0f)));
+
+            float afRadius[4], afTheta[4], afNewRadius[4], afNewTheta[4];
+
+            _mm_storeu_ps(afRadius, ceiling);
+            _mm_storeu_ps(afTheta, Atan2_SSE2(dy, dx));
+
+            // The radius and angle functions are scalar.
+            for (int i = 0; i < 4; i++)
+            {
+                afNewRadius[i] = static_cast<float>(key.pfnRadius(afRadius[i], dMaxRadius, afTheta[i]));
+                afNewTheta[i] = static_cast<float>(key.pfnTheta(afRadius[i], dMaxRadius, afTheta[i]));
+            }
+
+            __m128 sinTheta, cosTheta;
+            SinCos_SSE2(_mm_loadu_ps(afNewTheta), &sinTheta, &cosTheta);
+
+            const __m128 newRadius = _mm_loadu_ps(afNewRadius);
+
+            LONG alTransDx[4], alTransDy[4];
+
+            _mm_storeu_si128((__m128i*) alTransDx, _mm_sub_epi32(_mm_set1_epi32(lHalfWidth), _mm_cvttps_epi32(_mm_mul_ps(newRadius, cosTheta))));
+            _mm_storeu_si128((__m128i*) alTransDy, _mm_sub_epi32(_mm_set1_epi32(lHalfHeight), _mm_cvttps_epi32(_mm_mul_ps(newRadius, sinTheta))));
+
+            for (LONG i = 0; i < 4 && x + i < cPairs; i++)
+            {
+                if (afRadius[i] < dMaxRadius &&
+                    0 <= alTransDx[i] && alTransDx[i] < lMaxX &&
+                    0 <= alTransDy[i] && alTransDy[i] < lMaxY)
+                {
+                    pIndex[x + i] = alTransDy[i] * lMaxX + alTransDx[i];
+                }
+                else
+                {
+                    pIndex[x + i] = 0;
+                }
+            }
+        }
+        pIndex += cPairs;
+    }
+}
+
+#endif
+
+// Returns the function that generates lookup rows on this CPU.
+
+inline GENERATE_POLAR_ROWS_FN SelectGeneratePolarRows()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+    case CpuSimd_SSE2:
+        return GeneratePolarRows_SSE2;
+#endif
+
+    default:
+        return GeneratePolarRows;
+    }
+}
+
+
+//-------------------------------------------------------------------
+// Functions to copy the entries of a nearest-neighbor lookup table.
+//
+// Each entry is the byte offset of a source pixel pair (4:2:2), or of
+// two Y samples or one U-V sample (NV12). The rows are written in tiles
+// of cTilePairs entries by POLAR_TILE_ROWS rows; the result is the same
+// as in row order. (See TransformImage_422 in PolarEffect.cpp.)
+//-------------------------------------------------------------------
+
+// MapBytes: Maps each byte of a lookup entry through its point table.
+
+template <class PAIR>
+inline PAIR MapBytes(PAIR value, const BYTE (*pTables)[256])
+{
+    PAIR result = 0;
+
+    for (DWORD i = 0; i < sizeof(PAIR); i++)
+    {
+        result |= static_cast<PAIR>(pTables[i][(value >> (8 * i)) & 0xFF]) << (8 * i);
+    }
+    return result;
+}
+
+
+// GatherRows: Copies rows [dwRowBegin, dwRowEnd) of one plane, in tiles
+// that are cTilePairs wide, with an offset-encoded lookup table. PAIR is
+// the type of one lookup entry's pixels: DWORD for a 4:2:2 pixel pair,
+// WORD for two Y samples or one U-V sample. fMapBytes selects whether
+// the entries are mapped through pTables.
+
+template <class PAIR, bool fMapBytes>
+inline void GatherRowsImpl(
+    BYTE *pDest,
+    LONG lDestStride,
+    const BYTE *pSrc,
+    const UINT32 *pOffsets,
+    const BYTE (*pTables)[256],
+    DWORD cPairs,
+    DWORD cTilePairs,
+    DWORD dwRowBegin,
+    DWORD dwRowEnd)
+{
+    for (DWORD y0 = dwRowBegin; y0 < dwRowEnd; y0 += POLAR_TILE_ROWS)
+    {
+        const DWORD y1 = min(y0 + POLAR_TILE_ROWS, dwRowEnd);
+
+        for (DWORD x0 = 0; x0 < cPairs; x0 += cTilePairs)
+        {
+            const DWORD x1 = min(x0 + cTilePairs, cPairs);
+
+            BYTE *pDest_Row = pDest + lDestStride * (LONG) y0;
+            const UINT32 *pRowOffsets = pOffsets + cPairs * y0;
+
+            for (DWORD y = y0; y < y1; y++)
+            {
+                PAIR *pDest_Pairs = (PAIR*) pDest_Row;
+
+                for (DWORD x = x0; x < x1; x++)
+                {
+                    const PAIR value = *((const PAIR*) (pSrc + pRowOffsets[x]));
+                    pDest_Pairs[x] = (fMapBytes ? MapBytes(value, pTables) : value);
+                }
+                pDest_Row += lDestStride;
+                pRowOffsets += cPairs;
+            }
+        }
+    }
+}
+
+
+template <class PAIR>
+inline void GatherRows(
+    BYTE *pDest,
+    LONG lDestStride,
+    const BYTE *pSrc,
+    const UINT32 *pOffsets,
+    const BYTE (*pTables)[256],
+    DWORD cPairs,
+    DWORD cTilePairs,
+    DWORD dwRowBegin,
+    DWORD dwRowEnd)
+{
+    if (pTables == nullptr)
+    {
+        GatherRowsImpl<PAIR, false>(pDest, lDestStride, pSrc, pOffsets, pTables, cPairs, cTilePairs, dwRowBegin, dwRowEnd);
+    }
+    else
+    {
+        GatherRowsImpl<PAIR, true>(pDest, lDestStride, pSrc, pOffsets, pTables, cPairs, cTilePairs, dwRowBegin, dwRowEnd);
+    }
+}
+
+
+// EncodeLookupDelta: Delta-encodes cRows rows of cPairs offsets. (See
+// POLAR_LOOKUP.)
+
+inline void EncodeLookupDelta(const UINT32 *pOffsets, DWORD cPairs, DWORD cRows, std::vector<INT16> &deltas, std::vector<UINT32> &rowStarts)
+{
+    rowStarts.reserve(rowStarts.size() + cRows);
+    deltas.reserve(deltas.size() + cPairs * cRows);
+
+    for (UINT32 y = 0; y < cRows; y++)
+    {
+        const UINT32 *pOffset = &pOffsets[cPairs * y];
+        UINT32 uPrevious = 0;
+
+        rowStarts.push_back(static_cast<UINT32>(deltas.size()));
+
+        for (UINT32 x = 0; x < cPairs; x++)
+        {
+            const INT32 lDelta = static_cast<INT32>(pOffset[x] - uPrevious);
+
+            if (lDelta > POLAR_DELTA_ESCAPE && lDelta <= MAXSHORT)
+            {
+                deltas.push_back(static_cast<INT16>(lDelta));
+            }
+            else
+            {
+                deltas.push_back(POLAR_DELTA_ESCAPE);
+                deltas.push_back(static_cast<INT16>(LOWORD(pOffset[x])));
+                deltas.push_back(static_cast<INT16>(HIWORD(pOffset[x])));
+            }
+            uPrevious = pOffset[x];
+        }
+    }
+}
+
+
+// DecodeLookupDelta: Returns the offset of the next entry of a
+// delta-encoded lookup row, and advances pDelta past the entry.
+
+inline UINT32 DecodeLookupDelta(const INT16 *&pDelta, UINT32 uOffset)
+{
+    if (*pDelta != POLAR_DELTA_ESCAPE)
+    {
+        return uOffset + *pDelta++;
+    }
+
+    uOffset = static_cast<UINT32>(static_cast<WORD>(pDelta[1])) | (static_cast<UINT32>(static_cast<WORD>(pDelta[2])) << 16);
+    pDelta += 3;
+    return uOffset;
+}
+
+
+// GatherRowsDelta: Same as GatherRows, with a delta-encoded lookup table.
+
+template <class PAIR, bool fMapBytes>
+inline void GatherRowsDeltaImpl(
+    BYTE *pDest,
+    LONG lDestStride,
+    const BYTE *pSrc,
+    const INT16 *pDeltas,
+    const UINT32 *pRowStarts,
+    const BYTE (*pTables)[256],
+    DWORD cPairs,
+    DWORD cTilePairs,
+    DWORD dwRowBegin,
+    DWORD dwRowEnd)
+{
+    // A row can only be decoded from its start, so the decoder state of
+    // each row is kept from one tile to the next.
+    const INT16 *apDelta[POLAR_TILE_ROWS];
+    UINT32 auOffset[POLAR_TILE_ROWS];
+
+    for (DWORD y0 = dwRowBegin; y0 < dwRowEnd; y0 += POLAR_TILE_ROWS)
+    {
+        const DWORD cRows = min(POLAR_TILE_ROWS, dwRowEnd - y0);
+
+        for (DWORD i = 0; i < cRows; i++)
+        {
+            apDelta[i] = pDeltas + pRowStarts[y0 + i];
+            auOffset[i] = 0;
+        }
+
+        for (DWORD x0 = 0; x0 < cPairs; x0 += cTilePairs)
+        {
+            const DWORD x1 = min(x0 + cTilePairs, cPairs);
+
+            BYTE *pDest_Row = pDest + lDestStride * (LONG) y0;
+
+            for (DWORD i = 0; i < cRows; i++)
+            {
+                PAIR *pDest_Pairs = (PAIR*) pDest_Row;
+                const INT16 *pDelta = apDelta[i];
+                UINT32 uOffset = auOffset[i];
+
+                for (DWORD x = x0; x < x1; x++)
+                {
+                    uOffset = DecodeLookupDelta(pDelta, uOffset);
+
+                    const PAIR value = *((const PAIR*) (pSrc + uOffset));
+                    pDest_Pairs[x] = (fMapBytes ? MapBytes(value, pTables) : value);
+                }
+                apDelta[i] = pDelta;
+                auOffset[i] = uOffset;
+                pDest_Row += lDestStride;
+            }
+        }
+    }
+}
+
+template <class PAIR>
+inline void GatherRowsDelta(
+    BYTE *pDest,
+    LONG lDestStride,
+    const BYTE *pSrc,
+    const INT16 *pDeltas,
+    const UINT32 *pRowStarts,
+    const BYTE (*pTables)[256],
+    DWORD cPairs,
+    DWORD cTilePairs,
+    DWORD dwRowBegin,
+    DWORD dwRowEnd)
+{
+    if (pTables == nullptr)
+    {
+        GatherRowsDeltaImpl<PAIR, false>(pDest, lDestStride, pSrc, pDeltas, pRowStarts, pTables, cPairs, cTilePairs, dwRowBegin, dwRowEnd);
+    }
+    else
+    {
+        GatherRowsDeltaImpl<PAIR, true>(pDest, lDestStride, pSrc, pDeltas, pRowStarts, pTables, cPairs, cTilePairs, dwRowBegin, dwRowEnd);
+    }
+}
+
+
+// Returns the point tables of the U-V plane of an NV12 image.
+
+inline const BYTE (*GetChromaTables(const BYTE (*pTables)[256]))[256]
+{
+    return (pTables == nullptr ? nullptr : pTables + 4);
+}
+
+//-------------------------------------------------------------------
+// Functions to transform YUV images with an animated effect.
+//
+// Instead of reading a lookup table, these functions compute the source
+// pixel of each output pixel pair as they go, from the radial profile
+// in POLAR_ANIMATION. The profile holds the new radius times the cosine
+// and sine of the angle change, so that with dx and dy the distance
+// from the centre and r = sqrt(dx*dx + dy*dy):
+//
+//     srcX = cx - (a*dx - b*dy) / r
+//     srcY = cy - (a*dy + b*dx) / r
+//
+// which is the rotation of (dx, dy) by the angle change, scaled to the
+// new radius, without atan2, sin or cos per pixel. The offsets of a row
+// are computed in chunks, then copied with GatherRows, so the sampling
+// and the point tables are the same as with the lookup table. The
+// result matches the nearest-neighbor table to within a pixel where a
+// position falls close to a pixel boundary.
+//-------------------------------------------------------------------
+
+// Number of pixel pairs whose offsets are computed at a time.
+const DWORD POLAR_ANIMATION_CHUNK_PAIRS = 256;
+
+// Function pointer for the function that computes the source offsets of
+// a chunk of output pixel pairs in one row. pChromaOffsets is nullptr
+// except for the even rows of NV12 images.
+typedef void (*ANIMATED_OFFSETS_FN)(
+    const POLAR_ANIMATION *pAnimation,
+    LONG lWidth,
+    LONG lHeight,
+    LONG y,
+    LONG lPairBegin,
+    DWORD cPairs,
+    LONG lStride,
+    UINT32 cbPixel,
+    UINT32 *pOffsets,
+    UINT32 *pChromaOffsets);
+
+
+// Stores the offsets of the source pixel (srcX, srcY). Positions outside
+// the image read pixel 0, which holds the fill pixel.
+
+inline void StoreAnimatedOffset(
+    LONG srcX,
+    LONG srcY,
+    LONG lWidth,
+    LONG lHeight,
+    LONG lStride,
+    UINT32 cbPixel,
+    UINT32 *pOffset,
+    UINT32 *pChromaOffset)
+{
+    if (0 <= srcX && srcX < lWidth && 0 <= srcY && srcY < lHeight)
+    {
+        *pOffset = srcY * lStride + (srcX & ~1) * cbPixel;
+
+        if (pChromaOffset != nullptr)
+        {
+            *pChromaOffset = (srcY / 2) * lStride + (srcX & ~1);
+        }
+    }
+    else
+    {
+        *pOffset = 0;
+
+        if (pChromaOffset != nullptr)
+        {
+            *pChromaOffset = 0;
+        }
+    }
+}
+
+
+inline void GenerateAnimatedOffsets(
+    _In_ const POLAR_ANIMATION *pAnimation,
+    _In_ LONG lWidth,
+    _In_ LONG lHeight,
+    _In_ LONG y,
+    _In_ LONG lPairBegin,
+    _In_ DWORD cPairs,
+    _In_ LONG lStride,
+    _In_ UINT32 cbPixel,
+    _Out_writes_(cPairs) UINT32 *pOffsets,
+    _Out_writes_opt_(cPairs) UINT32 *pChromaOffsets)
+{
+    const LONG dy = pAnimation->lCenterY - y;
+
+    for (DWORD i = 0; i < cPairs; i++)
+    {
+        const LONG dx = pAnimation->lCenterX - 2 * (lPairBegin + (LONG) i);
+        const float fRadius = sqrtf(static_cast<float>(dx * dx + dy * dy));
+        const LONG r = static_cast<LONG>(ceil(fRadius));
+
+        LONG srcX = -1, srcY = -1;
+
+        if (r < pAnimation->cRadii)
+        {
+            const float a = pAnimation->pRadial[2 * r];
+            const float b = pAnimation->pRadial[2 * r + 1];
+
+            // Divide, rather than multiply by 1 / r, so that at strength 0
+            // (a = ceil(r), b = 0) the position cannot round below dx or dy,
+            // and every pixel stays where it is.
+            srcX = pAnimation->lCenterX - (fRadius > 0 ? static_cast<LONG>((a * dx - b * dy) / fRadius) : 0);
+            srcY = pAnimation->lCenterY - (fRadius > 0 ? static_cast<LONG>((a * dy + b * dx) / fRadius) : 0);
+        }
+
+        StoreAnimatedOffset(srcX, srcY, lWidth, lHeight, lStride, cbPixel, &pOffsets[i], (pChromaOffsets ? &pChromaOffsets[i] : nullptr));
+    }
+}
+
+#if defined(CPU_FEATURES_X86)
+
+// MultiplyLow_SSE2: Returns the low 32 bits of the products of four
+// values with the same value b.
+
+inline __m128i MultiplyLow_SSE2(__m128i a, __m128i b)
+{
+    const __m128i even = _mm_mul_epu32(a, b);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), b);
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+inline void GenerateAnimatedOffsets_SSE2(
+    _In_ const POLAR_ANIMATION *pAnimation,
+    _In_ LONG lWidth,
+    _In_ LONG lHeight,
+    _In_ LONG y,
+    _In_ LONG lPairBegin,
+    _In_ DWORD cPairs,
+    _In_ LONG lStride,
+    _In_ UINT32 cbPixel,
+    _Out_writes_(cPairs) UINT32 *pOffsets,
+    _Out_writes_opt_(cPairs) UINT32 *pChromaOffsets)
+{
+    const __m128 dy = _mm_set1_ps(static_cast<float>(pAnimation->lCenterY - y));
+    const __m128 dy2 = _mm_mul_ps(dy, dy);
+    const __m128i centerX = _mm_set1_epi32(pAnimation->lCenterX);
+    const __m128i centerY = _mm_set1_epi32(pAnimation->lCenterY);
+    const __m128i cRadii = _mm_set1_epi32(pAnimation->cRadii);
+    const __m128i width = _mm_set1_epi32(lWidth);
+    const __m128i height = _mm_set1_epi32(lHeight);
+    const __m128i stride = _mm_set1_epi32(lStride);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    const __m128i evenMask = _mm_set1_epi32(~1);
+    const __m128i pixelShift = _mm_cvtsi32_si128(cbPixel == 2 ? 1 : 0);
+
+    // Four output pixel pairs at a time.
+    for (DWORD i = 0; i < cPairs; i += 4)
+    {
+        const __m128 dx = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_set1_epi32(pAnimation->lCenterX - 2 * (lPairBegin + (LONG) i)), _mm_set_epi32(6, 4, 2, 0)));
+
+        // Radius, rounded up as in GeneratePolarRows_SSE2.
+        const __m128 radius = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dy2));
+        const __m128i truncated = _mm_cvttps_epi32(radius);
+        const __m128i ceiling = _mm_sub_epi32(truncated, _mm_castps_si128(_mm_cmplt_ps(_mm_cvtepi32_ps(truncated), radius)));
+        const __m128i inCircle = _mm_cmplt_epi32(ceiling, cRadii);
+
+        // The profile is indexed per lane. Radii outside the circle read
+        // the zero entry at cRadii, and give pixel 0 below. (The lanes are
+        // built with _mm_set_ps, because loading them from memory that was
+        // just written one float at a time would stall.)
+        const __m128i index = _mm_or_si128(_mm_and_si128(ceiling, inCircle), _mm_andnot_si128(inCircle, cRadii));
+        const float *pRadial = pAnimation->pRadial;
+
+        const int r0 = _mm_cvtsi128_si32(index);
+        const int r1 = _mm_cvtsi128_si32(_mm_shuffle_epi32(index, _MM_SHUFFLE(1, 1, 1, 1)));
+        const int r2 = _mm_cvtsi128_si32(_mm_shuffle_epi32(index, _MM_SHUFFLE(2, 2, 2, 2)));
+        const int r3 = _mm_cvtsi128_si32(_mm_shuffle_epi32(index, _MM_SHUFFLE(3, 3, 3, 3)));
+
+        const __m128 a = _mm_set_ps(pRadial[2 * r3], pRadial[2 * r2], pRadial[2 * r1], pRadial[2 * r0]);
+        const __m128 b = _mm_set_ps(pRadial[2 * r3 + 1], pRadial[2 * r2 + 1], pRadial[2 * r1 + 1], pRadial[2 * r0 + 1]);
+        // Divide as in the scalar version. The centre itself gives 0 / 0,
+        // which is masked to 0.
+        const __m128 nonZero = _mm_cmpgt_ps(radius, _mm_setzero_ps());
+        const __m128 moveX = _mm_and_ps(_mm_div_ps(_mm_sub_ps(_mm_mul_ps(a, dx), _mm_mul_ps(b, dy)), radius), nonZero);
+        const __m128 moveY = _mm_and_ps(_mm_div_ps(_mm_add_ps(_mm_mul_ps(a, dy), _mm_mul_ps(b, dx)), radius), nonZero);
+
+        const __m128i srcX = _mm_sub_epi32(centerX, _mm_cvttps_epi32(moveX));
+        const __m128i srcY = _mm_sub_epi32(centerY, _mm_cvttps_epi32(moveY));
+
+        // Positions outside the circle or the image read pixel 0.
+        const __m128i inside = _mm_and_si128(
+            _mm_and_si128(inCircle, _mm_and_si128(_mm_cmpgt_epi32(srcX, minusOne), _mm_cmplt_epi32(srcX, width))),
+            _mm_and_si128(_mm_cmpgt_epi32(srcY, minusOne), _mm_cmplt_epi32(srcY, height)));
+
+        const __m128i evenX = _mm_and_si128(srcX, evenMask);
+
+        __m128i offsets = _mm_and_si128(_mm_add_epi32(MultiplyLow_SSE2(srcY, stride), _mm_sll_epi32(evenX, pixelShift)), inside);
+        __m128i chromaOffsets = _mm_and_si128(_mm_add_epi32(MultiplyLow_SSE2(_mm_srai_epi32(srcY, 1), stride), evenX), inside);
+
+        if (i + 4 <= cPairs)
+        {
+            _mm_storeu_si128((__m128i*) &pOffsets[i], offsets);
+
+            if (pChromaOffsets != nullptr)
+            {
+                _mm_storeu_si128((__m128i*) &pChromaOffsets[i], chromaOffsets);
+            }
+        }
+        else
+        {
+            UINT32 auOffsets[4], auChromaOffsets[4];
+
+            _mm_storeu_si128((__m128i*) auOffsets, offsets);
+            _mm_storeu_si128((__m128i*) auChromaOffsets, chromaOffsets);
+
+            for (DWORD j = 0; i + j < cPairs; j++)
+            {
+                pOffsets[i + j] = auOffsets[j];
+
+                if (pChromaOffsets != nullptr)
+                {
+                    pChromaOffsets[i + j] = auChromaOffsets[j];
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+
+// Convert UYVY or YUY2 image with an animated effect.
+
+template <ANIMATED_OFFSETS_FN pfnOffsets>
+void AnimatedTransformImage_422(
+    _In_ const POLAR_ANIMATION *pAnimation,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const DWORD cPairs = dwWidthInPixels / 2;
+    UINT32 offsets[POLAR_ANIMATION_CHUNK_PAIRS];
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        BYTE *pDest_Row = pDest + lDestStride * (LONG) y;
+
+        for (DWORD x0 = 0; x0 < cPairs; x0 += POLAR_ANIMATION_CHUNK_PAIRS)
+        {
+            const DWORD cChunk = min(POLAR_ANIMATION_CHUNK_PAIRS, cPairs - x0);
+
+            (*pfnOffsets)(pAnimation, dwWidthInPixels, dwHeightInPixels, y, x0, cChunk, lSrcStride, 2, offsets, nullptr);
+
+            GatherRows<DWORD>(pDest_Row + x0 * 4, lDestStride, pSrc, offsets, pAnimation->pPointTables, cChunk, cChunk, 0, 1);
+        }
+    }
+}
+
+
+// Convert NV12 image with an animated effect.
+
+template <ANIMATED_OFFSETS_FN pfnOffsets>
+void AnimatedTransformImage_NV12(
+    _In_ const POLAR_ANIMATION *pAnimation,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    const DWORD cPairs = dwWidthInPixels / 2;
+    UINT32 offsets[POLAR_ANIMATION_CHUNK_PAIRS];
+    UINT32 chromaOffsets[POLAR_ANIMATION_CHUNK_PAIRS];
+
+    BYTE *pDest_UV = pDest + lDestStride * (LONG) dwHeightInPixels;
+    const BYTE *pSrc_UV = pSrc + lSrcStride * (LONG) dwHeightInPixels;
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        BYTE *pDest_Row = pDest + lDestStride * (LONG) y;
+
+        // Each U-V row is taken from the first of its two Y rows, as in
+        // the lookup table.
+        const bool fChromaRow = ((y & 1) == 0);
+        BYTE *pDest_UVRow = pDest_UV + lDestStride * (LONG) (y / 2);
+
+        for (DWORD x0 = 0; x0 < cPairs; x0 += POLAR_ANIMATION_CHUNK_PAIRS)
+        {
+            const DWORD cChunk = min(POLAR_ANIMATION_CHUNK_PAIRS, cPairs - x0);
+
+            (*pfnOffsets)(pAnimation, dwWidthInPixels, dwHeightInPixels, y, x0, cChunk, lSrcStride, 1, offsets, (fChromaRow ? chromaOffsets : nullptr));
+
+            GatherRows<WORD>(pDest_Row + x0 * 2, lDestStride, pSrc, offsets, pAnimation->pPointTables, cChunk, cChunk, 0, 1);
+
+            if (fChromaRow)
+            {
+                GatherRows<WORD>(pDest_UVRow + x0 * 2, lDestStride, pSrc_UV, chromaOffsets, GetChromaTables(pAnimation->pPointTables), cChunk, cChunk, 0, 1);
+            }
+        }
+    }
+}
+
+// BuildRadialProfile: Builds the radial profile of an effect at strength
+// s. (See POLAR_ANIMATION.)
+//
+// The built-in effects depend only on the radius: the new radius does
+// not depend on the angle, and the angle changes by an amount that
+// depends only on the radius. So the mapping is the same on every circle
+// around the centre, and one entry per radius describes it. The maximum
+// radius R is the one of the lookup table, whatever the centre. At
+// strength s, the new radius and the angle change are interpolated
+// between no effect (s = 0) and the full effect (s = 1).
+
+inline void BuildRadialProfile(
+    PolarTransformer pfnRadius,
+    PolarTransformer pfnTheta,
+    DWORD dwWidthInPixels,
+    DWORD dwHeightInPixels,
+    DOUBLE s,
+    std::vector<float> &radial)
+{
+    const LONG lHalfWidth = dwWidthInPixels / 2;
+    const LONG lHalfHeight = dwHeightInPixels / 2;
+    const DOUBLE dMaxRadius = floor( sqrtf( static_cast<float>(lHalfWidth*lHalfWidth+lHalfHeight*lHalfHeight) ) );
+    const LONG cRadii = static_cast<LONG>(dMaxRadius);
+
+    // One more entry, which is zero, for the radii outside the circle.
+    radial.assign(2 * (cRadii + 1), 0.0f);
+
+    for (LONG r = 0; r < cRadii; r++)
+    {
+        const DOUBLE dRadius = static_cast<DOUBLE>(r);
+        const DOUBLE dNewRadius = dRadius + s * (pfnRadius(dRadius, dMaxRadius, 0.0) - dRadius);
+        const DOUBLE dAngle = s * pfnTheta(dRadius, dMaxRadius, 0.0);
+
+        radial[2 * r] = static_cast<float>(dNewRadius * cos(dAngle));
+        radial[2 * r + 1] = static_cast<float>(dNewRadius * sin(dAngle));
+    }
+}
+
+// Returns the fastest animated UYVY/YUY2 function for this CPU.
+
+inline IMAGE_ANIMATED_TRANSFORM_FN SelectAnimatedTransform_422()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+    case CpuSimd_SSE2:
+        return AnimatedTransformImage_422<GenerateAnimatedOffsets_SSE2>;
+#endif
+
+    default:
+        return AnimatedTransformImage_422<GenerateAnimatedOffsets>;
+    }
+}
+
+// Returns the fastest animated NV12 function for this CPU.
+
+inline IMAGE_ANIMATED_TRANSFORM_FN SelectAnimatedTransform_NV12()
+{
+    switch (GetCpuSimdLevel())
+    {
+#if defined(CPU_FEATURES_X86)
+    case CpuSimd_AVX2:
+    case CpuSimd_SSE2:
+        return AnimatedTransformImage_NV12<GenerateAnimatedOffsets_SSE2>;
+#endif
+
+    default:
+        return AnimatedTransformImage_NV12<GenerateAnimatedOffsets>;
+    }
+}
+
+
+//-------------------------------------------------------------------
+// Functions to map the bytes of an image through the point tables of
+// the effect chain.
+//
+// These functions run the point steps on their own: over the whole
+// frame for a chain without a polar effect, and over the output of
+// the bilinear functions, a strip of rows at a time while the strip
+// is still in the cache. The parameters are the same as for
+// IMAGE_MAP_FN. For NV12, dwRowBegin must be even.
+//-------------------------------------------------------------------
+
+// MapRows: Maps rows [dwRowBegin, dwRowEnd) of one plane. cbEntry is
+// the size of a lookup entry, and byte i of each entry is mapped
+// through pTables[i].
+
+inline void MapRows(
+    BYTE *pDest,
+    LONG lDestStride,
+    const BYTE *pSrc,
+    LONG lSrcStride,
+    DWORD cbRow,
+    DWORD cbEntry,
+    const BYTE (*pTables)[256],
+    DWORD dwRowBegin,
+    DWORD dwRowEnd)
+{
+    pDest += lDestStride * (LONG) dwRowBegin;
+    pSrc += lSrcStride * (LONG) dwRowBegin;
+
+    for (DWORD y = dwRowBegin; y < dwRowEnd; y++)
+    {
+        for (DWORD x = 0; x < cbRow; x += cbEntry)
+        {
+            for (DWORD i = 0; i < cbEntry; i++)
+            {
+                pDest[x + i] = pTables[i][pSrc[x + i]];
+            }
+        }
+        pDest += lDestStride;
+        pSrc += lSrcStride;
+    }
+}
+
+// Map UYVY or YUY2 image.
+
+inline void MapImage_422(
+    _In_reads_(8) const BYTE (*pTables)[256],
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    MapRows(pDest, lDestStride, pSrc, lSrcStride, dwWidthInPixels * 2, 4, pTables, dwRowBegin, dwRowEnd);
+}
+
+// Map NV12 image.
+
+inline void MapImage_NV12(
+    _In_reads_(8) const BYTE (*pTables)[256],
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE *pDest, 
+    _In_ LONG lDestStride, 
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE *pSrc,
+    _In_ LONG lSrcStride, 
+    _In_ DWORD dwWidthInPixels, 
+    _In_ DWORD dwHeightInPixels,
+    _In_ DWORD dwRowBegin,
+    _In_ DWORD dwRowEnd)
+{
+    // Y plane
+    MapRows(pDest, lDestStride, pSrc, lSrcStride, dwWidthInPixels, 2, pTables, dwRowBegin, dwRowEnd);
+
+    // U-V plane
+    MapRows(
+        pDest + lDestStride * (LONG) dwHeightInPixels,
+        lDestStride,
+        pSrc + lSrcStride * (LONG) dwHeightInPixels,
+        lSrcStride,
+        dwWidthInPixels,
+        2,
+        pTables + 4,
+        dwRowBegin / 2,
+        (dwRowEnd + 1) / 2
+        );
+}
+
+
+// Chroma bytes of a lookup entry, in the order of the point tables.
+const bool POLAR_CHROMA_BYTES_YUY2[8] = { false, true, false, true };
+const bool POLAR_CHROMA_BYTES_UYVY[8] = { true, false, true, false };
+const bool POLAR_CHROMA_BYTES_NV12[8] = { false, false, false, false, true, true };
+
+// BuildPointTables: Builds the point tables and the fill pixel of an
+// effect chain. pfChroma gives the chroma bytes of a lookup entry.
+//
+// The tables apply all the point steps of the chain. Pixels outside the
+// source image read the fill pixel, which must come out as black after
+// the point steps that follow the polar effect only. For each byte, the
+// fill value is a value that the table maps there. (Grayscale and
+// Invert always leave one.)
+
+inline void BuildPointTables(const EffectChain &chain, const bool pfChroma[8], BYTE pTables[8][256], BYTE pFill[8])
+{
+    BYTE lumaTable[256], chromaTable[256];      // All the point steps.
+    BYTE lumaAfter[256], chromaAfter[256];      // Point steps after the polar effect.
+
+    chain.GetPointTables(lumaTable, chromaTable, false);
+    chain.GetPointTables(lumaAfter, chromaAfter, true);
+
+    for (DWORD i = 0; i < 8; i++)
+    {
+        const BYTE *pTable = (pfChroma[i] ? chromaTable : lumaTable);
+        const BYTE black = (pfChroma[i] ? 128 : 0);
+        const BYTE target = (pfChroma[i] ? chromaAfter[black] : lumaAfter[black]);
+
+        CopyMemory(pTables[i], pTable, 256);
+
+        pFill[i] = black;
+        for (DWORD value = 0; value < 256; value++)
+        {
+            if (pTable[value] == target)
+            {
+                pFill[i] = static_cast<BYTE>(value);
+                break;
+            }
+        }
+    }
+}
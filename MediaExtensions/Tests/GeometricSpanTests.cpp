@@ -0,0 +1,383 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// GeometricSpanTests.cpp
+// Checks the span rendering of the geometric source against a coverage
+// mask drawn pixel by pixel, as the drawers did before the edge tables,
+// and the SIMD fills against the scalar fill.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "KernelTest.h"
+#include "GeometricKernels.h"
+#include <string.h>
+
+struct FillKernel
+{
+    const char          *pszName;
+    FILL_PATTERN_FN     pfn;
+    CpuSimdLevel        level;      // Instruction set that the kernel needs.
+};
+
+static const FillKernel g_FillKernels[] =
+{
+#if defined(CPU_FEATURES_X86)
+    { "FillPattern_SSE2", FillPattern_SSE2, CpuSimd_SSE2 },
+#elif defined(CPU_FEATURES_ARM)
+    { "FillPattern_NEON", FillPattern_NEON, CpuSimd_NEON },
+#endif
+    { "FillPattern", FillPattern, CpuSimd_None },
+};
+
+enum Shape
+{
+    Shape_Square,
+    Shape_Circle,
+    Shape_Triangle,
+};
+
+static const char *const g_pszShapes[] = { "square", "circle", "triangle" };
+
+enum Format
+{
+    Format_RGB32,
+    Format_YUY2,
+    Format_NV12,
+};
+
+static const char *const g_pszFormats[] = { "RGB32", "YUY2", "NV12" };
+
+
+//-------------------------------------------------------------------
+// DrawCoverage
+// Marks the pixels of a shape, one at a time, with the loops of the
+// drawers before the edge tables. Pixels outside the frame are dropped.
+//-------------------------------------------------------------------
+
+static std::vector<bool> DrawCoverage(Shape eShape, int nWidth, int nHeight)
+{
+    std::vector<bool> mask(nWidth * nHeight, false);
+
+    auto SetColor = [&](int nLine, int nFirst, int cPixels)
+    {
+        for (int x = nFirst; x < nFirst + cPixels; x++)
+        {
+            if (0 <= nLine && nLine < nHeight && 0 <= x && x < nWidth)
+            {
+                mask[nLine * nWidth + x] = true;
+            }
+        }
+    };
+
+    const int nDimension = min(nWidth, nHeight);
+
+    switch (eShape)
+    {
+    case Shape_Square:
+        for (int nLine = 0; nLine < nDimension; ++nLine)
+        {
+            SetColor(nLine, (nWidth - nDimension) / 2, nDimension);
+        }
+        break;
+
+    case Shape_Circle:
+        {
+            const int nRadius = nDimension / 2;
+
+            for (int nLine = -nRadius; nLine < nRadius; ++nLine)
+            {
+                const int nXPos = (int)sqrt(nRadius*(double)nRadius - nLine*(double)nLine);
+
+                SetColor(nLine + nRadius, nWidth / 2 - nXPos, nXPos * 2);
+            }
+        }
+        break;
+
+    case Shape_Triangle:
+        {
+            int nLeft = nWidth / 2;
+            int nRight = nLeft + 1;
+
+            for (int nLine = 0, nLinesToGrow = 1; nLine < nDimension; ++nLine, --nLinesToGrow)
+            {
+                if (nLinesToGrow == 0)
+                {
+                    nLinesToGrow = 2;
+                    --nLeft;
+                    ++nRight;
+                }
+
+                SetColor(nLine, nLeft, nRight - nLeft);
+            }
+        }
+        break;
+    }
+
+    return mask;
+}
+
+
+//-------------------------------------------------------------------
+// RenderReference
+// Writes a frame from the coverage mask, one element at a time. YUY2
+// pixel pairs and NV12 U-V pairs take the color if their top-left pixel
+// is in the shape.
+//-------------------------------------------------------------------
+
+static void RenderReference(
+    const std::vector<bool> &mask,
+    Format eFormat,
+    DWORD dwWidth,
+    DWORD dwHeight,
+    BYTE *pBuf,
+    LONG lPitch,
+    const DWORD adwColor[2])
+{
+    for (DWORD y = 0; y < dwHeight; y++)
+    {
+        BYTE *pLine = pBuf + y * lPitch;
+
+        switch (eFormat)
+        {
+        case Format_RGB32:
+            for (DWORD x = 0; x < dwWidth; x++)
+            {
+                const DWORD dwPixel = mask[y * dwWidth + x] ? adwColor[0] : 0;
+                memcpy(pLine + x * 4, &dwPixel, 4);
+            }
+            break;
+
+        case Format_YUY2:
+            for (DWORD x = 0; x + 1 < dwWidth; x += 2)
+            {
+                const DWORD dwPair = mask[y * dwWidth + x] ? adwColor[0] : 0x80108010;
+                memcpy(pLine + x * 2, &dwPair, 4);
+            }
+            break;
+
+        case Format_NV12:
+            for (DWORD x = 0; x < dwWidth; x++)
+            {
+                pLine[x] = mask[y * dwWidth + x] ? static_cast<BYTE>(adwColor[0]) : 0x10;
+            }
+            break;
+        }
+    }
+
+    if (eFormat == Format_NV12)
+    {
+        for (DWORD y = 0; y < dwHeight / 2; y++)
+        {
+            BYTE *pLine = pBuf + (dwHeight + y) * lPitch;
+
+            for (DWORD x = 0; x + 1 < dwWidth; x += 2)
+            {
+                const WORD wPair = mask[2 * y * dwWidth + x] ? static_cast<WORD>(adwColor[1]) : 0x8080;
+                memcpy(pLine + x, &wPair, 2);
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// RenderSpans
+// Writes a frame as CFrameGenerator does: the spans of the shape, the
+// edge table of each plane, and three fills per row.
+//-------------------------------------------------------------------
+
+static void RenderSpans(
+    Shape eShape,
+    Format eFormat,
+    DWORD dwWidth,
+    DWORD dwHeight,
+    BYTE *pBuf,
+    LONG lPitch,
+    const DWORD adwColor[2],
+    FILL_PATTERN_FN pfnFill)
+{
+    std::vector<ShapeSpan> spans(dwHeight, ShapeSpan());
+
+    switch (eShape)
+    {
+    case Shape_Square:
+        GetSquareSpans(dwWidth, dwHeight, spans.data());
+        break;
+    case Shape_Circle:
+        GetCircleSpans(dwWidth, dwHeight, spans.data());
+        break;
+    case Shape_Triangle:
+        GetTriangleSpans(dwWidth, dwHeight, spans.data());
+        break;
+    }
+
+    std::vector<ShapePlane> planes;
+
+    switch (eFormat)
+    {
+    case Format_NV12:
+        planes.push_back(BuildShapePlane(spans, dwWidth, sizeof(BYTE), 1, 1, 0, 0x10101010));
+        planes.push_back(BuildShapePlane(spans, dwWidth, sizeof(WORD), 2, 2, dwHeight, 0x80808080));
+        break;
+
+    case Format_YUY2:
+        planes.push_back(BuildShapePlane(spans, dwWidth, sizeof(DWORD), 2, 1, 0, 0x80108010));
+        break;
+
+    default:
+        planes.push_back(BuildShapePlane(spans, dwWidth, sizeof(DWORD), 1, 1, 0, 0));
+        break;
+    }
+
+    for (size_t nPlane = 0; nPlane < planes.size(); ++nPlane)
+    {
+        RenderShapePlane(pBuf, lPitch, planes[nPlane], adwColor[nPlane], pfnFill);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestFills
+// Runs each fill on runs of 0 to 300 bytes at each byte alignment,
+// and compares with the scalar fill. The bytes around the run must not
+// change.
+//-------------------------------------------------------------------
+
+static void TestFills(TestRandom &random)
+{
+    std::vector<BYTE> expected(400);
+    std::vector<BYTE> actual(400);
+
+    for (DWORD cbFill = 0; cbFill <= 300; cbFill++)
+    {
+        for (DWORD offset = 0; offset < 32; offset++)
+        {
+            const DWORD dwPattern = random.Next();
+
+            for (const FillKernel &kernel : g_FillKernels)
+            {
+                if (!CanRun(kernel.level))
+                {
+                    continue;
+                }
+
+                memset(expected.data(), 0xCD, expected.size());
+                memset(actual.data(), 0xCD, actual.size());
+
+                FillPattern(&expected[offset], cbFill, dwPattern);
+                kernel.pfn(&actual[offset], cbFill, dwPattern);
+
+                TEST_CHECK(expected == actual, "%s, %u bytes at offset %u", kernel.pszName, cbFill, offset);
+            }
+
+            // The scalar fill repeats the pattern from the first byte.
+            bool fPattern = true;
+            for (DWORD i = 0; i < cbFill; i++)
+            {
+                fPattern = fPattern && (expected[offset + i] == static_cast<BYTE>(dwPattern >> (8 * (i % 4))));
+            }
+            TEST_CHECK(fPattern, "FillPattern, %u bytes: wrong pattern", cbFill);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestShapes
+// Renders each shape in each format at random sizes, wider and taller
+// than high, with the scalar fill and the fill that the source selects
+// for this CPU, and compares with the coverage mask.
+//-------------------------------------------------------------------
+
+static void TestShapes(TestRandom &random)
+{
+    const FILL_PATTERN_FN pfnSelected = SelectFillPattern();
+
+    for (int iteration = 0; iteration < 60; iteration++)
+    {
+        DWORD dwWidth = 2 + 2 * random.Below(200);
+        DWORD dwHeight = 2 + 2 * random.Below(150);
+
+        if (iteration == 0)
+        {
+            dwWidth = 3840;
+            dwHeight = 2160;
+        }
+        else if (iteration == 1)
+        {
+            dwWidth = 2;
+            dwHeight = 2;
+        }
+
+        for (int nShape = Shape_Square; nShape <= Shape_Triangle; nShape++)
+        {
+            const std::vector<bool> mask = DrawCoverage(static_cast<Shape>(nShape), dwWidth, dwHeight);
+
+            for (int nFormat = Format_RGB32; nFormat <= Format_NV12; nFormat++)
+            {
+                const Format eFormat = static_cast<Format>(nFormat);
+                const DWORD cbRow = (eFormat == Format_RGB32) ? dwWidth * 4 : (eFormat == Format_YUY2) ? dwWidth * 2 : dwWidth;
+                const DWORD cRows = (eFormat == Format_NV12) ? dwHeight * 3 / 2 : dwHeight;
+                const LONG lPitch = static_cast<LONG>(cbRow + 4 * random.Below(8));
+
+                const BYTE Y = static_cast<BYTE>(random.Below(256));
+                const BYTE U = static_cast<BYTE>(random.Below(256));
+                const BYTE V = static_cast<BYTE>(random.Below(256));
+                DWORD adwColor[2] = {};
+
+                switch (eFormat)
+                {
+                case Format_NV12:
+                    adwColor[0] = Y * 0x01010101u;
+                    adwColor[1] = (U | (V << 8)) * 0x00010001u;
+                    break;
+                case Format_YUY2:
+                    adwColor[0] = Y | (U << 8) | (Y << 16) | (V << 24);
+                    break;
+                default:
+                    adwColor[0] = random.Next() | 0xFF000000;
+                    break;
+                }
+
+                std::vector<BYTE> expected(lPitch * cRows, 0xCD);
+                std::vector<BYTE> scalar(expected.size(), 0xCD);
+                std::vector<BYTE> selected(expected.size(), 0xCD);
+
+                RenderReference(mask, eFormat, dwWidth, dwHeight, expected.data(), lPitch, adwColor);
+                RenderSpans(static_cast<Shape>(nShape), eFormat, dwWidth, dwHeight, scalar.data(), lPitch, adwColor, FillPattern);
+                RenderSpans(static_cast<Shape>(nShape), eFormat, dwWidth, dwHeight, selected.data(), lPitch, adwColor, pfnSelected);
+
+                DWORD cDiffRows = 0, cSimdDiffRows = 0;
+                for (DWORD y = 0; y < cRows; y++)
+                {
+                    cDiffRows += (memcmp(&expected[y * lPitch], &scalar[y * lPitch], cbRow) != 0) ? 1 : 0;
+                    cSimdDiffRows += (memcmp(&scalar[y * lPitch], &selected[y * lPitch], cbRow) != 0) ? 1 : 0;
+                }
+
+                TEST_CHECK(cDiffRows == 0, "%s %s %ux%u: %u rows differ from the coverage mask",
+                    g_pszShapes[nShape], g_pszFormats[nFormat], dwWidth, dwHeight, cDiffRows);
+                TEST_CHECK(cSimdDiffRows == 0, "%s %s %ux%u: %u rows differ with the selected fill",
+                    g_pszShapes[nShape], g_pszFormats[nFormat], dwWidth, dwHeight, cSimdDiffRows);
+            }
+        }
+    }
+}
+
+
+int main()
+{
+    printf("CPU: %s\n", CpuSimdLevelName(GetCpuSimdLevel()));
+
+    TestRandom random;
+
+    TestFills(random);
+    TestShapes(random);
+
+    return TestResult("GeometricSpanTests");
+}
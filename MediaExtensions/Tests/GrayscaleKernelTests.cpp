@@ -0,0 +1,479 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// GrayscaleKernelTests.cpp
+// Checks that the SIMD grayscale kernels give exactly the same result as
+// the scalar kernels, and that the image kernels match a per-pixel
+// reference.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "KernelTest.h"
+#include "GrayscaleKernels.h"
+#include <string.h>
+#include <algorithm>
+
+struct PixelPairKernel
+{
+    const char      *pszName;
+    PIXEL_PAIR_FN   pfn;
+    CpuSimdLevel    level;      // Instruction set that the kernel needs.
+};
+
+struct RGB32Kernel
+{
+    const char      *pszName;
+    RGB32_PIXEL_FN  pfn;
+    CpuSimdLevel    level;
+};
+
+static const PixelPairKernel g_PixelPairKernels[] =
+{
+#if defined(CPU_FEATURES_X86)
+    { "MaskPixelPairs_SSE2", MaskPixelPairs_SSE2, CpuSimd_SSE2 },
+    { "MaskPixelPairs_AVX2", MaskPixelPairs_AVX2, CpuSimd_AVX2 },
+#elif defined(CPU_FEATURES_ARM)
+    { "MaskPixelPairs_NEON", MaskPixelPairs_NEON, CpuSimd_NEON },
+#endif
+    { "MaskPixelPairs", MaskPixelPairs, CpuSimd_None },
+};
+
+static const RGB32Kernel g_RGB32Kernels[] =
+{
+#if defined(CPU_FEATURES_X86)
+    { "GrayPixels_RGB32_SSE2", GrayPixels_RGB32_SSE2, CpuSimd_SSE2 },
+    { "GrayPixels_RGB32_AVX2", GrayPixels_RGB32_AVX2, CpuSimd_AVX2 },
+#elif defined(CPU_FEATURES_ARM)
+    { "GrayPixels_RGB32_NEON", GrayPixels_RGB32_NEON, CpuSimd_NEON },
+#endif
+    { "GrayPixels_RGB32", GrayPixels_RGB32, CpuSimd_None },
+};
+
+
+//-------------------------------------------------------------------
+// TestPixelRuns
+// Runs each kernel on runs of 0 to 200 pixels at each DWORD alignment
+// of a vector, both out of place and in place, and compares with the
+// scalar kernel.
+//-------------------------------------------------------------------
+
+static void TestPixelRuns(TestRandom &random)
+{
+    const DWORD cMaxPixels = 200;
+    const DWORD masks[][2] =
+    {
+        { YUY2_LUMA_MASK, YUY2_GRAY_CHROMA },
+        { UYVY_LUMA_MASK, UYVY_GRAY_CHROMA },
+    };
+
+    std::vector<BYTE> src(cMaxPixels * 4 + 64);
+    std::vector<BYTE> expected(src.size());
+    std::vector<BYTE> actual(src.size());
+
+    random.Fill(src);
+
+    for (DWORD cPixels = 0; cPixels <= cMaxPixels; cPixels++)
+    {
+        for (DWORD offset = 0; offset < 32; offset += 4)
+        {
+            for (const PixelPairKernel &kernel : g_PixelPairKernels)
+            {
+                if (!CanRun(kernel.level))
+                {
+                    continue;
+                }
+
+                for (const DWORD *pMask : masks)
+                {
+                    memset(expected.data(), 0xCD, expected.size());
+                    memset(actual.data(), 0xCD, actual.size());
+
+                    MaskPixelPairs(&expected[offset], &src[offset], cPixels, pMask[0], pMask[1]);
+                    kernel.pfn(&actual[offset], &src[offset], cPixels, pMask[0], pMask[1]);
+
+                    TEST_CHECK(expected == actual, "%s, %u pairs at offset %u", kernel.pszName, cPixels, offset);
+
+                    // In place
+                    actual = src;
+                    kernel.pfn(&actual[offset], &actual[offset], cPixels, pMask[0], pMask[1]);
+
+                    TEST_CHECK(memcmp(&actual[offset], &expected[offset], cPixels * 4) == 0,
+                        "%s in place, %u pairs at offset %u", kernel.pszName, cPixels, offset);
+                }
+            }
+
+            for (const RGB32Kernel &kernel : g_RGB32Kernels)
+            {
+                if (!CanRun(kernel.level))
+                {
+                    continue;
+                }
+
+                memset(expected.data(), 0xCD, expected.size());
+                memset(actual.data(), 0xCD, actual.size());
+
+                GrayPixels_RGB32(&expected[offset], &src[offset], cPixels);
+                kernel.pfn(&actual[offset], &src[offset], cPixels);
+
+                TEST_CHECK(expected == actual, "%s, %u pixels at offset %u", kernel.pszName, cPixels, offset);
+
+                actual = src;
+                kernel.pfn(&actual[offset], &actual[offset], cPixels);
+
+                TEST_CHECK(memcmp(&actual[offset], &expected[offset], cPixels * 4) == 0,
+                    "%s in place, %u pixels at offset %u", kernel.pszName, cPixels, offset);
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestRGB32Values
+// Checks the scalar RGB32 kernel against the definition of the luma,
+// for every gray level and for the primary colors.
+//-------------------------------------------------------------------
+
+static void TestRGB32Values()
+{
+    for (DWORD v = 0; v < 256; v++)
+    {
+        const DWORD pixels[] = { 0xFF000000 | (v * 0x010101), v << 16, v << 8, v, 0x7F000000 | (v << 16) };
+        DWORD result[5] = {};
+
+        GrayPixels_RGB32(reinterpret_cast<BYTE*>(result), reinterpret_cast<const BYTE*>(pixels), 5);
+
+        for (DWORD i = 0; i < 5; i++)
+        {
+            const DWORD b = pixels[i] & 0xFF;
+            const DWORD g = (pixels[i] >> 8) & 0xFF;
+            const DWORD r = (pixels[i] >> 16) & 0xFF;
+            const DWORD luma = (LUMA_WEIGHT_R * r + LUMA_WEIGHT_G * g + LUMA_WEIGHT_B * b + 128) >> 8;
+
+            TEST_CHECK(result[i] == ((pixels[i] & 0xFF000000) | (luma * 0x010101)),
+                "pixel 0x%08X gives 0x%08X", pixels[i], result[i]);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// Per-pixel reference transforms. Each one copies pSrc to pDest and sets
+// a chroma sample to gray if any of the pixels that share it is inside
+// rc. RGB32 pixels inside rc are replaced by their luma.
+//-------------------------------------------------------------------
+
+typedef void (*REFERENCE_TRANSFORM_FN)(const D2D_RECT_U &rc, BYTE *pDest, const BYTE *pSrc, LONG lStride, DWORD dwWidth, DWORD dwHeight);
+
+// Returns true if any pixel of the block [x, x + cx) x [y, y + cy) is inside rc.
+static bool IsBlockInRect(const D2D_RECT_U &rc, DWORD x, DWORD y, DWORD cx, DWORD cy)
+{
+    return (x < rc.right) && (rc.left < x + cx) && (y < rc.bottom) && (rc.top < y + cy);
+}
+
+// Packed 4:2:2. iChroma is the offset of the first chroma byte in each
+// pixel pair: 1 for YUY2 (Y0 U0 Y1 V0), 0 for UYVY (U0 Y0 V0 Y1).
+template <DWORD iChroma>
+void ReferenceTransform_422(const D2D_RECT_U &rc, BYTE *pDest, const BYTE *pSrc, LONG lStride, DWORD dwWidth, DWORD dwHeight)
+{
+    memcpy(pDest, pSrc, lStride * dwHeight);
+
+    for (DWORD y = 0; y < dwHeight; y++)
+    {
+        for (DWORD x = 0; x + 1 < dwWidth; x += 2)
+        {
+            if (IsBlockInRect(rc, x, y, 2, 1))
+            {
+                pDest[y * lStride + x * 2 + iChroma] = 128;
+                pDest[y * lStride + x * 2 + iChroma + 2] = 128;
+            }
+        }
+    }
+}
+
+static void ReferenceTransform_RGB32(const D2D_RECT_U &rc, BYTE *pDest, const BYTE *pSrc, LONG lStride, DWORD dwWidth, DWORD dwHeight)
+{
+    memcpy(pDest, pSrc, lStride * dwHeight);
+
+    for (DWORD y = 0; y < dwHeight; y++)
+    {
+        for (DWORD x = 0; x < dwWidth; x++)
+        {
+            if (IsBlockInRect(rc, x, y, 1, 1))
+            {
+                GrayPixels_RGB32(&pDest[y * lStride + x * 4], &pSrc[y * lStride + x * 4], 1);
+            }
+        }
+    }
+}
+
+// NV12: Y plane, then an interleaved U-V plane with half as many rows.
+static void ReferenceTransform_NV12(const D2D_RECT_U &rc, BYTE *pDest, const BYTE *pSrc, LONG lStride, DWORD dwWidth, DWORD dwHeight)
+{
+    memcpy(pDest, pSrc, lStride * dwHeight * 3 / 2);
+
+    BYTE *pDest_UV = pDest + lStride * dwHeight;
+
+    for (DWORD y = 0; y < dwHeight / 2; y++)
+    {
+        for (DWORD x = 0; x < dwWidth; x++)
+        {
+            if (IsBlockInRect(rc, x & ~1, y * 2, 2, 2))
+            {
+                pDest_UV[y * lStride + x] = 128;
+            }
+        }
+    }
+}
+
+// I420, IYUV and YV12: Y plane, then two chroma planes with half the
+// width, height and stride.
+static void ReferenceTransform_YV12(const D2D_RECT_U &rc, BYTE *pDest, const BYTE *pSrc, LONG lStride, DWORD dwWidth, DWORD dwHeight)
+{
+    memcpy(pDest, pSrc, lStride * dwHeight * 3 / 2);
+
+    for (DWORD iPlane = 0; iPlane < 2; iPlane++)
+    {
+        BYTE *pDest_C = pDest + lStride * dwHeight + iPlane * (lStride / 2) * (dwHeight / 2);
+
+        for (DWORD y = 0; y < dwHeight / 2; y++)
+        {
+            for (DWORD x = 0; x < dwWidth / 2; x++)
+            {
+                if (IsBlockInRect(rc, x * 2, y * 2, 2, 2))
+                {
+                    pDest_C[y * (lStride / 2) + x] = 128;
+                }
+            }
+        }
+    }
+}
+
+// Returns a random rectangle with odd edges as often as even ones,
+// clipped to the frame as the effect does (see UpdateRegions).
+static D2D_RECT_U RandomRect(TestRandom &random, DWORD width, DWORD height, int iteration)
+{
+    D2D_RECT_U rc;
+    rc.left = random.Below(width + 1);
+    rc.right = rc.left + random.Below(width - rc.left + 1);
+    rc.top = random.Below(height + 1);
+    rc.bottom = rc.top + random.Below(height - rc.top + 1);
+
+    if (iteration % 5 == 0)
+    {
+        rc.left = 0;
+        rc.top = 0;
+        rc.right = width;
+        rc.bottom = height;
+    }
+    return rc;
+}
+
+
+//-------------------------------------------------------------------
+// TestImages
+// Converts random images with random rectangles and row bands, using
+// the transforms that the effect selects for this CPU, and compares
+// with the scalar transforms.
+//-------------------------------------------------------------------
+
+static void TestImages(TestRandom &random)
+{
+    struct ImageTransform
+    {
+        const char                  *pszName;
+        DWORD                       cbPixel;
+        IMAGE_TRANSFORM_FN          pfnScalar;
+        IMAGE_TRANSFORM_FN          pfnSelected;
+        IMAGE_TRANSFORM_IN_PLACE_FN pfnScalarInPlace;
+        IMAGE_TRANSFORM_IN_PLACE_FN pfnSelectedInPlace;
+        REFERENCE_TRANSFORM_FN      pfnReference;
+    };
+
+    const ImageTransform transforms[] =
+    {
+        { "YUY2", 2,
+            TransformImage_YUY2,
+            SelectTransform_422<YUY2_LUMA_MASK, YUY2_GRAY_CHROMA>(TransformImage_YUY2),
+            TransformImageInPlace_422<YUY2_LUMA_MASK, YUY2_GRAY_CHROMA, MaskPixelPairs>,
+            SelectTransformInPlace_422<YUY2_LUMA_MASK, YUY2_GRAY_CHROMA>(),
+            ReferenceTransform_422<1> },
+        { "UYVY", 2,
+            TransformImage_UYVY,
+            SelectTransform_422<UYVY_LUMA_MASK, UYVY_GRAY_CHROMA>(TransformImage_UYVY),
+            TransformImageInPlace_422<UYVY_LUMA_MASK, UYVY_GRAY_CHROMA, MaskPixelPairs>,
+            SelectTransformInPlace_422<UYVY_LUMA_MASK, UYVY_GRAY_CHROMA>(),
+            ReferenceTransform_422<0> },
+        { "RGB32", 4,
+            TransformImage_RGB32<GrayPixels_RGB32>,
+            SelectTransform_RGB32(),
+            TransformImageInPlace_RGB32<GrayPixels_RGB32>,
+            SelectTransformInPlace_RGB32(),
+            ReferenceTransform_RGB32 },
+    };
+
+    for (int iteration = 0; iteration < 300; iteration++)
+    {
+        const DWORD width = 2 + 2 * random.Below(300);
+        const DWORD height = 1 + random.Below(24);
+
+        const D2D_RECT_U rc = RandomRect(random, width, height, iteration);
+        const DWORD rowSplit = random.Below(height + 1);
+
+        for (const ImageTransform &transform : transforms)
+        {
+            const LONG lStride = static_cast<LONG>(width * transform.cbPixel + 4 * random.Below(8));
+
+            std::vector<BYTE> src(lStride * height);
+            std::vector<BYTE> expected(src.size(), 0xCD);
+            std::vector<BYTE> actual(src.size(), 0xCD);
+
+            random.Fill(src);
+
+            transform.pfnScalar(rc, expected.data(), lStride, src.data(), lStride, width, height, 0, height);
+
+            std::vector<BYTE> reference(src.size());
+            transform.pfnReference(rc, reference.data(), src.data(), lStride, width, height);
+
+            bool fReference = true;
+            for (DWORD y = 0; y < height; y++)
+            {
+                fReference = fReference && (memcmp(&expected[y * lStride], &reference[y * lStride], width * transform.cbPixel) == 0);
+            }
+            TEST_CHECK(fReference, "%s %ux%u differs from the reference, rect (%u,%u)-(%u,%u)",
+                transform.pszName, width, height, rc.left, rc.top, rc.right, rc.bottom);
+
+            // Two row bands, as if two threads converted the frame.
+            transform.pfnSelected(rc, actual.data(), lStride, src.data(), lStride, width, height, 0, rowSplit);
+            transform.pfnSelected(rc, actual.data(), lStride, src.data(), lStride, width, height, rowSplit, height);
+
+            bool fEqual = true;
+            for (DWORD y = 0; y < height; y++)
+            {
+                fEqual = fEqual && (memcmp(&expected[y * lStride], &actual[y * lStride], width * transform.cbPixel) == 0);
+            }
+            TEST_CHECK(fEqual, "%s %ux%u, rect (%u,%u)-(%u,%u)", transform.pszName, width, height, rc.left, rc.top, rc.right, rc.bottom);
+
+            // In place, the result must be the same as out of place.
+            std::vector<BYTE> expectedInPlace = src;
+            std::vector<BYTE> actualInPlace = src;
+
+            transform.pfnScalarInPlace(rc, expectedInPlace.data(), lStride, width, height, 0, height);
+            transform.pfnSelectedInPlace(rc, actualInPlace.data(), lStride, width, height, 0, rowSplit);
+            transform.pfnSelectedInPlace(rc, actualInPlace.data(), lStride, width, height, rowSplit, height);
+
+            fEqual = (expectedInPlace == actualInPlace);
+            for (DWORD y = 0; y < height; y++)
+            {
+                fEqual = fEqual && (memcmp(&expected[y * lStride], &actualInPlace[y * lStride], width * transform.cbPixel) == 0);
+            }
+            TEST_CHECK(fEqual, "%s in place %ux%u, rect (%u,%u)-(%u,%u)", transform.pszName, width, height, rc.left, rc.top, rc.right, rc.bottom);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestPlanarImages
+// Converts random 4:2:0 images (NV12, and I420/IYUV/YV12) with random
+// rectangles, in three row bands, and compares with the per-pixel
+// reference. The bands start on even rows, as the effect splits them.
+//-------------------------------------------------------------------
+
+static void TestPlanarImages(TestRandom &random)
+{
+    struct PlanarTransform
+    {
+        const char                  *pszName;
+        IMAGE_TRANSFORM_FN          pfn;
+        IMAGE_TRANSFORM_IN_PLACE_FN pfnInPlace;
+        REFERENCE_TRANSFORM_FN      pfnReference;
+    };
+
+    // There are no SIMD versions of these kernels.
+    const PlanarTransform transforms[] =
+    {
+        { "NV12", TransformImage_NV12, TransformImageInPlace_NV12, ReferenceTransform_NV12 },
+        { "YV12", TransformImage_YV12, TransformImageInPlace_YV12, ReferenceTransform_YV12 },
+    };
+
+    for (int iteration = 0; iteration < 300; iteration++)
+    {
+        const DWORD width = 2 + 2 * random.Below(300);
+        const DWORD height = 2 + 2 * random.Below(12);
+
+        const D2D_RECT_U rc = RandomRect(random, width, height, iteration);
+
+        DWORD bands[4] = { 0, 2 * random.Below(height / 2 + 1), 2 * random.Below(height / 2 + 1), height };
+        if (bands[1] > bands[2])
+        {
+            std::swap(bands[1], bands[2]);
+        }
+
+        for (const PlanarTransform &transform : transforms)
+        {
+            // The chroma stride of YV12 is half the luma stride, so keep it even.
+            const LONG lStride = static_cast<LONG>(width + 4 * random.Below(8));
+            const size_t cbImage = lStride * height * 3 / 2;
+
+            std::vector<BYTE> src(cbImage);
+            std::vector<BYTE> expected(cbImage);
+            std::vector<BYTE> actual(cbImage, 0xCD);
+
+            random.Fill(src);
+            transform.pfnReference(rc, expected.data(), src.data(), lStride, width, height);
+
+            for (DWORD i = 0; i < 3; i++)
+            {
+                transform.pfn(rc, actual.data(), lStride, src.data(), lStride, width, height, bands[i], bands[i + 1]);
+            }
+
+            // Compare the image only, not the padding at the end of each row.
+            const DWORD cbRow[2] = { width, (transform.pfn == TransformImage_NV12) ? width : width / 2 };
+            const LONG lRowStride[2] = { lStride, (transform.pfn == TransformImage_NV12) ? lStride : lStride / 2 };
+            const DWORD cRows[2] = { height, (transform.pfn == TransformImage_NV12) ? height / 2 : height };
+
+            bool fEqual = true;
+            for (DWORD iPart = 0, offset = 0; iPart < 2; offset += lRowStride[iPart] * cRows[iPart], iPart++)
+            {
+                for (DWORD y = 0; y < cRows[iPart]; y++)
+                {
+                    const size_t i = offset + y * lRowStride[iPart];
+                    fEqual = fEqual && (memcmp(&expected[i], &actual[i], cbRow[iPart]) == 0);
+                }
+            }
+            TEST_CHECK(fEqual, "%s %ux%u, rect (%u,%u)-(%u,%u), bands at %u, %u",
+                transform.pszName, width, height, rc.left, rc.top, rc.right, rc.bottom, bands[1], bands[2]);
+
+            // In place, the whole buffer must match the reference.
+            actual = src;
+            for (DWORD i = 0; i < 3; i++)
+            {
+                transform.pfnInPlace(rc, actual.data(), lStride, width, height, bands[i], bands[i + 1]);
+            }
+            TEST_CHECK(expected == actual, "%s in place %ux%u, rect (%u,%u)-(%u,%u), bands at %u, %u",
+                transform.pszName, width, height, rc.left, rc.top, rc.right, rc.bottom, bands[1], bands[2]);
+        }
+    }
+}
+
+
+int main()
+{
+    printf("CPU: %s\n", CpuSimdLevelName(GetCpuSimdLevel()));
+
+    TestRandom random;
+
+    TestPixelRuns(random);
+    TestRGB32Values();
+    TestImages(random);
+    TestPlanarImages(random);
+
+    return TestResult("GrayscaleKernelTests");
+}
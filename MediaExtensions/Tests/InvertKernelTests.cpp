@@ -0,0 +1,160 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// InvertKernelTests.cpp
+// Checks that the SIMD invert kernels give exactly the same result as
+// the scalar kernel, and that the scalar kernel matches the pixel shader.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "KernelTest.h"
+#include "InvertKernels.h"
+#include <string.h>
+
+struct InvertKernel
+{
+    const char          *pszName;
+    INVERT_PIXELS_FN    pfn;
+    CpuSimdLevel        level;      // Instruction set that the kernel needs.
+};
+
+static const InvertKernel g_Kernels[] =
+{
+#if defined(CPU_FEATURES_X86)
+    { "InvertPixels_SSE2", InvertPixels_SSE2, CpuSimd_SSE2 },
+    { "InvertPixels_AVX2", InvertPixels_AVX2, CpuSimd_AVX2 },
+#elif defined(CPU_FEATURES_ARM)
+    { "InvertPixels_NEON", InvertPixels_NEON, CpuSimd_NEON },
+#endif
+    { "InvertPixels", InvertPixels, CpuSimd_None },
+};
+
+
+//-------------------------------------------------------------------
+// TestValues
+// Checks the scalar kernel against the pixel shader: B, G and R become
+// 255 - x, and the fourth byte is kept.
+//-------------------------------------------------------------------
+
+static void TestValues()
+{
+    for (DWORD v = 0; v < 256; v++)
+    {
+        const BYTE src[8] = { static_cast<BYTE>(v), static_cast<BYTE>(255 - v), static_cast<BYTE>(v ^ 0x55), static_cast<BYTE>(v),
+                              0, 128, 255, static_cast<BYTE>(255 - v) };
+        BYTE result[8] = {};
+
+        InvertPixels(result, src, 2);
+
+        for (DWORD i = 0; i < 8; i++)
+        {
+            const BYTE expected = (i % 4 == 3) ? src[i] : static_cast<BYTE>(255 - src[i]);
+
+            TEST_CHECK(result[i] == expected, "byte %u of 0x%02X: 0x%02X, expected 0x%02X", i, src[i], result[i], expected);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestPixelRuns
+// Runs each kernel on runs of 0 to 200 pixels at each DWORD alignment
+// of a vector, both out of place and in place, and compares with the
+// scalar kernel. The bytes after the run must not change.
+//-------------------------------------------------------------------
+
+static void TestPixelRuns(TestRandom &random)
+{
+    const DWORD cMaxPixels = 200;
+
+    std::vector<BYTE> src(cMaxPixels * 4 + 64);
+    std::vector<BYTE> expected(src.size());
+    std::vector<BYTE> actual(src.size());
+
+    random.Fill(src);
+
+    for (DWORD cPixels = 0; cPixels <= cMaxPixels; cPixels++)
+    {
+        for (DWORD offset = 0; offset < 32; offset += 4)
+        {
+            for (const InvertKernel &kernel : g_Kernels)
+            {
+                if (!CanRun(kernel.level))
+                {
+                    continue;
+                }
+
+                memset(expected.data(), 0xCD, expected.size());
+                memset(actual.data(), 0xCD, actual.size());
+
+                InvertPixels(&expected[offset], &src[offset], cPixels);
+                kernel.pfn(&actual[offset], &src[offset], cPixels);
+
+                TEST_CHECK(expected == actual, "%s, %u pixels at offset %u", kernel.pszName, cPixels, offset);
+
+                // In place
+                actual = src;
+                kernel.pfn(&actual[offset], &actual[offset], cPixels);
+
+                TEST_CHECK(memcmp(&actual[offset], &expected[offset], cPixels * 4) == 0 &&
+                           memcmp(&actual[offset + cPixels * 4], &src[offset + cPixels * 4], src.size() - offset - cPixels * 4) == 0,
+                    "%s in place, %u pixels at offset %u", kernel.pszName, cPixels, offset);
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestImages
+// Inverts random images row by row with the kernel that the module
+// selects for this CPU, as CInvertModule::ProcessBuffer does, and
+// compares with the scalar kernel.
+//-------------------------------------------------------------------
+
+static void TestImages(TestRandom &random)
+{
+    const INVERT_PIXELS_FN pfnSelected = SelectInvertPixels();
+
+    for (int iteration = 0; iteration < 100; iteration++)
+    {
+        const DWORD width = 1 + random.Below(400);
+        const DWORD height = 1 + random.Below(24);
+        const LONG lSrcStride = static_cast<LONG>(width * 4 + 4 * random.Below(16));
+        const LONG lDestStride = static_cast<LONG>(width * 4 + 4 * random.Below(16));
+
+        std::vector<BYTE> src(lSrcStride * height);
+        std::vector<BYTE> expected(lDestStride * height, 0xCD);
+        std::vector<BYTE> actual(lDestStride * height, 0xCD);
+
+        random.Fill(src);
+
+        for (DWORD y = 0; y < height; y++)
+        {
+            InvertPixels(&expected[y * lDestStride], &src[y * lSrcStride], width);
+            pfnSelected(&actual[y * lDestStride], &src[y * lSrcStride], width);
+        }
+
+        TEST_CHECK(expected == actual, "%ux%u, strides %d and %d", width, height, lSrcStride, lDestStride);
+    }
+}
+
+
+int main()
+{
+    printf("CPU: %s\n", CpuSimdLevelName(GetCpuSimdLevel()));
+
+    TestRandom random;
+
+    TestValues();
+    TestPixelRuns(random);
+    TestImages(random);
+
+    return TestResult("InvertKernelTests");
+}
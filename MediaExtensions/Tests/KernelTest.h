@@ -0,0 +1,92 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+//  KernelTest.h
+//  Description: Helpers for the kernel tests. Each test is a program
+//  that prints the failed checks and returns the number of failures.
+//////////////////////////////////////////////////////////////////////////
+
+#include "PortableTypes.h"
+#include "CpuFeatures.h"
+#include <stdio.h>
+#include <vector>
+
+static int g_cTestFailures = 0;
+
+// TEST_CHECK: Reports a failure if the condition is false. The remaining
+// arguments are a printf format and its arguments, describing the case.
+#define TEST_CHECK(condition, ...) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            if (++g_cTestFailures <= 20) \
+            { \
+                printf("FAILED: %s (line %d): ", #condition, __LINE__); \
+                printf(__VA_ARGS__); \
+                printf("\n"); \
+            } \
+        } \
+    } while (0)
+
+// Returns the result of the test program.
+inline int TestResult(const char *pszName)
+{
+    printf("%s: %s (%d failures)\n", pszName, g_cTestFailures == 0 ? "passed" : "FAILED", g_cTestFailures);
+    return (g_cTestFailures == 0) ? 0 : 1;
+}
+
+inline const char *CpuSimdLevelName(CpuSimdLevel level)
+{
+    switch (level)
+    {
+    case CpuSimd_SSE2: return "SSE2";
+    case CpuSimd_AVX2: return "AVX2";
+    case CpuSimd_NEON: return "NEON";
+    default: return "scalar";
+    }
+}
+
+// CanRun: A kernel can run if the CPU supports its instruction set. AVX2
+// implies SSE2.
+inline bool CanRun(CpuSimdLevel level)
+{
+    const CpuSimdLevel cpu = GetCpuSimdLevel();
+
+    return (level == CpuSimd_None) || (level == cpu) || (level == CpuSimd_SSE2 && cpu == CpuSimd_AVX2);
+}
+
+// TestRandom: Small deterministic random number generator (xorshift32),
+// so that a failure can be reproduced.
+class TestRandom
+{
+public:
+    explicit TestRandom(DWORD seed = 0x2545F491) : m_state(seed ? seed : 1)
+    {
+    }
+
+    DWORD Next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    // Returns a number in [0, n).
+    DWORD Below(DWORD n)
+    {
+        return (n == 0) ? 0 : Next() % n;
+    }
+
+    void Fill(std::vector<BYTE> &data)
+    {
+        for (BYTE &b : data)
+        {
+            b = static_cast<BYTE>(Next() >> 24);
+        }
+    }
+
+private:
+    DWORD m_state;
+};
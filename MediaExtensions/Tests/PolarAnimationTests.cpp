@@ -0,0 +1,258 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PolarAnimationTests.cpp
+// Checks that the SSE2 offset generator of the animated polar effect
+// gives the same offsets as the scalar generator, and that strength 0
+// leaves the image inside the circle unchanged.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "KernelTest.h"
+#include "PolarKernels.h"
+#include <string.h>
+
+// The transformations of the effects, as in CPolarEffect.
+static DOUBLE DefaultRadius(DOUBLE r, DOUBLE R, DOUBLE theta) { return r; }
+static DOUBLE DefaultTheta(DOUBLE r, DOUBLE R, DOUBLE theta) { return theta; }
+static DOUBLE PinchRadius(DOUBLE r, DOUBLE R, DOUBLE theta) { return sqrt(r*R); }
+static DOUBLE FisheyeRadius(DOUBLE r, DOUBLE R, DOUBLE theta) { return (r*r)/R; }
+static DOUBLE WarpTheta(DOUBLE r, DOUBLE R, DOUBLE theta) { return theta + r / R; }
+
+struct PolarEffect
+{
+    const char          *pszName;
+    PolarTransformer    pfnRadius;
+    PolarTransformer    pfnTheta;
+};
+
+static const PolarEffect g_Effects[] =
+{
+    { "Fisheye", FisheyeRadius, DefaultTheta },
+    { "Pinch", PinchRadius, DefaultTheta },
+    { "Warp", DefaultRadius, WarpTheta },
+};
+
+// Frame sizes. The last one does not divide into chunks of four pairs.
+static const DWORD g_Sizes[][2] = { { 64, 48 }, { 320, 240 }, { 1920, 1080 }, { 102, 37 } };
+
+// Centres of the effect, as fractions of the frame size. The effect
+// clamps the centre to the frame, so these include the edges and corners.
+static const double g_Centers[][2] = { { 0.5, 0.5 }, { 0.0, 0.0 }, { 0.3, 0.8 }, { 1.0, 0.25 }, { 0.9, 1.0 } };
+
+static const double g_Strengths[] = { 0.0, 0.25, 0.5, 1.0 };
+
+static POLAR_ANIMATION MakeAnimation(const std::vector<float> &radial, DWORD width, DWORD height, const double *pCenter)
+{
+    const POLAR_ANIMATION animation =
+    {
+        radial.data(),
+        static_cast<LONG>(radial.size() / 2 - 1),
+        static_cast<LONG>(pCenter[0] * width),
+        static_cast<LONG>(pCenter[1] * height),
+        nullptr
+    };
+    return animation;
+}
+
+
+//-------------------------------------------------------------------
+// TestOffsets
+// Generates the offsets of every row of each effect, at each strength
+// and centre, in chunks of random length, and compares the SSE2
+// generator with the scalar one. The even rows also get the NV12
+// chroma offsets.
+//-------------------------------------------------------------------
+
+static void TestOffsets(TestRandom &random)
+{
+#if defined(CPU_FEATURES_X86)
+    if (!CanRun(CpuSimd_SSE2))
+    {
+        return;
+    }
+
+    for (const DWORD *pSize : g_Sizes)
+    {
+        const DWORD width = pSize[0];
+        const DWORD height = pSize[1];
+        const DWORD cPairs = width / 2;
+        const LONG lStride = static_cast<LONG>(width * 2 + 64);
+
+        std::vector<UINT32> expected(cPairs), expectedChroma(cPairs);
+        std::vector<UINT32> actual(cPairs), actualChroma(cPairs);
+
+        for (const PolarEffect &effect : g_Effects)
+        {
+            for (double s : g_Strengths)
+            {
+                std::vector<float> radial;
+                BuildRadialProfile(effect.pfnRadius, effect.pfnTheta, width, height, s, radial);
+
+                for (const double *pCenter : g_Centers)
+                {
+                    const POLAR_ANIMATION animation = MakeAnimation(radial, width, height, pCenter);
+                    DWORD cDifferent = 0;
+
+                    for (DWORD y = 0; y < height; y++)
+                    {
+                        const UINT32 cbPixel = 1 + (y % 3 == 0);
+                        UINT32 *pExpectedChroma = ((y & 1) == 0 ? expectedChroma.data() : nullptr);
+                        UINT32 *pActualChroma = ((y & 1) == 0 ? actualChroma.data() : nullptr);
+
+                        for (DWORD x0 = 0; x0 < cPairs; )
+                        {
+                            const DWORD cChunk = min(cPairs - x0, 1 + random.Below(POLAR_ANIMATION_CHUNK_PAIRS));
+
+                            GenerateAnimatedOffsets(&animation, width, height, y, x0, cChunk, lStride, cbPixel,
+                                &expected[x0], (pExpectedChroma ? &pExpectedChroma[x0] : nullptr));
+                            GenerateAnimatedOffsets_SSE2(&animation, width, height, y, x0, cChunk, lStride, cbPixel,
+                                &actual[x0], (pActualChroma ? &pActualChroma[x0] : nullptr));
+                            x0 += cChunk;
+                        }
+
+                        cDifferent += (expected != actual);
+                        cDifferent += (pExpectedChroma != nullptr && expectedChroma != actualChroma);
+                    }
+
+                    TEST_CHECK(cDifferent == 0, "%s %ux%u, strength %.2f, centre (%.1f, %.1f): %u rows differ",
+                        effect.pszName, width, height, s, pCenter[0], pCenter[1], cDifferent);
+                }
+            }
+        }
+    }
+#endif
+}
+
+
+//-------------------------------------------------------------------
+// TestIdentity
+// At strength 0, every output pixel pair inside the circle must read
+// the source pixel pair at the same position, and every pixel pair
+// outside it must read pixel 0. Checks both generators, and transforms
+// whole UYVY and NV12 images with the functions that the effect
+// selects for this CPU.
+//-------------------------------------------------------------------
+
+static void TestIdentity(TestRandom &random)
+{
+    struct OffsetGenerator
+    {
+        const char              *pszName;
+        ANIMATED_OFFSETS_FN     pfn;
+        CpuSimdLevel            level;
+    };
+
+    const OffsetGenerator generators[] =
+    {
+#if defined(CPU_FEATURES_X86)
+        { "GenerateAnimatedOffsets_SSE2", GenerateAnimatedOffsets_SSE2, CpuSimd_SSE2 },
+#endif
+        { "GenerateAnimatedOffsets", GenerateAnimatedOffsets, CpuSimd_None },
+    };
+
+    for (const DWORD *pSize : g_Sizes)
+    {
+        const DWORD width = pSize[0];
+        const DWORD height = pSize[1];
+        const DWORD cPairs = width / 2;
+        const LONG lStride = static_cast<LONG>(width * 2 + 64);
+
+        std::vector<float> radial;
+        BuildRadialProfile(FisheyeRadius, WarpTheta, width, height, 0.0, radial);
+
+        for (const double *pCenter : g_Centers)
+        {
+            const POLAR_ANIMATION animation = MakeAnimation(radial, width, height, pCenter);
+
+            for (const OffsetGenerator &generator : generators)
+            {
+                if (!CanRun(generator.level))
+                {
+                    continue;
+                }
+
+                std::vector<UINT32> offsets(cPairs);
+                DWORD cWrong = 0;
+
+                for (DWORD y = 0; y < height; y++)
+                {
+                    generator.pfn(&animation, width, height, y, 0, cPairs, lStride, 2, offsets.data(), nullptr);
+
+                    for (DWORD i = 0; i < cPairs; i++)
+                    {
+                        const LONG dx = animation.lCenterX - static_cast<LONG>(2 * i);
+                        const LONG dy = animation.lCenterY - static_cast<LONG>(y);
+                        const LONG r = static_cast<LONG>(ceil(sqrtf(static_cast<float>(dx * dx + dy * dy))));
+                        const UINT32 expected = (r < animation.cRadii ? y * lStride + i * 4 : 0);
+
+                        cWrong += (offsets[i] != expected);
+                    }
+                }
+
+                TEST_CHECK(cWrong == 0, "%s %ux%u, centre (%.1f, %.1f): %u pixel pairs move at strength 0",
+                    generator.pszName, width, height, pCenter[0], pCenter[1], cWrong);
+            }
+
+            // Whole images, in two bands. The source stride is larger than
+            // the destination stride, so that an offset computed for the
+            // wrong stride reads the wrong pixels.
+            const IMAGE_ANIMATED_TRANSFORM_FN pfnTransforms[] = { SelectAnimatedTransform_422(), SelectAnimatedTransform_NV12() };
+            const DWORD rowSplit = 2 * random.Below(height / 2 + 1);
+
+            for (int iFormat = 0; iFormat < 2; iFormat++)
+            {
+                const bool fNV12 = (iFormat == 1);
+                const DWORD cbRow = (fNV12 ? width : width * 2);
+                const DWORD cRows = (fNV12 ? height + (height + 1) / 2 : height);
+                const LONG lDestStride = static_cast<LONG>(cbRow);
+                const LONG lSrcStride = static_cast<LONG>(cbRow + 32);
+
+                std::vector<BYTE> src(lSrcStride * cRows);
+                std::vector<BYTE> dest(lDestStride * cRows, 0xCD);
+                random.Fill(src);
+
+                pfnTransforms[iFormat](&animation, dest.data(), lDestStride, src.data(), lSrcStride, width, height, 0, rowSplit);
+                pfnTransforms[iFormat](&animation, dest.data(), lDestStride, src.data(), lSrcStride, width, height, rowSplit, height);
+
+                DWORD cWrong = 0;
+
+                for (DWORD y = 0; y < height; y++)
+                {
+                    for (DWORD i = 0; i < cPairs; i++)
+                    {
+                        const LONG dx = animation.lCenterX - static_cast<LONG>(2 * i);
+                        const LONG dy = animation.lCenterY - static_cast<LONG>(y);
+                        const LONG r = static_cast<LONG>(ceil(sqrtf(static_cast<float>(dx * dx + dy * dy))));
+                        const DWORD cbPair = (fNV12 ? 2 : 4);
+                        const BYTE *pExpected = (r < animation.cRadii ? &src[y * lSrcStride + i * cbPair] : &src[0]);
+
+                        cWrong += (memcmp(&dest[y * lDestStride + i * cbPair], pExpected, cbPair) != 0);
+                    }
+                }
+
+                TEST_CHECK(cWrong == 0, "%s %ux%u, centre (%.1f, %.1f), bands split at row %u: %u pixel pairs move at strength 0",
+                    (fNV12 ? "NV12" : "UYVY"), width, height, pCenter[0], pCenter[1], rowSplit, cWrong);
+            }
+        }
+    }
+}
+
+
+int main()
+{
+    printf("CPU: %s\n", CpuSimdLevelName(GetCpuSimdLevel()));
+
+    TestRandom random;
+
+    TestOffsets(random);
+    TestIdentity(random);
+
+    return TestResult("PolarAnimationTests");
+}
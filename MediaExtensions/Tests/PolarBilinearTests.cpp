@@ -0,0 +1,156 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PolarBilinearTests.cpp
+// Checks that the SIMD bilinear kernels of the polar effect give exactly
+// the same result as the scalar kernels.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "KernelTest.h"
+#include "PolarKernels.h"
+#include <string.h>
+
+// MakeLookup: Random bilinear lookup table. Like the tables that the
+// effect builds, it keeps all four taps inside the image.
+static std::vector<POLAR_BILINEAR_SAMPLE> MakeLookup(TestRandom &random, DWORD width, DWORD height)
+{
+    const DWORD cPairs = width / 2;
+
+    std::vector<POLAR_BILINEAR_SAMPLE> lookup(cPairs * height);
+
+    for (POLAR_BILINEAR_SAMPLE &sample : lookup)
+    {
+        sample.x = static_cast<WORD>(random.Below(cPairs - 1));
+        sample.y = static_cast<WORD>(random.Below(height - 1));
+
+        // Include the weights 0 and 255.
+        switch (random.Below(8))
+        {
+        case 0:
+            sample.weightX = 0;
+            sample.weightY = 0;
+            break;
+        case 1:
+            sample.weightX = 255;
+            sample.weightY = 255;
+            break;
+        default:
+            sample.weightX = static_cast<BYTE>(random.Next() >> 24);
+            sample.weightY = static_cast<BYTE>(random.Next() >> 24);
+            break;
+        }
+    }
+    return lookup;
+}
+
+
+//-------------------------------------------------------------------
+// TestBlend
+// Checks the scalar blend against the exact bilinear interpolation.
+// The two rounding steps can each be off by 1/2.
+//-------------------------------------------------------------------
+
+static void TestBlend(TestRandom &random)
+{
+    for (int i = 0; i < 100000; i++)
+    {
+        const UINT32 a = random.Below(256), b = random.Below(256), c = random.Below(256), d = random.Below(256);
+        const UINT32 wx = random.Below(256), wy = random.Below(256);
+
+        const double fx = wx / 256.0;
+        const double fy = wy / 256.0;
+        const double exact = (a * (1 - fx) + b * fx) * (1 - fy) + (c * (1 - fx) + d * fx) * fy;
+        const BYTE result = BlendBilinear(a, b, c, d, wx, wy);
+
+        TEST_CHECK(result >= exact - 1.0 && result <= exact + 1.0,
+            "taps %u %u %u %u, weights %u %u: %u, exact %.3f", a, b, c, d, wx, wy, result, exact);
+
+        TEST_CHECK(BlendBilinear(a, b, c, d, 0, 0) == a, "weights 0 must return the top-left tap %u", a);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestImages
+// Transforms random images with random lookup tables, in row bands,
+// with the functions that the effect selects for this CPU, and
+// compares with the scalar functions.
+//-------------------------------------------------------------------
+
+static void TestImages(TestRandom &random)
+{
+    struct BilinearTransform
+    {
+        const char                  *pszName;
+        bool                        fNV12;
+        IMAGE_BILINEAR_TRANSFORM_FN pfnScalar;
+        IMAGE_BILINEAR_TRANSFORM_FN pfnSelected;
+    };
+
+    const BilinearTransform transforms[] =
+    {
+        { "422", false, BilinearTransformImage_422, SelectBilinearTransform_422() },
+        { "NV12", true, BilinearTransformImage_NV12, SelectBilinearTransform_NV12() },
+    };
+
+    for (int iteration = 0; iteration < 200; iteration++)
+    {
+        const DWORD width = 4 + 2 * random.Below(200);
+        const DWORD height = 2 + 2 * random.Below(20);
+
+        const std::vector<POLAR_BILINEAR_SAMPLE> lookup = MakeLookup(random, width, height);
+
+        // Row bands. For NV12, the bands start on even rows.
+        const DWORD rowSplit = 2 * random.Below(height / 2 + 1);
+
+        for (const BilinearTransform &transform : transforms)
+        {
+            const DWORD cbRow = transform.fNV12 ? width : width * 2;
+            const DWORD cRows = transform.fNV12 ? height + height / 2 : height;
+            const LONG lSrcStride = static_cast<LONG>(cbRow + 4 * random.Below(8));
+            const LONG lDestStride = static_cast<LONG>(cbRow + 4 * random.Below(8));
+
+            std::vector<BYTE> src(lSrcStride * cRows);
+            std::vector<BYTE> expected(lDestStride * cRows, 0xCD);
+            std::vector<BYTE> actual(lDestStride * cRows, 0xCD);
+
+            random.Fill(src);
+
+            transform.pfnScalar(lookup.data(), expected.data(), lDestStride, src.data(), lSrcStride, width, height, 0, height);
+
+            transform.pfnSelected(lookup.data(), actual.data(), lDestStride, src.data(), lSrcStride, width, height, 0, rowSplit);
+            transform.pfnSelected(lookup.data(), actual.data(), lDestStride, src.data(), lSrcStride, width, height, rowSplit, height);
+
+            DWORD cDiffRows = 0;
+            for (DWORD y = 0; y < cRows; y++)
+            {
+                if (memcmp(&expected[y * lDestStride], &actual[y * lDestStride], cbRow) != 0)
+                {
+                    cDiffRows++;
+                }
+            }
+
+            TEST_CHECK(cDiffRows == 0, "%s %ux%u, split at row %u: %u rows differ", transform.pszName, width, height, rowSplit, cDiffRows);
+        }
+    }
+}
+
+
+int main()
+{
+    printf("CPU: %s\n", CpuSimdLevelName(GetCpuSimdLevel()));
+
+    TestRandom random;
+
+    TestBlend(random);
+    TestImages(random);
+
+    return TestResult("PolarBilinearTests");
+}
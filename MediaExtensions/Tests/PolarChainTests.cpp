@@ -0,0 +1,201 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PolarChainTests.cpp
+// Checks that mapping an image through the point tables of an effect
+// chain gives the same result as running each effect of the chain as a
+// separate pass, one after another.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "KernelTest.h"
+#include "PolarKernels.h"
+#include <string.h>
+#include <algorithm>
+
+struct ChainFormat
+{
+    const char      *pszName;
+    IMAGE_MAP_FN    pfnMap;
+    const bool      *pfChroma;      // Chroma bytes of a lookup entry.
+    bool            fNV12;
+};
+
+static const ChainFormat g_Formats[] =
+{
+    { "YUY2", MapImage_422, POLAR_CHROMA_BYTES_YUY2, false },
+    { "UYVY", MapImage_422, POLAR_CHROMA_BYTES_UYVY, false },
+    { "NV12", MapImage_NV12, POLAR_CHROMA_BYTES_NV12, true },
+};
+
+// ApplyStep: Applies one point step to one byte, from the definitions in
+// EffectChain.h.
+static BYTE ApplyStep(EffectChainStep step, BYTE value, bool fChroma)
+{
+    switch (step)
+    {
+    case EffectChain_Grayscale:
+        return (fChroma ? 128 : value);
+
+    case EffectChain_Invert:
+        if (fChroma)
+        {
+            return static_cast<BYTE>(value == 0 ? 255 : 256 - value);
+        }
+        return static_cast<BYTE>(value > 235 + 16 ? 0 : 235 + 16 - value);
+
+    default:
+        return value;
+    }
+}
+
+// ApplyPass: Runs one point step over a whole frame, as a separate effect
+// would.
+static void ApplyPass(EffectChainStep step, const ChainFormat &format, std::vector<BYTE> &image, LONG lStride, DWORD width, DWORD height)
+{
+    const DWORD cbRow = (format.fNV12 ? width : width * 2);
+    const DWORD cRows = (format.fNV12 ? height + height / 2 : height);
+
+    for (DWORD y = 0; y < cRows; y++)
+    {
+        for (DWORD x = 0; x < cbRow; x++)
+        {
+            const bool fChroma = (format.fNV12 ? (y >= height) : format.pfChroma[x % 4]);
+            BYTE &value = image[y * lStride + x];
+
+            value = ApplyStep(step, value, fChroma);
+        }
+    }
+}
+
+// CompareImages: Compares the pixels of two frames, not the padding.
+static bool CompareImages(const std::vector<BYTE> &a, const std::vector<BYTE> &b, const ChainFormat &format, LONG lStride, DWORD width, DWORD height)
+{
+    const DWORD cbRow = (format.fNV12 ? width : width * 2);
+    const DWORD cRows = (format.fNV12 ? height + height / 2 : height);
+
+    for (DWORD y = 0; y < cRows; y++)
+    {
+        if (memcmp(&a[y * lStride], &b[y * lStride], cbRow) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//-------------------------------------------------------------------
+// TestMapImages
+// Builds random chains of up to five steps, maps random frames through
+// their point tables in random row bands (out of place and in place),
+// and compares with the separate passes. For chains with a gather
+// step, also checks that the fill pixel comes out as black after the
+// point steps that follow the gather.
+//-------------------------------------------------------------------
+
+static void TestMapImages(TestRandom &random)
+{
+    const EffectChainStep steps[] = { EffectChain_Grayscale, EffectChain_Invert, EffectChain_Gather };
+
+    for (int iteration = 0; iteration < 300; iteration++)
+    {
+        EffectChain chain;
+        std::vector<EffectChainStep> chainSteps;
+
+        for (DWORD i = 1 + random.Below(5); i > 0; i--)
+        {
+            const EffectChainStep step = steps[random.Below(3)];
+
+            if (chain.Append(step))
+            {
+                chainSteps.push_back(step);
+            }
+        }
+
+        const DWORD width = 2 + 2 * random.Below(100);
+        const DWORD height = 2 + 2 * random.Below(20);
+
+        // NV12 bands start on even rows.
+        DWORD bands[4] = { 0, 2 * random.Below(height / 2 + 1), 2 * random.Below(height / 2 + 1), height };
+        if (bands[1] > bands[2])
+        {
+            std::swap(bands[1], bands[2]);
+        }
+
+        for (const ChainFormat &format : g_Formats)
+        {
+            BYTE tables[8][256];
+            BYTE fill[8];
+            BuildPointTables(chain, format.pfChroma, tables, fill);
+
+            const DWORD cbRow = (format.fNV12 ? width : width * 2);
+            const DWORD cRows = (format.fNV12 ? height + height / 2 : height);
+            const LONG lStride = static_cast<LONG>(cbRow + 4 * random.Below(8));
+
+            std::vector<BYTE> src(lStride * cRows);
+            random.Fill(src);
+
+            std::vector<BYTE> expected = src;
+            for (EffectChainStep step : chainSteps)
+            {
+                ApplyPass(step, format, expected, lStride, width, height);
+            }
+
+            std::vector<BYTE> actual(src.size(), 0xCD);
+            std::vector<BYTE> actualInPlace = src;
+
+            for (DWORD i = 0; i < 3; i++)
+            {
+                format.pfnMap(tables, actual.data(), lStride, src.data(), lStride, width, height, bands[i], bands[i + 1]);
+                format.pfnMap(tables, actualInPlace.data(), lStride, actualInPlace.data(), lStride, width, height, bands[i], bands[i + 1]);
+            }
+
+            TEST_CHECK(CompareImages(expected, actual, format, lStride, width, height),
+                "%s %ux%u, %u steps, bands at %u, %u", format.pszName, width, height, static_cast<DWORD>(chainSteps.size()), bands[1], bands[2]);
+            TEST_CHECK(CompareImages(expected, actualInPlace, format, lStride, width, height),
+                "%s in place %ux%u, %u steps, bands at %u, %u", format.pszName, width, height, static_cast<DWORD>(chainSteps.size()), bands[1], bands[2]);
+
+            if (!chain.HasGather())
+            {
+                continue;
+            }
+
+            // Each byte of the fill pixel must give black, as it looks after
+            // the steps that follow the gather.
+            const auto gather = std::find(chainSteps.begin(), chainSteps.end(), EffectChain_Gather);
+            const DWORD cbEntry = (format.fNV12 ? 6 : 4);
+
+            for (DWORD i = 0; i < cbEntry; i++)
+            {
+                BYTE target = (format.pfChroma[i] ? 128 : 0);
+
+                for (auto step = gather; step != chainSteps.end(); ++step)
+                {
+                    target = ApplyStep(*step, target, format.pfChroma[i]);
+                }
+
+                TEST_CHECK(tables[i][fill[i]] == target, "%s fill byte %u maps to %u, black is %u",
+                    format.pszName, i, tables[i][fill[i]], target);
+            }
+        }
+    }
+}
+
+
+int main()
+{
+    printf("CPU: %s\n", CpuSimdLevelName(GetCpuSimdLevel()));
+
+    TestRandom random;
+
+    TestMapImages(random);
+
+    return TestResult("PolarChainTests");
+}
@@ -0,0 +1,228 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PolarGatherTests.cpp
+// Checks that the nearest-neighbor kernels of the polar effect write the
+// same image in tiles as in row order, and with a delta-encoded lookup
+// table as with an offset-encoded one.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "KernelTest.h"
+#include "PolarKernels.h"
+#include <string.h>
+#include <algorithm>
+
+// Size of the source buffer that the lookup entries point into. It is
+// larger than 64 KB, so that escaped deltas have a high WORD.
+static const DWORD c_cbSource = 256 * 1024;
+
+// MakeOffsets: Random offset-encoded lookup table. The offsets are
+// multiples of the entry size, as in the tables that the effect builds.
+// Like those tables, most entries are near the previous one, but some
+// jump anywhere in the source, which escapes the delta encoding.
+static std::vector<UINT32> MakeOffsets(TestRandom &random, DWORD cEntries, DWORD cbEntry)
+{
+    const DWORD cSourceEntries = c_cbSource / cbEntry;
+
+    std::vector<UINT32> offsets(cEntries);
+    DWORD index = 0;
+
+    for (UINT32 &offset : offsets)
+    {
+        if (random.Below(8) == 0)
+        {
+            index = random.Below(cSourceEntries);
+        }
+        else
+        {
+            index = min(index + random.Below(9) - min(index, 4u), cSourceEntries - 1);
+        }
+        offset = index * cbEntry;
+    }
+    return offsets;
+}
+
+// MakeTables: Random point tables, one for each byte of an entry.
+static std::vector<BYTE> MakeTables(TestRandom &random)
+{
+    std::vector<BYTE> tables(8 * 256);
+    random.Fill(tables);
+    return tables;
+}
+
+// GatherReference: Copies the entries in row order, one byte at a time.
+static void GatherReference(
+    BYTE *pDest,
+    LONG lDestStride,
+    const BYTE *pSrc,
+    const UINT32 *pOffsets,
+    const BYTE (*pTables)[256],
+    DWORD cPairs,
+    DWORD cbEntry,
+    DWORD cRows)
+{
+    for (DWORD y = 0; y < cRows; y++)
+    {
+        for (DWORD x = 0; x < cPairs; x++)
+        {
+            for (DWORD i = 0; i < cbEntry; i++)
+            {
+                const BYTE value = pSrc[pOffsets[y * cPairs + x] + i];
+                pDest[y * lDestStride + x * cbEntry + i] = (pTables ? pTables[i][value] : value);
+            }
+        }
+    }
+}
+
+// RandomBands: Splits cRows into one to four row bands at random rows.
+static std::vector<DWORD> RandomBands(TestRandom &random, DWORD cRows)
+{
+    std::vector<DWORD> bands;
+
+    bands.push_back(0);
+    for (DWORD i = random.Below(4); i > 0; i--)
+    {
+        bands.push_back(random.Below(cRows + 1));
+    }
+    bands.push_back(cRows);
+
+    std::sort(bands.begin(), bands.end());
+    return bands;
+}
+
+
+//-------------------------------------------------------------------
+// TestTiles
+// Copies random lookup tables with GatherRows, with several tile
+// widths (including ones that do not divide the width) and random row
+// bands, and compares with the reference in row order.
+//-------------------------------------------------------------------
+
+template <class PAIR>
+static void TestTiles(TestRandom &random)
+{
+    const DWORD cbEntry = sizeof(PAIR);
+
+    std::vector<BYTE> src(c_cbSource);
+    random.Fill(src);
+
+    const std::vector<BYTE> tableBytes = MakeTables(random);
+    const BYTE (*pTables)[256] = reinterpret_cast<const BYTE (*)[256]>(tableBytes.data());
+
+    for (int iteration = 0; iteration < 200; iteration++)
+    {
+        const DWORD cPairs = 1 + random.Below(300);
+        const DWORD cRows = 1 + random.Below(3 * POLAR_TILE_ROWS);
+        const LONG lDestStride = static_cast<LONG>(cPairs * cbEntry + 4 * random.Below(8));
+
+        const std::vector<UINT32> offsets = MakeOffsets(random, cPairs * cRows, cbEntry);
+        const std::vector<DWORD> bands = RandomBands(random, cRows);
+
+        const DWORD tileWidths[] = { 1, 7, 16, 64, cPairs, cPairs + 3, 1 + random.Below(cPairs) };
+
+        for (int iTables = 0; iTables < 2; iTables++)
+        {
+            const BYTE (*pPointTables)[256] = (iTables ? pTables : nullptr);
+
+            std::vector<BYTE> expected(lDestStride * cRows, 0xCD);
+            GatherReference(expected.data(), lDestStride, src.data(), offsets.data(), pPointTables, cPairs, cbEntry, cRows);
+
+            for (DWORD cTilePairs : tileWidths)
+            {
+                std::vector<BYTE> actual(expected.size(), 0xCD);
+
+                for (size_t i = 0; i + 1 < bands.size(); i++)
+                {
+                    GatherRows<PAIR>(actual.data(), lDestStride, src.data(), offsets.data(), pPointTables, cPairs, cTilePairs, bands[i], bands[i + 1]);
+                }
+
+                TEST_CHECK(expected == actual, "%u-byte entries, %u x %u, tiles of %u pairs, %u bands, %s point tables",
+                    cbEntry, cPairs, cRows, cTilePairs, static_cast<DWORD>(bands.size() - 1), (iTables ? "with" : "without"));
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestDelta
+// Delta-encodes random lookup tables, and checks that GatherRowsDelta
+// writes the same bytes as GatherRows, for every split of the rows
+// into two bands and for several tile widths.
+//-------------------------------------------------------------------
+
+template <class PAIR>
+static void TestDelta(TestRandom &random)
+{
+    const DWORD cbEntry = sizeof(PAIR);
+
+    std::vector<BYTE> src(c_cbSource);
+    random.Fill(src);
+
+    const std::vector<BYTE> tableBytes = MakeTables(random);
+    const BYTE (*pTables)[256] = reinterpret_cast<const BYTE (*)[256]>(tableBytes.data());
+
+    DWORD cEscapes = 0;
+
+    for (int iteration = 0; iteration < 20; iteration++)
+    {
+        const DWORD cPairs = 1 + random.Below(200);
+        const DWORD cRows = 1 + random.Below(2 * POLAR_TILE_ROWS + 8);
+        const LONG lDestStride = static_cast<LONG>(cPairs * cbEntry + 4 * random.Below(8));
+        const BYTE (*pPointTables)[256] = ((iteration & 1) ? pTables : nullptr);
+
+        const std::vector<UINT32> offsets = MakeOffsets(random, cPairs * cRows, cbEntry);
+
+        std::vector<INT16> deltas;
+        std::vector<UINT32> rowStarts;
+        EncodeLookupDelta(offsets.data(), cPairs, cRows, deltas, rowStarts);
+
+        TEST_CHECK(rowStarts.size() == cRows, "%u rows, %u row starts", cRows, static_cast<DWORD>(rowStarts.size()));
+
+        cEscapes += static_cast<DWORD>(std::count(deltas.begin(), deltas.end(), POLAR_DELTA_ESCAPE));
+
+        const DWORD tileWidths[] = { 1, 16, cPairs, 1 + random.Below(cPairs) };
+
+        for (DWORD cTilePairs : tileWidths)
+        {
+            std::vector<BYTE> expected(lDestStride * cRows, 0xCD);
+            GatherRows<PAIR>(expected.data(), lDestStride, src.data(), offsets.data(), pPointTables, cPairs, cTilePairs, 0, cRows);
+
+            for (DWORD rowSplit = 0; rowSplit <= cRows; rowSplit++)
+            {
+                std::vector<BYTE> actual(expected.size(), 0xCD);
+
+                GatherRowsDelta<PAIR>(actual.data(), lDestStride, src.data(), deltas.data(), rowStarts.data(), pPointTables, cPairs, cTilePairs, 0, rowSplit);
+                GatherRowsDelta<PAIR>(actual.data(), lDestStride, src.data(), deltas.data(), rowStarts.data(), pPointTables, cPairs, cTilePairs, rowSplit, cRows);
+
+                TEST_CHECK(expected == actual, "%u-byte entries, %u x %u, tiles of %u pairs, bands split at row %u, %s point tables",
+                    cbEntry, cPairs, cRows, cTilePairs, rowSplit, (pPointTables ? "with" : "without"));
+            }
+        }
+    }
+
+    // The tables must exercise the escaped entries.
+    TEST_CHECK(cEscapes > 0, "no escaped deltas in the %u-byte tables", cbEntry);
+}
+
+
+int main()
+{
+    printf("CPU: %s\n", CpuSimdLevelName(GetCpuSimdLevel()));
+
+    TestRandom random;
+
+    TestTiles<DWORD>(random);
+    TestTiles<WORD>(random);
+    TestDelta<DWORD>(random);
+    TestDelta<WORD>(random);
+
+    return TestResult("PolarGatherTests");
+}
@@ -0,0 +1,286 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PolarLookupTests.cpp
+// Checks the approximations of atan2, sin and cos in the SSE2 lookup
+// generator, and that the lookup tables of both generators are within
+// half a pixel of the exact mapping.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "KernelTest.h"
+#include "PolarKernels.h"
+#include <stdlib.h>
+
+// The transformations of the effects, as in CPolarEffect.
+static DOUBLE DefaultRadius(DOUBLE r, DOUBLE R, DOUBLE theta) { return r; }
+static DOUBLE DefaultTheta(DOUBLE r, DOUBLE R, DOUBLE theta) { return theta; }
+static DOUBLE PinchRadius(DOUBLE r, DOUBLE R, DOUBLE theta) { return sqrt(r*R); }
+static DOUBLE FisheyeRadius(DOUBLE r, DOUBLE R, DOUBLE theta) { return (r*r)/R; }
+static DOUBLE WarpTheta(DOUBLE r, DOUBLE R, DOUBLE theta) { return theta + r / R; }
+
+struct PolarEffect
+{
+    const char          *pszName;
+    PolarTransformer    pfnRadius;
+    PolarTransformer    pfnTheta;
+};
+
+static const PolarEffect g_Effects[] =
+{
+    { "Identity", DefaultRadius, DefaultTheta },
+    { "Fisheye", FisheyeRadius, DefaultTheta },
+    { "Pinch", PinchRadius, DefaultTheta },
+    { "Warp", DefaultRadius, WarpTheta },
+};
+
+// Largest error of the approximations, in radians.
+static const double c_dMaxAngleError = 1e-5;
+
+// Largest distance of a table entry from the exact source position, in pixels.
+static const double c_dMaxPixelError = 0.5;
+
+
+#if defined(CPU_FEATURES_X86)
+
+//-------------------------------------------------------------------
+// TestApproximations
+// Checks Atan2_SSE2 and SinCos_SSE2 against the C library, on the
+// pixel offsets of a 4K image and over the angles that the effects
+// produce (Warp adds up to one radian).
+//-------------------------------------------------------------------
+
+static void TestApproximations(TestRandom &random)
+{
+    double dMaxAtan2 = 0, dMaxSinCos = 0;
+
+    for (int i = 0; i < 200000; i++)
+    {
+        float afX[4], afY[4], afAtan2[4];
+
+        for (int j = 0; j < 4; j++)
+        {
+            afX[j] = static_cast<float>(static_cast<int>(random.Below(3841)) - 1920);
+            afY[j] = static_cast<float>(static_cast<int>(random.Below(2161)) - 1080);
+        }
+        if (i == 0)
+        {
+            afX[0] = afY[0] = 0.0f;             // atan2(0, 0) is 0.
+            afX[1] = -1.0f; afY[1] = 0.0f;
+            afX[2] = 0.0f; afY[2] = -1.0f;
+            afX[3] = 5.0f; afY[3] = 5.0f;
+        }
+
+        _mm_storeu_ps(afAtan2, Atan2_SSE2(_mm_loadu_ps(afY), _mm_loadu_ps(afX)));
+
+        for (int j = 0; j < 4; j++)
+        {
+            const double dError = fabs(afAtan2[j] - atan2(static_cast<double>(afY[j]), static_cast<double>(afX[j])));
+
+            dMaxAtan2 = max(dMaxAtan2, dError);
+            TEST_CHECK(dError < c_dMaxAngleError, "atan2(%g, %g): %.8f, error %g", afY[j], afX[j], afAtan2[j], dError);
+        }
+
+        float afTheta[4], afSin[4], afCos[4];
+
+        for (int j = 0; j < 4; j++)
+        {
+            afTheta[j] = static_cast<float>((random.Next() / 4294967296.0) * 2 * (3.14159265358979 + 1) - (3.14159265358979 + 1));
+        }
+
+        __m128 sinTheta, cosTheta;
+        SinCos_SSE2(_mm_loadu_ps(afTheta), &sinTheta, &cosTheta);
+        _mm_storeu_ps(afSin, sinTheta);
+        _mm_storeu_ps(afCos, cosTheta);
+
+        for (int j = 0; j < 4; j++)
+        {
+            const double dError = max(fabs(afSin[j] - sin(static_cast<double>(afTheta[j]))),
+                                      fabs(afCos[j] - cos(static_cast<double>(afTheta[j]))));
+
+            dMaxSinCos = max(dMaxSinCos, dError);
+            TEST_CHECK(dError < c_dMaxAngleError, "sincos(%.8f): %.8f %.8f, error %g", afTheta[j], afSin[j], afCos[j], dError);
+        }
+    }
+
+    printf("Largest error: atan2 %.2e, sin/cos %.2e\n", dMaxAtan2, dMaxSinCos);
+}
+
+#endif
+
+
+// Distance from d to the values that truncate to t.
+static double DistanceToTruncated(double d, LONG t)
+{
+    const double dLow = (t > 0) ? t : t - 1.0;
+    const double dHigh = (t < 0) ? t : t + 1.0;
+
+    return (d < dLow) ? dLow - d : (d > dHigh) ? d - dHigh : 0.0;
+}
+
+
+//-------------------------------------------------------------------
+// CheckTable
+// Compares a lookup table with the exact mapping: the same radius as
+// the generators (rounded up from sqrtf), and the angle, sin and cos in
+// double precision. Each entry must be the exact source pixel, or a
+// neighbor when the exact position is within half a pixel of it.
+// Returns the number of entries that are not the exact source pixel.
+//-------------------------------------------------------------------
+
+static DWORD CheckTable(const char *pszName, const POLAR_LOOKUP_KEY &key, const std::vector<UINT32> &table)
+{
+    const LONG lMaxX = (LONG)key.unWidth;
+    const LONG lMaxY = (LONG)key.unHeight;
+    const LONG lHalfWidth = key.unWidth / 2;
+    const LONG lHalfHeight = key.unHeight / 2;
+    const LONG cPairs = key.unWidth / 2;
+    const DOUBLE dMaxRadius = floor( sqrtf( static_cast<float>(lHalfWidth*lHalfWidth+lHalfHeight*lHalfHeight) ) );
+
+    DWORD cInexact = 0;
+
+    for (LONG y = 0; y < lMaxY; y++)
+    {
+        for (LONG x = 0; x < cPairs; x++)
+        {
+            const LONG lDx = lHalfWidth - 2 * x;
+            const LONG lDy = lHalfHeight - y;
+            const DOUBLE dRadius = ceil( sqrtf( static_cast<float>(lDx*lDx + lDy*lDy) ) );
+            const UINT32 index = table[y * cPairs + x];
+
+            if (dRadius >= dMaxRadius)
+            {
+                TEST_CHECK(index == 0, "%s %ux%u (%d, %d): outside the circle, index %u", pszName, key.unWidth, key.unHeight, 2 * x, y, index);
+                continue;
+            }
+
+            const DOUBLE dTheta = atan2(static_cast<DOUBLE>(lDy), static_cast<DOUBLE>(lDx));
+            const DOUBLE dNewRadius = key.pfnRadius(dRadius, dMaxRadius, dTheta);
+            const DOUBLE dNewTheta = key.pfnTheta(dRadius, dMaxRadius, dTheta);
+
+            // Offsets from the centre, before truncation.
+            const DOUBLE dOffsetX = dNewRadius * cos(dNewTheta);
+            const DOUBLE dOffsetY = dNewRadius * sin(dNewTheta);
+
+            const LONG lExactX = lHalfWidth - (LONG)dOffsetX;
+            const LONG lExactY = lHalfHeight - (LONG)dOffsetY;
+            const bool fExactInside = (0 <= lExactX && lExactX < lMaxX && 0 <= lExactY && lExactY < lMaxY);
+            const UINT32 exactIndex = fExactInside ? lExactY * lMaxX + lExactX : 0;
+
+            if (index == exactIndex)
+            {
+                continue;
+            }
+
+            cInexact++;
+
+            // An entry of 0 is also the top-left pixel. Either way, the
+            // other result must then be at the edge.
+            const LONG lX = (LONG)(index % lMaxX);
+            const LONG lY = (LONG)(index / lMaxX);
+            const double dDistance = (index == 0 || !fExactInside) ? 0.0 :
+                max(DistanceToTruncated(dOffsetX, lHalfWidth - lX), DistanceToTruncated(dOffsetY, lHalfHeight - lY));
+            const bool fEdge = (lExactX <= 0 || lExactX >= lMaxX - 1 || lExactY <= 0 || lExactY >= lMaxY - 1);
+
+            TEST_CHECK((index == 0 || !fExactInside) ? fEdge : dDistance <= c_dMaxPixelError,
+                "%s %ux%u (%d, %d): pixel (%d, %d), exact position (%.3f, %.3f)",
+                pszName, key.unWidth, key.unHeight, 2 * x, y, lX, lY, lHalfWidth - dOffsetX, lHalfHeight - dOffsetY);
+        }
+    }
+
+    return cInexact;
+}
+
+
+//-------------------------------------------------------------------
+// TestTables
+// Generates the tables of each effect at a few frame sizes, in two row
+// bands, with the scalar generator and with the one that the effect
+// selects for this CPU.
+//-------------------------------------------------------------------
+
+static void TestTables()
+{
+    static const UINT32 sizes[][2] =
+    {
+        { 2, 2 }, { 6, 4 }, { 38, 30 }, { 322, 242 }, { 640, 480 }, { 1920, 1080 }, { 3840, 2160 },
+    };
+
+    const GENERATE_POLAR_ROWS_FN pfnSelected = SelectGeneratePolarRows();
+
+    for (const UINT32 *pSize : sizes)
+    {
+        for (const PolarEffect &effect : g_Effects)
+        {
+            POLAR_LOOKUP_KEY key = {};
+
+            key.type = PolarLookup_Offset;
+            key.unWidth = pSize[0];
+            key.unHeight = pSize[1];
+            key.pfnRadius = effect.pfnRadius;
+            key.pfnTheta = effect.pfnTheta;
+
+            const DWORD cEntries = key.unWidth / 2 * key.unHeight;
+            const DWORD rowSplit = key.unHeight / 3;
+
+            std::vector<UINT32> scalar(cEntries, 0xCDCDCDCD);
+            std::vector<UINT32> selected(cEntries, 0xCDCDCDCD);
+
+            GeneratePolarRows(key, scalar.data(), 0, key.unHeight);
+
+            pfnSelected(key, selected.data(), 0, rowSplit);
+            pfnSelected(key, selected.data(), rowSplit, key.unHeight);
+
+            const DWORD cScalarInexact = CheckTable("scalar", key, scalar);
+            const DWORD cSelectedInexact = CheckTable("selected", key, selected);
+
+            // Where the results differ, they must be neighbors. (Entries of
+            // 0 at the edges are checked by CheckTable.)
+            DWORD cDiff = 0;
+            for (DWORD i = 0; i < cEntries; i++)
+            {
+                if (scalar[i] == selected[i])
+                {
+                    continue;
+                }
+                cDiff++;
+
+                if (scalar[i] != 0 && selected[i] != 0)
+                {
+                    const LONG lDx = (LONG)(selected[i] % key.unWidth) - (LONG)(scalar[i] % key.unWidth);
+                    const LONG lDy = (LONG)(selected[i] / key.unWidth) - (LONG)(scalar[i] / key.unWidth);
+
+                    TEST_CHECK(abs(lDx) <= 1 && abs(lDy) <= 1, "%s %ux%u entry %u: %u, scalar %u",
+                        effect.pszName, key.unWidth, key.unHeight, i, selected[i], scalar[i]);
+                }
+            }
+
+            if (key.unWidth == 3840)
+            {
+                printf("%s %ux%u: %u scalar and %u selected entries off by a pixel, %u differ\n",
+                    effect.pszName, key.unWidth, key.unHeight, cScalarInexact, cSelectedInexact, cDiff);
+            }
+        }
+    }
+}
+
+
+int main()
+{
+    printf("CPU: %s\n", CpuSimdLevelName(GetCpuSimdLevel()));
+
+#if defined(CPU_FEATURES_X86)
+    TestRandom random;
+
+    TestApproximations(random);
+#endif
+    TestTables();
+
+    return TestResult("PolarLookupTests");
+}
@@ -0,0 +1,275 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RowBandThreadPoolTests.cpp
+// Checks that RowBandThreadPool processes every row exactly once, in
+// aligned bands, that several pools can share the worker threads
+// without going over their thread counts, and that Run rethrows an
+// exception from any thread once no thread is in the band function.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "KernelTest.h"
+#include "RowBandThreadPool.h"
+#include <chrono>
+#include <stdexcept>
+#include <string.h>
+
+// BandCounter: Counts the threads that are in the band function at the
+// same time.
+struct BandCounter
+{
+    BandCounter() : cCurrent(0), cMax(0) {}
+
+    void Enter()
+    {
+        const DWORD c = ++cCurrent;
+        DWORD cOld = cMax.load();
+        while (c > cOld && !cMax.compare_exchange_weak(cOld, c))
+        {
+        }
+    }
+
+    void Leave() { --cCurrent; }
+
+    std::atomic<DWORD>  cCurrent;
+    std::atomic<DWORD>  cMax;
+};
+
+// Spin: Keeps a thread busy for a while, so that the others get a chance
+// to claim bands.
+static void Spin(DWORD cMicroseconds)
+{
+    const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(cMicroseconds);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        std::this_thread::yield();
+    }
+}
+
+// CoverageResult: What RunCovered found wrong with one call to Run.
+struct CoverageResult
+{
+    DWORD   cRows;
+    DWORD   dwRowAlign;
+    LONG    lStride;
+    DWORD   cThreads;
+    DWORD   cWrongRows;     // Rows not processed exactly once.
+    DWORD   cMisaligned;    // Bands that are empty or start off the alignment.
+    DWORD   cMaxThreads;    // Most threads in the band function at once.
+};
+
+// RunCovered: Runs a pool over cRows rows, counting the visits to each
+// row and the threads in the band function. Does not report failures,
+// so that it can run on any thread.
+static CoverageResult RunCovered(RowBandThreadPool &pool, DWORD cRows, DWORD dwRowAlign, LONG lStride, DWORD cSpin)
+{
+    std::vector<BYTE> visits(cRows, 0);
+    std::atomic<DWORD> cMisaligned(0);
+    BandCounter counter;
+
+    pool.Run(cRows, dwRowAlign, lStride, [&](DWORD yBegin, DWORD yEnd)
+    {
+        counter.Enter();
+
+        // An image with no rows is one empty band.
+        cMisaligned += (yBegin % dwRowAlign != 0 || (yBegin >= yEnd && cRows > 0));
+        for (DWORD y = yBegin; y < yEnd && y < cRows; y++)
+        {
+            visits[y]++;
+        }
+        Spin(cSpin);
+
+        counter.Leave();
+    });
+
+    CoverageResult result = { cRows, dwRowAlign, lStride, pool.GetThreadCount(), 0, cMisaligned.load(), counter.cMax.load() };
+    for (BYTE v : visits)
+    {
+        result.cWrongRows += (v != 1);
+    }
+    return result;
+}
+
+// CheckCoverage: Reports the failures of a call to RunCovered: each row
+// must be processed once, the bands must start on a multiple of the row
+// alignment, and no more threads than the thread count of the pool may
+// be in the band function at once.
+static void CheckCoverage(const CoverageResult &result, const char *pszName)
+{
+    TEST_CHECK(result.cWrongRows == 0, "%s: %u rows, align %u, stride %d, %u threads: %u rows not processed once",
+        pszName, result.cRows, result.dwRowAlign, result.lStride, result.cThreads, result.cWrongRows);
+    TEST_CHECK(result.cMisaligned == 0, "%s: %u rows, align %u, stride %d, %u threads: %u bands misaligned or empty",
+        pszName, result.cRows, result.dwRowAlign, result.lStride, result.cThreads, result.cMisaligned);
+    TEST_CHECK(result.cMaxThreads <= result.cThreads, "%s: %u threads in the band function, limit %u",
+        pszName, result.cMaxThreads, result.cThreads);
+}
+
+
+//-------------------------------------------------------------------
+// TestCoverage
+// Runs pools of 1 to 8 threads over random numbers of rows, with random
+// row alignments and strides.
+//-------------------------------------------------------------------
+
+static void TestCoverage(TestRandom &random)
+{
+    RowBandThreadPool pool;
+
+    for (int iteration = 0; iteration < 400; iteration++)
+    {
+        pool.SetThreadCount(1 + random.Below(8));
+
+        const DWORD cRows = random.Below(2000);
+        const DWORD dwRowAlign = 1 + random.Below(4);
+        const LONG lStride = static_cast<LONG>(1 + random.Below(8192)) * (random.Below(2) ? -1 : 1);
+
+        CheckCoverage(RunCovered(pool, cRows, dwRowAlign, lStride, 0), "TestCoverage");
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestSharedWorkers
+// Runs several pools at once, each on its own thread and with its own
+// thread count, as several effects would, and creates and destroys
+// pools while the others run.
+//-------------------------------------------------------------------
+
+static void TestSharedWorkers(TestRandom &random)
+{
+    const DWORD cCallers = 4;
+    const DWORD cIterations = 20;
+
+    std::vector<std::thread> callers;
+    std::vector<DWORD> seeds(cCallers);
+    std::vector<CoverageResult> results(cCallers * cIterations);
+
+    for (DWORD &seed : seeds)
+    {
+        seed = random.Next();
+    }
+
+    for (DWORD i = 0; i < cCallers; i++)
+    {
+        callers.push_back(std::thread([i, &seeds, &results]()
+        {
+            TestRandom callerRandom(seeds[i]);
+
+            for (DWORD iteration = 0; iteration < cIterations; iteration++)
+            {
+                RowBandThreadPool pool;
+                pool.SetThreadCount(1 + (i + iteration) % 4);
+
+                results[i * cIterations + iteration] = RunCovered(pool, 256 + callerRandom.Below(512), 2, 64, 50);
+            }
+        }));
+    }
+
+    for (std::thread &caller : callers)
+    {
+        caller.join();
+    }
+
+    for (const CoverageResult &result : results)
+    {
+        CheckCoverage(result, "TestSharedWorkers");
+    }
+}
+
+
+//-------------------------------------------------------------------
+// TestExceptions
+// Throws from the band function on the calling thread and on a worker
+// thread. Run must rethrow the exception, and no thread may call the
+// band function after Run returns.
+//-------------------------------------------------------------------
+
+static void TestExceptions()
+{
+    const std::thread::id caller = std::this_thread::get_id();
+
+    for (int iThrower = 0; iThrower < 2; iThrower++)
+    {
+        const bool fThrowOnWorker = (iThrower == 1);
+        const char *pszThrower = (fThrowOnWorker ? "worker" : "caller");
+
+        for (int iteration = 0; iteration < 20; iteration++)
+        {
+            RowBandThreadPool pool;
+            pool.SetThreadCount(4);
+
+            std::atomic<bool> fWorkerEntered(false);
+            std::atomic<bool> fReturned(false);
+            std::atomic<DWORD> cLateCalls(0);
+            bool fCaught = false;
+
+            try
+            {
+                pool.Run(1024, 1, 64, [&](DWORD yBegin, DWORD yEnd)
+                {
+                    cLateCalls += fReturned.load();
+
+                    const bool fOnCaller = (std::this_thread::get_id() == caller);
+
+                    if (!fOnCaller)
+                    {
+                        fWorkerEntered = true;
+                    }
+                    else
+                    {
+                        // Give a worker time to join in before throwing.
+                        const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+                        while (!fWorkerEntered && std::chrono::steady_clock::now() < end)
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+
+                    if (fOnCaller != fThrowOnWorker)
+                    {
+                        throw std::runtime_error(fOnCaller ? "caller" : "worker");
+                    }
+
+                    Spin(200);
+                    cLateCalls += fReturned.load();
+                });
+            }
+            catch (const std::runtime_error &error)
+            {
+                fCaught = (strcmp(error.what(), pszThrower) == 0);
+            }
+            fReturned = true;
+
+            // A worker that was still running would call in now.
+            Spin(2000);
+
+            TEST_CHECK(fCaught, "exception on the %s was not rethrown", pszThrower);
+            TEST_CHECK(cLateCalls == 0, "exception on the %s: band function called %u times after Run returned",
+                pszThrower, cLateCalls.load());
+
+            // The pool still works after an exception.
+            CheckCoverage(RunCovered(pool, 1024, 1, 64, 0), "TestExceptions");
+        }
+    }
+}
+
+
+int main()
+{
+    printf("CPU: %s\n", CpuSimdLevelName(GetCpuSimdLevel()));
+
+    TestRandom random;
+
+    TestCoverage(random);
+    TestSharedWorkers(random);
+    TestExceptions();
+
+    return TestResult("RowBandThreadPoolTests");
+}